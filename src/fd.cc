@@ -36,7 +36,8 @@ std::string file_discriptor::read(const value_type limit) {
     return buf;
 }
 
-ssize_t file_discriptor::read(std::string &buf, const value_type limit) {
+template <class String>
+ssize_t file_discriptor::read_append(String &buf, const value_type limit) {
     size_t buf_size = std::min<size_t>(1024 * 1024, limit);
     //! Previously, we neglected to allocate for `but_t`, resulting in a read failure
     void* but_t = (void*)malloc(buf_size);
@@ -45,15 +46,26 @@ ssize_t file_discriptor::read(std::string &buf, const value_type limit) {
     if (limit > 0 && read_len == 0) set_eof();
     if (read_len > static_cast<ssize_t>(buf_size)) {
         fatal << "read() read more than requested";
+        free(but_t);
         return -1;
     }
-    buf += static_cast<char*>(but_t);
+    //! exactly the bytes that were read, bodies may well contain NULs
+    if (read_len > 0) buf.append(static_cast<char*>(but_t), static_cast<size_t>(read_len));
+    free(but_t);
 
     update_rd();
 
     return read_len;
 }
 
+ssize_t file_discriptor::read(std::string &buf, const value_type limit) {
+    return read_append(buf, limit);
+}
+
+ssize_t file_discriptor::read(std::pmr::string &buf, const value_type limit) {
+    return read_append(buf, limit);
+}
+
 ssize_t file_discriptor::write(const char* src, const value_type buf_len) {
     if (buf_len < 0) {
         exit(1);
@@ -81,6 +93,9 @@ ssize_t file_discriptor::send(const char* src, const value_type buf_len) {
 ssize_t file_discriptor::receive(std::string& buf, const value_type limit) {
     return read(buf, limit);
 }
+ssize_t file_discriptor::receive(std::pmr::string& buf, const value_type limit) {
+    return read(buf, limit);
+}
 bool file_discriptor::is_readable() {
     return _internal_fd->_read_count > 0;
 }
@@ -0,0 +1,174 @@
+#include "include/histogram.h"
+#include "include/defs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+NT_NAMESPACE_BEGEN
+
+histogram::histogram(value_type highest, int significant_digits)
+    : _highest(std::max<value_type>(highest, 2)), _unit_magnitude(0)
+    , _total(0), _min(std::numeric_limits<value_type>::max()), _max(0) {
+    significant_digits = std::clamp(significant_digits, 1, 5);
+
+    //! enough sub-buckets to tell apart every value below 2 * 10^digits
+    value_type single_unit_resolution = 2;
+    for (int i = 0; i < significant_digits; i++) single_unit_resolution *= 10;
+    int sub_bucket_count_magnitude = static_cast<int>(std::ceil(std::log2(static_cast<double>(single_unit_resolution))));
+
+    _sub_bucket_half_count_magnitude = std::max(sub_bucket_count_magnitude, 1) - 1;
+    _sub_bucket_count       = value_type(1) << (_sub_bucket_half_count_magnitude + 1);
+    _sub_bucket_half_count  = _sub_bucket_count / 2;
+    _sub_bucket_mask        = (_sub_bucket_count - 1) << _unit_magnitude;
+
+    //! each further bucket doubles the covered range
+    value_type smallest_untrackable = _sub_bucket_count << _unit_magnitude;
+    size_t buckets = 1;
+    while (smallest_untrackable <= _highest) {
+        if (smallest_untrackable > std::numeric_limits<value_type>::max() / 2) {
+            buckets++;
+            break;
+        }
+        smallest_untrackable <<= 1;
+        buckets++;
+    }
+    _counts.assign((buckets + 1) * _sub_bucket_half_count, 0);
+}
+
+size_t histogram::bucket_index(value_type value) const {
+    int pow2_ceiling = 64 - __builtin_clzll(value | _sub_bucket_mask);
+    return static_cast<size_t>(pow2_ceiling - _unit_magnitude - (_sub_bucket_half_count_magnitude + 1));
+}
+
+size_t histogram::counts_index(value_type value) const {
+    size_t bucket = bucket_index(value);
+    value_type sub_bucket = value >> (bucket + static_cast<size_t>(_unit_magnitude));
+    return ((bucket + 1) << _sub_bucket_half_count_magnitude) + static_cast<size_t>(sub_bucket - _sub_bucket_half_count);
+}
+
+histogram::value_type histogram::value_from_index(size_t index) const {
+    ptrdiff_t bucket = static_cast<ptrdiff_t>(index >> _sub_bucket_half_count_magnitude) - 1;
+    value_type sub_bucket = (index & (_sub_bucket_half_count - 1)) + _sub_bucket_half_count;
+    if (bucket < 0) {
+        sub_bucket -= _sub_bucket_half_count;
+        bucket = 0;
+    }
+    return sub_bucket << (static_cast<size_t>(bucket) + static_cast<size_t>(_unit_magnitude));
+}
+
+histogram::value_type histogram::highest_equivalent(value_type value) const {
+    size_t bucket = bucket_index(value);
+    value_type sub_bucket = value >> (bucket + static_cast<size_t>(_unit_magnitude));
+    size_t adjusted = sub_bucket >= _sub_bucket_count ? bucket + 1 : bucket;
+    value_type lowest = sub_bucket << (bucket + static_cast<size_t>(_unit_magnitude));
+    return lowest + (value_type(1) << (static_cast<size_t>(_unit_magnitude) + adjusted)) - 1;
+}
+
+void histogram::record(value_type value, count_type count) {
+    value = std::min(value, _highest);
+    _counts[counts_index(value)] += count;
+    _total += count;
+    _min = std::min(_min, value);
+    _max = std::max(_max, value);
+}
+
+void histogram::record_corrected(value_type value, value_type expected_interval) {
+    record(value);
+    if (expected_interval == 0 || value <= expected_interval) return;
+    for (value_type missing = value - expected_interval; missing >= expected_interval; missing -= expected_interval) {
+        record(missing);
+    }
+}
+
+void histogram::merge(__self_ref_const other) {
+    if (other._counts.size() != _counts.size()) return;
+    for (size_t i = 0; i < _counts.size(); i++) _counts[i] += other._counts[i];
+    _total += other._total;
+    _min = std::min(_min, other._min);
+    _max = std::max(_max, other._max);
+}
+
+void histogram::reset() {
+    std::fill(_counts.begin(), _counts.end(), 0);
+    _total = 0;
+    _min = std::numeric_limits<value_type>::max();
+    _max = 0;
+}
+
+histogram::value_type histogram::value_at_percentile(double percentile) const {
+    if (_total == 0) return 0;
+    percentile = std::clamp(percentile, 0.0, 100.0);
+    count_type wanted = static_cast<count_type>(percentile / 100.0 * static_cast<double>(_total) + 0.5);
+    wanted = std::max<count_type>(wanted, 1);
+
+    count_type seen = 0;
+    for (size_t i = 0; i < _counts.size(); i++) {
+        seen += _counts[i];
+        if (seen >= wanted) return std::min(highest_equivalent(value_from_index(i)), _max);
+    }
+    return _max;
+}
+
+histogram::value_type histogram::min() const { return _total == 0 ? 0 : _min; }
+histogram::value_type histogram::max() const { return _max; }
+histogram::count_type histogram::total_count() const { return _total; }
+
+double histogram::mean() const {
+    if (_total == 0) return 0.0;
+    double sum = 0.0;
+    for (size_t i = 0; i < _counts.size(); i++) {
+        if (_counts[i] == 0) continue;
+        value_type value = value_from_index(i);
+        double median = static_cast<double>(value + highest_equivalent(value)) / 2.0;
+        sum += median * static_cast<double>(_counts[i]);
+    }
+    return sum / static_cast<double>(_total);
+}
+
+double histogram::stddev() const {
+    if (_total == 0) return 0.0;
+    double avg = mean();
+    double sum = 0.0;
+    for (size_t i = 0; i < _counts.size(); i++) {
+        if (_counts[i] == 0) continue;
+        value_type value = value_from_index(i);
+        double dev = static_cast<double>(value + highest_equivalent(value)) / 2.0 - avg;
+        sum += dev * dev * static_cast<double>(_counts[i]);
+    }
+    return std::sqrt(sum / static_cast<double>(_total));
+}
+
+std::string histogram::to_text(double scale, const std::string& unit) const {
+    std::string out;
+    char line[96];
+    for (double percentile : HISTOGRAM_PERCENTILES) {
+        snprintf(line, sizeof(line), " %8.3f%% %12.3f%s\n", percentile,
+                 static_cast<double>(value_at_percentile(percentile)) / scale, unit.c_str());
+        out += line;
+    }
+    return out;
+}
+
+std::string histogram::to_json() const {
+    std::string out;
+    char field[96];
+    snprintf(field, sizeof(field), "{\"count\":%llu,\"min\":%llu,\"max\":%llu,",
+             static_cast<unsigned long long>(_total), static_cast<unsigned long long>(min()),
+             static_cast<unsigned long long>(max()));
+    out += field;
+    snprintf(field, sizeof(field), "\"mean\":%.3f,\"stdev\":%.3f,\"percentiles\":{", mean(), stddev());
+    out += field;
+    bool first = true;
+    for (double percentile : HISTOGRAM_PERCENTILES) {
+        snprintf(field, sizeof(field), "%s\"%.3f\":%llu", first ? "" : ",", percentile,
+                 static_cast<unsigned long long>(value_at_percentile(percentile)));
+        out += field;
+        first = false;
+    }
+    out += "}}";
+    return out;
+}
+
+NT_NAMESPACE_END
@@ -0,0 +1,472 @@
+#include "../include/http/hpack.h"
+#include "../include/defs.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+//! RFC 7541 Appendix A
+static const std::pair<const char*, const char*> STATIC_TABLE[] = {
+  { ":authority", "" },
+  { ":method", "GET" },
+  { ":method", "POST" },
+  { ":path", "/" },
+  { ":path", "/index.html" },
+  { ":scheme", "http" },
+  { ":scheme", "https" },
+  { ":status", "200" },
+  { ":status", "204" },
+  { ":status", "206" },
+  { ":status", "304" },
+  { ":status", "400" },
+  { ":status", "404" },
+  { ":status", "500" },
+  { "accept-charset", "" },
+  { "accept-encoding", "gzip, deflate" },
+  { "accept-language", "" },
+  { "accept-ranges", "" },
+  { "accept", "" },
+  { "access-control-allow-origin", "" },
+  { "age", "" },
+  { "allow", "" },
+  { "authorization", "" },
+  { "cache-control", "" },
+  { "content-disposition", "" },
+  { "content-encoding", "" },
+  { "content-language", "" },
+  { "content-length", "" },
+  { "content-location", "" },
+  { "content-range", "" },
+  { "content-type", "" },
+  { "cookie", "" },
+  { "date", "" },
+  { "etag", "" },
+  { "expect", "" },
+  { "expires", "" },
+  { "from", "" },
+  { "host", "" },
+  { "if-match", "" },
+  { "if-modified-since", "" },
+  { "if-none-match", "" },
+  { "if-range", "" },
+  { "if-unmodified-since", "" },
+  { "last-modified", "" },
+  { "link", "" },
+  { "location", "" },
+  { "max-forwards", "" },
+  { "proxy-authenticate", "" },
+  { "proxy-authorization", "" },
+  { "range", "" },
+  { "referer", "" },
+  { "refresh", "" },
+  { "retry-after", "" },
+  { "server", "" },
+  { "set-cookie", "" },
+  { "strict-transport-security", "" },
+  { "transfer-encoding", "" },
+  { "user-agent", "" },
+  { "vary", "" },
+  { "via", "" },
+  { "www-authenticate", "" },
+};
+
+constexpr const size_t STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+constexpr const size_t ENTRY_OVERHEAD = 32;
+
+//! RFC 7541 Appendix B, the last entry is EOS
+static const uint32_t HUFFMAN_CODES[257] = {
+  0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+  0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+  0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+  0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+  0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+  0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+  0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+  0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+  0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+  0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+  0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+  0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+  0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+  0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+  0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+  0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+  0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+  0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+  0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+  0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+  0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+  0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+  0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+  0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+  0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+  0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+  0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+  0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+  0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+  0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+  0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+  0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+  0x3fffffff,
+};
+
+static const uint8_t HUFFMAN_LENGTHS[257] = {
+  13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+  28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+  5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+  13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+  15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+  6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+  20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+  24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+  22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+  21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+  26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+  19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+  20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+  26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+  30,
+};
+
+namespace {
+
+/**
+ * @brief Lookup structures derived from the tables once.
+ */
+struct hpack_statics {
+  std::vector<std::pair<std::string, std::string>> table;
+  std::unordered_map<std::string_view, size_t>     first_by_name;    // the lowest static index of a name
+
+  //! decoding codes of up to 8 bits by the next byte of input, `length` 0 for longer codes
+  struct fast_entry {
+    uint16_t symbol;
+    uint8_t  length;
+  } fast[256];
+
+  //! canonical decoding of the longer codes, by code length
+  uint32_t first_code[31];
+  uint32_t count[31];
+  uint32_t offset[31];
+  uint16_t symbols[257];
+
+  hpack_statics() {
+    for (size_t i = 0; i < STATIC_TABLE_SIZE; i++) {
+      table.emplace_back(STATIC_TABLE[i].first, STATIC_TABLE[i].second);
+    }
+    for (size_t i = 0; i < STATIC_TABLE_SIZE; i++) {
+      first_by_name.emplace(table[i].first, i + 1);
+    }
+
+    memset(fast, 0, sizeof(fast));
+    memset(count, 0, sizeof(count));
+    for (uint16_t sym = 0; sym < 257; sym++) {
+      count[HUFFMAN_LENGTHS[sym]]++;
+      if (HUFFMAN_LENGTHS[sym] > 8) continue;
+      uint32_t shift = 8u - HUFFMAN_LENGTHS[sym];
+      for (uint32_t low = 0; low < (1u << shift); low++) {
+        fast[(HUFFMAN_CODES[sym] << shift) | low] = { sym, HUFFMAN_LENGTHS[sym] };
+      }
+    }
+    uint32_t code = 0;
+    uint32_t index = 0;
+    for (uint32_t len = 1; len <= 30; len++) {
+      first_code[len] = code;
+      offset[len] = index;
+      index += count[len];
+      code = (code + count[len]) << 1;
+    }
+    //! the code is canonical, symbols of one length are numbered in symbol order
+    uint32_t fill[31];
+    memcpy(fill, offset, sizeof(fill));
+    for (uint16_t sym = 0; sym < 257; sym++) {
+      symbols[fill[HUFFMAN_LENGTHS[sym]]++] = sym;
+    }
+  }
+};
+
+const hpack_statics& statics() {
+  static const hpack_statics instance;
+  return instance;
+}
+
+void encode_int(std::string& out, uint8_t flags, unsigned prefix, uint64_t value) {
+  uint64_t max = (1u << prefix) - 1;
+  if (value < max) {
+    out.push_back(static_cast<char>(flags | value));
+    return;
+  }
+  out.push_back(static_cast<char>(flags | max));
+  value -= max;
+  while (value >= 128) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+bool decode_int(const uint8_t*& p, const uint8_t* end, unsigned prefix, uint64_t& value) {
+  uint64_t max = (1u << prefix) - 1;
+  value = *p++ & max;
+  if (value < max) return true;
+  for (unsigned shift = 0; p < end; shift += 7) {
+    //! no sane header block needs more than 32 bits
+    if (shift > 28) return false;
+    uint8_t b = *p++;
+    value += static_cast<uint64_t>(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+void encode_string(std::string& out, std::string_view s) {
+  size_t huffman = huffman_encoded_size(s);
+  if (huffman < s.size()) {
+    encode_int(out, 0x80, 7, huffman);
+    huffman_encode(s, out);
+  } else {
+    encode_int(out, 0x00, 7, s.size());
+    out.append(s.data(), s.size());
+  }
+}
+
+bool decode_string(const uint8_t*& p, const uint8_t* end, std::string& out) {
+  if (p == end) return false;
+  bool huffman = (*p & 0x80) != 0;
+  uint64_t len = 0;
+  if (!decode_int(p, end, 7, len)) return false;
+  if (len > static_cast<uint64_t>(end - p)) return false;
+  out.clear();
+  const char* data = reinterpret_cast<const char*>(p);
+  p += len;
+  if (huffman) return huffman_decode(data, static_cast<size_t>(len), out);
+  out.assign(data, static_cast<size_t>(len));
+  return true;
+}
+
+}
+
+size_t huffman_encoded_size(std::string_view in) {
+  uint64_t bits = 0;
+  for (char c : in) bits += HUFFMAN_LENGTHS[static_cast<uint8_t>(c)];
+  return static_cast<size_t>((bits + 7) / 8);
+}
+
+void huffman_encode(std::string_view in, std::string& out) {
+  uint64_t acc = 0;
+  unsigned nbits = 0;
+  for (char c : in) {
+    uint8_t sym = static_cast<uint8_t>(c);
+    acc = (acc << HUFFMAN_LENGTHS[sym]) | HUFFMAN_CODES[sym];
+    nbits += HUFFMAN_LENGTHS[sym];
+    while (nbits >= 8) {
+      nbits -= 8;
+      out.push_back(static_cast<char>(acc >> nbits));
+    }
+  }
+  if (nbits > 0) {
+    //! pad with the most significant bits of EOS, which are all ones
+    unsigned pad = 8 - nbits;
+    out.push_back(static_cast<char>((acc << pad) | ((1u << pad) - 1)));
+  }
+}
+
+bool huffman_decode(const char* data, size_t len, std::string& out) {
+  const hpack_statics& s = statics();
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  const uint8_t* end = p + len;
+  uint64_t acc = 0;
+  unsigned nbits = 0;
+
+  while (true) {
+    while (nbits <= 56 && p < end) {
+      acc = (acc << 8) | *p++;
+      nbits += 8;
+    }
+    if (nbits == 0) return true;
+
+    //! the fast table covers every code of up to 8 bits
+    uint32_t peek = nbits >= 8 ? static_cast<uint32_t>(acc >> (nbits - 8)) & 0xff
+                               : static_cast<uint32_t>(acc << (8 - nbits)) & 0xff;
+    const auto& fast = s.fast[peek];
+    if (fast.length != 0 && fast.length <= nbits) {
+      out.push_back(static_cast<char>(fast.symbol));
+      nbits -= fast.length;
+      continue;
+    }
+
+    bool found = false;
+    for (unsigned l = 5; l <= 30 && l <= nbits; l++) {
+      uint32_t code = static_cast<uint32_t>(acc >> (nbits - l)) & ((1u << l) - 1);
+      if (code >= s.first_code[l] && code - s.first_code[l] < s.count[l]) {
+        uint16_t sym = s.symbols[s.offset[l] + code - s.first_code[l]];
+        if (sym == 256) return false;
+        out.push_back(static_cast<char>(sym));
+        nbits -= l;
+        found = true;
+        break;
+      }
+    }
+    if (found) continue;
+
+    //! what is left must be the EOS padding
+    uint64_t mask = (1ull << nbits) - 1;
+    return p == end && nbits <= 7 && (acc & mask) == mask;
+  }
+}
+
+hpack_table::hpack_table(size_t max_size) : _size(0), _max_size(max_size) {}
+
+void hpack_table::evict(size_t max_size) {
+  while (_size > max_size && !_entries.empty()) {
+    _size -= _entries.back().first.size() + _entries.back().second.size() + ENTRY_OVERHEAD;
+    _entries.pop_back();
+  }
+}
+
+void hpack_table::add(std::string_view name, std::string_view value) {
+  size_t entry = name.size() + value.size() + ENTRY_OVERHEAD;
+  if (entry > _max_size) {
+    evict(0);
+    return;
+  }
+  evict(_max_size - entry);
+  _entries.emplace_front(std::string(name), std::string(value));
+  _size += entry;
+}
+
+void hpack_table::resize(size_t max_size) {
+  _max_size = max_size;
+  evict(max_size);
+}
+
+const std::pair<std::string, std::string>* hpack_table::get(size_t index) const {
+  if (index == 0) return nullptr;
+  if (index <= STATIC_TABLE_SIZE) return &statics().table[index - 1];
+  index -= STATIC_TABLE_SIZE + 1;
+  return index < _entries.size() ? &_entries[index] : nullptr;
+}
+
+size_t hpack_table::find(std::string_view name, std::string_view value, bool& name_only) const {
+  const hpack_statics& s = statics();
+  size_t name_index = 0;
+  auto it = s.first_by_name.find(name);
+  if (it != s.first_by_name.end()) {
+    for (size_t i = it->second; i <= STATIC_TABLE_SIZE && s.table[i - 1].first == name; i++) {
+      if (s.table[i - 1].second == value) {
+        name_only = false;
+        return i;
+      }
+    }
+    name_index = it->second;
+  }
+  for (size_t i = 0; i < _entries.size(); i++) {
+    if (_entries[i].first != name) continue;
+    if (_entries[i].second == value) {
+      name_only = false;
+      return STATIC_TABLE_SIZE + 1 + i;
+    }
+    if (name_index == 0) name_index = STATIC_TABLE_SIZE + 1 + i;
+  }
+  name_only = true;
+  return name_index;
+}
+
+hpack_encoder::hpack_encoder(size_t max_table_size)
+  : _table(max_table_size), _pending_size(SIZE_MAX) {}
+
+void hpack_encoder::set_max_table_size(size_t max_size) {
+  //! keep the default table size unless the peer asks for less
+  max_size = std::min(max_size, HPACK_DEFAULT_TABLE_SIZE);
+  if (max_size == _table.max_size()) return;
+  _table.resize(max_size);
+  _pending_size = max_size;
+}
+
+void hpack_encoder::encode(const header_list& headers, std::string& out) {
+  if (_pending_size != SIZE_MAX) {
+    encode_int(out, 0x20, 5, _pending_size);
+    _pending_size = SIZE_MAX;
+  }
+
+  for (const auto& field : headers) {
+    const std::string& name = field.first;
+    const std::string& value = field.second;
+    bool name_only = false;
+    size_t index = _table.find(name, value, name_only);
+    if (index != 0 && !name_only) {
+      encode_int(out, 0x80, 7, index);
+      continue;
+    }
+
+    //! credentials are never indexed, not even by intermediaries
+    bool sensitive = name == "authorization" || name == "proxy-authorization"
+      || (name == "cookie" && value.size() < 20);
+    bool indexed = !sensitive && name.size() + value.size() + ENTRY_OVERHEAD <= _table.max_size() / 2;
+    if (indexed) {
+      encode_int(out, 0x40, 6, index);
+    } else {
+      encode_int(out, sensitive ? 0x10 : 0x00, 4, index);
+    }
+    if (index == 0) encode_string(out, name);
+    encode_string(out, value);
+    if (indexed) _table.add(name, value);
+  }
+}
+
+hpack_decoder::hpack_decoder(size_t max_table_size)
+  : _table(max_table_size), _limit(max_table_size) {}
+
+void hpack_decoder::set_max_table_size(size_t max_size) {
+  _limit = max_size;
+  if (_table.max_size() > max_size) _table.resize(max_size);
+}
+
+bool hpack_decoder::decode(const char* data, size_t len, header_list& headers) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  const uint8_t* end = p + len;
+  bool leading = true;
+  std::string name;
+  std::string value;
+
+  while (p < end) {
+    uint8_t b = *p;
+    uint64_t index = 0;
+    if (b & 0x80) {
+      //! indexed field
+      if (!decode_int(p, end, 7, index)) return false;
+      const auto* entry = _table.get(static_cast<size_t>(index));
+      if (entry == nullptr) return false;
+      headers.push_back(*entry);
+      leading = false;
+      continue;
+    }
+    if ((b & 0xe0) == 0x20) {
+      //! dynamic table size updates may only lead the block
+      if (!leading || !decode_int(p, end, 5, index) || index > _limit) return false;
+      _table.resize(static_cast<size_t>(index));
+      continue;
+    }
+
+    bool indexed = (b & 0x40) != 0;
+    if (!decode_int(p, end, indexed ? 6 : 4, index)) return false;
+    if (index != 0) {
+      const auto* entry = _table.get(static_cast<size_t>(index));
+      if (entry == nullptr) return false;
+      name = entry->first;
+    } else if (!decode_string(p, end, name)) {
+      return false;
+    }
+    if (!decode_string(p, end, value)) return false;
+    if (indexed) _table.add(name, value);
+    headers.emplace_back(std::move(name), std::move(value));
+    leading = false;
+  }
+  return true;
+}
+}
+NT_NAMESPACE_END
@@ -0,0 +1,447 @@
+#include "../include/http/http2_client.h"
+#include "../include/defs.h"
+#include "../include/log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/uio.h>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+h2_client::h2_client(std::string ip, short port)
+  : h2_client(std::move(ip), port, options()) {}
+
+h2_client::h2_client(std::string ip, short port, const options& opts)
+  : _ip(std::move(ip)), _port(port), _opts(opts)
+  , _out_offset(0), _in(opts.read_size * 2), _in_begin(0), _in_end(0)
+  , _block_stream(0), _block_end_stream(false), _next_stream_id(1), _goaway(false)
+  , _peer_max_streams(SIZE_MAX), _peer_initial_window(H2_DEFAULT_WINDOW_SIZE)
+  , _peer_max_frame_size(H2_DEFAULT_MAX_FRAME_SIZE), _send_window(H2_DEFAULT_WINDOW_SIZE)
+  , _recv_unacked(0), _retries(0), _connections(0), _bytes_received(0) {
+  if (_opts.max_concurrent_streams == 0) _opts.max_concurrent_streams = 1;
+  _opts.initial_window_size = std::min(std::max(_opts.initial_window_size, H2_DEFAULT_WINDOW_SIZE), H2_MAX_WINDOW_SIZE);
+  _opts.connection_window_size = std::min(std::max(_opts.connection_window_size, H2_DEFAULT_WINDOW_SIZE), H2_MAX_WINDOW_SIZE);
+  _host = _ip + ":" + std::to_string(static_cast<unsigned short>(_port));
+}
+
+bool h2_client::send(const Request& req, uint64_t tag) {
+  while (outstanding() >= _opts.max_concurrent_streams) {
+    //! every stream is busy, read responses ahead and keep them for `recv`
+    size_type before = outstanding();
+    if (!flush() || !read_once()) return false;
+    if (_opts.nonblocking && outstanding() == before) return false;
+  }
+
+  stream s;
+  s.req = req;
+  s.tag = tag;
+  if (s.req.method.empty()) s.req.method = "GET";
+  if (s.req.path.empty()) s.req.path = "/";
+  _queued.push_back(std::move(s));
+  return true;
+}
+
+bool h2_client::recv(Response& resp, uint64_t* tag) {
+  while (_ready.empty()) {
+    if (outstanding() == 0) return false;
+    if (!flush() || !read_once()) return false;
+  }
+  return try_recv(resp, tag);
+}
+
+bool h2_client::request(const Request& req, Response& resp) {
+  return send(req) && recv(resp);
+}
+
+bool h2_client::poll() {
+  if (outstanding() == 0 && !_sock) return true;
+  return read_once();
+}
+
+bool h2_client::try_recv(Response& resp, uint64_t* tag) {
+  if (_ready.empty()) return false;
+  if (tag != nullptr) *tag = _ready.front().first;
+  resp = std::move(_ready.front().second);
+  _ready.pop_front();
+  return true;
+}
+
+bool h2_client::flush() {
+  if (!_sock) {
+    if (_queued.empty()) return true;
+    if (!reconnect()) return false;
+  }
+  pump();
+
+  while (_out_offset < _out.size()) {
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(_out.data() + _out_offset);
+    iov.iov_len  = _out.size() - _out_offset;
+    ssize_t written = _sock->sendv(&iov, 1);
+    if (written < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      //! the peer went away while we were writing, start over on a new connection
+      if (!reconnect()) return false;
+      pump();
+      continue;
+    }
+    _out_offset += static_cast<size_type>(written);
+  }
+  _out.clear();
+  _out_offset = 0;
+  return true;
+}
+
+bool h2_client::can_open() const {
+  return !_goaway && _next_stream_id <= H2_MAX_WINDOW_SIZE
+    && _streams.size() < std::min(_peer_max_streams, _opts.max_concurrent_streams);
+}
+
+void h2_client::pump() {
+  if (!_sock) return;
+
+  header_list headers;
+  std::string block;
+  while (!_queued.empty() && can_open()) {
+    uint32_t id = _next_stream_id;
+    _next_stream_id += 2;
+
+    stream& s = _streams.emplace(id, std::move(_queued.front())).first->second;
+    _queued.pop_front();
+    s.send_window = _peer_initial_window;
+
+    headers.clear();
+    h2_request_headers(s.req, _host, headers);
+    block.clear();
+    _encoder.encode(headers, block);
+    write_h2_headers(_out, id, block, s.req.body.empty(), _peer_max_frame_size);
+    if (!s.req.body.empty()) _sending.push_back(id);
+  }
+
+  //! frame request bodies round-robin as far as the stream and connection windows allow
+  size_type rounds = _sending.size();
+  while (rounds-- > 0 && _send_window > 0) {
+    uint32_t id = _sending.front();
+    _sending.pop_front();
+    auto it = _streams.find(id);
+    if (it == _streams.end()) continue;
+
+    stream& s = it->second;
+    while (s.body_sent < s.req.body.size() && s.send_window > 0 && _send_window > 0) {
+      size_type chunk = std::min<size_type>(s.req.body.size() - s.body_sent, _peer_max_frame_size);
+      chunk = std::min<size_type>(chunk, static_cast<size_type>(std::min(s.send_window, _send_window)));
+      bool last = s.body_sent + chunk == s.req.body.size();
+      write_h2_data(_out, id, std::string_view(s.req.body).substr(s.body_sent, chunk), last);
+      s.body_sent += chunk;
+      s.send_window -= static_cast<int64_t>(chunk);
+      _send_window -= static_cast<int64_t>(chunk);
+    }
+    if (s.body_sent < s.req.body.size()) _sending.push_back(id);
+  }
+}
+
+bool h2_client::read_once() {
+  if (!_sock && !reconnect()) return false;
+
+  if (_in_begin == _in_end) {
+    _in_begin = _in_end = 0;
+  } else if (_in.size() - _in_end < _opts.read_size) {
+    //! compact first, and grow only if a single frame does not fit
+    std::copy(_in.begin() + static_cast<ptrdiff_t>(_in_begin), _in.begin() + static_cast<ptrdiff_t>(_in_end), _in.begin());
+    _in_end -= _in_begin;
+    _in_begin = 0;
+    if (_in.size() - _in_end < _opts.read_size) _in.resize(_in.size() * 2);
+  }
+
+  ssize_t received = _sock->recv(_in.data() + _in_end, _in.size() - _in_end);
+  if (received > 0) {
+    _in_end += static_cast<size_type>(received);
+    _bytes_received += static_cast<size_type>(received);
+    while (_sock) {
+      h2_frame frame;
+      ssize_t consumed = parse_h2_frame(_in.data() + _in_begin, _in_end - _in_begin, H2_DEFAULT_MAX_FRAME_SIZE, frame);
+      if (consumed == PARSE_INCOMPLETE) break;
+      if (consumed < 0 || !on_frame(frame)) {
+        erron << "HTTP/2 protocol error from " << _host;
+        std::string goaway;
+        write_h2_goaway(goaway, 0, h2_error::protocol_error);
+        struct iovec iov = { const_cast<char*>(goaway.data()), goaway.size() };
+        _sock->sendv(&iov, 1);
+        disconnect();
+        _queued.clear();
+        return false;
+      }
+      _in_begin += static_cast<size_type>(consumed);
+    }
+    if (_sock && _goaway && _streams.empty()) {
+      //! drained: queued requests go to a new connection
+      disconnect();
+      return _queued.empty() || reconnect();
+    }
+    pump();
+    return true;
+  }
+  if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+
+  //! orderly shutdown or reset: replay every unanswered request
+  disconnect();
+  if (outstanding() != 0) return reconnect();
+  return true;
+}
+
+bool h2_client::on_frame(const h2_frame& frame) {
+  //! a header block must not be interleaved with any other frame
+  if (_block_stream != 0 && (frame.type != h2_frame_type::continuation || frame.stream_id != _block_stream)) return false;
+
+  switch (frame.type) {
+    case h2_frame_type::data: {
+      std::string_view content;
+      if (frame.stream_id == 0 || !h2_frame_content(frame, content)) return false;
+      uint32_t size = static_cast<uint32_t>(frame.payload.size());
+      _recv_unacked += size;
+      if (_recv_unacked >= _opts.connection_window_size / 2) {
+        write_h2_window_update(_out, 0, _recv_unacked);
+        _recv_unacked = 0;
+      }
+
+      //! data of a stream we have already given up on still counts for the connection
+      auto it = _streams.find(frame.stream_id);
+      if (it == _streams.end()) return true;
+      stream& s = it->second;
+      s.resp.body.append(content.data(), content.size());
+      if (frame.flags & H2_FLAG_END_STREAM) {
+        complete(frame.stream_id);
+        return true;
+      }
+      s.recv_unacked += size;
+      if (s.recv_unacked >= _opts.initial_window_size / 2) {
+        write_h2_window_update(_out, frame.stream_id, s.recv_unacked);
+        s.recv_unacked = 0;
+      }
+      return true;
+    }
+    case h2_frame_type::headers: {
+      std::string_view content;
+      if (frame.stream_id == 0 || !h2_frame_content(frame, content)) return false;
+      _block.assign(content.data(), content.size());
+      _block_end_stream = (frame.flags & H2_FLAG_END_STREAM) != 0;
+      if (frame.flags & H2_FLAG_END_HEADERS) return on_headers(frame.stream_id, _block_end_stream);
+      _block_stream = frame.stream_id;
+      return true;
+    }
+    case h2_frame_type::continuation: {
+      if (_block_stream == 0) return false;
+      _block.append(frame.payload.data(), frame.payload.size());
+      if ((frame.flags & H2_FLAG_END_HEADERS) == 0) return true;
+      _block_stream = 0;
+      return on_headers(frame.stream_id, _block_end_stream);
+    }
+    case h2_frame_type::rst_stream: {
+      h2_error error;
+      if (frame.stream_id == 0 || !parse_h2_rst_stream(frame.payload, error)) return false;
+      auto it = _streams.find(frame.stream_id);
+      if (it == _streams.end()) return true;
+      if (error == h2_error::refused_stream) {
+        //! the server did not process the request at all, it is safe to send again
+        requeue(frame.stream_id);
+        return true;
+      }
+      it->second.resp.status = 0;
+      it->second.resp.reason = "RST_STREAM " + std::to_string(static_cast<uint32_t>(error));
+      complete(frame.stream_id);
+      return true;
+    }
+    case h2_frame_type::settings: {
+      if (frame.stream_id != 0) return false;
+      if (frame.flags & H2_FLAG_ACK) return true;
+      h2_settings settings;
+      if (!parse_h2_settings(frame.payload, settings)) return false;
+      for (const auto& setting : settings) {
+        switch (setting.first) {
+          case h2_setting::header_table_size:
+            _encoder.set_max_table_size(setting.second);
+            break;
+          case h2_setting::max_concurrent_streams:
+            _peer_max_streams = setting.second;
+            break;
+          case h2_setting::initial_window_size: {
+            if (setting.second > H2_MAX_WINDOW_SIZE) return false;
+            //! the change applies to every open stream
+            int64_t delta = static_cast<int64_t>(setting.second) - static_cast<int64_t>(_peer_initial_window);
+            for (auto& s : _streams) s.second.send_window += delta;
+            _peer_initial_window = setting.second;
+            break;
+          }
+          case h2_setting::max_frame_size:
+            if (setting.second < H2_DEFAULT_MAX_FRAME_SIZE || setting.second > 0xffffff) return false;
+            _peer_max_frame_size = setting.second;
+            break;
+          case h2_setting::enable_push:
+          case h2_setting::max_header_list_size:
+          default:
+            break;
+        }
+      }
+      write_h2_settings_ack(_out);
+      return true;
+    }
+    case h2_frame_type::ping: {
+      if (frame.stream_id != 0 || frame.payload.size() != 8) return false;
+      if ((frame.flags & H2_FLAG_ACK) == 0) write_h2_ping(_out, frame.payload.data(), true);
+      return true;
+    }
+    case h2_frame_type::goaway: {
+      uint32_t last = 0;
+      h2_error error;
+      if (frame.stream_id != 0 || !parse_h2_goaway(frame.payload, last, error)) return false;
+      _goaway = true;
+      //! streams above `last` were never processed and go to the next connection
+      std::vector<uint32_t> unprocessed;
+      for (const auto& s : _streams) {
+        if (s.first > last) unprocessed.push_back(s.first);
+      }
+      std::sort(unprocessed.rbegin(), unprocessed.rend());
+      for (uint32_t id : unprocessed) requeue(id);
+      return true;
+    }
+    case h2_frame_type::window_update: {
+      uint32_t increment = parse_h2_window_update(frame.payload);
+      if (increment == 0) return false;
+      if (frame.stream_id == 0) {
+        _send_window += increment;
+        if (_send_window > H2_MAX_WINDOW_SIZE) return false;
+      } else {
+        auto it = _streams.find(frame.stream_id);
+        if (it != _streams.end()) it->second.send_window += increment;
+      }
+      return true;
+    }
+    case h2_frame_type::push_promise:
+      //! push is disabled in our SETTINGS
+      return false;
+    case h2_frame_type::priority:
+    default:
+      return true;
+  }
+}
+
+bool h2_client::on_headers(uint32_t stream_id, bool end_stream) {
+  //! decode every block, even of streams we no longer track, to keep the dynamic table in sync
+  header_list headers;
+  if (!_decoder.decode(_block.data(), _block.size(), headers)) return false;
+  _block.clear();
+
+  auto it = _streams.find(stream_id);
+  if (it == _streams.end()) return true;
+  stream& s = it->second;
+  if (!s.has_headers) {
+    Response resp;
+    if (!h2_response_from_headers(headers, resp)) return false;
+    //! interim responses (`100 Continue`) do not answer the request
+    if (resp.status >= 100 && resp.status < 200) return true;
+    s.resp.status  = resp.status;
+    s.resp.version = std::move(resp.version);
+    s.resp.headers = std::move(resp.headers);
+    s.has_headers  = true;
+  } else {
+    //! trailers, e.g. `grpc-status`
+    Response trailers;
+    h2_response_from_headers(headers, trailers);
+    for (auto& h : trailers.headers) s.resp.headers[h.first] = std::move(h.second);
+  }
+  if (end_stream) complete(stream_id);
+  return true;
+}
+
+void h2_client::complete(uint32_t stream_id) {
+  auto it = _streams.find(stream_id);
+  Response& resp = it->second.resp;
+  resp.method = std::move(it->second.req.method);
+  resp.path   = std::move(it->second.req.path);
+  _ready.emplace_back(it->second.tag, std::move(resp));
+  _streams.erase(it);
+  _retries = 0;
+}
+
+void h2_client::requeue(uint32_t stream_id) {
+  auto it = _streams.find(stream_id);
+  stream s;
+  s.req = std::move(it->second.req);
+  s.tag = it->second.tag;
+  _queued.push_front(std::move(s));
+  _streams.erase(it);
+}
+
+bool h2_client::connect() {
+  _sock = socket::connect(_ip, _port);
+  if (!_sock) return false;
+  if (_opts.nodelay) _sock->set_nodelay(true);
+  if (_opts.nonblocking) _sock->set_nonblocking(true);
+  _connections++;
+
+  //! every connection starts with a fresh HPACK context and default settings
+  _encoder = hpack_encoder();
+  _decoder = hpack_decoder();
+  _next_stream_id = 1;
+  _goaway = false;
+  _peer_max_streams = SIZE_MAX;
+  _peer_initial_window = H2_DEFAULT_WINDOW_SIZE;
+  _peer_max_frame_size = H2_DEFAULT_MAX_FRAME_SIZE;
+  _send_window = H2_DEFAULT_WINDOW_SIZE;
+  _recv_unacked = 0;
+
+  _out.assign(H2_CLIENT_PREFACE.data(), H2_CLIENT_PREFACE.size());
+  _out_offset = 0;
+  write_h2_settings(_out, {
+    { h2_setting::enable_push, 0 },
+    { h2_setting::initial_window_size, _opts.initial_window_size },
+  });
+  if (_opts.connection_window_size > H2_DEFAULT_WINDOW_SIZE) {
+    write_h2_window_update(_out, 0, _opts.connection_window_size - H2_DEFAULT_WINDOW_SIZE);
+  }
+  return true;
+}
+
+void h2_client::disconnect() {
+  _sock.reset();
+  _in_begin = _in_end = 0;
+  _out.clear();
+  _out_offset = 0;
+  _block.clear();
+  _block_stream = 0;
+  _sending.clear();
+
+  //! every unanswered request is replayed on the next connection, oldest first
+  std::vector<uint32_t> open;
+  for (const auto& s : _streams) open.push_back(s.first);
+  std::sort(open.rbegin(), open.rend());
+  for (uint32_t id : open) requeue(id);
+}
+
+bool h2_client::reconnect() {
+  disconnect();
+  //! `_retries` counts connections that completed no stream, failed connects are counted per call
+  if (_retries++ <= _opts.max_retries) {
+    for (size_type attempt = 0; attempt <= _opts.max_retries; attempt++) {
+      if (connect()) return true;
+    }
+    erron << "unable to connect to " << _host;
+  } else {
+    erron << "connection to " << _host << " keeps closing without a response";
+  }
+  //! give up on what is queued, the next request starts with a fresh budget
+  _retries = 0;
+  _queued.clear();
+  return false;
+}
+
+h2_client::size_type h2_client::outstanding() const { return _queued.size() + _streams.size(); }
+h2_client::size_type h2_client::connections() const { return _connections; }
+bool h2_client::is_connected() const { return static_cast<bool>(_sock); }
+bool h2_client::wants_write() const { return _out_offset < _out.size() || (!_queued.empty() && can_open()); }
+int h2_client::get_fd() const { return _sock ? _sock->get_fd() : -1; }
+h2_client::size_type h2_client::bytes_received() const { return _bytes_received; }
+
+}
+NT_NAMESPACE_END
@@ -0,0 +1,232 @@
+#include "../include/http/http2_frame.h"
+#include "../include/defs.h"
+#include <algorithm>
+#include <cstring>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+static inline uint32_t read_u32(const char* p) {
+  const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+  return (static_cast<uint32_t>(u[0]) << 24) | (static_cast<uint32_t>(u[1]) << 16)
+       | (static_cast<uint32_t>(u[2]) << 8) | static_cast<uint32_t>(u[3]);
+}
+
+static inline void append_u32(std::string& out, uint32_t v) {
+  char b[4] = { static_cast<char>(v >> 24), static_cast<char>(v >> 16), static_cast<char>(v >> 8), static_cast<char>(v) };
+  out.append(b, 4);
+}
+
+ssize_t parse_h2_frame(const char* data, size_t len, uint32_t max_frame_size, h2_frame& frame) {
+  if (len < H2_FRAME_HEADER_SIZE) return PARSE_INCOMPLETE;
+  const uint8_t* u = reinterpret_cast<const uint8_t*>(data);
+  size_t length = (static_cast<size_t>(u[0]) << 16) | (static_cast<size_t>(u[1]) << 8) | u[2];
+  if (length > max_frame_size) return PARSE_ERROR;
+  if (len < H2_FRAME_HEADER_SIZE + length) return PARSE_INCOMPLETE;
+
+  frame.type = static_cast<h2_frame_type>(u[3]);
+  frame.flags = u[4];
+  frame.stream_id = read_u32(data + 5) & 0x7fffffff;
+  frame.payload = std::string_view(data + H2_FRAME_HEADER_SIZE, length);
+  return static_cast<ssize_t>(H2_FRAME_HEADER_SIZE + length);
+}
+
+bool h2_frame_content(const h2_frame& frame, std::string_view& content) {
+  content = frame.payload;
+  size_t pad = 0;
+  if (frame.flags & H2_FLAG_PADDED) {
+    if (content.empty()) return false;
+    pad = static_cast<uint8_t>(content.front());
+    content.remove_prefix(1);
+  }
+  if (frame.type == h2_frame_type::headers && (frame.flags & H2_FLAG_PRIORITY)) {
+    //! stream dependency (4) and weight (1)
+    if (content.size() < 5) return false;
+    content.remove_prefix(5);
+  }
+  if (pad > content.size()) return false;
+  content.remove_suffix(pad);
+  return true;
+}
+
+bool parse_h2_settings(std::string_view payload, h2_settings& settings) {
+  if (payload.size() % 6 != 0) return false;
+  for (size_t i = 0; i < payload.size(); i += 6) {
+    const uint8_t* u = reinterpret_cast<const uint8_t*>(payload.data() + i);
+    uint16_t id = static_cast<uint16_t>((u[0] << 8) | u[1]);
+    settings.emplace_back(static_cast<h2_setting>(id), read_u32(payload.data() + i + 2));
+  }
+  return true;
+}
+
+uint32_t parse_h2_window_update(std::string_view payload) {
+  if (payload.size() != 4) return 0;
+  return read_u32(payload.data()) & 0x7fffffff;
+}
+
+bool parse_h2_rst_stream(std::string_view payload, h2_error& error) {
+  if (payload.size() != 4) return false;
+  error = static_cast<h2_error>(read_u32(payload.data()));
+  return true;
+}
+
+bool parse_h2_goaway(std::string_view payload, uint32_t& last_stream_id, h2_error& error) {
+  if (payload.size() < 8) return false;
+  last_stream_id = read_u32(payload.data()) & 0x7fffffff;
+  error = static_cast<h2_error>(read_u32(payload.data() + 4));
+  return true;
+}
+
+void write_h2_frame_header(std::string& out, size_t length, h2_frame_type type, uint8_t flags, uint32_t stream_id) {
+  char b[H2_FRAME_HEADER_SIZE] = {
+    static_cast<char>(length >> 16), static_cast<char>(length >> 8), static_cast<char>(length),
+    static_cast<char>(type), static_cast<char>(flags),
+    static_cast<char>((stream_id >> 24) & 0x7f), static_cast<char>(stream_id >> 16),
+    static_cast<char>(stream_id >> 8), static_cast<char>(stream_id),
+  };
+  out.append(b, sizeof(b));
+}
+
+void write_h2_headers(std::string& out, uint32_t stream_id, std::string_view block, bool end_stream, uint32_t max_frame_size) {
+  h2_frame_type type = h2_frame_type::headers;
+  uint8_t flags = end_stream ? H2_FLAG_END_STREAM : 0;
+  do {
+    size_t n = std::min<size_t>(block.size(), max_frame_size);
+    if (n == block.size()) flags |= H2_FLAG_END_HEADERS;
+    write_h2_frame_header(out, n, type, flags, stream_id);
+    out.append(block.data(), n);
+    block.remove_prefix(n);
+    type = h2_frame_type::continuation;
+    flags = 0;
+  } while (!block.empty());
+}
+
+void write_h2_data(std::string& out, uint32_t stream_id, std::string_view data, bool end_stream) {
+  write_h2_frame_header(out, data.size(), h2_frame_type::data, end_stream ? H2_FLAG_END_STREAM : 0, stream_id);
+  out.append(data.data(), data.size());
+}
+
+void write_h2_settings(std::string& out, const h2_settings& settings) {
+  write_h2_frame_header(out, settings.size() * 6, h2_frame_type::settings, 0, 0);
+  for (const auto& s : settings) {
+    uint16_t id = static_cast<uint16_t>(s.first);
+    out.push_back(static_cast<char>(id >> 8));
+    out.push_back(static_cast<char>(id));
+    append_u32(out, s.second);
+  }
+}
+
+void write_h2_settings_ack(std::string& out) {
+  write_h2_frame_header(out, 0, h2_frame_type::settings, H2_FLAG_ACK, 0);
+}
+
+void write_h2_window_update(std::string& out, uint32_t stream_id, uint32_t increment) {
+  write_h2_frame_header(out, 4, h2_frame_type::window_update, 0, stream_id);
+  append_u32(out, increment & 0x7fffffff);
+}
+
+void write_h2_ping(std::string& out, const char opaque[8], bool ack) {
+  write_h2_frame_header(out, 8, h2_frame_type::ping, ack ? H2_FLAG_ACK : 0, 0);
+  out.append(opaque, 8);
+}
+
+void write_h2_rst_stream(std::string& out, uint32_t stream_id, h2_error error) {
+  write_h2_frame_header(out, 4, h2_frame_type::rst_stream, 0, stream_id);
+  append_u32(out, static_cast<uint32_t>(error));
+}
+
+void write_h2_goaway(std::string& out, uint32_t last_stream_id, h2_error error, std::string_view debug_data) {
+  write_h2_frame_header(out, 8 + debug_data.size(), h2_frame_type::goaway, 0, 0);
+  append_u32(out, last_stream_id & 0x7fffffff);
+  append_u32(out, static_cast<uint32_t>(error));
+  out.append(debug_data.data(), debug_data.size());
+}
+
+static std::string lower(const std::string& s) {
+  std::string r(s);
+  for (char& c : r) {
+    if (c >= 'A' && c <= 'Z') c = static_cast<char>(c + ('a' - 'A'));
+  }
+  return r;
+}
+
+//! connection-specific fields are not allowed in HTTP/2 (RFC 7540 8.1.2.2), `host` becomes `:authority`
+static bool is_connection_header(const std::string& name) {
+  return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+    || name == "transfer-encoding" || name == "upgrade" || name == "host";
+}
+
+static void append_regular_headers(const headers_type& from, header_list& headers) {
+  for (const auto& h : from) {
+    std::string name = lower(h.first);
+    if (is_connection_header(name)) continue;
+    headers.emplace_back(std::move(name), h.second);
+  }
+}
+
+void h2_request_headers(const Request& req, std::string_view authority, header_list& headers) {
+  const std::string* host = find_header_nocase(req.headers, "host");
+  headers.emplace_back(":method", req.method.empty() ? "GET" : req.method);
+  headers.emplace_back(":scheme", "http");
+  headers.emplace_back(":authority", host != nullptr ? *host : std::string(authority));
+  headers.emplace_back(":path", req.path.empty() ? "/" : req.path);
+  append_regular_headers(req.headers, headers);
+  if (!req.body.empty() && find_header_nocase(req.headers, "content-length") == nullptr) {
+    headers.emplace_back("content-length", std::to_string(req.body.size()));
+  }
+}
+
+void h2_response_headers(const Response& resp, header_list& headers) {
+  headers.emplace_back(":status", std::to_string(resp.status == 0 ? 200 : resp.status));
+  append_regular_headers(resp.headers, headers);
+  if (find_header_nocase(resp.headers, "content-length") == nullptr) {
+    headers.emplace_back("content-length", std::to_string(resp.body.size()));
+  }
+}
+
+static void fold_header(headers_type& to, const std::string& name, const std::string& value) {
+  auto it = to.find(name);
+  if (it == to.end()) {
+    to.emplace(name, value);
+  } else {
+    it->second.append(", ").append(value);
+  }
+}
+
+bool h2_request_from_headers(const header_list& headers, Request& req) {
+  req.version = "HTTP/2";
+  for (const auto& h : headers) {
+    if (h.first == ":method") {
+      req.method = h.second;
+    } else if (h.first == ":path") {
+      req.path = h.second;
+    } else if (h.first == ":authority") {
+      fold_header(req.headers, "host", h.second);
+    } else if (h.first.empty() || h.first.front() != ':') {
+      fold_header(req.headers, h.first, h.second);
+    }
+  }
+  return !req.method.empty() && !req.path.empty();
+}
+
+bool h2_response_from_headers(const header_list& headers, Response& resp) {
+  resp.version = "HTTP/2";
+  bool has_status = false;
+  for (const auto& h : headers) {
+    if (h.first == ":status") {
+      if (h.second.size() != 3) return false;
+      int status = 0;
+      for (char c : h.second) {
+        if (c < '0' || c > '9') return false;
+        status = status * 10 + (c - '0');
+      }
+      resp.status = status;
+      has_status = true;
+    } else if (h.first.empty() || h.first.front() != ':') {
+      fold_header(resp.headers, h.first, h.second);
+    }
+  }
+  return has_status;
+}
+}
+NT_NAMESPACE_END
@@ -0,0 +1,225 @@
+#include "../include/http/http_client.h"
+#include "../include/defs.h"
+#include "../include/log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+client::client(std::string ip, short port)
+  : client(std::move(ip), port, options()) {}
+
+client::client(std::string ip, short port, const options& opts)
+  : _ip(std::move(ip)), _port(port), _opts(opts)
+  , _sent(0), _sent_offset(0), _in(opts.read_size * 2)
+  , _in_begin(0), _in_end(0), _closing(false)
+  , _retries(0), _connections(0), _bytes_received(0) {
+  if (_opts.pipeline_depth == 0) _opts.pipeline_depth = 1;
+  _host = _ip + ":" + std::to_string(static_cast<unsigned short>(_port));
+}
+
+bool client::send(const Request& req) {
+  while (_inflight.size() >= _opts.pipeline_depth) {
+    //! the window is full, read the oldest response ahead and keep it for `recv`
+    size_type before = _inflight.size();
+    if (!flush() || !read_once()) return false;
+    if (_opts.nonblocking && _inflight.size() == before) return false;
+  }
+
+  pending p;
+  req.serialize(p.wire);
+  if (find_header_nocase(req.headers, "host") == nullptr) {
+    //! insert `Host` right after the request line
+    size_t eol = p.wire.find("\r\n");
+    p.wire.insert(eol + 2, "Host: " + _host + "\r\n");
+  }
+  p.method = req.method.empty() ? "GET" : req.method;
+  p.path   = req.path.empty() ? "/" : req.path;
+  _inflight.push_back(std::move(p));
+  return true;
+}
+
+bool client::recv(Response& resp) {
+  while (_ready.empty()) {
+    if (_inflight.empty()) return false;
+    if (!flush() || !read_once()) return false;
+  }
+  resp = std::move(_ready.front());
+  _ready.pop_front();
+  return true;
+}
+
+bool client::request(const Request& req, Response& resp) {
+  return send(req) && recv(resp);
+}
+
+bool client::poll() {
+  if (_inflight.empty() && !_sock) return true;
+  return read_once();
+}
+
+bool client::try_recv(Response& resp) {
+  if (_ready.empty()) return false;
+  resp = std::move(_ready.front());
+  _ready.pop_front();
+  return true;
+}
+
+bool client::flush() {
+  if (_sent == _inflight.size()) return true;
+  if (!_sock && !reconnect()) return false;
+
+  struct iovec iov[64];
+  while (_sent < _inflight.size()) {
+    int iovcnt = 0;
+    for (size_type i = _sent; i < _inflight.size() && iovcnt < 64; i++, iovcnt++) {
+      const std::string& wire = _inflight[i].wire;
+      size_type skip = (i == _sent) ? _sent_offset : 0;
+      iov[iovcnt].iov_base = const_cast<char*>(wire.data() + skip);
+      iov[iovcnt].iov_len  = wire.size() - skip;
+    }
+
+    ssize_t written = _sock->sendv(iov, iovcnt);
+    if (written < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      //! the peer went away while we were writing, start over on a new connection
+      if (!reconnect()) return false;
+      continue;
+    }
+
+    size_type left = static_cast<size_type>(written);
+    while (left > 0) {
+      size_type rest = _inflight[_sent].wire.size() - _sent_offset;
+      if (left < rest) {
+        _sent_offset += left;
+        break;
+      }
+      left -= rest;
+      _sent++;
+      _sent_offset = 0;
+    }
+  }
+  return true;
+}
+
+bool client::read_once() {
+  if (!_sock && !reconnect()) return false;
+
+  if (_in_begin == _in_end) {
+    _in_begin = _in_end = 0;
+  } else if (_in.size() - _in_end < _opts.read_size) {
+    //! compact first, and grow only if a single message does not fit
+    std::copy(_in.begin() + static_cast<ptrdiff_t>(_in_begin), _in.begin() + static_cast<ptrdiff_t>(_in_end), _in.begin());
+    _in_end -= _in_begin;
+    _in_begin = 0;
+    if (_in.size() - _in_end < _opts.read_size) _in.resize(_in.size() * 2);
+  }
+
+  ssize_t received = _sock->recv(_in.data() + _in_end, _in.size() - _in_end);
+  if (received > 0) {
+    _in_end += static_cast<size_type>(received);
+    _bytes_received += static_cast<size_type>(received);
+    if (!parse_responses(false)) {
+      erron << "malformed response from " << _host;
+      disconnect();
+      _inflight.clear();
+      return false;
+    }
+    if (_closing) {
+      //! the server will not answer anything queued after the `Connection: close` response
+      disconnect();
+    }
+    return true;
+  }
+  if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+
+  //! orderly shutdown or reset: finish a body delimited by the close, then replay the rest
+  if (received == 0 && !parse_responses(true)) {
+    erron << "malformed response from " << _host;
+  }
+  disconnect();
+  if (!_inflight.empty()) return reconnect();
+  return true;
+}
+
+bool client::parse_responses(bool eof) {
+  while (!_inflight.empty() && !_closing) {
+    pending& p = _inflight.front();
+    Response resp;
+    ssize_t consumed = parse_response(_in.data() + _in_begin, _in_end - _in_begin, resp, p.method == "HEAD", eof);
+    if (consumed == PARSE_INCOMPLETE) return true;
+    if (consumed < 0) return false;
+    _in_begin += static_cast<size_type>(consumed);
+
+    //! interim responses (`100 Continue`) do not answer the request
+    if (resp.status >= 100 && resp.status < 200 && resp.status != 101) continue;
+
+    const std::string* conn = find_header(resp.headers, "connection");
+    if (conn != nullptr ? has_token(*conn, "close") : resp.version == "HTTP/1.0") {
+      _closing = true;
+    }
+    resp.method = std::move(p.method);
+    resp.path   = std::move(p.path);
+    _ready.push_back(std::move(resp));
+    _retries = 0;
+
+    //! the answered request has left the pipeline
+    _inflight.pop_front();
+    if (_sent > 0) {
+      _sent--;
+    } else {
+      _sent_offset = 0;
+    }
+  }
+  return true;
+}
+
+bool client::connect() {
+  _sock = socket::connect(_ip, _port);
+  if (!_sock) return false;
+  if (_opts.nodelay) _sock->set_nodelay(true);
+  if (_opts.nonblocking) _sock->set_nonblocking(true);
+  _connections++;
+  return true;
+}
+
+void client::disconnect() {
+  _sock.reset();
+  _in_begin = _in_end = 0;
+  _closing = false;
+
+  //! every unanswered request is replayed from the start on the next connection
+  _sent = 0;
+  _sent_offset = 0;
+}
+
+bool client::reconnect() {
+  disconnect();
+  //! `_retries` counts connections that answered nothing, failed connects are counted per call
+  if (_retries++ <= _opts.max_retries) {
+    for (size_type attempt = 0; attempt <= _opts.max_retries; attempt++) {
+      if (connect()) return true;
+    }
+    erron << "unable to connect to " << _host;
+  } else {
+    erron << "connection to " << _host << " keeps closing without a response";
+  }
+  //! give up on what is queued, the next request starts with a fresh budget
+  _retries = 0;
+  _inflight.clear();
+  return false;
+}
+
+client::size_type client::outstanding() const { return _inflight.size(); }
+client::size_type client::connections() const { return _connections; }
+bool client::is_connected() const { return static_cast<bool>(_sock); }
+bool client::wants_write() const { return _sent < _inflight.size(); }
+int client::get_fd() const { return _sock ? _sock->get_fd() : -1; }
+client::size_type client::bytes_received() const { return _bytes_received; }
+
+}
+NT_NAMESPACE_END
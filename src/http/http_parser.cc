@@ -0,0 +1,190 @@
+#include "../include/http/http_parser.h"
+#include "../include/defs.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <limits>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+static inline char to_lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+static inline bool equals_nocase(std::string_view lhs, std::string_view rhs) {
+  if (lhs.size() != rhs.size()) return false;
+  for (size_t i = 0; i < lhs.size(); i++) {
+    if (to_lower(lhs[i]) != to_lower(rhs[i])) return false;
+  }
+  return true;
+}
+
+static inline std::string_view trim(std::string_view sv) {
+  while (!sv.empty() && (sv.front() == ' ' || sv.front() == '\t')) sv.remove_prefix(1);
+  while (!sv.empty() && (sv.back() == ' ' || sv.back() == '\t')) sv.remove_suffix(1);
+  return sv;
+}
+
+template <class Headers>
+ssize_t parse_headers(const char* data, size_t len, Headers& headers) {
+  size_t pos = 0;
+  while (true) {
+    const char* eol = static_cast<const char*>(memchr(data + pos, '\n', len - pos));
+    if (eol == nullptr) return PARSE_INCOMPLETE;
+
+    size_t line_end = static_cast<size_t>(eol - data);
+    std::string_view line(data + pos, line_end - pos);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    pos = line_end + 1;
+
+    //! the empty line terminates the header block
+    if (line.empty()) return static_cast<ssize_t>(pos);
+
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0) return PARSE_ERROR;
+
+    typename Headers::key_type name(line.substr(0, colon), headers.get_allocator());
+    std::transform(name.begin(), name.end(), name.begin(), to_lower);
+    std::string_view value = trim(line.substr(colon + 1));
+
+    auto it = headers.find(name);
+    if (it == headers.end()) {
+      headers.emplace(std::move(name), typename Headers::mapped_type(value, headers.get_allocator()));
+    } else {
+      it->second.append(", ").append(value);
+    }
+  }
+}
+
+template <class String>
+static ssize_t parse_chunked(const char* data, size_t len, String& body) {
+  size_t pos = 0;
+  String decoded(body.get_allocator());
+  while (true) {
+    const char* eol = static_cast<const char*>(memchr(data + pos, '\n', len - pos));
+    if (eol == nullptr) return PARSE_BODY_INCOMPLETE;
+
+    //! chunk-size [; chunk-ext] CRLF
+    size_t chunk = 0;
+    size_t digits = 0;
+    const char* p = data + pos;
+    for (; p < eol && isxdigit(static_cast<unsigned char>(*p)); p++, digits++) {
+      if (chunk > (std::numeric_limits<size_t>::max() >> 4)) return PARSE_ERROR;
+      chunk = (chunk << 4) | static_cast<size_t>(isdigit(static_cast<unsigned char>(*p)) ? *p - '0' : (to_lower(*p) - 'a' + 10));
+    }
+    if (digits == 0) return PARSE_ERROR;
+    pos = static_cast<size_t>(eol - data) + 1;
+
+    if (chunk == 0) {
+      //! the last chunk is followed by optional trailers and an empty line
+      headers_type trailers;
+      ssize_t consumed = parse_headers(data + pos, len - pos, trailers);
+      if (consumed == PARSE_INCOMPLETE) return PARSE_BODY_INCOMPLETE;
+      if (consumed < 0) return PARSE_ERROR;
+      body.append(decoded);
+      return static_cast<ssize_t>(pos) + consumed;
+    }
+
+    if (chunk > len - pos || len - pos - chunk < 2) return PARSE_BODY_INCOMPLETE;
+    decoded.append(data + pos, chunk);
+    pos += chunk;
+    if (data[pos] == '\r') pos++;
+    if (data[pos] != '\n') return PARSE_ERROR;
+    pos++;
+  }
+}
+
+template <class String>
+ssize_t parse_body(const char* data, size_t len, const body_framing& framing, bool eof, String& body) {
+  switch (framing.kind) {
+    case body_kind::none:
+      return 0;
+    case body_kind::length:
+      if (len < framing.length) return PARSE_BODY_INCOMPLETE;
+      body.append(data, framing.length);
+      return static_cast<ssize_t>(framing.length);
+    case body_kind::chunked:
+      return parse_chunked(data, len, body);
+    case body_kind::until_close:
+      if (!eof) return PARSE_BODY_INCOMPLETE;
+      body.append(data, len);
+      return static_cast<ssize_t>(len);
+  }
+  return PARSE_ERROR;
+}
+
+template <class Headers>
+const typename Headers::mapped_type* find_header(const Headers& headers, std::string_view name) {
+  auto it = headers.find(typename Headers::key_type(name, headers.get_allocator()));
+  return it == headers.end() ? nullptr : &it->second;
+}
+
+template <class Headers>
+const typename Headers::mapped_type* find_header_nocase(const Headers& headers, std::string_view name) {
+  for (const auto& [key, value] : headers) {
+    if (equals_nocase(key, name)) return &value;
+  }
+  return nullptr;
+}
+
+bool has_token(std::string_view value, std::string_view token) {
+  while (!value.empty()) {
+    size_t comma = value.find(',');
+    if (equals_nocase(trim(value.substr(0, comma)), token)) return true;
+    if (comma == std::string_view::npos) break;
+    value.remove_prefix(comma + 1);
+  }
+  return false;
+}
+
+template <class Headers>
+bool framing_from_headers(const Headers& headers, body_framing& framing) {
+  const auto* te = find_header(headers, "transfer-encoding");
+  if (te != nullptr && has_token(*te, "chunked")) {
+    framing.kind = body_kind::chunked;
+    return true;
+  }
+
+  const auto* cl = find_header(headers, "content-length");
+  if (cl != nullptr) {
+    size_t length = 0;
+    if (cl->empty()) return false;
+    for (char c : *cl) {
+      if (!isdigit(static_cast<unsigned char>(c))) return false;
+      size_t digit = static_cast<size_t>(c - '0');
+      if (length > (std::numeric_limits<size_t>::max() - digit) / 10) return false;
+      length = length * 10 + digit;
+    }
+    framing.kind = body_kind::length;
+    framing.length = length;
+    return true;
+  }
+
+  framing.kind = body_kind::none;
+  return true;
+}
+
+template <class Headers, class String>
+void serialize_headers(const Headers& headers, String& out) {
+  for (const auto& [key, value] : headers) {
+    out.append(key).append(": ").append(value).append("\r\n");
+  }
+}
+
+//! the header maps and strings of the plain and the `std::pmr` messages
+#define NT_HTTP_PARSER_INSTANTIATE(Headers, String)                                                         \
+  template ssize_t parse_headers<Headers>(const char*, size_t, Headers&);                                   \
+  template ssize_t parse_body<String>(const char*, size_t, const body_framing&, bool, String&);              \
+  template const Headers::mapped_type* find_header<Headers>(const Headers&, std::string_view);              \
+  template const Headers::mapped_type* find_header_nocase<Headers>(const Headers&, std::string_view);       \
+  template bool framing_from_headers<Headers>(const Headers&, body_framing&);                               \
+  template void serialize_headers<Headers, std::string>(const Headers&, std::string&);                      \
+  template void serialize_headers<Headers, std::pmr::string>(const Headers&, std::pmr::string&);
+
+NT_HTTP_PARSER_INSTANTIATE(headers_type, std::string)
+NT_HTTP_PARSER_INSTANTIATE(pmr::headers_type, std::pmr::string)
+#undef NT_HTTP_PARSER_INSTANTIATE
+
+}
+NT_NAMESPACE_END
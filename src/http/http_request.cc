@@ -0,0 +1,85 @@
+#include "../include/http/http_request.h"
+#include "../include/defs.h"
+#include <cstring>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+template <class Alloc>
+typename basic_request<Alloc>::string_type basic_request<Alloc>::to_string() const {
+  string_type out(get_allocator());
+  serialize(out);
+  return out;
+}
+
+template <class Alloc>
+template <class String>
+void basic_request<Alloc>::serialize(String& out) const {
+  out.append(method.empty() ? "GET" : method).append(" ")
+     .append(path.empty() ? "/" : path).append(" ")
+     .append(version.empty() ? "HTTP/1.1" : version).append("\r\n");
+  serialize_headers(headers, out);
+  if (!body.empty()
+      && find_header_nocase(headers, "content-length") == nullptr
+      && find_header_nocase(headers, "transfer-encoding") == nullptr) {
+    out.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+  }
+  out.append("\r\n").append(body);
+}
+
+template <class Alloc>
+ssize_t parse_request(const char* data, size_t len, basic_request<Alloc>& req) {
+  //! request-line = method SP request-target SP HTTP-version CRLF
+  const char* eol = static_cast<const char*>(memchr(data, '\n', len));
+  if (eol == nullptr) return PARSE_INCOMPLETE;
+
+  std::string_view line(data, static_cast<size_t>(eol - data));
+  if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+  size_t sp1 = line.find(' ');
+  size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+  if (sp2 == std::string_view::npos) return PARSE_ERROR;
+
+  size_t pos = static_cast<size_t>(eol - data) + 1;
+  typename basic_request<Alloc>::headers_type headers(req.get_allocator());
+  ssize_t consumed = parse_headers(data + pos, len - pos, headers);
+  if (consumed <= 0) return consumed;
+  pos += static_cast<size_t>(consumed);
+
+  body_framing framing;
+  if (!framing_from_headers(headers, framing)) return PARSE_ERROR;
+  typename basic_request<Alloc>::string_type body(req.get_allocator());
+  consumed = parse_body(data + pos, len - pos, framing, false, body);
+  if (consumed == PARSE_BODY_INCOMPLETE) return PARSE_INCOMPLETE;
+  if (consumed < 0) return PARSE_ERROR;
+  pos += static_cast<size_t>(consumed);
+
+  req.method.assign(line.substr(0, sp1));
+  req.path.assign(line.substr(sp1 + 1, sp2 - sp1 - 1));
+  req.version.assign(line.substr(sp2 + 1));
+  req.headers = std::move(headers);
+  req.body = std::move(body);
+  return static_cast<ssize_t>(pos);
+}
+
+//! the plain and the `std::pmr` requests
+template struct basic_request<std::allocator<char>>;
+template struct basic_request<std::pmr::polymorphic_allocator<char>>;
+template void Request::serialize<std::string>(std::string&) const;
+template void Request::serialize<std::pmr::string>(std::pmr::string&) const;
+template void pmr::Request::serialize<std::string>(std::string&) const;
+template void pmr::Request::serialize<std::pmr::string>(std::pmr::string&) const;
+template ssize_t parse_request<std::allocator<char>>(const char*, size_t, Request&);
+template ssize_t parse_request<std::pmr::polymorphic_allocator<char>>(const char*, size_t, pmr::Request&);
+
+Request parse_request(std::string stream) {
+  Request req;
+  static_cast<void>(parse_request(stream.data(), stream.size(), req));
+  return req;
+}
+
+Request parse_request(char* stream) {
+  return parse_request(std::string(stream));
+}
+
+}
+NT_NAMESPACE_END
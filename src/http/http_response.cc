@@ -0,0 +1,157 @@
+#include "../include/http/http_response.h"
+#include "../include/defs.h"
+#include <cstring>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+std::string_view status_reason(int status) {
+  switch (status) {
+    case 100: return "Continue";
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 203: return "Non-Authoritative Information";
+    case 204: return "No Content";
+    case 205: return "Reset Content";
+    case 206: return "Partial Content";
+    case 300: return "Multiple Choices";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 303: return "See Other";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 308: return "Permanent Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 402: return "Payment Required";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 406: return "Not Acceptable";
+    case 407: return "Proxy Authentication Required";
+    case 408: return "Request Timeout";
+    case 409: return "Conflict";
+    case 410: return "Gone";
+    case 411: return "Length Required";
+    case 412: return "Precondition Failed";
+    case 413: return "Content Too Large";
+    case 414: return "URI Too Long";
+    case 415: return "Unsupported Media Type";
+    case 416: return "Range Not Satisfiable";
+    case 417: return "Expectation Failed";
+    case 421: return "Misdirected Request";
+    case 422: return "Unprocessable Content";
+    case 426: return "Upgrade Required";
+    case 428: return "Precondition Required";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    case 505: return "HTTP Version Not Supported";
+    default:  return std::string_view();
+  }
+}
+
+template <class Alloc>
+typename basic_response<Alloc>::string_type basic_response<Alloc>::to_string() const {
+  string_type out(get_allocator());
+  serialize(out);
+  return out;
+}
+
+template <class Alloc>
+template <class String>
+void basic_response<Alloc>::serialize(String& out) const {
+  int code = (status == 0 ? 200 : status);
+  out.append(version.empty() ? "HTTP/1.1" : version).append(" ").append(std::to_string(code)).append(" ");
+  if (reason.empty()) {
+    std::string_view standard = status_reason(code);
+    out.append(standard.data(), standard.size());
+  } else {
+    out.append(reason);
+  }
+  out.append("\r\n");
+  serialize_headers(headers, out);
+  //! 1xx and 204 responses must not carry a `Content-Length`, and that of a 304 is the one
+  //! of the representation, not of its empty body (RFC 9110 8.6)
+  bool bodiless = (code >= 100 && code < 200) || code == 204 || code == 304;
+  if (!bodiless && find_header_nocase(headers, "content-length") == nullptr
+      && find_header_nocase(headers, "transfer-encoding") == nullptr) {
+    out.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+  }
+  out.append("\r\n").append(body);
+}
+
+template <class Alloc>
+ssize_t parse_response(const char* data, size_t len, basic_response<Alloc>& resp, bool head_request, bool eof) {
+  //! status-line = HTTP-version SP status-code SP [ reason-phrase ] CRLF
+  const char* eol = static_cast<const char*>(memchr(data, '\n', len));
+  if (eol == nullptr) return PARSE_INCOMPLETE;
+
+  std::string_view line(data, static_cast<size_t>(eol - data));
+  if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+  size_t sp1 = line.find(' ');
+  if (sp1 == std::string_view::npos || line.size() < sp1 + 4) return PARSE_ERROR;
+
+  int status = 0;
+  for (size_t i = sp1 + 1; i < sp1 + 4; i++) {
+    if (line[i] < '0' || line[i] > '9') return PARSE_ERROR;
+    status = status * 10 + (line[i] - '0');
+  }
+
+  size_t pos = static_cast<size_t>(eol - data) + 1;
+  typename basic_response<Alloc>::headers_type headers(resp.get_allocator());
+  ssize_t consumed = parse_headers(data + pos, len - pos, headers);
+  if (consumed <= 0) return consumed;
+  pos += static_cast<size_t>(consumed);
+
+  body_framing framing;
+  if (head_request || (status >= 100 && status < 200) || status == 204 || status == 304) {
+    framing.kind = body_kind::none;
+  } else {
+    if (!framing_from_headers(headers, framing)) return PARSE_ERROR;
+    //! a response without any length information is delimited by the connection close
+    if (framing.kind == body_kind::none) framing.kind = body_kind::until_close;
+  }
+
+  typename basic_response<Alloc>::string_type body(resp.get_allocator());
+  consumed = parse_body(data + pos, len - pos, framing, eof, body);
+  if (consumed == PARSE_BODY_INCOMPLETE) return PARSE_INCOMPLETE;
+  if (consumed < 0) return PARSE_ERROR;
+  pos += static_cast<size_t>(consumed);
+
+  resp.version.assign(line.substr(0, sp1));
+  resp.status = status;
+  resp.reason.assign(line.size() > sp1 + 5 ? line.substr(sp1 + 5) : std::string_view());
+  resp.headers = std::move(headers);
+  resp.body = std::move(body);
+  return static_cast<ssize_t>(pos);
+}
+
+//! the plain and the `std::pmr` responses
+template struct basic_response<std::allocator<char>>;
+template struct basic_response<std::pmr::polymorphic_allocator<char>>;
+template void Response::serialize<std::string>(std::string&) const;
+template void Response::serialize<std::pmr::string>(std::pmr::string&) const;
+template void pmr::Response::serialize<std::string>(std::string&) const;
+template void pmr::Response::serialize<std::pmr::string>(std::pmr::string&) const;
+template ssize_t parse_response<std::allocator<char>>(const char*, size_t, Response&, bool, bool);
+template ssize_t parse_response<std::pmr::polymorphic_allocator<char>>(const char*, size_t, pmr::Response&, bool, bool);
+
+Response parse_response(std::string stream) {
+  Response resp;
+  static_cast<void>(parse_response(stream.data(), stream.size(), resp, false, true));
+  return resp;
+}
+
+Response parse_response(char* stream) {
+  return parse_response(std::string(stream));
+}
+
+}
+NT_NAMESPACE_END
@@ -0,0 +1,195 @@
+#include "../include/http/http_router.h"
+#include "../include/defs.h"
+#include <algorithm>
+#include <cstring>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+std::string_view route_params::get(std::string_view name) const {
+  for (size_t i = 0; i < count; i++) {
+    if (items[i].first == name) return items[i].second;
+  }
+  return {};
+}
+
+struct router::node {
+  std::string                        prefix;     // static text consumed by this node
+  std::string                        indices;    // first byte of every static child
+  std::vector<std::unique_ptr<node>> children;
+  std::unique_ptr<node>              param;      // the `:name` child
+  std::unique_ptr<node>              wildcard;   // the `*name` child, always a leaf
+  std::string                        name;       // the parameter name of `param` and `wildcard` nodes
+  std::vector<std::pair<std::string, handler_type>> endpoints;    // by method, "" for any
+
+  const handler_type* endpoint(std::string_view method) const {
+    const handler_type* any = nullptr;
+    for (const auto& e : endpoints) {
+      if (e.first == method) return &e.second;
+      if (e.first.empty()) any = &e.second;
+    }
+    return any;
+  }
+};
+
+router::router() : _root(new node), _size(0) {}
+router::~router() = default;
+router::router(router&&) noexcept = default;
+router& router::operator= (router&&) noexcept = default;
+
+/**
+ * @brief Check the pattern syntax up front so that a rejected route leaves the trie unchanged.
+ */
+static bool valid_pattern(std::string_view pattern) {
+  if (pattern.empty() || pattern.front() != '/') return false;
+  size_t params = 0;
+  for (size_t i = 0; i < pattern.size(); i++) {
+    char c = pattern[i];
+    if (c != ':' && c != '*') continue;
+    //! parameters take whole segments
+    if (pattern[i - 1] != '/') return false;
+    size_t end = pattern.find('/', i);
+    if (c == '*' && end != std::string_view::npos) return false;
+    if (end == std::string_view::npos) end = pattern.size();
+    std::string_view name = pattern.substr(i + 1, end - i - 1);
+    if (name.empty() || name.find_first_of(":*") != std::string_view::npos) return false;
+    if (++params > route_params::MAX_PARAMS) return false;
+    i = end;
+  }
+  return true;
+}
+
+bool router::add(const std::string& pattern, handler_type handler) {
+  return add(std::string(), pattern, std::move(handler));
+}
+
+bool router::add(const std::string& method, const std::string& pattern, handler_type handler) {
+  if (!valid_pattern(pattern)) return false;
+
+  //! walk the pattern once read-only for parameter name conflicts
+  std::string_view rest = pattern;
+  node* n = _root.get();
+  while (n != nullptr && !rest.empty()) {
+    if (rest.front() == ':' || rest.front() == '*') {
+      size_t end = rest.front() == ':' ? std::min(rest.find('/'), rest.size()) : rest.size();
+      const std::unique_ptr<node>& slot = rest.front() == ':' ? n->param : n->wildcard;
+      if (slot && slot->name != rest.substr(1, end - 1)) return false;
+      n = slot.get();
+      rest.remove_prefix(end);
+      continue;
+    }
+    size_t idx = n->indices.find(rest.front());
+    if (idx == std::string::npos) break;
+    node* child = n->children[idx].get();
+    if (rest.compare(0, child->prefix.size(), child->prefix) != 0) break;
+    rest.remove_prefix(child->prefix.size());
+    n = child;
+  }
+
+  rest = pattern;
+  n = _root.get();
+  while (!rest.empty()) {
+    if (rest.front() == ':' || rest.front() == '*') {
+      size_t end = rest.front() == ':' ? std::min(rest.find('/'), rest.size()) : rest.size();
+      std::unique_ptr<node>& slot = rest.front() == ':' ? n->param : n->wildcard;
+      if (!slot) {
+        slot.reset(new node);
+        slot->name = std::string(rest.substr(1, end - 1));
+      }
+      n = slot.get();
+      rest.remove_prefix(end);
+      continue;
+    }
+
+    std::string_view text = rest.substr(0, rest.find_first_of(":*"));
+    rest.remove_prefix(text.size());
+    while (!text.empty()) {
+      size_t idx = n->indices.find(text.front());
+      if (idx == std::string::npos) {
+        n->indices.push_back(text.front());
+        n->children.emplace_back(new node);
+        n = n->children.back().get();
+        n->prefix = std::string(text);
+        break;
+      }
+
+      node* child = n->children[idx].get();
+      size_t common = 0;
+      while (common < text.size() && common < child->prefix.size() && text[common] == child->prefix[common]) common++;
+      if (common < child->prefix.size()) {
+        //! split the edge at the first differing byte
+        std::unique_ptr<node> mid(new node);
+        mid->prefix = child->prefix.substr(0, common);
+        child->prefix.erase(0, common);
+        mid->indices.push_back(child->prefix.front());
+        mid->children.push_back(std::move(n->children[idx]));
+        n->children[idx] = std::move(mid);
+        child = n->children[idx].get();
+      }
+      text.remove_prefix(common);
+      n = child;
+    }
+  }
+
+  for (const auto& e : n->endpoints) {
+    if (e.first == method) return false;
+  }
+  n->endpoints.emplace_back(method, std::move(handler));
+  _size++;
+  return true;
+}
+
+/**
+ * @brief Match `path` below `n`, whose own prefix is already consumed.
+ *
+ * Alternatives are tried static first, then the parameter, then the wildcard;
+ * captured parameters are rolled back when an alternative fails.
+ */
+const router::handler_type* router::match_node(const node* n, std::string_view method,
+                                              std::string_view path, route_params& params) {
+  if (path.empty()) {
+    const handler_type* handler = n->endpoint(method);
+    if (handler != nullptr) return handler;
+  } else {
+    const void* found = memchr(n->indices.data(), path.front(), n->indices.size());
+    if (found != nullptr) {
+      const node* child = n->children[static_cast<size_t>(static_cast<const char*>(found) - n->indices.data())].get();
+      if (path.size() >= child->prefix.size() && memcmp(path.data(), child->prefix.data(), child->prefix.size()) == 0) {
+        const handler_type* handler = match_node(child, method, path.substr(child->prefix.size()), params);
+        if (handler != nullptr) return handler;
+      }
+    }
+
+    if (n->param) {
+      size_t end = path.find('/');
+      if (end == std::string_view::npos) end = path.size();
+      if (end != 0) {
+        size_t saved = params.count;
+        params.items[params.count++] = { n->param->name, path.substr(0, end) };
+        const handler_type* handler = match_node(n->param.get(), method, path.substr(end), params);
+        if (handler != nullptr) return handler;
+        params.count = saved;
+      }
+    }
+  }
+
+  if (n->wildcard) {
+    const handler_type* handler = n->wildcard->endpoint(method);
+    if (handler != nullptr) {
+      params.items[params.count++] = { n->wildcard->name, path };
+      return handler;
+    }
+  }
+  return nullptr;
+}
+
+const router::handler_type* router::match(std::string_view method, std::string_view path, route_params& params) const {
+  params.count = 0;
+  return match_node(_root.get(), method, path, params);
+}
+
+size_t router::size() const {
+  return _size;
+}
+}
+NT_NAMESPACE_END
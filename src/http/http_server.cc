@@ -0,0 +1,392 @@
+#include "../include/http/http_server.h"
+#include "../include/http/http_url.h"
+#include "../include/defs.h"
+#include "../include/log.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+static constexpr const uint64_t LISTEN_TOKEN = ~uint64_t(0);
+static constexpr const uint64_t WAKEUP_TOKEN = ~uint64_t(0) - 1;
+
+static const std::string BAD_REQUEST =
+  "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+static inline uint64_t now_us() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * @brief A client connection owned by one worker.
+ */
+struct peer {
+  int                 fd = -1;
+  uint64_t            serial = 0;       // tells a reused descriptor apart in the timer queue
+  std::vector<char>   in;
+  size_t              in_begin = 0;
+  size_t              in_end = 0;
+  std::string         out;
+  size_t              out_pos = 0;
+  std::deque<std::pair<uint64_t, std::string>> delayed;   // responses held back by the latency
+  size_t              served = 0;
+  bool                closing = false;  // close once everything queued has been written
+  bool                want_write = false;
+};
+
+/**
+ * @brief The state of one worker thread.
+ */
+struct server::worker {
+  int                   listener = -1;
+  int                   epfd = -1;
+  int                   wakeup = -1;
+  uint64_t              next_serial = 0;
+  std::unordered_map<int, std::unique_ptr<peer>> conns;
+  //! responses become due in the order they were queued since the latency is constant
+  std::deque<std::pair<uint64_t, std::pair<int, uint64_t>>> timers;
+  alignas(64) std::atomic<uint64_t> requests { 0 };
+
+  ~worker() {
+    if (listener >= 0) ::close(listener);
+    if (wakeup >= 0) ::close(wakeup);
+    if (epfd >= 0) ::close(epfd);
+  }
+};
+
+server::server(const options& opts)
+  : _opts(opts), _port(opts.port), _running(false) {
+  if (_opts.threads == 0) _opts.threads = 1;
+  Response resp;
+  resp.headers["Content-Type"] = "text/plain";
+  resp.body.assign(_opts.response_size, 'x');
+  _default = serialize_canned(resp);
+}
+
+server::~server() {
+  stop();
+  wait();
+}
+
+server::canned server::serialize_canned(const Response& resp) {
+  canned c;
+  resp.serialize(c.keep_alive);
+  Response closing = resp;
+  closing.headers["Connection"] = "close";
+  closing.serialize(c.close);
+  return c;
+}
+
+void server::set_response(const std::string& path, const Response& resp) {
+  _canned[path] = serialize_canned(resp);
+}
+
+void server::set_handler(handler_type handler) {
+  _handler = std::move(handler);
+}
+
+void server::set_router(router routes) {
+  _router = std::move(routes);
+}
+
+int server::listen_socket(short port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1) return -1;
+
+  //! every worker binds its own socket to the same port, the kernel spreads the connections
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = inet_addr(_opts.ip.c_str());
+  addr.sin_port = htons(port);
+  if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) == -1 || ::listen(fd, _opts.backlog) == -1) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool server::start() {
+  if (_running) return true;
+  //! the workers of a previous run close their sockets once their threads are gone
+  wait();
+  _workers.clear();
+  for (size_t i = 0; i < _opts.threads; i++) {
+    auto w = std::make_unique<worker>();
+    w->listener = listen_socket(_port);
+    if (w->listener == -1) {
+      erron << "unable to listen on " << _opts.ip << ":" << static_cast<unsigned short>(_port) << ": " << strerror(errno);
+      _workers.clear();
+      return false;
+    }
+    if (_port == 0) {
+      //! the first worker picked an ephemeral port, the others join it
+      sockaddr_in addr;
+      socklen_t len = sizeof(addr);
+      getsockname(w->listener, (sockaddr*)&addr, &len);
+      _port = static_cast<short>(ntohs(addr.sin_port));
+    }
+
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    w->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = LISTEN_TOKEN;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->listener, &ev);
+    ev.data.u64 = WAKEUP_TOKEN;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->wakeup, &ev);
+    _workers.push_back(std::move(w));
+  }
+
+  _running = true;
+  for (auto& w : _workers) {
+    worker* wp = w.get();
+    _threads.emplace_back([this, wp]() { run(*wp); });
+  }
+  return true;
+}
+
+void server::stop() {
+  if (!_running.exchange(false)) return;
+  for (auto& w : _workers) {
+    uint64_t one = 1;
+    ssize_t ret = ::write(w->wakeup, &one, sizeof(one));
+    static_cast<void>(ret);
+  }
+}
+
+void server::wait() {
+  for (auto& t : _threads) {
+    if (t.joinable()) t.join();
+  }
+  _threads.clear();
+}
+
+short server::get_port() const { return _port; }
+
+uint64_t server::requests() const {
+  uint64_t total = 0;
+  for (const auto& w : _workers) total += w->requests.load(std::memory_order_relaxed);
+  return total;
+}
+
+/**
+ * @brief Write as much of the queued output as the socket takes.
+ *
+ * @return false if the connection has to be closed.
+ */
+static bool flush_connection(int epfd, peer& conn) {
+  while (conn.out_pos < conn.out.size()) {
+    ssize_t n = ::send(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos, MSG_NOSIGNAL);
+    if (n > 0) {
+      conn.out_pos += static_cast<size_t>(n);
+      continue;
+    }
+    if (n == -1 && errno == EINTR) continue;
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    return false;
+  }
+
+  bool pending = conn.out_pos < conn.out.size();
+  if (!pending) {
+    conn.out.clear();
+    conn.out_pos = 0;
+    if (conn.closing && conn.delayed.empty()) return false;
+  }
+  if (pending != conn.want_write) {
+    epoll_event ev {};
+    ev.events = EPOLLIN | (pending ? static_cast<uint32_t>(EPOLLOUT) : static_cast<uint32_t>(0));
+    ev.data.u64 = static_cast<uint64_t>(conn.fd);
+    epoll_ctl(epfd, EPOLL_CTL_MOD, conn.fd, &ev);
+    conn.want_write = pending;
+  }
+  return true;
+}
+
+void server::run(worker& w) {
+  std::vector<epoll_event> events(256);
+  const size_t read_size = _opts.read_size;
+
+  auto close_connection = [&w](int fd) {
+    ::close(fd);
+    w.conns.erase(fd);
+  };
+
+  //! queue a response, held back until `due` when an artificial latency is configured
+  auto emit = [&w](peer& conn, const std::string& bytes, uint64_t due) {
+    if (due != 0) {
+      conn.delayed.emplace_back(due, bytes);
+      w.timers.emplace_back(due, std::make_pair(conn.fd, conn.serial));
+    } else {
+      conn.out.append(bytes);
+    }
+  };
+
+  //! answer every complete request in the input buffer, pipelined requests in order
+  auto serve = [&](peer& conn) {
+    uint64_t due = _opts.latency_us != 0 ? now_us() + _opts.latency_us : 0;
+    route_params params;
+    while (!conn.closing) {
+      Request req;
+      ssize_t consumed = parse_request(conn.in.data() + conn.in_begin, conn.in_end - conn.in_begin, req);
+      if (consumed == PARSE_INCOMPLETE) break;
+      if (consumed < 0) {
+        conn.closing = true;
+        emit(conn, BAD_REQUEST, due);
+        break;
+      }
+      conn.in_begin += static_cast<size_t>(consumed);
+      conn.served++;
+      w.requests.fetch_add(1, std::memory_order_relaxed);
+
+      const std::string* conn_header = find_header(req.headers, "connection");
+      bool close = !_opts.keep_alive
+        || (_opts.max_requests != 0 && conn.served >= _opts.max_requests)
+        || (conn_header != nullptr ? has_token(*conn_header, "close") : req.version == "HTTP/1.0");
+      conn.closing = close;
+
+      const std::string* bytes = nullptr;
+      std::string built;
+      std::string_view path = parse_url(req.path).path;
+      auto it = path.size() == req.path.size() ? _canned.find(req.path) : _canned.find(std::string(path));
+      const router::handler_type* route = nullptr;
+      if (it != _canned.end()) {
+        bytes = close ? &it->second.close : &it->second.keep_alive;
+      } else if (_router.size() != 0 && (route = _router.match(req.method, path, params)) != nullptr) {
+        Response resp;
+        (*route)(req, params, resp);
+        if (close) resp.headers["Connection"] = "close";
+        resp.serialize(built);
+        bytes = &built;
+      } else if (_handler) {
+        Response resp;
+        _handler(req, resp);
+        if (close) resp.headers["Connection"] = "close";
+        resp.serialize(built);
+        bytes = &built;
+      } else {
+        bytes = close ? &_default.close : &_default.keep_alive;
+      }
+      if (req.method == "HEAD") {
+        //! the headers a GET would get, `Content-Length` included, without the body
+        size_t end = bytes->find("\r\n\r\n");
+        if (end != std::string::npos) {
+          if (bytes == &built) {
+            built.resize(end + 4);
+          } else {
+            built.assign(*bytes, 0, end + 4);
+          }
+          bytes = &built;
+        }
+      }
+
+      emit(conn, *bytes, due);
+    }
+    if (conn.in_begin == conn.in_end) conn.in_begin = conn.in_end = 0;
+  };
+
+  while (_running.load(std::memory_order_relaxed)) {
+    int timeout = -1;
+    if (!w.timers.empty()) {
+      uint64_t now = now_us();
+      uint64_t due = w.timers.front().first;
+      timeout = due > now ? static_cast<int>((due - now + 999) / 1000) : 0;
+    }
+
+    int ready = epoll_wait(w.epfd, events.data(), static_cast<int>(events.size()), timeout);
+    for (int e = 0; e < ready; e++) {
+      uint64_t token = events[e].data.u64;
+      if (token == WAKEUP_TOKEN) continue;
+
+      if (token == LISTEN_TOKEN) {
+        while (true) {
+          int fd = accept4(w.listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+          if (fd == -1) break;
+          int on = 1;
+          setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+          auto conn = std::make_unique<peer>();
+          conn->fd = fd;
+          conn->serial = ++w.next_serial;
+          conn->in.resize(read_size);
+          epoll_event ev {};
+          ev.events = EPOLLIN;
+          ev.data.u64 = static_cast<uint64_t>(fd);
+          epoll_ctl(w.epfd, EPOLL_CTL_ADD, fd, &ev);
+          w.conns[fd] = std::move(conn);
+        }
+        continue;
+      }
+
+      int fd = static_cast<int>(token);
+      auto found = w.conns.find(fd);
+      if (found == w.conns.end()) continue;
+      peer& conn = *found->second;
+
+      if (events[e].events & EPOLLIN) {
+        if (conn.in.size() - conn.in_end < read_size / 2) {
+          //! make room: compact, or grow for a request larger than the buffer
+          if (conn.in_begin != 0) {
+            std::memmove(conn.in.data(), conn.in.data() + conn.in_begin, conn.in_end - conn.in_begin);
+            conn.in_end -= conn.in_begin;
+            conn.in_begin = 0;
+          }
+          if (conn.in.size() - conn.in_end < read_size / 2) conn.in.resize(conn.in.size() * 2);
+        }
+        ssize_t n = ::recv(fd, conn.in.data() + conn.in_end, conn.in.size() - conn.in_end, 0);
+        if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+          close_connection(fd);
+          continue;
+        }
+        if (n > 0) {
+          conn.in_end += static_cast<size_t>(n);
+          serve(conn);
+        }
+      } else if (events[e].events & (EPOLLHUP | EPOLLERR)) {
+        close_connection(fd);
+        continue;
+      }
+      if (!flush_connection(w.epfd, conn)) close_connection(fd);
+    }
+
+    //! release the delayed responses that are due
+    if (!w.timers.empty()) {
+      uint64_t now = now_us();
+      while (!w.timers.empty() && w.timers.front().first <= now) {
+        auto [fd, serial] = w.timers.front().second;
+        w.timers.pop_front();
+        auto found = w.conns.find(fd);
+        if (found == w.conns.end() || found->second->serial != serial) continue;
+
+        peer& conn = *found->second;
+        while (!conn.delayed.empty() && conn.delayed.front().first <= now) {
+          conn.out.append(conn.delayed.front().second);
+          conn.delayed.pop_front();
+        }
+        if (!flush_connection(w.epfd, conn)) close_connection(fd);
+      }
+    }
+  }
+
+  for (auto& [fd, conn] : w.conns) ::close(fd);
+  w.conns.clear();
+}
+
+}
+NT_NAMESPACE_END
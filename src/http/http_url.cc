@@ -0,0 +1,124 @@
+#include "../include/http/http_url.h"
+#include "../include/defs.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+url_view parse_url(std::string_view target) {
+  url_view url;
+
+  size_t hash = target.find('#');
+  if (hash != std::string_view::npos) {
+    url.fragment = target.substr(hash + 1);
+    target = target.substr(0, hash);
+  }
+  size_t question = target.find('?');
+  if (question != std::string_view::npos) {
+    url.query = target.substr(question + 1);
+    target = target.substr(0, question);
+  }
+
+  //! absolute-form: scheme "://" authority [ path ]
+  size_t scheme_end = target.find("://");
+  if (scheme_end != std::string_view::npos && scheme_end != 0 && target.front() != '/') {
+    url.scheme = target.substr(0, scheme_end);
+    target = target.substr(scheme_end + 3);
+    size_t slash = target.find('/');
+    url.authority = target.substr(0, slash);
+    target = slash == std::string_view::npos ? std::string_view("/") : target.substr(slash);
+  }
+  url.path = target;
+  return url;
+}
+
+bool next_query_param(std::string_view& query, std::string_view& key, std::string_view& value) {
+  while (!query.empty()) {
+    size_t amp = query.find('&');
+    std::string_view pair = query.substr(0, amp);
+    query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+    if (pair.empty()) continue;
+
+    size_t eq = pair.find('=');
+    key = pair.substr(0, eq);
+    value = eq == std::string_view::npos ? std::string_view() : pair.substr(eq + 1);
+    return true;
+  }
+  return false;
+}
+
+bool find_query_param(std::string_view query, std::string_view key, std::string_view& value) {
+  std::string_view k;
+  std::string_view v;
+  while (next_query_param(query, k, v)) {
+    if (k == key) {
+      value = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+ssize_t percent_decode(const char* in, size_t len, char* out, bool plus_as_space) {
+  size_t i = 0;
+  size_t o = 0;
+#if defined(__SSE2__)
+  const __m128i percent = _mm_set1_epi8('%');
+  const __m128i plus = _mm_set1_epi8(plus_as_space ? '+' : '%');
+#endif
+  while (i < len) {
+#if defined(__SSE2__)
+    //! copy whole blocks without escapes, in place decoding is safe since `o <= i`
+    while (i + 16 <= len) {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+      int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, percent), _mm_cmpeq_epi8(block, plus)));
+      if (mask != 0) {
+        int clean = __builtin_ctz(static_cast<unsigned>(mask));
+        if (out + o != in + i) memmove(out + o, in + i, static_cast<size_t>(clean));
+        i += static_cast<size_t>(clean);
+        o += static_cast<size_t>(clean);
+        break;
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), block);
+      i += 16;
+      o += 16;
+    }
+    if (i == len) break;
+#endif
+    char c = in[i];
+    if (c == '%') {
+      if (len - i < 3) return -1;
+      int hi = hex_value(in[i + 1]);
+      int lo = hex_value(in[i + 2]);
+      if (hi < 0 || lo < 0) return -1;
+      out[o++] = static_cast<char>((hi << 4) | lo);
+      i += 3;
+    } else {
+      out[o++] = (plus_as_space && c == '+') ? ' ' : c;
+      i++;
+    }
+  }
+  return static_cast<ssize_t>(o);
+}
+
+bool percent_decode(std::string_view in, std::string& out, bool plus_as_space) {
+  out.resize(in.size());
+  ssize_t n = percent_decode(in.data(), in.size(), &out[0], plus_as_space);
+  if (n < 0) return false;
+  out.resize(static_cast<size_t>(n));
+  return true;
+}
+}
+NT_NAMESPACE_END
@@ -0,0 +1,312 @@
+#include "../include/http/websocket.h"
+#include "../include/defs.h"
+
+#include <cstring>
+#include <random>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+//! the build targets plain x86-64, so AVX2 is compiled in per function and chosen at run time
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define NT_WS_MASK_AVX2 1
+#endif
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+static inline bool is_control(ws_opcode opcode) {
+  return (static_cast<uint8_t>(opcode) & 0x8) != 0;
+}
+
+static inline bool is_known_opcode(uint8_t opcode) {
+  return opcode <= 0x2 || (opcode >= 0x8 && opcode <= 0xa);
+}
+
+ssize_t parse_ws_frame(const char* data, size_t len, size_t max_payload, ws_frame& frame) {
+  if (len < 2) return PARSE_INCOMPLETE;
+  const uint8_t* u = reinterpret_cast<const uint8_t*>(data);
+  //! no extension is negotiated, so the RSV bits must be clear
+  if ((u[0] & 0x70) != 0 || !is_known_opcode(u[0] & 0x0f)) return PARSE_ERROR;
+
+  frame.fin = (u[0] & 0x80) != 0;
+  frame.opcode = static_cast<ws_opcode>(u[0] & 0x0f);
+  frame.masked = (u[1] & 0x80) != 0;
+
+  size_t pos = 2;
+  uint64_t length = u[1] & 0x7f;
+  if (length == 126) {
+    if (len < 4) return PARSE_INCOMPLETE;
+    length = (static_cast<uint64_t>(u[2]) << 8) | u[3];
+    pos = 4;
+  } else if (length == 127) {
+    if (len < 10) return PARSE_INCOMPLETE;
+    length = 0;
+    for (size_t i = 2; i < 10; i++) length = (length << 8) | u[i];
+    if (length >> 63) return PARSE_ERROR;
+    pos = 10;
+  }
+  if (is_control(frame.opcode) && (!frame.fin || length > WS_MAX_CONTROL_PAYLOAD)) return PARSE_ERROR;
+  if (length > max_payload) return PARSE_ERROR;
+
+  frame.mask_key = 0;
+  if (frame.masked) {
+    if (len < pos + 4) return PARSE_INCOMPLETE;
+    memcpy(&frame.mask_key, data + pos, 4);
+    pos += 4;
+  }
+  if (len - pos < length) return PARSE_INCOMPLETE;
+  frame.payload = std::string_view(data + pos, static_cast<size_t>(length));
+  return static_cast<ssize_t>(pos + length);
+}
+
+#if defined(NT_WS_MASK_AVX2)
+/**
+ * @brief XOR the whole 32 byte blocks of `in` with `key`, on CPUs with AVX2 only.
+ *
+ * @return the number of bytes done.
+ */
+__attribute__((target("avx2"))) static size_t ws_mask_avx2(const char* in, char* out, size_t len, uint32_t key) {
+  const __m256i key32 = _mm256_set1_epi32(static_cast<int>(key));
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_xor_si256(block, key32));
+  }
+  return i;
+}
+
+static bool has_avx2() {
+  static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2") != 0);
+  return avx2;
+}
+#endif
+
+void ws_mask(const char* in, char* out, size_t len, uint32_t key, size_t offset) {
+  //! rotate the key so that its first byte lines up with `in[0]`
+  size_t shift = offset & 3;
+  if (shift != 0) {
+    uint8_t k[4];
+    memcpy(k, &key, 4);
+    uint8_t r[4] = { k[shift], k[(shift + 1) & 3], k[(shift + 2) & 3], k[(shift + 3) & 3] };
+    memcpy(&key, r, 4);
+  }
+
+  size_t i = 0;
+#if defined(NT_WS_MASK_AVX2)
+  if (len >= 32 && has_avx2()) i = ws_mask_avx2(in, out, len, key);
+#endif
+#if defined(__SSE2__)
+  const __m128i key16 = _mm_set1_epi32(static_cast<int>(key));
+  for (; i + 16 <= len; i += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(block, key16));
+  }
+#endif
+  //! both halves hold the same key, so the word is right in either byte order
+  const uint64_t key8 = static_cast<uint64_t>(key) | (static_cast<uint64_t>(key) << 32);
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, in + i, 8);
+    word ^= key8;
+    memcpy(out + i, &word, 8);
+  }
+  uint8_t k[4];
+  memcpy(k, &key, 4);
+  for (; i < len; i++) out[i] = static_cast<char>(in[i] ^ k[i & 3]);
+}
+
+size_t write_ws_frame_header(char* out, size_t length, ws_opcode opcode, bool fin, bool masked, uint32_t key) {
+  uint8_t* u = reinterpret_cast<uint8_t*>(out);
+  u[0] = static_cast<uint8_t>((fin ? 0x80 : 0) | static_cast<uint8_t>(opcode));
+  uint8_t mask_bit = masked ? 0x80 : 0;
+  size_t pos = 2;
+  if (length < 126) {
+    u[1] = static_cast<uint8_t>(mask_bit | length);
+  } else if (length <= 0xffff) {
+    u[1] = static_cast<uint8_t>(mask_bit | 126);
+    u[2] = static_cast<uint8_t>(length >> 8);
+    u[3] = static_cast<uint8_t>(length);
+    pos = 4;
+  } else {
+    u[1] = static_cast<uint8_t>(mask_bit | 127);
+    for (size_t i = 0; i < 8; i++) u[2 + i] = static_cast<uint8_t>(static_cast<uint64_t>(length) >> (56 - 8 * i));
+    pos = 10;
+  }
+  if (masked) {
+    memcpy(out + pos, &key, 4);
+    pos += 4;
+  }
+  return pos;
+}
+
+void write_ws_frame(std::string& out, ws_opcode opcode, std::string_view payload, bool fin, bool masked, uint32_t key) {
+  char header[WS_MAX_FRAME_HEADER_SIZE];
+  out.append(header, write_ws_frame_header(header, payload.size(), opcode, fin, masked, key));
+  if (!masked) {
+    out.append(payload.data(), payload.size());
+    return;
+  }
+  //! mask straight into the output buffer instead of through a temporary copy
+  size_t pos = out.size();
+  out.resize(pos + payload.size());
+  ws_mask(payload.data(), &out[pos], payload.size(), key);
+}
+
+void write_ws_close(std::string& out, uint16_t code, std::string_view reason, bool masked, uint32_t key) {
+  if (reason.size() > WS_MAX_CONTROL_PAYLOAD - 2) reason = reason.substr(0, WS_MAX_CONTROL_PAYLOAD - 2);
+  char payload[WS_MAX_CONTROL_PAYLOAD];
+  payload[0] = static_cast<char>(code >> 8);
+  payload[1] = static_cast<char>(code);
+  memcpy(payload + 2, reason.data(), reason.size());
+  write_ws_frame(out, ws_opcode::close, std::string_view(payload, reason.size() + 2), true, masked, key);
+}
+
+bool parse_ws_close(std::string_view payload, uint16_t& code, std::string_view& reason) {
+  reason = {};
+  if (payload.empty()) {
+    code = static_cast<uint16_t>(ws_close_code::no_status);
+    return true;
+  }
+  if (payload.size() < 2) return false;
+  const uint8_t* u = reinterpret_cast<const uint8_t*>(payload.data());
+  code = static_cast<uint16_t>((u[0] << 8) | u[1]);
+  reason = payload.substr(2);
+  //! 1004-1006 and 1015 are reserved for reporting, never for the wire (RFC 6455 7.4.1)
+  return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) || (code >= 3000 && code <= 4999);
+}
+
+//! SHA-1 (RFC 3174), only used to derive `Sec-WebSocket-Accept`
+static void sha1(const char* data, size_t len, uint8_t digest[20]) {
+  uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+  std::string msg(data, len);
+  msg.push_back(static_cast<char>(0x80));
+  while (msg.size() % 64 != 56) msg.push_back('\0');
+  uint64_t bits = static_cast<uint64_t>(len) * 8;
+  for (int i = 7; i >= 0; i--) msg.push_back(static_cast<char>(bits >> (8 * i)));
+
+  auto rol = [](uint32_t v, int n) { return (v << n) | (v >> (32 - n)); };
+  for (size_t block = 0; block < msg.size(); block += 64) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(msg.data() + block);
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+      w[i] = (static_cast<uint32_t>(p[4 * i]) << 24) | (static_cast<uint32_t>(p[4 * i + 1]) << 16)
+           | (static_cast<uint32_t>(p[4 * i + 2]) << 8) | p[4 * i + 3];
+    }
+    for (int i = 16; i < 80; i++) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5a827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+      uint32_t t = rol(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rol(b, 30);
+      b = a;
+      a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+  for (int i = 0; i < 5; i++) {
+    digest[4 * i]     = static_cast<uint8_t>(h[i] >> 24);
+    digest[4 * i + 1] = static_cast<uint8_t>(h[i] >> 16);
+    digest[4 * i + 2] = static_cast<uint8_t>(h[i] >> 8);
+    digest[4 * i + 3] = static_cast<uint8_t>(h[i]);
+  }
+}
+
+static std::string base64_encode(const uint8_t* data, size_t len) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((len + 2) / 3 * 4);
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = static_cast<uint32_t>(data[i]) << 16;
+    if (i + 1 < len) v |= static_cast<uint32_t>(data[i + 1]) << 8;
+    if (i + 2 < len) v |= data[i + 2];
+    out.push_back(alphabet[(v >> 18) & 0x3f]);
+    out.push_back(alphabet[(v >> 12) & 0x3f]);
+    out.push_back(i + 1 < len ? alphabet[(v >> 6) & 0x3f] : '=');
+    out.push_back(i + 2 < len ? alphabet[v & 0x3f] : '=');
+  }
+  return out;
+}
+
+std::string ws_generate_key() {
+  static thread_local std::mt19937 rng(std::random_device{}());
+  uint8_t nonce[16];
+  for (size_t i = 0; i < sizeof(nonce); i += 4) {
+    uint32_t r = rng();
+    memcpy(nonce + i, &r, 4);
+  }
+  return base64_encode(nonce, sizeof(nonce));
+}
+
+std::string ws_accept_key(std::string_view key) {
+  std::string input(key);
+  input.append(WS_GUID.data(), WS_GUID.size());
+  uint8_t digest[20];
+  sha1(input.data(), input.size(), digest);
+  return base64_encode(digest, sizeof(digest));
+}
+
+void ws_handshake_request(Request& req, std::string_view host, std::string_view path, std::string_view key) {
+  req.method = "GET";
+  req.path = path.empty() ? "/" : std::string(path);
+  req.version = "HTTP/1.1";
+  req.body.clear();
+  req.headers["Host"] = std::string(host);
+  req.headers["Upgrade"] = "websocket";
+  req.headers["Connection"] = "Upgrade";
+  req.headers["Sec-WebSocket-Key"] = std::string(key);
+  req.headers["Sec-WebSocket-Version"] = "13";
+}
+
+bool ws_check_handshake(const Response& resp, std::string_view key) {
+  if (resp.status != 101) return false;
+  const std::string* upgrade = find_header_nocase(resp.headers, "upgrade");
+  const std::string* connection = find_header_nocase(resp.headers, "connection");
+  const std::string* accept = find_header_nocase(resp.headers, "sec-websocket-accept");
+  return upgrade != nullptr && has_token(*upgrade, "websocket")
+    && connection != nullptr && has_token(*connection, "upgrade")
+    && accept != nullptr && *accept == ws_accept_key(key);
+}
+
+bool ws_accept_handshake(const Request& req, Response& resp) {
+  if (req.method != "GET" || req.version == "HTTP/1.0") return false;
+  const std::string* upgrade = find_header_nocase(req.headers, "upgrade");
+  const std::string* connection = find_header_nocase(req.headers, "connection");
+  const std::string* version = find_header_nocase(req.headers, "sec-websocket-version");
+  const std::string* key = find_header_nocase(req.headers, "sec-websocket-key");
+  if (upgrade == nullptr || !has_token(*upgrade, "websocket")) return false;
+  if (connection == nullptr || !has_token(*connection, "upgrade")) return false;
+  if (version == nullptr || *version != "13") return false;
+  //! the key is a base64 encoded 16 byte nonce
+  if (key == nullptr || key->size() != 24 || key->compare(22, 2, "==") != 0) return false;
+
+  resp.version = "HTTP/1.1";
+  resp.status = 101;
+  resp.reason = "Switching Protocols";
+  resp.headers.clear();
+  resp.headers["Upgrade"] = "websocket";
+  resp.headers["Connection"] = "Upgrade";
+  resp.headers["Sec-WebSocket-Accept"] = ws_accept_key(*key);
+  resp.body.clear();
+  return true;
+}
+}
+NT_NAMESPACE_END
@@ -0,0 +1,278 @@
+#include "../include/http/websocket_client.h"
+#include "../include/defs.h"
+#include "../include/log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <random>
+#include <sys/uio.h>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+
+ws_client::ws_client(std::string ip, short port, std::string path)
+  : ws_client(std::move(ip), port, std::move(path), options()) {}
+
+ws_client::ws_client(std::string ip, short port, std::string path, const options& opts)
+  : _ip(std::move(ip)), _port(port), _path(std::move(path)), _opts(opts)
+  , _out_offset(0), _in(opts.read_size * 2), _in_begin(0), _in_end(0)
+  , _message_opcode(ws_opcode::binary), _fragmented(false), _close_sent(false)
+  , _close_received(false), _close_code(0), _mask_state(0)
+  , _messages_received(0), _bytes_received(0) {
+  _host = _ip + ":" + std::to_string(static_cast<unsigned short>(_port));
+}
+
+bool ws_client::connect() {
+  disconnect();
+  _sock = socket::connect(_ip, _port);
+  if (!_sock) {
+    erron << "unable to connect to " << _host;
+    return false;
+  }
+  if (_opts.nodelay) _sock->set_nodelay(true);
+
+  _fragmented = false;
+  _close_sent = _close_received = false;
+  _close_code = 0;
+  std::random_device seed;
+  _mask_state = (static_cast<uint64_t>(seed()) << 32) | seed() | 1;
+
+  std::string key = ws_generate_key();
+  Request req;
+  ws_handshake_request(req, _host, _path, key);
+  std::string wire;
+  req.serialize(wire);
+  for (size_type sent = 0; sent < wire.size();) {
+    struct iovec iov = { const_cast<char*>(wire.data() + sent), wire.size() - sent };
+    ssize_t written = _sock->sendv(&iov, 1);
+    if (written <= 0) {
+      disconnect();
+      return false;
+    }
+    sent += static_cast<size_type>(written);
+  }
+
+  //! frames may follow the handshake response in the same read, they stay in `_in`
+  while (true) {
+    Response resp;
+    ssize_t consumed = parse_response(_in.data() + _in_begin, _in_end - _in_begin, resp);
+    if (consumed > 0) {
+      _in_begin += static_cast<size_type>(consumed);
+      if (!ws_check_handshake(resp, key)) {
+        erron << "WebSocket upgrade refused by " << _host << " with status " << resp.status;
+        disconnect();
+        return false;
+      }
+      break;
+    }
+    if (consumed < 0 || !read_once()) {
+      disconnect();
+      return false;
+    }
+  }
+  if (_opts.nonblocking) _sock->set_nonblocking(true);
+  return true;
+}
+
+uint32_t ws_client::next_mask_key() {
+  //! xorshift64*, a masking key only has to be unpredictable to scripts, not secret
+  _mask_state ^= _mask_state >> 12;
+  _mask_state ^= _mask_state << 25;
+  _mask_state ^= _mask_state >> 27;
+  return static_cast<uint32_t>((_mask_state * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+void ws_client::queue_frame(ws_opcode opcode, std::string_view payload, bool fin) {
+  if (_out_offset == _out.size()) {
+    _out.clear();
+    _out_offset = 0;
+  }
+  write_ws_frame(_out, opcode, payload, fin, true, next_mask_key());
+}
+
+bool ws_client::send(ws_opcode opcode, std::string_view data) {
+  if (!_sock || _close_sent) return false;
+  if (opcode != ws_opcode::text && opcode != ws_opcode::binary) return false;
+
+  size_type fragment = _opts.fragment_size == 0 ? data.size() : _opts.fragment_size;
+  do {
+    size_type n = std::min(fragment, data.size());
+    queue_frame(opcode, data.substr(0, n), n == data.size());
+    data.remove_prefix(n);
+    opcode = ws_opcode::continuation;
+  } while (!data.empty());
+  return true;
+}
+
+bool ws_client::ping(std::string_view data) {
+  if (!_sock || _close_sent) return false;
+  queue_frame(ws_opcode::ping, data.substr(0, std::min(data.size(), WS_MAX_CONTROL_PAYLOAD)), true);
+  return true;
+}
+
+bool ws_client::close(uint16_t code, std::string_view reason) {
+  if (!_sock || _close_sent) return false;
+  if (_out_offset == _out.size()) {
+    _out.clear();
+    _out_offset = 0;
+  }
+  write_ws_close(_out, code, reason, true, next_mask_key());
+  _close_sent = true;
+  return true;
+}
+
+bool ws_client::flush() {
+  if (!_sock) return false;
+  while (_out_offset < _out.size()) {
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(_out.data() + _out_offset);
+    iov.iov_len  = _out.size() - _out_offset;
+    ssize_t written = _sock->sendv(&iov, 1);
+    if (written < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      if (_close_code == 0) _close_code = static_cast<uint16_t>(ws_close_code::abnormal);
+      disconnect();
+      return false;
+    }
+    _out_offset += static_cast<size_type>(written);
+  }
+  _out.clear();
+  _out_offset = 0;
+  //! both close frames have been exchanged, the session is over
+  if (_close_sent && _close_received) disconnect();
+  return true;
+}
+
+bool ws_client::recv(ws_opcode& opcode, std::string_view& data) {
+  while (!try_recv(opcode, data)) {
+    if (!_sock || !flush() || !_sock || !read_once()) return false;
+  }
+  //! send the echoed close frame right away, the caller is likely done with the client
+  if (opcode == ws_opcode::close) flush();
+  return true;
+}
+
+bool ws_client::poll() {
+  if (!_sock) return false;
+  return read_once();
+}
+
+bool ws_client::try_recv(ws_opcode& opcode, std::string_view& data) {
+  while (_sock && !_close_received) {
+    ws_frame frame;
+    ssize_t consumed = parse_ws_frame(_in.data() + _in_begin, _in_end - _in_begin, _opts.max_message_size, frame);
+    if (consumed == PARSE_INCOMPLETE) return false;
+    //! a server must never mask its frames (RFC 6455 5.1)
+    if (consumed < 0 || frame.masked) return fail(ws_close_code::protocol_error);
+    _in_begin += static_cast<size_type>(consumed);
+
+    switch (frame.opcode) {
+      case ws_opcode::ping:
+        if (!_close_sent) queue_frame(ws_opcode::pong, frame.payload, true);
+        break;
+      case ws_opcode::pong:
+        break;
+      case ws_opcode::close: {
+        uint16_t code = 0;
+        std::string_view reason;
+        if (!parse_ws_close(frame.payload, code, reason)) return fail(ws_close_code::protocol_error);
+        if (!_close_sent) {
+          //! echo the code to complete the closing handshake
+          uint16_t echo = code == static_cast<uint16_t>(ws_close_code::no_status)
+            ? static_cast<uint16_t>(ws_close_code::normal) : code;
+          close(echo);
+        }
+        _close_received = true;
+        _close_code = code;
+        opcode = ws_opcode::close;
+        data = reason;
+        return true;
+      }
+      case ws_opcode::text:
+      case ws_opcode::binary:
+        if (_fragmented) return fail(ws_close_code::protocol_error);
+        if (frame.fin) {
+          //! the common case: hand out the payload where it was received
+          _messages_received++;
+          opcode = frame.opcode;
+          data = frame.payload;
+          return true;
+        }
+        _message.assign(frame.payload.data(), frame.payload.size());
+        _message_opcode = frame.opcode;
+        _fragmented = true;
+        break;
+      case ws_opcode::continuation:
+        if (!_fragmented) return fail(ws_close_code::protocol_error);
+        if (_message.size() + frame.payload.size() > _opts.max_message_size) return fail(ws_close_code::message_too_big);
+        _message.append(frame.payload.data(), frame.payload.size());
+        if (frame.fin) {
+          _fragmented = false;
+          _messages_received++;
+          opcode = _message_opcode;
+          data = _message;
+          return true;
+        }
+        break;
+    }
+  }
+  return false;
+}
+
+bool ws_client::read_once() {
+  if (!_sock) return false;
+
+  if (_in_begin == _in_end) {
+    _in_begin = _in_end = 0;
+  } else if (_in.size() - _in_end < _opts.read_size) {
+    //! compact first, and grow only if a single frame does not fit
+    std::copy(_in.begin() + static_cast<ptrdiff_t>(_in_begin), _in.begin() + static_cast<ptrdiff_t>(_in_end), _in.begin());
+    _in_end -= _in_begin;
+    _in_begin = 0;
+    if (_in.size() - _in_end < _opts.read_size) _in.resize(_in.size() * 2);
+  }
+
+  ssize_t received = _sock->recv(_in.data() + _in_end, _in.size() - _in_end);
+  if (received > 0) {
+    _in_end += static_cast<size_type>(received);
+    _bytes_received += static_cast<size_type>(received);
+    return true;
+  }
+  if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+
+  if (_close_code == 0) _close_code = static_cast<uint16_t>(ws_close_code::abnormal);
+  disconnect();
+  return false;
+}
+
+bool ws_client::fail(ws_close_code code) {
+  erron << "WebSocket protocol error from " << _host;
+  if (!_close_sent) {
+    std::string frame;
+    write_ws_close(frame, static_cast<uint16_t>(code), {}, true, next_mask_key());
+    struct iovec iov = { const_cast<char*>(frame.data()), frame.size() };
+    _sock->sendv(&iov, 1);
+  }
+  _close_code = static_cast<uint16_t>(code);
+  disconnect();
+  return false;
+}
+
+void ws_client::disconnect() {
+  _sock.reset();
+  _in_begin = _in_end = 0;
+  _out.clear();
+  _out_offset = 0;
+  _message.clear();
+  _fragmented = false;
+}
+
+bool ws_client::wants_write() const { return _out_offset < _out.size(); }
+int ws_client::get_fd() const { return _sock ? _sock->get_fd() : -1; }
+bool ws_client::is_open() const { return static_cast<bool>(_sock); }
+uint16_t ws_client::close_code() const { return _close_code; }
+ws_client::size_type ws_client::messages_received() const { return _messages_received; }
+ws_client::size_type ws_client::bytes_received() const { return _bytes_received; }
+
+}
+NT_NAMESPACE_END
@@ -13,6 +13,7 @@
 #include <utility>
 #include <limits>
 #include <memory>
+#include <memory_resource>
 #include <stdexcept>
 #include <sys/types.h>
 
@@ -73,6 +74,9 @@ private:
 
     void update_rd();
     void update_wt();
+
+    template <class String>
+    ret_type read_append(String& buf, const value_type limit);
 public:
     /**
      * @brief Construct a file_discriptor object with the given file descriptor.
@@ -101,6 +105,14 @@ public:
      * @return The number of bytes read.
      */
     ret_type read(std::string& buf, const value_type limit = limits::max());
+    /**
+     * @brief Read data into a buffer of a `std::pmr::memory_resource`, such as an `nt::heap_resource`.
+     * 
+     * @param buf The buffer to read the data into.
+     * @param limit The maximum number of bytes to read.
+     * @return The number of bytes read.
+     */
+    ret_type read(std::pmr::string& buf, const value_type limit = limits::max());
     /**
      * @brief Write data to the file descriptor.
      * 
@@ -133,6 +145,7 @@ public:
      * @return The number of bytes received.
      */
     ret_type receive(std::string& buf, const value_type limit = limits::max());
+    ret_type receive(std::pmr::string& buf, const value_type limit = limits::max());
     /**
      * @brief Check if the file descriptor is readable.
      * 
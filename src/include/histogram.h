@@ -0,0 +1,113 @@
+#ifndef __LIBNT_HISTOGRAM_H
+#define __LIBNT_HISTOGRAM_H
+
+#include "defs.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+NT_NAMESPACE_BEGEN
+
+/**
+ * @brief The `histogram` records integer values (e.g. latencies in microseconds)
+ * with a bounded relative error, in the layout of HdrHistogram.
+ *
+ * Values are kept in power-of-two buckets, each split linearly into enough
+ * sub-buckets to hold `significant_digits` decimal digits, so recording is a
+ * couple of bit operations and an increment, and percentiles up to p99.999
+ * stay exact to within 0.1% (for 3 digits) with a fixed memory footprint.
+ */
+class histogram {
+    using __self_ref        = histogram&;
+    using __self_ref_const  = const histogram&;
+    using value_type        = uint64_t;
+    using count_type        = uint64_t;
+
+public:
+    /**
+     * @brief Construct a histogram tracking values in `[1, highest]`.
+     *
+     * @param highest The highest value to be tracked, larger values are clamped.
+     * @param significant_digits The number of significant decimal digits to keep (1 to 5).
+     */
+    explicit histogram(value_type highest = 3600ULL * 1000 * 1000, int significant_digits = 3);
+
+    /**
+     * @brief Record `count` occurrences of `value`.
+     */
+    void record(value_type value, count_type count = 1);
+    /**
+     * @brief Record `value` and back-fill the samples a stalled closed-loop
+     * tester failed to issue while waiting for it.
+     *
+     * If `value` exceeds `expected_interval`, the values `value - expected_interval`,
+     * `value - 2 * expected_interval`, ... down to `expected_interval` are recorded
+     * as well, which corrects for coordinated omission.
+     *
+     * @param value The measured value.
+     * @param expected_interval The expected interval between two samples, 0 disables the correction.
+     */
+    void record_corrected(value_type value, value_type expected_interval);
+    /**
+     * @brief Add all the samples of `other`, which must have the same layout.
+     */
+    void merge(__self_ref_const other);
+    /**
+     * @brief Forget all recorded samples.
+     */
+    void reset();
+
+    /**
+     * @brief The value below or at which `percentile` percent of the samples fall.
+     *
+     * @param percentile The percentile in [0, 100].
+     */
+    value_type value_at_percentile(double percentile) const;
+    value_type min() const;
+    value_type max() const;
+    double     mean() const;
+    double     stddev() const;
+    count_type total_count() const;
+
+    /**
+     * @brief Format the standard percentiles (p50 to p99.999) as text.
+     *
+     * @param scale Divide the values by `scale` before printing (e.g. 1000 for us -> ms).
+     * @param unit The unit printed after each value.
+     */
+    std::string to_text(double scale = 1.0, const std::string& unit = "") const;
+    /**
+     * @brief Format the summary and the standard percentiles as a JSON object.
+     */
+    std::string to_json() const;
+
+private:
+    size_t     counts_index(value_type value) const;
+    size_t     bucket_index(value_type value) const;
+    value_type value_from_index(size_t index) const;
+    value_type highest_equivalent(value_type value) const;
+
+    value_type              _highest;
+    int                     _unit_magnitude;
+    int                     _sub_bucket_half_count_magnitude;
+    value_type              _sub_bucket_count;
+    value_type              _sub_bucket_half_count;
+    value_type              _sub_bucket_mask;
+    std::vector<count_type> _counts;
+    count_type              _total;
+    value_type              _min;
+    value_type              _max;
+};
+
+/**
+ * @brief The percentiles reported by `histogram::to_text` and `histogram::to_json`.
+ */
+constexpr const double HISTOGRAM_PERCENTILES[] = {
+    50.0, 75.0, 90.0, 99.0, 99.9, 99.99, 99.999, 100.0,
+};
+
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_HISTOGRAM_H
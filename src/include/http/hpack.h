@@ -0,0 +1,144 @@
+#ifndef __LIBNT_HTTP_HPACK_H
+#define __LIBNT_HTTP_HPACK_H
+
+#include "../defs.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+  /**
+   * @brief An ordered list of header fields, as carried by an HTTP/2 header block.
+   *
+   * Unlike `headers_type` the order and repeated names are preserved, pseudo-headers
+   * (`:method`, `:status`, ...) come first.
+   */
+  using header_list = std::vector<std::pair<std::string, std::string>>;
+
+  /**
+   * @brief The default `SETTINGS_HEADER_TABLE_SIZE` of RFC 7541.
+   */
+  constexpr const size_t HPACK_DEFAULT_TABLE_SIZE = 4096;
+
+  /**
+   * @brief The HPACK dynamic table, shared in shape by the encoder and the decoder.
+   *
+   * Entries are kept newest first; the size of an entry is its name and value
+   * length plus 32 bytes, and the oldest entries are evicted to stay within `max_size`.
+   */
+  class hpack_table {
+  public:
+    explicit hpack_table(size_t max_size = HPACK_DEFAULT_TABLE_SIZE);
+
+    /**
+     * @brief Insert an entry, evicting as needed; an entry larger than the table empties it.
+     */
+    void add(std::string_view name, std::string_view value);
+    /**
+     * @brief Change the maximum size, evicting entries that no longer fit.
+     */
+    void resize(size_t max_size);
+
+    /**
+     * @brief The entry at `index` of the combined address space (1..61 static, then dynamic).
+     *
+     * @return nullptr if the index is out of range.
+     */
+    const std::pair<std::string, std::string>* get(size_t index) const;
+    /**
+     * @brief Find the best index for a field.
+     *
+     * @param name_only Set to true when only the name matched.
+     * @return the index of an exact match, else of a name match, else 0.
+     */
+    size_t find(std::string_view name, std::string_view value, bool& name_only) const;
+
+    size_t size() const { return _size; }
+    size_t max_size() const { return _max_size; }
+    size_t count() const { return _entries.size(); }
+
+  private:
+    void evict(size_t max_size);
+
+    std::deque<std::pair<std::string, std::string>> _entries;
+    size_t                                          _size;
+    size_t                                          _max_size;
+  };
+
+  /**
+   * @brief Compresses header lists into HPACK header blocks (RFC 7541).
+   *
+   * Fields found in the static or dynamic table are sent as a single index, other
+   * fields are added to the dynamic table, except for credentials and very large
+   * values which are sent without indexing. String literals are Huffman coded
+   * whenever that is shorter.
+   */
+  class hpack_encoder {
+  public:
+    explicit hpack_encoder(size_t max_table_size = HPACK_DEFAULT_TABLE_SIZE);
+
+    /**
+     * @brief Apply the `SETTINGS_HEADER_TABLE_SIZE` announced by the peer.
+     *
+     * The resulting dynamic table size update is emitted at the start of the next block.
+     */
+    void set_max_table_size(size_t max_size);
+    /**
+     * @brief Append the header block of `headers` to `out`.
+     */
+    void encode(const header_list& headers, std::string& out);
+
+  private:
+    hpack_table _table;
+    size_t      _pending_size;    // table size to announce, SIZE_MAX if none
+  };
+
+  /**
+   * @brief Decompresses HPACK header blocks back into header lists.
+   */
+  class hpack_decoder {
+  public:
+    explicit hpack_decoder(size_t max_table_size = HPACK_DEFAULT_TABLE_SIZE);
+
+    /**
+     * @brief The table size limit we announced with `SETTINGS_HEADER_TABLE_SIZE`.
+     */
+    void set_max_table_size(size_t max_size);
+    /**
+     * @brief Decode one complete header block, appending the fields to `headers`.
+     *
+     * Every block of a connection must be decoded in order, also those of streams
+     * that are no longer of interest, since they update the dynamic table.
+     *
+     * @return false if the block is malformed, the connection is then unusable.
+     */
+    bool decode(const char* data, size_t len, header_list& headers);
+
+  private:
+    hpack_table _table;
+    size_t      _limit;
+  };
+
+  /**
+   * @brief Append the Huffman coding of `in` to `out`, padded with EOS bits.
+   */
+  void huffman_encode(std::string_view in, std::string& out);
+  /**
+   * @brief The length of the Huffman coding of `in` in bytes.
+   */
+  size_t huffman_encoded_size(std::string_view in);
+  /**
+   * @brief Append the decoding of a Huffman coded string to `out`.
+   *
+   * @return false on an EOS symbol, padding longer than 7 bits or padding that is not all ones.
+   */
+  bool huffman_decode(const char* data, size_t len, std::string& out);
+}
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_HTTP_HPACK_H
@@ -0,0 +1,207 @@
+#ifndef __LIBNT_HTTP2_CLIENT_H
+#define __LIBNT_HTTP2_CLIENT_H
+
+#include "../defs.h"
+#include "../socket.h"
+#include "hpack.h"
+#include "http2_frame.h"
+#include "http_request.h"
+#include "http_response.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+  /**
+   * @brief The `h2_client` multiplexes requests as HTTP/2 streams over a single `nt::socket`.
+   *
+   * The connection is cleartext with prior knowledge (h2c): the client preface is sent
+   * right after connecting, without an `Upgrade` round trip. Up to `max_concurrent_streams`
+   * requests are outstanding at once, further limited by the server's
+   * `SETTINGS_MAX_CONCURRENT_STREAMS`; responses are delivered in completion order.
+   * Request bodies respect the stream and connection flow-control windows, and received
+   * data is acknowledged with `WINDOW_UPDATE` frames as it is consumed.
+   *
+   * Like the HTTP/1.1 `client`, streams refused by the server (`REFUSED_STREAM`, or above
+   * the last stream of a `GOAWAY`) and streams lost with the connection are replayed on a
+   * new connection, so callers never see the reconnect.
+   */
+  class h2_client {
+    using __self_ref       = h2_client&;
+    using size_type        = size_t;
+
+    /**
+     * @brief A request that has been queued or opened but not answered yet.
+     */
+    struct stream {
+      Request   req;
+      uint64_t  tag          = 0;
+      size_type body_sent    = 0;
+      int64_t   send_window  = 0;
+      uint32_t  recv_unacked = 0;       // received bytes not yet acknowledged with `WINDOW_UPDATE`
+      bool      has_headers  = false;   // the final (non 1xx) response headers have arrived
+      Response  resp;
+    };
+
+  public:
+    struct options {
+      size_type max_concurrent_streams = 100;         // maximum number of outstanding requests
+      uint32_t  initial_window_size    = 1 << 20;     // receive window of every stream
+      uint32_t  connection_window_size = 16 << 20;    // receive window of the connection
+      size_type max_retries            = 3;           // connect retries per reconnect, and reconnects without any progress
+      size_type read_size              = 64 * 1024;   // minimum free space for each read
+      bool      nodelay                = true;        // set `TCP_NODELAY` on every connection
+      bool      nonblocking            = false;       // never wait in `flush`/`poll`, for event loops
+    };
+
+    h2_client(std::string ip, short port);
+    h2_client(std::string ip, short port, const options& opts);
+    ~h2_client() = default;
+
+    h2_client(const h2_client&)            = delete;
+    h2_client(h2_client&&)                 = default;
+    __self_ref operator= (const h2_client&) = delete;
+    __self_ref operator= (h2_client&&)      = default;
+
+    /**
+     * @brief Queue a request as a new stream.
+     *
+     * When `max_concurrent_streams` requests are already outstanding, responses are
+     * read ahead and kept for `recv` until a stream is free.
+     *
+     * @param tag An opaque value handed back with the response, since responses
+     * complete out of order.
+     * @return false if the connection could not be (re-)established, or in
+     * non-blocking mode if every stream is busy and no response has arrived yet.
+     */
+    bool send(const Request& req, uint64_t tag = 0);
+    /**
+     * @brief Wait for the next completed response, in completion order.
+     *
+     * A stream reset by the server with an error other than `REFUSED_STREAM` completes
+     * with `status` 0 and the error in `reason`.
+     *
+     * @param resp The response to fill, its `method` and `path` are those of the request.
+     * @param tag Receives the tag the request was sent with.
+     * @return false if nothing is outstanding or the server could not be reached.
+     */
+    bool recv(Response& resp, uint64_t* tag = nullptr);
+    /**
+     * @brief Send a request and wait for a response, see `client::request`.
+     */
+    bool request(const Request& req, Response& resp);
+    /**
+     * @brief Open queued streams and write pending frames to the socket.
+     *
+     * @return false if the connection could not be (re-)established.
+     */
+    bool flush();
+
+    /**
+     * @brief Read whatever has arrived and process the complete frames, see `client::poll`.
+     *
+     * @return false if the server could not be reached or violated the protocol.
+     */
+    bool poll();
+    /**
+     * @brief Pop a response that has already been read, without any I/O.
+     */
+    bool try_recv(Response& resp, uint64_t* tag = nullptr);
+    /**
+     * @brief Whether frames are waiting to be written.
+     */
+    bool wants_write() const;
+    /**
+     * @brief The descriptor of the current connection, -1 if there is none.
+     */
+    int get_fd() const;
+
+    /**
+     * @brief The number of requests that have not been answered yet, queued or open.
+     */
+    size_type outstanding() const;
+    /**
+     * @brief The number of connections opened so far (1 + reconnects).
+     */
+    size_type connections() const;
+    /**
+     * @brief Whether a connection is currently open.
+     */
+    bool is_connected() const;
+    /**
+     * @brief The number of bytes received so far, frame headers included.
+     */
+    size_type bytes_received() const;
+
+  private:
+    bool connect();
+    void disconnect();
+    bool reconnect();
+    /**
+     * @brief Whether another stream may be opened on the current connection.
+     */
+    bool can_open() const;
+    /**
+     * @brief Open queued streams and frame request bodies as far as the windows allow.
+     */
+    void pump();
+    /**
+     * @brief Read once from the socket and process every complete frame.
+     */
+    bool read_once();
+    /**
+     * @brief Process one frame.
+     *
+     * @return false on a connection error.
+     */
+    bool on_frame(const h2_frame& frame);
+    bool on_headers(uint32_t stream_id, bool end_stream);
+    void complete(uint32_t stream_id);
+    /**
+     * @brief Put an open stream back at the front of the queue, to be opened again.
+     */
+    void requeue(uint32_t stream_id);
+
+    std::string               _ip;
+    short                     _port;
+    options                   _opts;
+    std::string               _host;
+
+    std::unique_ptr<socket>   _sock;
+    std::deque<stream>        _queued;        // requests waiting for a stream, in FIFO order
+    std::unordered_map<uint32_t, stream> _streams;    // open streams by id
+    std::deque<uint32_t>      _sending;       // open streams with request body left to send
+    std::deque<std::pair<uint64_t, Response>> _ready;   // tagged responses read ahead of `recv`
+    std::string               _out;           // frames waiting to be written
+    size_type                 _out_offset;
+    std::vector<char>         _in;            // receive buffer
+    size_type                 _in_begin;
+    size_type                 _in_end;
+
+    hpack_encoder             _encoder;
+    hpack_decoder             _decoder;
+    std::string               _block;         // header block being assembled from CONTINUATION frames
+    uint32_t                  _block_stream;  // the stream of `_block`, 0 if none
+    bool                      _block_end_stream;
+    uint32_t                  _next_stream_id;
+    bool                      _goaway;        // no new streams on this connection
+    size_type                 _peer_max_streams;
+    uint32_t                  _peer_initial_window;
+    uint32_t                  _peer_max_frame_size;
+    int64_t                   _send_window;
+    uint32_t                  _recv_unacked;
+
+    size_type                 _retries;
+    size_type                 _connections;
+    size_type                 _bytes_received;
+  };
+}
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_HTTP2_CLIENT_H
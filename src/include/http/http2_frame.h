@@ -0,0 +1,164 @@
+#ifndef __LIBNT_HTTP2_FRAME_H
+#define __LIBNT_HTTP2_FRAME_H
+
+#include "../defs.h"
+#include "hpack.h"
+#include "http_request.h"
+#include "http_response.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+  /**
+   * @brief The connection preface a client sends before its first frame (RFC 7540 3.5).
+   */
+  constexpr const std::string_view H2_CLIENT_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+  constexpr const size_t   H2_FRAME_HEADER_SIZE       = 9;
+  constexpr const uint32_t H2_DEFAULT_MAX_FRAME_SIZE  = 16384;
+  constexpr const uint32_t H2_DEFAULT_WINDOW_SIZE     = 65535;
+  constexpr const uint32_t H2_MAX_WINDOW_SIZE         = 0x7fffffff;
+
+  enum class h2_frame_type : uint8_t {
+    data          = 0x0,
+    headers       = 0x1,
+    priority      = 0x2,
+    rst_stream    = 0x3,
+    settings      = 0x4,
+    push_promise  = 0x5,
+    ping          = 0x6,
+    goaway        = 0x7,
+    window_update = 0x8,
+    continuation  = 0x9,
+  };
+
+  constexpr const uint8_t H2_FLAG_END_STREAM  = 0x01;
+  constexpr const uint8_t H2_FLAG_ACK         = 0x01;   // SETTINGS and PING
+  constexpr const uint8_t H2_FLAG_END_HEADERS = 0x04;
+  constexpr const uint8_t H2_FLAG_PADDED      = 0x08;
+  constexpr const uint8_t H2_FLAG_PRIORITY    = 0x20;
+
+  enum class h2_setting : uint16_t {
+    header_table_size      = 0x1,
+    enable_push            = 0x2,
+    max_concurrent_streams = 0x3,
+    initial_window_size    = 0x4,
+    max_frame_size         = 0x5,
+    max_header_list_size   = 0x6,
+  };
+
+  enum class h2_error : uint32_t {
+    no_error            = 0x0,
+    protocol_error      = 0x1,
+    internal_error      = 0x2,
+    flow_control_error  = 0x3,
+    settings_timeout    = 0x4,
+    stream_closed       = 0x5,
+    frame_size_error    = 0x6,
+    refused_stream      = 0x7,
+    cancel              = 0x8,
+    compression_error   = 0x9,
+    connect_error       = 0xa,
+    enhance_your_calm   = 0xb,
+    inadequate_security = 0xc,
+    http_1_1_required   = 0xd,
+  };
+
+  using h2_settings = std::vector<std::pair<h2_setting, uint32_t>>;
+
+  /**
+   * @brief A frame parsed in place, `payload` is a view into the input buffer.
+   */
+  struct h2_frame {
+    h2_frame_type    type = h2_frame_type::data;
+    uint8_t          flags = 0;
+    uint32_t         stream_id = 0;
+    std::string_view payload;
+  };
+
+  /**
+   * @brief Parse the frame at the start of `data`.
+   *
+   * @param max_frame_size The `SETTINGS_MAX_FRAME_SIZE` we announced.
+   * @return the number of bytes consumed, `PARSE_INCOMPLETE`, or `PARSE_ERROR`
+   * if the frame is larger than `max_frame_size`.
+   */
+  ssize_t parse_h2_frame(const char* data, size_t len, uint32_t max_frame_size, h2_frame& frame);
+
+  /**
+   * @brief The header block fragment of a HEADERS, or the data of a DATA frame,
+   * with padding and priority fields removed.
+   *
+   * @return false if the padding is longer than the payload.
+   */
+  bool h2_frame_content(const h2_frame& frame, std::string_view& content);
+
+  /**
+   * @brief Decode the parameters of a SETTINGS frame.
+   *
+   * @return false if the payload is not a multiple of 6 bytes.
+   */
+  bool parse_h2_settings(std::string_view payload, h2_settings& settings);
+  /**
+   * @brief Decode the increment of a WINDOW_UPDATE frame, 0 if malformed.
+   */
+  uint32_t parse_h2_window_update(std::string_view payload);
+  /**
+   * @brief Decode the error code of a RST_STREAM frame.
+   */
+  bool parse_h2_rst_stream(std::string_view payload, h2_error& error);
+  /**
+   * @brief Decode the last stream and error code of a GOAWAY frame.
+   */
+  bool parse_h2_goaway(std::string_view payload, uint32_t& last_stream_id, h2_error& error);
+
+  void write_h2_frame_header(std::string& out, size_t length, h2_frame_type type, uint8_t flags, uint32_t stream_id);
+  /**
+   * @brief Append a header block as one HEADERS frame and as many CONTINUATION frames as needed.
+   */
+  void write_h2_headers(std::string& out, uint32_t stream_id, std::string_view block, bool end_stream,
+                        uint32_t max_frame_size = H2_DEFAULT_MAX_FRAME_SIZE);
+  void write_h2_data(std::string& out, uint32_t stream_id, std::string_view data, bool end_stream);
+  void write_h2_settings(std::string& out, const h2_settings& settings);
+  void write_h2_settings_ack(std::string& out);
+  void write_h2_window_update(std::string& out, uint32_t stream_id, uint32_t increment);
+  void write_h2_ping(std::string& out, const char opaque[8], bool ack);
+  void write_h2_rst_stream(std::string& out, uint32_t stream_id, h2_error error);
+  void write_h2_goaway(std::string& out, uint32_t last_stream_id, h2_error error, std::string_view debug_data = {});
+
+  /**
+   * @brief The header list of a request: pseudo-headers first, names lower-cased and
+   * connection-specific headers (`Connection`, `Keep-Alive`, `Transfer-Encoding`, ...) dropped.
+   *
+   * @param authority The `:authority`, used when the request has no `Host` header.
+   */
+  void h2_request_headers(const Request& req, std::string_view authority, header_list& headers);
+  /**
+   * @brief The header list of a response, see `h2_request_headers`.
+   */
+  void h2_response_headers(const Response& resp, header_list& headers);
+  /**
+   * @brief Fill the method, path, version and headers of `req` from a decoded header list.
+   *
+   * `:authority` becomes the `host` header, repeated fields are folded like `parse_headers` does.
+   *
+   * @return false if `:method` or `:path` is missing.
+   */
+  bool h2_request_from_headers(const header_list& headers, Request& req);
+  /**
+   * @brief Fill the status and headers of `resp` from a decoded header list.
+   *
+   * @return false if `:status` is missing or malformed.
+   */
+  bool h2_response_from_headers(const header_list& headers, Response& resp);
+}
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_HTTP2_FRAME_H
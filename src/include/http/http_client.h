@@ -0,0 +1,172 @@
+#ifndef __LIBNT_HTTP_CLIENT_H
+#define __LIBNT_HTTP_CLIENT_H
+
+#include "../defs.h"
+#include "../socket.h"
+#include "http_request.h"
+#include "http_response.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+  /**
+   * @brief The `client` is a keep-alive HTTP/1.1 client over a single `nt::socket`.
+   *
+   * Requests are pipelined: up to `pipeline_depth` requests are written before
+   * their responses are read back, and responses are matched to requests in
+   * FIFO order. When the server answers with `Connection: close` (or drops the
+   * connection) the client reconnects and replays every request that has not been
+   * answered yet, so callers never see the reconnect.
+   *
+   * @note replaying is only safe for idempotent requests, which is what load
+   * tools send; callers mixing in e.g. `POST` should keep `pipeline_depth` at 1.
+   */
+  class client {
+    using __self_ref       = client&;
+    using size_type        = size_t;
+
+    /**
+     * @brief A request that has been queued but not answered yet.
+     */
+    struct pending {
+      std::string wire;         // the serialized request, kept for replaying
+      std::string method;
+      std::string path;
+    };
+
+  public:
+    struct options {
+      size_type pipeline_depth = 16;          // maximum number of outstanding requests
+      size_type max_retries    = 3;           // connect retries per reconnect, and reconnects without any progress
+      size_type read_size      = 64 * 1024;   // minimum free space for each read
+      bool      nodelay        = true;        // set `TCP_NODELAY` on every connection
+      bool      nonblocking    = false;       // never wait in `flush`/`poll`, for event loops
+    };
+
+    client(std::string ip, short port);
+    client(std::string ip, short port, const options& opts);
+    ~client() = default;
+
+    client(const client&)               = delete;
+    client(client&&)                    = default;
+    __self_ref operator= (const client&) = delete;
+    __self_ref operator= (client&&)      = default;
+
+    /**
+     * @brief Queue a request on the connection.
+     *
+     * The request is written lazily; when `pipeline_depth` requests are already
+     * outstanding the oldest response is read first and kept for `recv`.
+     * A `Host` header is added when missing.
+     *
+     * @param req The request to send.
+     * @return false if the connection could not be (re-)established, or in
+     * non-blocking mode if the window is full and no response has arrived yet.
+     */
+    bool send(const Request& req);
+    /**
+     * @brief Wait for the response of the oldest outstanding request.
+     *
+     * @param resp The response to fill, its `method` and `path` are those of the request.
+     * @return false if nothing is outstanding or the server could not be reached.
+     */
+    bool recv(Response& resp);
+    /**
+     * @brief Send a request and wait for its response.
+     *
+     * Responses of previously queued requests are delivered first, so this is
+     * only meaningful when nothing else is outstanding.
+     */
+    bool request(const Request& req, Response& resp);
+    /**
+     * @brief Write queued requests to the socket.
+     *
+     * @return false if the connection could not be (re-)established.
+     */
+    bool flush();
+
+    /**
+     * @brief Read whatever has arrived and parse the complete responses.
+     *
+     * Together with `flush`, `try_recv` and `get_fd` this drives the client from an
+     * event loop when `options::nonblocking` is set: register `get_fd()` for reading
+     * (and for writing while `wants_write()`), then `poll` and drain with `try_recv`.
+     * The descriptor changes when the client reconnects.
+     *
+     * @return false if the server could not be reached or sent a malformed response.
+     */
+    bool poll();
+    /**
+     * @brief Pop a response that has already been read, without any I/O.
+     *
+     * @return false if no response is ready.
+     */
+    bool try_recv(Response& resp);
+    /**
+     * @brief Whether queued requests are still waiting to be written.
+     */
+    bool wants_write() const;
+    /**
+     * @brief The descriptor of the current connection, -1 if there is none.
+     */
+    int get_fd() const;
+
+    /**
+     * @brief The number of requests that have not been answered by the server yet.
+     */
+    size_type outstanding() const;
+    /**
+     * @brief The number of connections opened so far (1 + reconnects).
+     */
+    size_type connections() const;
+    /**
+     * @brief Whether a connection is currently open.
+     */
+    bool is_connected() const;
+    /**
+     * @brief The number of response bytes received so far.
+     */
+    size_type bytes_received() const;
+
+  private:
+    bool connect();
+    void disconnect();
+    bool reconnect();
+    /**
+     * @brief Read once from the socket and parse every complete response.
+     */
+    bool read_once();
+    /**
+     * @brief Parse complete responses out of the input buffer.
+     *
+     * @param eof Whether the peer has closed the connection.
+     * @return false if the stream is malformed.
+     */
+    bool parse_responses(bool eof);
+
+    std::string               _ip;
+    short                     _port;
+    options                   _opts;
+    std::string               _host;
+
+    std::unique_ptr<socket>   _sock;
+    std::deque<pending>       _inflight;      // unanswered requests in FIFO order
+    size_type                 _sent;          // number of `_inflight` entries fully written
+    size_type                 _sent_offset;   // bytes written of `_inflight[_sent]`
+    std::deque<Response>      _ready;         // responses read ahead of `recv`
+    std::vector<char>         _in;            // receive buffer
+    size_type                 _in_begin;
+    size_type                 _in_end;
+    bool                      _closing;       // the server announced `Connection: close`
+    size_type                 _retries;
+    size_type                 _connections;
+    size_type                 _bytes_received;
+  };
+}
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_HTTP_CLIENT_H
@@ -0,0 +1,122 @@
+#ifndef __LIBNT_HTTP_PARSER_H
+#define __LIBNT_HTTP_PARSER_H
+
+#include "../defs.h"
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+  using headers_type = std::unordered_map<std::string, std::string>;
+
+  /**
+   * @brief Messages whose strings and headers come from a `std::pmr::memory_resource`,
+   * such as an `nt::heap_resource` per connection.
+   *
+   * The functions below that take a header map or a string accept both these types and the plain ones.
+   */
+  namespace pmr {
+    using headers_type = std::pmr::unordered_map<std::pmr::string, std::pmr::string>;
+  }
+
+  /**
+   * @brief Returned by the incremental parsers when more bytes are needed.
+   */
+  constexpr const ssize_t PARSE_INCOMPLETE = 0;
+  /**
+   * @brief Returned by the incremental parsers when the stream is malformed.
+   */
+  constexpr const ssize_t PARSE_ERROR = -1;
+  /**
+   * @brief Returned by `parse_body` when more bytes are needed, an empty body consumes 0 bytes.
+   */
+  constexpr const ssize_t PARSE_BODY_INCOMPLETE = -2;
+
+  /**
+   * @brief How the body of a message is delimited on the wire.
+   */
+  enum class body_kind {
+    none,         // no body at all (HEAD, 1xx, 204, 304, requests without length)
+    length,       // `Content-Length` bytes follow the header block
+    chunked,      // `Transfer-Encoding: chunked`
+    until_close,  // the body runs until the peer closes the connection
+  };
+
+  struct body_framing {
+    body_kind kind = body_kind::none;
+    size_t    length = 0;
+  };
+
+  /**
+   * @brief Parse the header lines of a message up to and including the empty line.
+   *
+   * Header names are stored lower-cased so that lookups are case-insensitive,
+   * repeated headers are folded into one comma separated value.
+   *
+   * @param data The bytes following the start line.
+   * @param len The number of available bytes.
+   * @param headers The map receiving the headers.
+   * @return the number of bytes consumed, `PARSE_INCOMPLETE` or `PARSE_ERROR`.
+   */
+  template <class Headers>
+  ssize_t parse_headers(const char* data, size_t len, Headers& headers);
+
+  /**
+   * @brief Decode a message body framed as described by `framing`.
+   *
+   * @param data The bytes following the header block.
+   * @param len The number of available bytes.
+   * @param framing The framing determined from the headers.
+   * @param eof Whether the peer has closed the connection (ends `until_close` bodies).
+   * @param body The string receiving the decoded body.
+   * @return the number of bytes consumed, `PARSE_BODY_INCOMPLETE` or `PARSE_ERROR`.
+   */
+  template <class String>
+  ssize_t parse_body(const char* data, size_t len, const body_framing& framing, bool eof, String& body);
+
+  /**
+   * @brief Look up a header by its lower-case name in a parsed header map.
+   *
+   * @return the header value, or nullptr if it is absent.
+   */
+  template <class Headers>
+  const typename Headers::mapped_type* find_header(const Headers& headers, std::string_view name);
+
+  /**
+   * @brief Look up a header by name ignoring case, for maps built by the user.
+   *
+   * @return the header value, or nullptr if it is absent.
+   */
+  template <class Headers>
+  const typename Headers::mapped_type* find_header_nocase(const Headers& headers, std::string_view name);
+
+  /**
+   * @brief Check whether a comma separated header value contains `token` (ignoring case).
+   *
+   * e.g. `has_token("keep-alive, Upgrade", "upgrade")` is true.
+   */
+  bool has_token(std::string_view value, std::string_view token);
+
+  /**
+   * @brief Determine the body framing from the parsed headers of a message.
+   *
+   * @param headers The parsed (lower-case) headers.
+   * @param framing The resulting framing.
+   * @return false if the length information is malformed.
+   */
+  template <class Headers>
+  bool framing_from_headers(const Headers& headers, body_framing& framing);
+
+  /**
+   * @brief Append `name: value\r\n` for each header to `out`.
+   */
+  template <class Headers, class String>
+  void serialize_headers(const Headers& headers, String& out);
+}
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_HTTP_PARSER_H
@@ -1,21 +1,71 @@
+#ifndef __LIBNT_HTTP_REQUEST_H
+#define __LIBNT_HTTP_REQUEST_H
+
 #include "../defs.h"
+#include "http_parser.h"
 #include <string>
 #include <unordered_map>
 
 NT_NAMESPACE_BEGEN
 namespace HTTP {
-  struct Request{
-    std::string method;
-    std::string path;
-    std::string version;
-    std::unordered_map<std::string, std::string> headers;
-    std::string body;
-
-    std::string to_string();
+  /**
+   * @brief A request whose strings and headers use `Alloc`, see `Request` and `pmr::Request`.
+   */
+  template <class Alloc>
+  struct basic_request{
+    using allocator_type  = Alloc;
+    using string_type     = std::basic_string<char, std::char_traits<char>, Alloc>;
+    using headers_type    = std::unordered_map<string_type, string_type, std::hash<string_type>, std::equal_to<string_type>,
+                                               typename std::allocator_traits<Alloc>::template rebind_alloc<std::pair<const string_type, string_type>>>;
+
+    string_type method;
+    string_type path;
+    string_type version;
+    headers_type headers;
+    string_type body;
+
+    basic_request() = default;
+    explicit basic_request(const allocator_type& alloc)
+      : method(alloc), path(alloc), version(alloc), headers(alloc), body(alloc) {}
+
+    allocator_type get_allocator() const { return body.get_allocator(); }
+
+    string_type to_string() const;
+    /**
+     * @brief Append the wire form of the request to `out`.
+     *
+     * An empty `version` is sent as `HTTP/1.1`, and `Content-Length` is added
+     * when the body is not empty and no framing header was given.
+     *
+     * @param out A `std::string` or a `std::pmr::string`.
+     */
+    template <class String>
+    void serialize(String& out) const;
   };
+
+  using Request = basic_request<std::allocator<char>>;
+  namespace pmr {
+    using Request = basic_request<std::pmr::polymorphic_allocator<char>>;
+  }
+
   Request parse_request(std::string stream);
   Request parse_request(char* stream);
+
+  /**
+   * @brief Incrementally parse one request from the front of a stream.
+   *
+   * Header names are stored lower-cased.
+   *
+   * @param data The received bytes.
+   * @param len The number of received bytes.
+   * @param req The request to fill, a `Request` or a `pmr::Request` whose allocator the parsed fields use.
+   * @return the number of bytes consumed by the request, `PARSE_INCOMPLETE`
+   * if more bytes are needed, or `PARSE_ERROR` if the stream is malformed.
+   */
+  template <class Alloc>
+  ssize_t parse_request(const char* data, size_t len, basic_request<Alloc>& req);
 }
 
 NT_NAMESPACE_END
 
+#endif //! __LIBNT_HTTP_REQUEST_H
@@ -1,20 +1,80 @@
+#ifndef __LIBNT_HTTP_RESPONSE_H
+#define __LIBNT_HTTP_RESPONSE_H
+
 #include "../defs.h"
+#include "http_parser.h"
 #include <unordered_map>
 
 
 NT_NAMESPACE_BEGEN
 namespace HTTP {
-  struct Response{
-    std::string method;
-    std::string path;
-    std::string version;
-    std::unordered_map<std::string, std::string> headers;
-    std::string body;    
-
-    std::string to_string();
+  /**
+   * @brief A response whose strings and headers use `Alloc`, see `Response` and `pmr::Response`.
+   */
+  template <class Alloc>
+  struct basic_response{
+    using allocator_type  = Alloc;
+    using string_type     = std::basic_string<char, std::char_traits<char>, Alloc>;
+    using headers_type    = std::unordered_map<string_type, string_type, std::hash<string_type>, std::equal_to<string_type>,
+                                               typename std::allocator_traits<Alloc>::template rebind_alloc<std::pair<const string_type, string_type>>>;
+
+    string_type method;     // method of the request this response answers
+    string_type path;       // path of the request this response answers
+    string_type version;
+    int         status = 0;
+    string_type reason;
+    headers_type headers;
+    string_type body;
+
+    basic_response() = default;
+    explicit basic_response(const allocator_type& alloc)
+      : method(alloc), path(alloc), version(alloc), reason(alloc), headers(alloc), body(alloc) {}
+
+    allocator_type get_allocator() const { return body.get_allocator(); }
+
+    string_type to_string() const;
+    /**
+     * @brief Append the wire form of the response to `out`.
+     *
+     * An empty `version` is sent as `HTTP/1.1`, an empty `reason` as the standard
+     * phrase of the status, and `Content-Length` is added unless a framing header
+     * was given or the status is 1xx, 204 or 304.
+     *
+     * @param out A `std::string` or a `std::pmr::string`.
+     */
+    template <class String>
+    void serialize(String& out) const;
  };
 
+  /**
+   * @brief The standard reason phrase of `status`, empty for a status without one.
+   */
+  std::string_view status_reason(int status);
+
+  using Response = basic_response<std::allocator<char>>;
+  namespace pmr {
+    using Response = basic_response<std::pmr::polymorphic_allocator<char>>;
+  }
+
   Response parse_response(std::string stream);
   Response parse_response(char* stream);
+
+  /**
+   * @brief Incrementally parse one response from the front of a stream.
+   *
+   * Header names are stored lower-cased.
+   *
+   * @param data The received bytes.
+   * @param len The number of received bytes.
+   * @param resp The response to fill, a `Response` or a `pmr::Response` whose allocator the parsed fields use.
+   * @param head_request Whether the response answers a `HEAD` request (and has no body).
+   * @param eof Whether the peer has closed the connection after `data`.
+   * @return the number of bytes consumed by the response, `PARSE_INCOMPLETE`
+   * if more bytes are needed, or `PARSE_ERROR` if the stream is malformed.
+   */
+  template <class Alloc>
+  ssize_t parse_response(const char* data, size_t len, basic_response<Alloc>& resp, bool head_request = false, bool eof = false);
 }
 NT_NAMESPACE_END
+
+#endif //! __LIBNT_HTTP_RESPONSE_H
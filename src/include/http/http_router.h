@@ -0,0 +1,98 @@
+#ifndef __LIBNT_HTTP_ROUTER_H
+#define __LIBNT_HTTP_ROUTER_H
+
+#include "../defs.h"
+#include "http_request.h"
+#include "http_response.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+  /**
+   * @brief The `:param` and `*wildcard` values captured by a route match.
+   *
+   * A fixed capacity array of views into the matched path, so matching never allocates.
+   * Values are left percent-encoded, see `percent_decode`.
+   */
+  struct route_params {
+    static constexpr size_t MAX_PARAMS = 8;
+
+    std::pair<std::string_view, std::string_view> items[MAX_PARAMS];
+    size_t                                         count = 0;
+
+    /**
+     * @brief The value captured for `name`, empty if there is none.
+     */
+    std::string_view get(std::string_view name) const;
+  };
+
+  /**
+   * @brief A compressed radix-trie router over request paths.
+   *
+   * Patterns are made of static text, `:name` segments matching one non-empty path
+   * segment and a trailing `*name` matching the rest of the path (possibly empty).
+   * At every node static text is preferred over a parameter, which is preferred over
+   * a wildcard, so `/users/me` wins over `/users/:id` regardless of insertion order.
+   * Matching walks the trie once with bounded backtracking and does not allocate.
+   */
+  class router {
+    using __self_ref = router&;
+
+  public:
+    using handler_type = std::function<void(const Request&, const route_params&, Response&)>;
+
+    router();
+    ~router();
+
+    router(const router&)                = delete;
+    router(router&&) noexcept;
+    __self_ref operator= (const router&) = delete;
+    __self_ref operator= (router&&) noexcept;
+
+    /**
+     * @brief Route `pattern` for any method to `handler`.
+     *
+     * @return false if the pattern is malformed, has more than `route_params::MAX_PARAMS`
+     * parameters or names a parameter differently from an existing route at the same place.
+     */
+    bool add(const std::string& pattern, handler_type handler);
+    /**
+     * @brief Route `pattern` for `method` only to `handler`, method routes win over any-method routes.
+     */
+    bool add(const std::string& method, const std::string& pattern, handler_type handler);
+
+    /**
+     * @brief Find the handler of `path`.
+     *
+     * @param method The request method.
+     * @param path The request path without the query, see `parse_url`.
+     * @param params Receives the captured parameters, views into `path`.
+     * @return the handler, or nullptr if no route matches.
+     */
+    const handler_type* match(std::string_view method, std::string_view path, route_params& params) const;
+
+    /**
+     * @brief The number of routes added.
+     */
+    size_t size() const;
+
+  private:
+    struct node;
+
+    static const handler_type* match_node(const node* n, std::string_view method,
+                                          std::string_view path, route_params& params);
+
+    std::unique_ptr<node> _root;
+    size_t                _size;
+  };
+}
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_HTTP_ROUTER_H
@@ -0,0 +1,122 @@
+#ifndef __LIBNT_HTTP_SERVER_H
+#define __LIBNT_HTTP_SERVER_H
+
+#include "../defs.h"
+#include "http_request.h"
+#include "http_response.h"
+#include "http_router.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+  /**
+   * @brief The `server` is a minimal multi-threaded HTTP/1.1 server for local testing.
+   *
+   * Every worker thread owns its own `SO_REUSEPORT` listening socket and epoll loop,
+   * so accepting and serving scale with the thread count without any shared state.
+   * Requests are answered from pre-serialized canned responses (by exact path), by
+   * a `router` or by a user handler, in order, with pipelining, optional keep-alive and an optional
+   * artificial latency that never blocks the worker.
+   */
+  class server {
+    using __self_ref = server&;
+
+  public:
+    using handler_type = std::function<void(const Request&, Response&)>;
+
+    struct options {
+      std::string ip            = "0.0.0.0";
+      short       port          = 8080;       // 0 picks an ephemeral port, see `get_port`
+      size_t      threads       = 1;
+      int         backlog       = 4096;
+      bool        keep_alive    = true;       // false answers every request with `Connection: close`
+      size_t      max_requests  = 0;          // close a connection after this many requests, 0 for never
+      uint64_t    latency_us    = 0;          // delay before each response is written
+      size_t      response_size = 0;          // body size of the default canned response
+      size_t      read_size     = 64 * 1024;
+    };
+
+    explicit server(const options& opts);
+    ~server();
+
+    server(const server&)                = delete;
+    server(server&&)                     = delete;
+    __self_ref operator= (const server&) = delete;
+    __self_ref operator= (server&&)      = delete;
+
+    /**
+     * @brief Answer requests for exactly `path` with `resp`.
+     *
+     * The response is serialized once; must be called before `start`.
+     */
+    void set_response(const std::string& path, const Response& resp);
+    /**
+     * @brief Dispatch paths without a canned response through `routes`.
+     *
+     * Must be called before `start`.
+     */
+    void set_router(router routes);
+    /**
+     * @brief Build the response of every path without a canned response or route with `handler`.
+     *
+     * Must be called before `start`.
+     */
+    void set_handler(handler_type handler);
+
+    /**
+     * @brief Bind the listening sockets and start the worker threads.
+     *
+     * @return false if the address could not be bound.
+     */
+    bool start();
+    /**
+     * @brief Stop the workers and close every connection.
+     */
+    void stop();
+    /**
+     * @brief Block until `stop` is called from another thread or a signal handler.
+     */
+    void wait();
+
+    /**
+     * @brief The bound port, useful when `options::port` is 0.
+     */
+    short get_port() const;
+    /**
+     * @brief The number of requests answered so far.
+     */
+    uint64_t requests() const;
+
+  private:
+    struct canned {
+      std::string keep_alive;   // the serialized response
+      std::string close;        // the same with `Connection: close`
+    };
+    struct worker;
+
+    static canned serialize_canned(const Response& resp);
+    int listen_socket(short port);
+    void run(worker& w);
+
+    options                                 _opts;
+    std::unordered_map<std::string, canned> _canned;
+    canned                                  _default;
+    router                                  _router;
+    handler_type                            _handler;
+    std::vector<std::unique_ptr<worker>>    _workers;
+    std::vector<std::thread>                _threads;
+    short                                   _port;
+    std::atomic<bool>                       _running;
+  };
+}
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_HTTP_SERVER_H
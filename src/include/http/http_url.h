@@ -0,0 +1,79 @@
+#ifndef __LIBNT_HTTP_URL_H
+#define __LIBNT_HTTP_URL_H
+
+#include "../defs.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+  /**
+   * @brief The components of a request target, every member is a view into the target.
+   *
+   * Origin-form targets (`/path?query`) leave `scheme` and `authority` empty,
+   * absolute-form targets (`http://host:port/path?query`) fill them in.
+   */
+  struct url_view {
+    std::string_view scheme;
+    std::string_view authority;
+    std::string_view path;
+    std::string_view query;       // without the leading '?'
+    std::string_view fragment;    // without the leading '#'
+  };
+
+  /**
+   * @brief Split a request target into its components without copying.
+   *
+   * An absolute-form target without a path gets the path "/".
+   *
+   * @param target The request target, e.g. `Request::path`.
+   * @return the components, views into `target`.
+   */
+  url_view parse_url(std::string_view target);
+
+  /**
+   * @brief Take the next `key=value` pair off a query string.
+   *
+   * Pairs are separated by '&', empty pairs are skipped and a pair without '='
+   * has an empty value. Keys and values are left encoded, see `percent_decode`.
+   *
+   * @param query The remaining query, advanced past the returned pair.
+   * @param key The view receiving the key.
+   * @param value The view receiving the value.
+   * @return false once the query is exhausted.
+   */
+  bool next_query_param(std::string_view& query, std::string_view& key, std::string_view& value);
+
+  /**
+   * @brief Find the first value of `key` in a query string.
+   *
+   * @return false if the key is not present.
+   */
+  bool find_query_param(std::string_view query, std::string_view key, std::string_view& value);
+
+  /**
+   * @brief Decode `%XX` escapes (and '+' as space for form encoding) into `out`.
+   *
+   * Runs of bytes without escapes are scanned and copied 16 bytes at a time.
+   * `out` must hold at least `len` bytes and may be `in` itself, decoding never grows.
+   *
+   * @param in The encoded bytes.
+   * @param len The number of encoded bytes.
+   * @param out The buffer receiving the decoded bytes.
+   * @param plus_as_space Decode '+' as ' ', as in `application/x-www-form-urlencoded`.
+   * @return the decoded length, or -1 on a truncated or non-hex escape.
+   */
+  ssize_t percent_decode(const char* in, size_t len, char* out, bool plus_as_space = false);
+
+  /**
+   * @brief Decode `in` into `out`, see `percent_decode` above.
+   *
+   * @return false on a malformed escape, `out` is then unspecified.
+   */
+  bool percent_decode(std::string_view in, std::string& out, bool plus_as_space = false);
+}
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_HTTP_URL_H
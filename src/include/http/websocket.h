@@ -0,0 +1,129 @@
+#ifndef __LIBNT_WEBSOCKET_H
+#define __LIBNT_WEBSOCKET_H
+
+#include "../defs.h"
+#include "http_request.h"
+#include "http_response.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+  /**
+   * @brief The GUID appended to `Sec-WebSocket-Key` to derive `Sec-WebSocket-Accept` (RFC 6455 1.3).
+   */
+  constexpr const std::string_view WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+  constexpr const size_t WS_MAX_FRAME_HEADER_SIZE = 14;   // 2 + 8 bytes of extended length + 4 of mask
+  constexpr const size_t WS_MAX_CONTROL_PAYLOAD   = 125;
+
+  enum class ws_opcode : uint8_t {
+    continuation = 0x0,
+    text         = 0x1,
+    binary       = 0x2,
+    close        = 0x8,
+    ping         = 0x9,
+    pong         = 0xa,
+  };
+
+  enum class ws_close_code : uint16_t {
+    normal           = 1000,
+    going_away       = 1001,
+    protocol_error   = 1002,
+    unsupported_data = 1003,
+    no_status        = 1005,   // never sent, reported when a close frame has no payload
+    abnormal         = 1006,   // never sent, reported when the connection dropped
+    invalid_payload  = 1007,
+    policy_violation = 1008,
+    message_too_big  = 1009,
+    internal_error   = 1011,
+  };
+
+  /**
+   * @brief A frame parsed in place, `payload` is a view into the input buffer.
+   *
+   * A masked payload is left masked, see `ws_mask`.
+   */
+  struct ws_frame {
+    bool             fin = true;
+    ws_opcode        opcode = ws_opcode::binary;
+    bool             masked = false;
+    uint32_t         mask_key = 0;   // the 4 key bytes in wire order, loaded with `memcpy`
+    std::string_view payload;
+  };
+
+  /**
+   * @brief Parse the frame at the start of `data`.
+   *
+   * @param max_payload The largest payload accepted.
+   * @return the number of bytes consumed, `PARSE_INCOMPLETE`, or `PARSE_ERROR` if
+   * reserved bits or opcodes are set, a control frame is fragmented or longer than
+   * 125 bytes, or the payload is larger than `max_payload`.
+   */
+  ssize_t parse_ws_frame(const char* data, size_t len, size_t max_payload, ws_frame& frame);
+
+  /**
+   * @brief XOR `len` bytes of `in` with the mask `key` into `out`, 16 or 32 bytes at a time.
+   *
+   * Masking and unmasking are the same operation, and `in` may equal `out`.
+   *
+   * @param key The 4 key bytes in wire order, loaded with `memcpy`.
+   * @param offset The position of `in` within the payload, so that a payload can be
+   * (un)masked piecewise.
+   */
+  void ws_mask(const char* in, char* out, size_t len, uint32_t key, size_t offset = 0);
+
+  /**
+   * @brief Write a frame header for a payload of `length` bytes.
+   *
+   * @return the number of bytes written to `out`, at most `WS_MAX_FRAME_HEADER_SIZE`.
+   */
+  size_t write_ws_frame_header(char* out, size_t length, ws_opcode opcode, bool fin, bool masked, uint32_t key);
+  /**
+   * @brief Append a frame to `out`, masking the payload straight into the buffer when `masked`.
+   */
+  void write_ws_frame(std::string& out, ws_opcode opcode, std::string_view payload, bool fin = true,
+                      bool masked = false, uint32_t key = 0);
+  /**
+   * @brief Append a close frame carrying `code` and a reason of at most 123 bytes.
+   */
+  void write_ws_close(std::string& out, uint16_t code, std::string_view reason, bool masked = false, uint32_t key = 0);
+  /**
+   * @brief Decode the (unmasked) payload of a close frame.
+   *
+   * An empty payload yields `ws_close_code::no_status`.
+   *
+   * @return false if the payload is 1 byte long or the code may not be sent on the wire.
+   */
+  bool parse_ws_close(std::string_view payload, uint16_t& code, std::string_view& reason);
+
+  /**
+   * @brief A random, base64 encoded 16 byte `Sec-WebSocket-Key`.
+   */
+  std::string ws_generate_key();
+  /**
+   * @brief The `Sec-WebSocket-Accept` answering `key`: base64(SHA-1(key + `WS_GUID`)).
+   */
+  std::string ws_accept_key(std::string_view key);
+  /**
+   * @brief Fill `req` with the opening handshake of a client.
+   */
+  void ws_handshake_request(Request& req, std::string_view host, std::string_view path, std::string_view key);
+  /**
+   * @brief Check that the server accepted the opening handshake sent with `key`.
+   */
+  bool ws_check_handshake(const Response& resp, std::string_view key);
+  /**
+   * @brief Answer the opening handshake of a client with `101 Switching Protocols`.
+   *
+   * @return false, leaving `resp` untouched, if `req` is not a valid WebSocket upgrade.
+   */
+  bool ws_accept_handshake(const Request& req, Response& resp);
+}
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_WEBSOCKET_H
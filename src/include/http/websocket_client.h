@@ -0,0 +1,171 @@
+#ifndef __LIBNT_WEBSOCKET_CLIENT_H
+#define __LIBNT_WEBSOCKET_CLIENT_H
+
+#include "../defs.h"
+#include "../socket.h"
+#include "websocket.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+NT_NAMESPACE_BEGEN
+namespace HTTP {
+  /**
+   * @brief The `ws_client` speaks WebSocket (RFC 6455) over a single `nt::socket`.
+   *
+   * `connect` performs the HTTP/1.1 Upgrade handshake, after which messages are queued
+   * with `send` and written with `flush`, so a burst of small messages leaves in a few
+   * system calls. Outgoing frames are masked straight into the output buffer, and received
+   * messages are handed out as views into the receive buffer; only fragmented messages
+   * are reassembled into a separate buffer. Pings are answered and the closing handshake
+   * is completed automatically.
+   *
+   * Unlike the HTTP clients a dropped connection is not re-established, since the
+   * server side state of a WebSocket session is lost with it.
+   */
+  class ws_client {
+    using __self_ref       = ws_client&;
+    using size_type        = size_t;
+
+  public:
+    struct options {
+      size_type max_message_size = 64 << 20;    // larger messages fail the connection with 1009
+      size_type fragment_size    = 0;           // split sent messages into frames of this size, 0 for never
+      size_type read_size        = 64 * 1024;   // minimum free space for each read
+      bool      nodelay          = true;        // set `TCP_NODELAY` on the connection
+      bool      nonblocking      = false;       // never wait in `flush`/`poll` after the handshake, for event loops
+    };
+
+    ws_client(std::string ip, short port, std::string path = "/");
+    ws_client(std::string ip, short port, std::string path, const options& opts);
+    ~ws_client() = default;
+
+    ws_client(const ws_client&)            = delete;
+    ws_client(ws_client&&)                 = default;
+    __self_ref operator= (const ws_client&) = delete;
+    __self_ref operator= (ws_client&&)      = default;
+
+    /**
+     * @brief Connect and perform the opening handshake, blocking until it completes.
+     *
+     * @return false if the server could not be reached or refused the upgrade.
+     */
+    bool connect();
+    /**
+     * @brief Queue a text or binary message.
+     *
+     * @return false if the connection is not open or a close frame has been sent.
+     */
+    bool send(ws_opcode opcode, std::string_view data);
+    bool send_text(std::string_view data) { return send(ws_opcode::text, data); }
+    bool send_binary(std::string_view data) { return send(ws_opcode::binary, data); }
+    /**
+     * @brief Queue a ping, `data` is truncated to 125 bytes.
+     */
+    bool ping(std::string_view data = {});
+    /**
+     * @brief Start the closing handshake; messages keep arriving until the server answers.
+     */
+    bool close(uint16_t code = static_cast<uint16_t>(ws_close_code::normal), std::string_view reason = {});
+    /**
+     * @brief Write queued frames to the socket.
+     *
+     * @return false if the connection is lost.
+     */
+    bool flush();
+
+    /**
+     * @brief Wait for the next message.
+     *
+     * @param opcode Receives `text`, `binary`, or `close` once the server closed the
+     * session, with the close reason in `data`.
+     * @param data The payload, valid until the next call that receives on this client.
+     * @return false once the connection is closed or failed.
+     */
+    bool recv(ws_opcode& opcode, std::string_view& data);
+    /**
+     * @brief Read whatever has arrived, see `client::poll`.
+     *
+     * @return false if the connection is closed or failed.
+     */
+    bool poll();
+    /**
+     * @brief Pop a message that has already been read, without any I/O, see `recv`.
+     *
+     * Control frames met on the way are handled, which may queue a pong or close frame.
+     */
+    bool try_recv(ws_opcode& opcode, std::string_view& data);
+    /**
+     * @brief Whether frames are waiting to be written.
+     */
+    bool wants_write() const;
+    /**
+     * @brief The descriptor of the connection, -1 if there is none.
+     */
+    int get_fd() const;
+
+    /**
+     * @brief Whether the connection is open (the closing handshake may be in progress).
+     */
+    bool is_open() const;
+    /**
+     * @brief The code the server closed the session with, `ws_close_code::abnormal`
+     * if the connection dropped without a close frame, 0 while open.
+     */
+    uint16_t close_code() const;
+    /**
+     * @brief The number of data messages received so far.
+     */
+    size_type messages_received() const;
+    /**
+     * @brief The number of bytes received so far, handshake included.
+     */
+    size_type bytes_received() const;
+
+  private:
+    void disconnect();
+    /**
+     * @brief Read once from the socket.
+     */
+    bool read_once();
+    /**
+     * @brief Send a close frame with `code` right away and drop the connection.
+     */
+    bool fail(ws_close_code code);
+    /**
+     * @brief Append a masked frame to the output buffer.
+     */
+    void queue_frame(ws_opcode opcode, std::string_view payload, bool fin);
+    uint32_t next_mask_key();
+
+    std::string               _ip;
+    short                     _port;
+    std::string               _path;
+    options                   _opts;
+    std::string               _host;
+
+    std::unique_ptr<socket>   _sock;
+    std::string               _out;           // frames waiting to be written
+    size_type                 _out_offset;
+    std::vector<char>         _in;            // receive buffer
+    size_type                 _in_begin;
+    size_type                 _in_end;
+
+    std::string               _message;       // fragmented message being reassembled
+    ws_opcode                 _message_opcode;
+    bool                      _fragmented;    // a fragmented message is in progress
+    bool                      _close_sent;
+    bool                      _close_received;
+    uint16_t                  _close_code;
+    uint64_t                  _mask_state;    // xorshift state of the masking keys
+
+    size_type                 _messages_received;
+    size_type                 _bytes_received;
+  };
+}
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_WEBSOCKET_CLIENT_H
@@ -15,11 +15,10 @@
 #define __LIBNT_MALLOC_H
 
 #include "../defs.h"
+#include "ntmalloc_trace.h"
 #include "types.h"
 
 #include <cstddef>
-#include <string>
-#include <charconv>
 
 /**
  * @brief Declare a thread-local storage variable
@@ -57,12 +56,71 @@ NT_NAMESPACE_BEGEN
  * 
  * This function allocates a block of memory of the given size and returns a pointer to it. 
  * nt_attr_alloc_s1(1) specifies that the function parameter at position 1 determines the allocated memory size.
+ * Sizes up to `NT_LARGE_SIZE_MAX` share pages of their size class, larger objects get a huge segment of their own.
  * 
  * @param size The size of the memory block to allocate
- * @return A pointer to the allocated memory block
+ * @return A pointer to the allocated memory block, or nullptr with `errno` set to ENOMEM
  */
 nt_export(void*) nt_malloc(size_t size) nt_attr_malloc nt_attr_alloc_s1(1);
 
+/**
+ * @brief Allocates zeroed memory for an array of `count` elements of `size` bytes.
+ * 
+ * Memory fresh from the OS is known to be zeroed and is not cleared again.
+ * 
+ * @return the block, or nullptr with `errno` set to ENOMEM, also when `count * size` overflows
+ */
+nt_export(void*) nt_calloc(size_t count, size_t size) nt_attr_malloc nt_attr_alloc_s2(1, 2);
+/**
+ * @brief Resizes a block, keeping its contents up to the smaller of both sizes.
+ * 
+ * The block is kept when it is large enough and not more than half of it would go unused,
+ * and a huge block grows in place as long as its segment has room; otherwise the contents
+ * move to a new block.
+ * 
+ * @param p The block to resize, nullptr allocates a new one
+ * @param newsize The new size
+ * @return the resized block, or nullptr with `errno` set to ENOMEM, `p` is still valid then
+ */
+nt_export(void*) nt_realloc(void* p, size_t newsize) nt_attr_alloc_s1(2);
+/**
+ * @brief Allocates `size` bytes aligned to `alignment`.
+ * 
+ * Alignments up to 256 are served without waste from size classes whose blocks are all aligned.
+ * 
+ * @param alignment A power of 2, otherwise nullptr is returned with `errno` set to EINVAL
+ */
+nt_export(void*) nt_malloc_aligned(size_t size, size_t alignment) nt_attr_malloc nt_attr_alloc_s1(1);
+/**
+ * @brief C11 `aligned_alloc`, `nt_malloc_aligned` with the arguments swapped.
+ */
+nt_export(void*) nt_aligned_alloc(size_t alignment, size_t size) nt_attr_malloc nt_attr_alloc_s1(2);
+/**
+ * @brief Returns the number of bytes usable at `p`, at least the size it was allocated with.
+ * 
+ * Growing a buffer up to its usable size never needs `nt_realloc`.
+ * 
+ * @return the usable size, 0 for nullptr
+ */
+nt_export(size_t) nt_usable_size(const void* p);
+
+/**
+ * @brief Frees a block allocated by ntmalloc, from any thread.
+ * 
+ * Frees by the thread owning the block need no atomic operation; blocks freed by other
+ * threads are pushed onto the `thread_free` list of their page with a single CAS and
+ * reclaimed in batches by the owner.
+ * 
+ * @param p The block to free, nullptr is ignored
+ */
+nt_export(void) nt_free(void* p);
+/**
+ * @brief Frees a block of which the caller knows the size, like C++ sized deallocation.
+ * 
+ * @param size At most the usable size of `p`, checked in debug builds
+ */
+nt_export(void) nt_free_size(void* p, size_t size);
+
 /**
  * @brief Initializes the process for tracking statistics.
  */
@@ -76,7 +134,43 @@ nt_export(void) nt_thread_init(void);
  */
 nt_export(void) nt_thread_done(void);
 
+/**
+ * @brief Creates a heap for the calling thread, with pages of its own.
+ * 
+ * Allocate from it with the `nt_heap_` functions or make it the default with `nt_heap_set_default`.
+ * Its blocks can be freed one by one with `nt_free`, from any thread, or all at once with `nt_heap_destroy`.
+ * A heap belongs to the thread that made it and is deleted when that thread exits.
+ * 
+ * @return the new heap, or nullptr when out of memory
+ */
 nt_export(nt_heap_t*) nt_heap_new(void);
+/**
+ * @brief Deletes a heap of the calling thread, the blocks still in use move to its backing heap and stay valid.
+ * 
+ * The backing heap itself cannot be deleted and is ignored.
+ */
+nt_export(void) nt_heap_delete(nt_heap_t* heap);
+/**
+ * @brief Destroys a heap of the calling thread together with all blocks allocated from it.
+ * 
+ * Costs a step per page rather than per block: its pages go back to their segments at once,
+ * so no block of `heap` may be used or freed afterwards. The backing heap is ignored.
+ */
+nt_export(void) nt_heap_destroy(nt_heap_t* heap);
+/**
+ * @brief Makes `heap` the one `nt_malloc` and friends allocate from in the calling thread.
+ * 
+ * @return the previous default heap
+ */
+nt_export(nt_heap_t*) nt_heap_set_default(nt_heap_t* heap);
+/**
+ * @brief Returns the default heap of the calling thread.
+ */
+nt_export(nt_heap_t*) nt_heap_get_default(void);
+/**
+ * @brief Returns the backing heap of the calling thread, the default heap until `nt_heap_set_default`.
+ */
+nt_export(nt_heap_t*) nt_heap_get_backing(void);
 
 /**
  * @brief Allocates a block of memory of a specified size from a heap
@@ -100,6 +194,97 @@ nt_export(void*) nt_heap_malloc(nt_heap_t* heap, size_t size) nt_attr_malloc nt_
  * @return A pointer to the allocated memory block
  */
 nt_export(void*) nt_heap_malloc_small(nt_heap_t* heap, size_t size) nt_attr_malloc nt_attr_alloc_s1(2);
+/**
+ * @brief `nt_calloc` from a heap.
+ */
+nt_export(void*) nt_heap_calloc(nt_heap_t* heap, size_t count, size_t size) nt_attr_malloc nt_attr_alloc_s2(2, 3);
+/**
+ * @brief `nt_realloc` from a heap, a block that has to move goes to `heap`.
+ */
+nt_export(void*) nt_heap_realloc(nt_heap_t* heap, void* p, size_t newsize) nt_attr_alloc_s1(3);
+/**
+ * @brief `nt_malloc_aligned` from a heap.
+ */
+nt_export(void*) nt_heap_malloc_aligned(nt_heap_t* heap, size_t size, size_t alignment) nt_attr_malloc nt_attr_alloc_s1(2);
+
+/**
+ * @brief Runtime options, each one can also be set with the environment variable `NT_MALLOC_<NAME>`.
+ */
+typedef enum nt_option {
+    NT_OPTION_PURGE_DELAY = 0,  //! milliseconds before free pages and cached segments are purged, 0 is immediately, -1 is never (100)
+    NT_OPTION_SHOW_STATS,       //! print the statistics to stderr at process exit (0)
+    NT_OPTION_LARGE_OS_PAGES,   //! back segments by 2mb pages: 1 advises transparent huge pages, 2 tries hugetlbfs first (0)
+    NT_OPTION_SAMPLE_RATE,      //! sample one allocation per this many bytes on average for `nt_profile_dump`, 0 is off (0)
+    NT_OPTION_USE_NUMA,         //! place segments on the NUMA node of the allocating thread and prefer those of its node (1)
+    NT_OPTION_FREE_BATCH,       //! frees into a page of another thread are pushed this many at a time, 0 or 1 pushes every free (32)
+    NT_OPTION_COUNT,
+} nt_option_t;
+
+nt_export(long) nt_option_get(nt_option_t option);
+nt_export(void) nt_option_set(nt_option_t option, long value);
+
+/**
+ * @brief Purges the free memory of the calling thread whose purge delay expired, or all of it with `force`.
+ * 
+ * Allocating threads do this by themselves every now and then, threads going idle after a burst can call it.
+ * With `force` the calling thread also adopts all segments left behind by exited threads.
+ */
+nt_export(void) nt_collect(bool force);
+
+/**
+ * @brief Adds the statistics of the calling thread to the process totals.
+ * 
+ * Threads do this by themselves when they exit. `nt_stats_print` and `nt_stats_json` include the
+ * calling thread without merging it, so reports can be taken as often as needed.
+ */
+nt_export(void) nt_stats_merge(void);
+/**
+ * @brief Clears the statistics of the calling thread and the process totals.
+ */
+nt_export(void) nt_stats_reset(void);
+/**
+ * @brief Writes the process totals as a table to `fd`, followed by a row per size class
+ * with its block count and peak bytes (with `NT_STAT > 1`).
+ */
+nt_export(void) nt_stats_print(int fd);
+/**
+ * @brief Formats the process totals, including the size classes, as a JSON object.
+ * 
+ * @param buf Receives the NUL terminated JSON, truncated if it does not fit
+ * @param size The size of `buf`
+ * @return the length of the complete JSON, like `snprintf`
+ */
+nt_export(size_t) nt_stats_json(char* buf, size_t size);
+
+/**
+ * @brief Writes the heap profile to `fd` in the text format of gperftools, which `pprof` reads.
+ * 
+ * With `NT_OPTION_SAMPLE_RATE` set, about one allocation per that many bytes has its stack recorded.
+ * The profile lists the sampled objects still alive and all sampled so far per stack, followed by
+ * the mappings of the process. `pprof` scales the samples up to estimates of the real totals.
+ * 
+ * @return the number of stacks written
+ */
+nt_export(size_t) nt_profile_dump(int fd);
+
+/**
+ * @brief Copies the newest trace events of the calling thread, oldest first.
+ * 
+ * @param entries Receives the events
+ * @param count The room in `entries`, at most `NT_TRACE_RING_SIZE` events are kept
+ * @return the number of events copied, always 0 unless built with `NT_TRACE=1`
+ */
+nt_export(size_t) nt_trace_read(nt_trace_entry_t* entries, size_t count);
+/**
+ * @brief Returns the name of a trace event.
+ */
+nt_export(const char*) nt_trace_event_name(nt_trace_event_t event);
+/**
+ * @brief Writes the trace events of the calling thread to `fd`, one per line, without allocating.
+ * 
+ * @return the number of events written
+ */
+nt_export(size_t) nt_trace_dump(int fd);
 
 NT_NAMESPACE_END
 
@@ -0,0 +1,129 @@
+#ifndef __LIBNT_MALLOC_ALLOCATOR_H
+#define __LIBNT_MALLOC_ALLOCATOR_H
+
+#include "../defs.h"
+#include "ntmalloc.h"
+
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+
+/**
+ * --------------------------------------------
+ * C++ allocators
+ *
+ * `nt::allocator<T>` plugs ntmalloc into the standard containers,
+ * `nt::heap_resource` into everything built on `std::pmr`. Both
+ * allocate from one heap, or from the default heap of the calling
+ * thread when none is given. A heap made by `nt_heap_new` may only
+ * be allocated from by its own thread, but its blocks can be freed
+ * by any thread, or all at once with `nt_heap_destroy`.
+ * --------------------------------------------
+ */
+
+NT_NAMESPACE_BEGEN
+
+/**
+ * @brief Allocates `size` bytes aligned to `alignment` from `heap`, or from the default heap when it is nullptr.
+ */
+inline void* nt_alloc_from(nt_heap_t* heap, size_t size, size_t alignment) {
+    //! blocks are word aligned, larger alignments need the aligned path
+    if (alignment <= sizeof(void*)) return (heap == nullptr ? nt_malloc(size) : nt_heap_malloc(heap, size));
+    return (heap == nullptr ? nt_malloc_aligned(size, alignment) : nt_heap_malloc_aligned(heap, size, alignment));
+}
+
+/**
+ * @brief A standard allocator backed by ntmalloc.
+ *
+ * Allocators compare equal when they allocate from the same heap, so that containers
+ * of different heaps never take over each others memory when moved.
+ */
+template <class T>
+class allocator {
+    nt_heap_t* _heap = nullptr;     // nullptr allocates from the default heap of the calling thread
+public:
+    using value_type        = T;
+    using size_type         = size_t;
+    using difference_type   = ptrdiff_t;
+    using propagate_on_container_copy_assignment    = std::true_type;
+    using propagate_on_container_move_assignment    = std::true_type;
+    using propagate_on_container_swap               = std::true_type;
+    using is_always_equal                           = std::false_type;
+
+    template <class U>
+    struct rebind { using other = allocator<U>; };
+
+    allocator() noexcept = default;
+    /**
+     * @param heap The heap to allocate from, nullptr for the default heap of the allocating thread.
+     */
+    explicit allocator(nt_heap_t* heap) noexcept : _heap(heap) {}
+    template <class U>
+    allocator(const allocator<U>& other) noexcept : _heap(other.heap()) {}
+
+    /**
+     * @brief Allocates room for `n` objects of `T`.
+     *
+     * @throw std::bad_array_new_length when `n * sizeof(T)` overflows
+     * @throw std::bad_alloc when out of memory
+     */
+    [[nodiscard]] T* allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) throw std::bad_array_new_length();
+        void* p = nt_alloc_from(_heap, n * sizeof(T), alignof(T));
+        if (p == nullptr) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        nt_free_size(p, n * sizeof(T));
+    }
+
+    nt_heap_t* heap() const noexcept { return _heap; }
+};
+
+template <class T, class U>
+inline bool operator== (const allocator<T>& lhs, const allocator<U>& rhs) noexcept {
+    return lhs.heap() == rhs.heap();
+}
+
+template <class T, class U>
+inline bool operator!= (const allocator<T>& lhs, const allocator<U>& rhs) noexcept {
+    return !(lhs == rhs);
+}
+
+/**
+ * @brief A `std::pmr::memory_resource` backed by ntmalloc.
+ *
+ * The resource does not own its heap: destroying the heap with `nt_heap_destroy`
+ * releases everything allocated through it without running any destructor.
+ */
+class heap_resource : public std::pmr::memory_resource {
+    nt_heap_t* _heap = nullptr;     // nullptr allocates from the default heap of the calling thread
+public:
+    heap_resource() noexcept = default;
+    /**
+     * @param heap The heap to allocate from, nullptr for the default heap of the allocating thread.
+     */
+    explicit heap_resource(nt_heap_t* heap) noexcept : _heap(heap) {}
+
+    nt_heap_t* heap() const noexcept { return _heap; }
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* p = nt_alloc_from(_heap, bytes, alignment);
+        if (p == nullptr) throw std::bad_alloc();
+        return p;
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        static_cast<void>(alignment);
+        nt_free_size(p, bytes);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        const heap_resource* resource = dynamic_cast<const heap_resource*>(&other);
+        return (resource != nullptr && resource->_heap == _heap);
+    }
+};
+
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_MALLOC_ALLOCATOR_H
@@ -62,6 +62,35 @@ static inline int64_t nt_atomic_add(volatile int64_t* p, int64_t add) {
     return to_atomic(*p).fetch_add(add, std::memory_order_relaxed) + add;
 }
 
+/**
+ * @brief Raises a value of type int64_t to at least `x`, e.g. a peak.
+ * 
+ * @param p Pointer to int64_t
+ * @param x The lower bound
+ */
+static inline void nt_atomic_max64(volatile int64_t* p, int64_t x) {
+    int64_t current = to_atomic(*p).load(std::memory_order_relaxed);
+    while (current < x && !to_atomic(*p).compare_exchange_weak(current, x, std::memory_order_relaxed)) {}
+}
+
+/**
+ * @brief Performs atomic addition operation on a value of type uintptr_t.
+ * 
+ * @param p Pointer to uintptr_t
+ * @param add Value to add
+ * @return uintptr_t The value after addition
+ */
+static inline uintptr_t nt_atomic_add_uintptr(volatile uintptr_t* p, uintptr_t add) {
+    return to_atomic(*p).fetch_add(add, std::memory_order_relaxed) + add;
+}
+
+/**
+ * @brief A full memory barrier, orders a store before a later load of another location.
+ */
+static inline void nt_atomic_fence(void) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
 /**
  * @brief Performs atomic subtraction operation on a value of type uintptr_t.
  * 
@@ -87,25 +116,30 @@ static inline uintptr_t nt_atomic_subtract32(volatile uint32_t* p, uint32_t sub)
 /**
  * @brief Performs atomic compare-and-exchange operation on a value of type uint32_t.
  * 
+ * A successful exchange releases the writes made before it (e.g. the `next` link
+ * of a block pushed onto a list), and the loaded value acquires those of other threads.
+ * 
  * @param p Pointer to uint32_t
  * @param exchange Value to exchange
  * @param compare Value to compare
  * @return bool True if the comparison is successful and the exchange is performed, false otherwise
  */
 static inline bool nt_atomic_compare_exchange32(volatile uint32_t* p, uint32_t exchange, uint32_t compare) {
-    return to_atomic(*p).compare_exchange_weak(compare, exchange, std::memory_order_relaxed, std::memory_order_seq_cst);
+    return to_atomic(*p).compare_exchange_weak(compare, exchange, std::memory_order_acq_rel, std::memory_order_acquire);
 }
 
 /**
  * @brief Performs atomic compare-and-exchange operation on a value of type uintptr_t.
  * 
+ * Ordered like `nt_atomic_compare_exchange32`.
+ * 
  * @param p Pointer to uintptr_t
  * @param exchange Value to exchange
  * @param compare Value to compare
  * @return bool True if the comparison is successful and the exchange is performed, false otherwise
  */
 static inline bool nt_atomic_compare_exchange(volatile uintptr_t* p, uintptr_t exchange, uintptr_t compare) {
-    return to_atomic(*p).compare_exchange_weak(compare, exchange, std::memory_order_relaxed, std::memory_order_seq_cst);
+    return to_atomic(*p).compare_exchange_weak(compare, exchange, std::memory_order_acq_rel, std::memory_order_acquire);
 }
 
 /**
@@ -116,7 +150,39 @@ static inline bool nt_atomic_compare_exchange(volatile uintptr_t* p, uintptr_t e
  * @return uintptr_t The value before the exchange
  */
 static inline uintptr_t nt_atomic_exchange(volatile uintptr_t* p, uintptr_t exchange) {
-    return to_atomic(*p).exchange(exchange, std::memory_order_relaxed);
+    return to_atomic(*p).exchange(exchange, std::memory_order_acq_rel);
+}
+
+/**
+ * @brief Reads a value of type uintptr_t, acquiring the writes released by the thread that stored it.
+ * 
+ * @param p Pointer to uintptr_t
+ * @return uintptr_t The current value
+ */
+static inline uintptr_t nt_atomic_read(volatile uintptr_t* p) {
+    return to_atomic(*p).load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Performs atomic compare-and-exchange operation on a pointer, ordered like `nt_atomic_compare_exchange`.
+ * 
+ * @param p Pointer to the pointer
+ * @param exchange Value to exchange
+ * @param compare Value to compare
+ * @return bool True if the comparison is successful and the exchange is performed, false otherwise
+ */
+static inline bool nt_atomic_compare_exchange_ptr(volatile void** p, void* exchange, void* compare) {
+    return nt_atomic_compare_exchange((volatile uintptr_t*)p, (uintptr_t)exchange, (uintptr_t)compare);
+}
+
+/**
+ * @brief Reads a pointer, ordered like `nt_atomic_read`.
+ * 
+ * @param p Pointer to the pointer
+ * @return void* The current value
+ */
+static inline void* nt_atomic_read_ptr(volatile void** p) {
+    return (void*)nt_atomic_read((volatile uintptr_t*)p);
 }
 
 #if defined (__cplusplus)
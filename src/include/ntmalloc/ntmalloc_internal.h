@@ -5,11 +5,8 @@
 #include "types.h"
 #include <cstddef>
 #include <cstdint>
-#include <string>
 #include <utility>
 
-extern std::string stack_path;
-
 NT_NAMESPACE_BEGEN
 
 /**
@@ -26,14 +23,165 @@ NT_NAMESPACE_BEGEN
  */
 bool _nt_is_main_thread(void);
 
+/**
+ * @brief Returns a random seed that differs between processes and threads, never 0.
+ *
+ * @param seed Mixed in, e.g. the thread id.
+ */
 uintptr_t _nt_random_init(uintptr_t seed);
 /**
  * @brief Performs a random shuffle operation on the given value.
  *
- * @param x The value to be shuffled.
+ * @param x The value to be shuffled, the sequence stays at 0 once 0 is reached.
  * @return The shuffled value.
  */
-constexpr uintptr_t _nt_random_shuffle(uintptr_t x);
+constexpr inline uintptr_t _nt_random_shuffle(uintptr_t x) {
+  // by Sebastiano Vigna, see: <http://xoshiro.di.unimi.it/splitmix64.c>
+  if constexpr (NT_INTPTR_SIZE == 8) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9UL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebUL;
+    x ^= x >> 31;
+  } else if constexpr (NT_INTPTR_SIZE == 4) {
+  // by Chris Wellons, see: <https://nullprogram.com/blog/2018/07/31/>
+    x ^= x >> 16;
+    x *= 0x7feb352dUL;
+    x ^= x >> 15;
+    x *= 0x846ca68bUL;
+    x ^= x >> 16;
+  }
+  return x;
+}
+
+/**
+ * @brief Advances the random state of `heap` and returns it.
+ */
+static inline uintptr_t _nt_heap_random_next(nt_heap_t* heap) {
+  heap->random = _nt_random_shuffle(heap->random);
+  return heap->random;
+}
+
+/**
+ * --------------------------------------
+ * os.cc
+ * --------------------------------------
+ */
+
+/**
+ * @brief Maps `size` bytes of fresh, zeroed memory from the OS.
+ */
+void* _nt_os_alloc(size_t size, nt_stats_t* stats);
+/**
+ * @brief Returns memory obtained from `_nt_os_alloc` to the OS.
+ */
+void _nt_os_free(void* p, size_t size, nt_stats_t* stats);
+/**
+ * @brief Maps `size` bytes of fresh, zeroed memory aligned to `alignment` (a power of 2).
+ * 
+ * With `NT_OPTION_LARGE_OS_PAGES` a mapping of whole 2mb pages is backed by huge pages where possible.
+ * 
+ * @param kind Receives how the memory is backed
+ */
+void* _nt_os_alloc_aligned(size_t size, size_t alignment, nt_os_mem_kind_t* kind, nt_os_tld_t* tld);
+/**
+ * @brief Returns memory obtained from `_nt_os_alloc_aligned` to the OS.
+ */
+void _nt_os_free_aligned(void* p, size_t size, nt_os_mem_kind_t kind, nt_stats_t* stats);
+/**
+ * @brief The bytes of the process backed by transparent huge pages, as the kernel reports them.
+ * 
+ * @return -1 if the kernel does not tell.
+ */
+int64_t _nt_os_thp_backed(void);
+/**
+ * @brief The number of NUMA nodes, 1 when the machine has a single one or `NT_OPTION_USE_NUMA` is off.
+ */
+int _nt_os_numa_node_count(void);
+/**
+ * @brief The node count of a sysfs node list such as `0`, `0-3` or `0-1,3`: the highest
+ * node id plus one, or 1 when the list holds a single node or can not be parsed.
+ */
+int _nt_os_numa_parse_nodes(const char* list);
+/**
+ * @brief The NUMA node the calling thread runs on, always 0 with a single node.
+ */
+int _nt_os_numa_node(void);
+/**
+ * @brief A monotonic clock in milliseconds.
+ */
+uint64_t _nt_clock_now(void);
+/**
+ * @brief Returns the physical memory of the whole OS pages in the range, which stays mapped.
+ * 
+ * @return false if nothing was reset.
+ */
+bool _nt_os_reset(void* p, size_t size, nt_stats_t* stats);
+/**
+ * @brief Takes a range reset by `_nt_os_reset` in use again.
+ */
+void _nt_os_unreset(void* p, size_t size, nt_stats_t* stats);
+
+/**
+ * --------------------------------------
+ * stats.cc
+ * --------------------------------------
+ */
+
+/**
+ * @brief The process totals of the statistics.
+ */
+extern nt_stats_t _nt_stats_main;
+/**
+ * @brief Adds the statistics of a thread to the process totals and clears them.
+ */
+void _nt_stats_done(nt_stats_t* stats);
+
+/**
+ * --------------------------------------
+ * segment.cc
+ * --------------------------------------
+ */
+
+/**
+ * @brief Takes an unused page able to hold blocks of `block_size` from the segments of the thread.
+ * 
+ * Blocks up to 1/8 of `NT_SMALL_PAGE_SIZE` get a small page, blocks up to `NT_LARGE_SIZE_MAX`
+ * a large page, and anything larger a huge segment of its own.
+ * 
+ * @return the page, or nullptr if the OS is out of memory.
+ */
+nt_page_t* _nt_segment_page_alloc(size_t block_size, nt_segments_tld_t* tld, nt_os_tld_t* os_tld);
+/**
+ * @brief Returns the start of the memory of `page` within `segment`.
+ * 
+ * @param page_size Receives the usable size of the page, the first page is shorter
+ * since it starts after the segment info.
+ */
+uint8_t* _nt_segment_page_start(const nt_segment_t* segment, const nt_page_t* page, size_t* page_size);
+/**
+ * @brief Gives an unused page back to its segment, a segment without used pages goes to the cache or the OS.
+ */
+void _nt_segment_page_free(nt_page_t* page, nt_segments_tld_t* tld);
+/**
+ * @brief Returns the cached segments of a thread to the OS.
+ */
+void _nt_segment_thread_collect(nt_segments_tld_t* tld);
+/**
+ * @brief Purges the free pages and cached segments of a thread whose purge delay expired, or all of them with `force`.
+ */
+void _nt_segment_purge(nt_segments_tld_t* tld, bool force);
+/**
+ * @brief Hands a page with live blocks of an exiting thread to its segment, once all used pages
+ * of the segment are abandoned the segment goes onto the global abandoned list.
+ */
+void _nt_segment_page_abandon(nt_page_t* page, nt_segments_tld_t* tld);
+/**
+ * @brief Adopts segments of exited threads into `heap`, a few at a time or all of them with `try_all`.
+ * 
+ * @return true if any segment was reclaimed.
+ */
+bool _nt_segment_try_reclaim_abandoned(nt_heap_t* heap, bool try_all, nt_segments_tld_t* tld);
 
 /**
  * --------------------------------------
@@ -50,6 +198,107 @@ constexpr uintptr_t _nt_random_shuffle(uintptr_t x);
  * @return void* Pointer to the allocated memory, or NULL if allocation fails.
  */
 void* _nt_malloc_generic(nt_heap_t* heap, size_t size) nt_attr_malloc;
+/**
+ * @brief Moves the blocks freed since the page was last exhausted to its `free` list.
+ */
+void _nt_page_free_collect(nt_page_t* page);
+/**
+ * @brief Called when the last block of `page` is freed, gives the page back to its segment
+ * unless it is better kept around for the next allocations of its size.
+ */
+void _nt_page_retire(nt_page_t* page);
+/**
+ * @brief Moves a full page back to the queue of its size once a block of it is freed.
+ */
+void _nt_page_unfull(nt_page_t* page);
+/**
+ * @brief Sets the delayed free state of `page`, waiting for a concurrent `NT_DELAYED_FREEING` to finish.
+ */
+void _nt_page_use_delayed_free(nt_page_t* page, nt_delayed_t delay);
+/**
+ * @brief Frees the blocks that other threads handed to `heap->thread_delayed_free`.
+ */
+void _nt_heap_delayed_free(nt_heap_t* heap);
+/**
+ * @brief Adds a page of a reclaimed segment to the queue of its size in `heap`.
+ */
+void _nt_page_reclaim(nt_heap_t* heap, nt_page_t* page);
+/**
+ * @brief Frees the empty pages of an exiting thread and abandons the others.
+ */
+void _nt_heap_collect_abandon(nt_heap_t* heap);
+/**
+ * @brief Moves all pages of `from` to `heap` of the same thread, with the blocks still in use.
+ */
+void _nt_heap_absorb(nt_heap_t* heap, nt_heap_t* from);
+/**
+ * @brief Gives all pages of `heap` back to their segments at once, whatever is still in use.
+ */
+void _nt_heap_destroy_pages(nt_heap_t* heap);
+
+/**
+ * --------------------------------------
+ * heap.cc
+ * --------------------------------------
+ */
+
+/**
+ * @brief Deletes the heaps made by `nt_heap_new` in an exiting thread, their blocks go to the backing heap.
+ */
+void _nt_heap_delete_all(nt_tld_t* tld);
+
+/**
+ * --------------------------------------
+ * profile.cc
+ * --------------------------------------
+ */
+
+/**
+ * @brief Sets the countdown of a new heap, so that its first allocation is not sampled by default.
+ */
+void _nt_sample_init(nt_heap_t* heap);
+/**
+ * @brief Called when `heap->sample_countdown` runs out: records the stack of `block` if sampling is on,
+ * and sets the countdown to the next sample.
+ */
+void _nt_sample_malloc(nt_heap_t* heap, nt_page_t* page, void* block, size_t size);
+/**
+ * @brief Drops `block` from the profile if it was sampled, for blocks of pages with `has_sampled`.
+ */
+void _nt_sample_free(void* block);
+/**
+ * @brief Drops all sampled blocks of `page` from the profile, before the page is released as a whole.
+ */
+void _nt_sample_forget_page(nt_page_t* page);
+
+/**
+ * --------------------------------------
+ * ntmalloc.cc
+ * --------------------------------------
+ */
+
+/**
+ * @brief Pops a block from the `free` list of `page`, or takes the generic path when it is empty.
+ */
+void* _nt_page_malloc(nt_heap_t* heap, nt_page_t* page, size_t size) nt_attr_malloc;
+/**
+ * @brief Frees a block taken from `heap->thread_delayed_free` by the owning thread.
+ * 
+ * @return false if the other thread is still finishing the delayed free, try again later.
+ */
+bool _nt_free_delayed_block(nt_block_t* block);
+/**
+ * @brief Counts `count` blocks of `page` freed by other threads as freed, by the thread owning the page.
+ */
+void _nt_free_stat_collected(const nt_page_t* page, size_t count);
+/**
+ * @brief Pushes the frees held back by the thread of `tld` to their pages.
+ */
+void _nt_free_batch_flush(nt_tld_t* tld);
+/**
+ * @brief Takes the frees another thread holds back for `page`, by the thread owning the page.
+ */
+void _nt_free_batch_steal(nt_page_t* page);
 
 /**
  * --------------------------------------
@@ -155,7 +404,8 @@ void* _nt_malloc_generic(nt_heap_t* heap, size_t size) nt_attr_malloc;
     NT_STAT_COUNT_EMPTY(), NT_STAT_COUNT_EMPTY(), \
     NT_STAT_COUNT_EMPTY(), NT_STAT_COUNT_EMPTY(), \
     NT_STAT_COUNT_EMPTY(), NT_STAT_COUNT_EMPTY(), \
-    { 0, 0 } \
+    NT_STAT_COUNT_EMPTY(), NT_STAT_COUNT_EMPTY(), \
+    { 0, 0 }, { 0, 0 }, { 0, 0 } \
     NT_STAT_COUNT_END_EMPTY()
 
 /**
@@ -167,10 +417,38 @@ void* _nt_malloc_generic(nt_heap_t* heap, size_t size) nt_attr_malloc;
  * @return The calculated word size
  */
 static inline size_t _nt_wsize_from_size(size_t size) {
-  stack_path += "_nt_wsize_from_size -> ";
   return (size + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
 }
 
+/**
+ * @brief Index of the most significant bit that is set, `x` must not be 0.
+ */
+static inline uint8_t nt_bsr32(uint32_t x) {
+  return (uint8_t)(31 - __builtin_clz(x));
+}
+
+/**
+ * @brief Returns the bin (size class) of the given size.
+ * 
+ * Every word size up to 8 words has its own bin, above that there are 4 bins for
+ * every doubling, so the block size is at most 25% (12.5% on average) larger than the request.
+ * Bins line up with the `block_size` of the queues in `NT_PAGE_QUEUES_EMPTY`,
+ * everything above `NT_LARGE_SIZE_MAX` goes to `NT_BIN_HUGE`.
+ * 
+ * @param size The requested size in bytes
+ * @return The bin, between 1 and `NT_BIN_HUGE`
+ */
+static inline uint8_t _nt_bin(size_t size) {
+  size_t wsize = _nt_wsize_from_size(size);
+  if (wsize <= 1) return 1;
+  if (wsize <= 8) return (uint8_t)wsize;
+  if (wsize > NT_LARGE_WSIZE_MAX) return NT_BIN_HUGE;
+  wsize--;
+  uint8_t b = nt_bsr32((uint32_t)wsize);
+  //! the 2 bits below the top bit select 1 of 4 bins within `[2^b, 2^(b+1))`
+  return (uint8_t)(((b << 2) + (uint8_t)((wsize >> (b - 2)) & 0x03)) - 3);
+}
+
 /**
  * @brief default heap to allocate from
  */
@@ -179,6 +457,10 @@ extern nt_thread(nt_heap_t*) _nt_heap_default;
  * @brief An empty heap
  */
 extern const nt_heap_t _nt_heap_empty;
+/**
+ * @brief An empty page, the initial entry of every `pages_free_direct` slot
+ */
+extern const nt_page_t _nt_page_empty;
 /**
  * @brief 
  * TODO
@@ -193,7 +475,6 @@ extern nt_heap_t _nt_heap_main;
  * @return A pointer to the default heap
  */
 static inline nt_heap_t* nt_get_default_heap(void) {
-  stack_path += "nt_get_default_heap -> ";
   return _nt_heap_default;
 }
 
@@ -204,8 +485,7 @@ static inline nt_heap_t* nt_get_default_heap(void) {
  * @return true if the heap is initialized, false otherwise.
  */
 static inline bool nt_heap_is_initialized(nt_heap_t* heap) {
-  stack_path += "nt_heap_is_initialized";
-  nt_assert_internal(heap != nullprt);
+  nt_assert_internal(heap != nullptr);
   return (heap != &_nt_heap_empty);
 }
 
@@ -253,6 +533,52 @@ static inline nt_page_t* _nt_ptr_page(void* p) {
   return _nt_segment_page_of(_nt_ptr_segment(p), p);
 }
 
+/**
+ * @brief Returns the segment a page belongs to, the page info lives in the segment header.
+ */
+static inline nt_segment_t* _nt_page_segment(const nt_page_t* page) {
+  return _nt_ptr_segment(page);
+}
+
+/**
+ * @brief Returns the start of the block an interior pointer `p` of `page` points into,
+ * for pages that hand out aligned pointers (`has_aligned`).
+ */
+static inline nt_block_t* _nt_page_ptr_unalign(const nt_segment_t* segment, const nt_page_t* page, const void* p) {
+  size_t diff = (size_t)((const uint8_t*)p - _nt_segment_page_start(segment, page, nullptr));
+  return (nt_block_t*)((uintptr_t)p - diff % page->block_size);
+}
+
+/**
+ * @brief Reads the next block of a free list.
+ * 
+ * The `page` is passed along so that the link can be encoded with `page->cookie` later on.
+ */
+static inline nt_block_t* nt_block_next(const nt_page_t* page, const nt_block_t* block) {
+  UNUSED(page);
+  return (nt_block_t*)block->next;
+}
+
+static inline void nt_block_set_next(const nt_page_t* page, nt_block_t* block, const nt_block_t* next) {
+  UNUSED(page);
+  block->next = (nt_block_t::nt_encode_t)next;
+}
+
+/**
+ * @brief The head block of a `thread_free` value, the low 2 bits hold the `nt_delayed_t` state.
+ */
+static inline nt_block_t* nt_tf_block(uintptr_t tf) {
+  return (nt_block_t*)(tf & ~(uintptr_t)0x03);
+}
+
+static inline nt_delayed_t nt_tf_delayed(uintptr_t tf) {
+  return (nt_delayed_t)(tf & 0x03);
+}
+
+static inline uintptr_t nt_tf_make(const nt_block_t* block, nt_delayed_t delayed) {
+  return (uintptr_t)block | (uintptr_t)delayed;
+}
+
 /**
  * @brief Retrieves a free small page from the heap
  * 
@@ -263,9 +589,7 @@ static inline nt_page_t* _nt_ptr_page(void* p) {
  * @return A pointer to the retrieved free page
  */
 static inline nt_page_t* _nt_heap_get_free_small_page(nt_heap_t* heap, size_t size) {
-  stack_path += "_nt_heap_get_free_small_page -> ";
   nt_assert_internal(size <= NT_SMALL_SIZE_MAX);
-  info << "direct free pages idx = " << _nt_wsize_from_size(size);
   return heap->pages_free_direct[_nt_wsize_from_size(size)];
 }
 
@@ -276,7 +600,6 @@ static inline nt_page_t* _nt_heap_get_free_small_page(nt_heap_t* heap, size_t si
  * @ref see: https://akkadia.org/drepper/tls.pdf
  */
 static inline uintptr_t _nt_thread_id(void) {
-  stack_path += "_nt_thread_id -> ";
   uintptr_t tid;
   #if defined (__i386__)
   __asm__("movl %%gs:0, %0" : "=r" (tid) : :);  // IA32 32 bit always uses GS
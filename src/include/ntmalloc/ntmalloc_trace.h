@@ -0,0 +1,75 @@
+#ifndef __LIBNT_MALLOC_TRACE_H
+#define __LIBNT_MALLOC_TRACE_H
+
+#include "../defs.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * --------------------------------------------
+ * Tracing
+ *
+ * Opt-in (`NT_TRACE=1`, the `NT_MALLOC_TRACE` cmake option) record of the
+ * slow-path events of the allocator in a fixed-size ring per thread.
+ * Recording never allocates, and with `NT_TRACE=0` the `nt_trace` calls
+ * compile to nothing. The fast paths record no events at all.
+ * --------------------------------------------
+ */
+
+#ifndef NT_TRACE
+#   define NT_TRACE 0
+#endif
+
+NT_NAMESPACE_BEGEN
+
+typedef enum nt_trace_event {
+    NT_TRACE_NONE = 0,
+    NT_TRACE_PROCESS_INIT,      //! (thread id, 0)
+    NT_TRACE_THREAD_INIT,       //! (thread id, heap)
+    NT_TRACE_THREAD_DONE,       //! (thread id, heap)
+    NT_TRACE_MALLOC_GENERIC,    //! (size, heap)
+    NT_TRACE_PAGE_FRESH,        //! (page, block size)
+    NT_TRACE_PAGE_FULL,         //! (page, block size)
+    NT_TRACE_PAGE_UNFULL,       //! (page, block size)
+    NT_TRACE_PAGE_RETIRE,       //! (page, block size)
+    NT_TRACE_HUGE_ALLOC,        //! (page, block size)
+    NT_TRACE_DELAYED_FREE,      //! (heap, blocks freed)
+    NT_TRACE_SEGMENT_ALLOC,     //! (segment, segment size)
+    NT_TRACE_SEGMENT_CACHED,    //! (segment, segment size), reused from the cache
+    NT_TRACE_SEGMENT_FREE,      //! (segment, segment size)
+    NT_TRACE_OS_ALLOC,          //! (address, size)
+    NT_TRACE_OS_FREE,           //! (address, size)
+    NT_TRACE_OS_RESET,          //! (address, size), purged
+    NT_TRACE_SEGMENT_ABANDON,   //! (segment, pages in use), its thread exited
+    NT_TRACE_SEGMENT_RECLAIM,   //! (segment, pages in use), adopted by the tracing thread
+    NT_TRACE_EVENT_COUNT,
+} nt_trace_event_t;
+
+typedef struct nt_trace_entry {
+    uint64_t            seq;        //! per thread sequence number of the event
+    nt_trace_event_t    event;
+    uintptr_t           arg0;
+    uintptr_t           arg1;
+} nt_trace_entry_t;
+
+/**
+ * @brief Number of events a thread keeps, the oldest ones are overwritten.
+ */
+constexpr const size_t NT_TRACE_RING_SIZE = 256;
+
+typedef struct nt_trace_ring {
+    uint64_t            count;      //! events recorded so far
+    nt_trace_entry_t    entries[NT_TRACE_RING_SIZE];
+} nt_trace_ring_t;
+
+#if (NT_TRACE)
+void _nt_trace(nt_trace_event_t event, uintptr_t arg0, uintptr_t arg1);
+#   define nt_trace(event, arg0, arg1)    _nt_trace(event, (uintptr_t)(arg0), (uintptr_t)(arg1))
+#else
+#   define nt_trace(event, arg0, arg1)    ((void)0)
+#endif
+
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_MALLOC_TRACE_H
@@ -0,0 +1,108 @@
+#include "../ntmalloc.h"
+#include "../ntmalloc_internal.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+NT_NAMESPACE_BEGEN
+
+/**
+ * -----------------------------------------------------------
+ * First class heaps
+ *
+ * A heap made by `nt_heap_new` shares the thread local data
+ * (segments, caches and statistics) of its thread with the
+ * backing heap, but has its own pages. All blocks of such a
+ * heap can therefore be released at once by giving its pages
+ * back to their segments.
+ * -----------------------------------------------------------
+ */
+
+static bool nt_heap_is_backing(const nt_heap_t* heap) {
+    return (heap->tld->heap_backing == heap);
+}
+
+nt_heap_t* nt_heap_new(void) {
+    nt_heap_t* bheap = nt_get_default_heap();
+    if (!nt_heap_is_initialized(bheap)) {
+        nt_thread_init();
+        bheap = nt_get_default_heap();
+        if (!nt_heap_is_initialized(bheap)) return nullptr;
+    }
+    bheap = bheap->tld->heap_backing;
+
+    nt_heap_t* heap = (nt_heap_t*)nt_heap_malloc(bheap, sizeof(nt_heap_t));
+    if (heap == nullptr) return nullptr;
+    memcpy((void*)heap, &_nt_heap_empty, sizeof(*heap));
+    heap->tld = bheap->tld;
+    heap->thread_id = _nt_thread_id();
+    heap->random = _nt_random_init((uintptr_t)heap);
+    heap->cookie = ((uintptr_t)heap ^ heap->random) | 1;
+    //! segments abandoned by other threads are adopted by the backing heap only,
+    //! they should not be released together with this heap
+    heap->no_reclaim = true;
+    _nt_sample_init(heap);
+    heap->next = heap->tld->heaps;
+    heap->tld->heaps = heap;
+    return heap;
+}
+
+/**
+ * @brief Unlinks `heap` from its thread and frees it, the default heap falls back to the backing heap.
+ */
+static void nt_heap_free(nt_heap_t* heap) {
+    nt_tld_t* tld = heap->tld;
+    if (nt_get_default_heap() == heap) _nt_heap_default = tld->heap_backing;
+
+    nt_heap_t** prev = &tld->heaps;
+    while (*prev != nullptr && *prev != heap) prev = &(*prev)->next;
+    if (*prev == heap) *prev = heap->next;
+    nt_free(heap);
+}
+
+void nt_heap_delete(nt_heap_t* heap) {
+    if (heap == nullptr || !nt_heap_is_initialized(heap)) return;
+    nt_assert(heap->thread_id == _nt_thread_id());
+    if (nt_heap_is_backing(heap)) return;   //! the backing heap lives as long as its thread
+
+    _nt_heap_absorb(heap->tld->heap_backing, heap);
+    nt_heap_free(heap);
+}
+
+void nt_heap_destroy(nt_heap_t* heap) {
+    if (heap == nullptr || !nt_heap_is_initialized(heap)) return;
+    nt_assert(heap->thread_id == _nt_thread_id());
+    //! the backing heap also holds the heap structures and blocks of `nt_malloc`
+    if (nt_heap_is_backing(heap)) return;
+
+    _nt_heap_destroy_pages(heap);
+    nt_heap_free(heap);
+}
+
+nt_heap_t* nt_heap_set_default(nt_heap_t* heap) {
+    nt_heap_t* old = nt_get_default_heap();
+    if (heap == nullptr || !nt_heap_is_initialized(heap)) return old;
+    nt_assert(heap->thread_id == _nt_thread_id());
+    _nt_heap_default = heap;
+    return old;
+}
+
+nt_heap_t* nt_heap_get_default(void) {
+    nt_heap_t* heap = nt_get_default_heap();
+    if (!nt_heap_is_initialized(heap)) {
+        nt_thread_init();
+        heap = nt_get_default_heap();
+    }
+    return heap;
+}
+
+nt_heap_t* nt_heap_get_backing(void) {
+    return nt_heap_get_default()->tld->heap_backing;
+}
+
+void _nt_heap_delete_all(nt_tld_t* tld) {
+    while (tld->heaps != nullptr) nt_heap_delete(tld->heaps);
+}
+
+NT_NAMESPACE_END
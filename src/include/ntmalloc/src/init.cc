@@ -1,12 +1,13 @@
 #include "../ntmalloc.h"
+#include "../ntmalloc_atomic.h"
 #include "../ntmalloc_internal.h"
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <pthread.h>
-#include <string>
-
-extern std::string stack_path;
+#include <unistd.h>
 
 NT_NAMESPACE_BEGEN
 
@@ -66,28 +67,14 @@ nt_heap_t _nt_heap_main = {
  * -----------------------------------------
  */
 
-constexpr uintptr_t _nt_random_shuffle(uintptr_t x) {
-    // by Sebastiano Vigna, see: <http://xoshiro.di.unimi.it/splitmix64.c>
-    if constexpr (NT_INTPTR_SIZE == 8) {
-        x ^= x >> 30;
-        x *= 0xbf58476d1ce4e5b9UL;
-        x ^= x >> 27;
-        x *= 0x94d049bb133111ebUL;
-        x ^= x >> 31;
-    } else if constexpr (NT_INTPTR_SIZE == 4) {
-    // by Chris Wellons, see: <https://nullprogram.com/blog/2018/07/31/>
-        x ^= x >> 16;
-        x *= 0x7feb352dUL;
-        x ^= x >> 15;
-        x *= 0x846ca68bUL;
-        x ^= x >> 16;
-    }
-    return x;
-}
-
 uintptr_t _nt_random_init(uintptr_t seed) {
-    stack_path += "_nt_random_init -> ";
-    return {};
+    //! the stack and image addresses differ per process (ASLR) and per thread, the clock per call
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uintptr_t x = seed ^ (uintptr_t)&ts ^ ((uintptr_t)&_nt_heap_main << 17);
+    x ^= (uintptr_t)ts.tv_nsec ^ ((uintptr_t)ts.tv_sec << (4 * NT_INTPTR_SIZE));
+    for (int i = 0; i < 4; i++) x = _nt_random_shuffle(x ^ (uintptr_t)i);
+    return (x == 0 ? 1 : x);
 }
 
 /**
@@ -103,10 +90,66 @@ static void nt_pthread_done(void* value) {
     if (value != nullptr) nt_thread_done();
 }
 
+/**
+ * @brief The heap and thread local data of a thread other than the main thread,
+ * allocated from the OS so that initializing a thread never recurses into `nt_malloc`.
+ */
+typedef struct nt_thread_data {
+    nt_heap_t                heap;
+    nt_tld_t                 tld;
+    struct nt_thread_data*   next;      //! the next entry of `nt_thread_data_free`
+} nt_thread_data_t;
+
+/**
+ * @brief The thread data of exited threads, kept for new threads rather than unmapped:
+ * another thread may still be taking a free batch out of a slot in `tld`.
+ */
+static nt_thread_data_t* volatile nt_thread_data_free = nullptr;
+
+static void nt_thread_data_push(nt_thread_data_t* first, nt_thread_data_t* last) {
+    nt_thread_data_t* head = nullptr;
+    do {
+        head = (nt_thread_data_t*)nt_atomic_read_ptr((volatile void**)&nt_thread_data_free);
+        last->next = head;
+    } while (!nt_atomic_compare_exchange_ptr((volatile void**)&nt_thread_data_free, first, head));
+}
+
+static nt_thread_data_t* nt_thread_data_pop(void) {
+    if (nt_atomic_read_ptr((volatile void**)&nt_thread_data_free) == nullptr) return nullptr;
+    //! the whole list is taken so that no two threads pop the same entry, the rest goes back
+    nt_thread_data_t* td = (nt_thread_data_t*)nt_atomic_exchange((volatile uintptr_t*)&nt_thread_data_free, 0);
+    if (td == nullptr) return nullptr;
+    if (td->next != nullptr) {
+        nt_thread_data_t* last = td->next;
+        while (last->next != nullptr) last = last->next;
+        nt_thread_data_push(td->next, last);
+    }
+    return td;
+}
+
 void nt_thread_done(void) {
     nt_heap_t* heap = nt_get_default_heap();
     if (!_nt_is_main_thread() && nt_heap_is_initialized(heap)) {
+        heap = heap->tld->heap_backing;
+        nt_trace(NT_TRACE_THREAD_DONE, heap->thread_id, heap);
         nt_stat_decrease(heap->tld->stats.threads, 1);
+        //! frees made from destructors after this point are pushed right away
+        _nt_free_batch_flush(heap->tld);
+        heap->tld->free_batch_done = true;
+        //! blocks of heaps left alive are still valid, they are abandoned with the backing heap
+        _nt_heap_delete_all(heap->tld);
+        _nt_heap_default = heap;
+        //! blocks still in use keep their segments alive, other threads adopt them
+        _nt_heap_collect_abandon(heap);
+        //! the cached segments are not of use to any other thread
+        _nt_segment_purge(&heap->tld->segments, true);
+        _nt_segment_thread_collect(&heap->tld->segments);
+        _nt_stats_done(&heap->tld->stats);
+        //! detach the thread and keep its data for the next thread to start
+        _nt_heap_default = (nt_heap_t*)&_nt_heap_empty;
+        pthread_setspecific(nt_pthread_key, nullptr);
+        nt_thread_data_t* td = (nt_thread_data_t*)heap;
+        nt_thread_data_push(td, td);
     }
 }
 
@@ -114,12 +157,10 @@ void nt_thread_done(void) {
  * @brief Set up handlers so `nt_thread_done` is called automatically
  */
 static void nt_process_setup_auto_thread_done(void) {
-    stack_path += "nt_process_setup_auto_thread_done -> ";
     static bool tls_initialized = false;
     if (tls_initialized) return;
     tls_initialized = true;
     pthread_key_create(&nt_pthread_key, nt_pthread_done);
-    info << "pthread_key = " << nt_pthread_key;
 }
 
 nt_thread(nt_heap_t*) _nt_heap_default = (nt_heap_t*)&_nt_heap_empty;
@@ -128,42 +169,66 @@ bool _nt_is_main_thread(void) {
     return (_nt_heap_main.thread_id == 0 || _nt_heap_main.thread_id == _nt_thread_id());
 }
 
+/**
+ * @brief Sets up the backing heap of the calling thread as its default heap.
+ * 
+ * @return true if the thread was already initialized.
+ */
+static bool _nt_heap_init(void) {
+    if (nt_heap_is_initialized(nt_get_default_heap())) return true;
+    if (_nt_is_main_thread()) {
+        _nt_heap_default = &_nt_heap_main;
+        return false;
+    }
+
+    nt_thread_data_t* td = nt_thread_data_pop();
+    if (td != nullptr) {
+        memset((void*)td, 0, sizeof(*td));
+    } else {
+        td = (nt_thread_data_t*)_nt_os_alloc(sizeof(nt_thread_data_t), &_nt_stats_main);
+        if (td == nullptr) return false;
+    }
+    nt_tld_t* tld = &td->tld;
+    nt_heap_t* heap = &td->heap;
+    memcpy((void*)heap, &_nt_heap_empty, sizeof(*heap));
+    heap->thread_id = _nt_thread_id();
+    heap->random = _nt_random_init(heap->thread_id);
+    heap->cookie = ((uintptr_t)heap ^ heap->random) | 1;
+    heap->tld = tld;
+    _nt_sample_init(heap);
+    //! zeroed memory is the empty state of `tld`
+    tld->heap_backing = heap;
+    tld->segments.stats = &tld->stats;
+    tld->os.stats = &tld->stats;
+    _nt_heap_default = heap;
+    return false;
+}
+
 void nt_thread_init(void) {
-    stack_path += "nt_thread_init -> ";
     nt_process_init();
-    // TODO
+    if (_nt_heap_init()) return;
+    nt_heap_t* heap = nt_get_default_heap();
+    if (!nt_heap_is_initialized(heap)) return;
+    nt_stat_increase(heap->tld->stats.threads, 1);
+    nt_trace(NT_TRACE_THREAD_INIT, heap->thread_id, heap);
+    //! a non-null value makes `nt_pthread_done` run when the thread exits
+    pthread_setspecific(nt_pthread_key, heap);
 }
 
 static void nt_process_done(void);
 
-auto dec2hex = [](auto x) {
-    char buffer[32];
-    auto ret = std::to_chars(buffer, buffer + 32, x, 16);
-    *ret.ptr = '\0';
-    return std::string(buffer);
-};
-
 void nt_process_init(void) {
-    stack_path += "nt_process_init -> ";
     //! ensure we are called once
     if (_nt_process_is_initialized) return;
     _nt_process_is_initialized = !_nt_process_is_initialized;
 
     _nt_heap_main.thread_id = _nt_thread_id();
-    // _nt_verbose_message("process init: 0x%zx\n", _nt_heap_main.thread_id);
-    info << "process init: 0x" << dec2hex(_nt_heap_main.thread_id);
+    nt_trace(NT_TRACE_PROCESS_INIT, _nt_heap_main.thread_id, 0);
 
     uintptr_t random = _nt_random_init(_nt_heap_main.thread_id);
-    info << "random = " << random;
-
     _nt_heap_main.cookie = (uintptr_t)&_nt_heap_main ^ random;
     _nt_heap_main.random = _nt_random_shuffle(random);
-    info << "cookie = " << _nt_heap_main.cookie;
-    info << "random = " << _nt_heap_main.random;
-#if NT_DEBUG
-    // _nt_verbose_message("debug level : %d\n", MI_DEBUG);
-    info << "debug level: " << NT_DEBUG;
-#endif
+    _nt_sample_init(&_nt_heap_main);
     atexit(&nt_process_done);
     // TODO
     nt_process_setup_auto_thread_done();
@@ -175,7 +240,6 @@ void nt_process_init(void) {
  * TODO
  */
 static void nt_process_done(void) {
-    stack_path += "nt_process_done -> ";
     //! only shutdown if we were initialized
     if (!_nt_process_is_initialized) return;
 
@@ -184,10 +248,10 @@ static void nt_process_done(void) {
     if (process_done) return;
     process_done = !process_done;
 
-#ifndef NDEBUG
-    // TODO
-#endif
-    // TODO
+    nt_heap_t* heap = nt_get_default_heap();
+    if (nt_heap_is_initialized(heap)) _nt_free_batch_flush(heap->tld);
+    nt_stats_merge();
+    if (nt_option_get(NT_OPTION_SHOW_STATS) != 0) nt_stats_print(STDERR_FILENO);
 }
 
 NT_NAMESPACE_END
\ No newline at end of file
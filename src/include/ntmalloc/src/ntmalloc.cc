@@ -1,61 +1,472 @@
 #include "../ntmalloc.h"
+#include "../ntmalloc_atomic.h"
 #include "../ntmalloc_internal.h"
 
+#include <cerrno>
 #include <cstddef>
-#include <string>
-
-extern std::string stack_path;  //! In order to more intuitively reflect the function call stack
+#include <cstdint>
+#include <cstring>
 
 NT_NAMESPACE_BEGEN
 
 void* _nt_page_malloc(nt_heap_t* heap, nt_page_t* page, size_t size) {
-    stack_path += "_nt_page_malloc -> ";
     nt_assert_internal(page->block_size == 0 || page->block_size >= size);
-    //! 获取page中的空闲链表块
     nt_block_t* block = page->free;
-    info << "block == null is " << (block == nullptr);
     if (nt_unlikely(block == nullptr)) {
-        //! In this case, the block must be empty because of the page
-        //! 第一次会进入到一个默认的申请空间
-        info << "try to malloc generic";
+        //! the page is exhausted, or still the empty page of a fresh heap
         return _nt_malloc_generic(heap, size);
     }
     nt_assert_internal(block != nullptr && _nt_ptr_page(block) == page);
-    // pop from the free list
-    
-    return {};
+    //! pop from the free list
+    page->free = nt_block_next(page, block);
+    page->used++;
+#if NT_STAT > 1
+    if (page->block_size <= NT_LARGE_SIZE_MAX) nt_heap_stat_increase(heap, normal[_nt_bin(page->block_size)], 1);
+    nt_heap_stat_increase(heap, malloc, page->block_size);
+#endif
+    if (nt_unlikely((heap->sample_countdown -= (int64_t)size) < 0)) _nt_sample_malloc(heap, page, block, size);
+    return block;
 }
 
 void* nt_heap_malloc_small(nt_heap_t* heap, size_t size) {
-    stack_path += "nt_heap_malloc_small -> ";
     nt_assert(size <= NT_SMALL_SIZE_MAX);
-
-    //! 这里就获取到了heap中一块空闲的，默认初始化为空的page
     nt_page_t* page = _nt_heap_get_free_small_page(heap, size);
-    
-    //! 因此接下来就应该为page申请一块空间
     return _nt_page_malloc(heap, page, size);
 }
 
 void* nt_heap_malloc(nt_heap_t* heap, size_t size) {
-    stack_path += "nt_heap_malloc -> ";
     nt_assert(heap != nullptr);
     nt_assert(heap->thread_id == 0 || heap->thread_id == _nt_thread_id());
 
-    info << "heap thread = " << heap->thread_id;
-
-    void* p;
-    if (nt_likely(size < NT_SMALL_SIZE_MAX)) {
-        p = nt_heap_malloc_small(heap, size);
-    } else {
-        // p = _nt_malloc_generic(heap, size);
+    if (nt_likely(size <= NT_SMALL_SIZE_MAX)) {
+        return nt_heap_malloc_small(heap, size);
     }
-    return {};
+    return _nt_malloc_generic(heap, size);
 }
 
 void* nt_malloc(size_t size) {
-    stack_path += "nt_malloc -> ";
     return nt_heap_malloc(nt_get_default_heap(), size);
 }
 
-NT_NAMESPACE_END
\ No newline at end of file
+/**
+ * -----------------------------------------------------------
+ * Zero initialized allocation
+ * -----------------------------------------------------------
+ */
+
+/**
+ * @brief Blocks of a page fresh from the OS are zeroed already, only their free list link is not.
+ */
+static void nt_block_zero_init(const nt_page_t* page, void* p, size_t size) {
+    if (page->is_zero && size >= sizeof(nt_block_t)) {
+        ((nt_block_t*)p)->next = 0;
+    } else {
+        memset(p, 0, size);
+    }
+}
+
+void* nt_heap_calloc(nt_heap_t* heap, size_t count, size_t size) {
+    size_t total = 0;
+    if (nt_unlikely(__builtin_mul_overflow(count, size, &total))) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    void* p = nt_heap_malloc(heap, total);
+    //! `is_zero` is read before anything else is taken from the page
+    if (p != nullptr) nt_block_zero_init(_nt_ptr_page(p), p, total);
+    return p;
+}
+
+void* nt_calloc(size_t count, size_t size) {
+    return nt_heap_calloc(nt_get_default_heap(), count, size);
+}
+
+/**
+ * -----------------------------------------------------------
+ * Aligned allocation
+ *
+ * Every page starts at least `NT_SEGMENT_INFO_ALIGN` aligned, so
+ * all blocks of a size class that is a multiple of the alignment
+ * are aligned without any waste. Other requests over-allocate and
+ * hand out an interior pointer, the page is then marked
+ * `has_aligned` so `nt_free` finds the start of the block again.
+ * -----------------------------------------------------------
+ */
+
+void* nt_heap_malloc_aligned(nt_heap_t* heap, size_t size, size_t alignment) {
+    if (nt_unlikely(alignment == 0 || (alignment & (alignment - 1)) != 0)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    if (nt_unlikely(size > (size_t)PTRDIFF_MAX || alignment > (size_t)PTRDIFF_MAX - size)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    //! every block is word aligned
+    if (alignment <= sizeof(uintptr_t)) return nt_heap_malloc(heap, size);
+
+    //! 1. the next free block of the size class may happen to be aligned
+    if (size <= NT_SMALL_SIZE_MAX) {
+        nt_page_t* page = _nt_heap_get_free_small_page(heap, size);
+        if (page->free != nullptr && ((uintptr_t)page->free & (alignment - 1)) == 0) {
+            return _nt_page_malloc(heap, page, size);
+        }
+    }
+
+    //! 2. a size class whose blocks are all aligned
+    if (alignment <= NT_SEGMENT_INFO_ALIGN) {
+        size_t asize = (size + alignment - 1) & ~(alignment - 1);
+        if (asize <= NT_LARGE_SIZE_MAX && (heap->pages[_nt_bin(asize)].block_size % alignment) == 0) {
+            void* p = nt_heap_malloc(heap, asize);
+            nt_assert_internal(((uintptr_t)p & (alignment - 1)) == 0);
+            return p;
+        }
+    }
+
+    //! 3. over-allocate and align within the block
+    uint8_t* p = (uint8_t*)nt_heap_malloc(heap, size + alignment - 1);
+    if (p == nullptr) return nullptr;
+    uintptr_t adjust = (alignment - ((uintptr_t)p & (alignment - 1))) & (alignment - 1);
+    if (adjust != 0) _nt_ptr_page(p)->flags.has_aligned = true;
+    return p + adjust;
+}
+
+void* nt_malloc_aligned(size_t size, size_t alignment) {
+    return nt_heap_malloc_aligned(nt_get_default_heap(), size, alignment);
+}
+
+void* nt_aligned_alloc(size_t alignment, size_t size) {
+    return nt_heap_malloc_aligned(nt_get_default_heap(), size, alignment);
+}
+
+/**
+ * -----------------------------------------------------------
+ * Free
+ * -----------------------------------------------------------
+ */
+
+/**
+ * @brief Free by the thread owning the page: push onto `local_free`, no atomics needed.
+ */
+static inline void _nt_free_block_local(nt_page_t* page, nt_block_t* block) {
+    nt_block_set_next(page, block, page->local_free);
+    page->local_free = block;
+    page->used--;
+    if (nt_unlikely(page->used - page->thread_freed == 0)) {
+        _nt_page_retire(page);
+    } else if (nt_unlikely(page->flags.is_full)) {
+        _nt_page_unfull(page);
+    }
+}
+
+/**
+ * @brief Free by another thread: push onto the `thread_free` list of the page with a CAS,
+ * the owner takes the whole list at once in `_nt_page_free_collect`.
+ * 
+ * The first free into a full page (`NT_USE_DELAYED_FREE`) goes to `thread_delayed_free`
+ * of the owning heap instead, so the owner moves the page out of the full queue.
+ */
+static void _nt_free_block_mt(nt_page_t* page, nt_block_t* block) {
+    uintptr_t tfree = 0;
+    uintptr_t tfreex = 0;
+    bool use_delayed = false;
+    do {
+        tfree = nt_atomic_read(&page->thread_free.value);
+        use_delayed = (nt_tf_delayed(tfree) == NT_USE_DELAYED_FREE);
+        if (nt_unlikely(use_delayed)) {
+            //! claim the delayed free, this keeps the heap alive until it is reset below
+            tfreex = nt_tf_make(nt_tf_block(tfree), NT_DELAYED_FREEING);
+        } else {
+            nt_block_set_next(page, block, nt_tf_block(tfree));
+            tfreex = nt_tf_make(block, nt_tf_delayed(tfree));
+        }
+    } while (!nt_atomic_compare_exchange(&page->thread_free.value, tfreex, tfree));
+
+    if (nt_likely(!use_delayed)) {
+        nt_atomic_increment(&page->thread_freed);
+        return;
+    }
+
+    nt_heap_t* heap = page->heap;
+    if (heap != nullptr) {
+        nt_block_t* dfree = nullptr;
+        do {
+            dfree = (nt_block_t*)nt_atomic_read_ptr((volatile void**)&heap->thread_delayed_free);
+            block->next = (nt_block_t::nt_encode_t)dfree;
+        } while (!nt_atomic_compare_exchange_ptr((volatile void**)&heap->thread_delayed_free, block, dfree));
+    }
+
+    //! later frees go to the page again, the owner unfulls the page when it sees this block
+    do {
+        tfree = nt_atomic_read(&page->thread_free.value);
+        tfreex = nt_tf_make(nt_tf_block(tfree), NT_NO_DELAYED_FREE);
+    } while (!nt_atomic_compare_exchange(&page->thread_free.value, tfreex, tfree));
+}
+
+/**
+ * -----------------------------------------------------------
+ * Batched frees of other threads
+ *
+ * A thread that frees many blocks of another thread, as the
+ * consumer of a producer does, holds them back per page in a slot
+ * of its own and pushes them as one chain: one CAS on the shared
+ * `thread_free` and one atomic add for up to `NT_OPTION_FREE_BATCH`
+ * blocks, instead of two atomics on the page per block. Appending
+ * to the slot is a CAS as well, but on a line only the freeing
+ * thread writes.
+ *
+ * The slot is registered in `page->batch`, so that the owner takes
+ * the chain whenever it collects the frees of the page. A thread
+ * that frees and then blocks thus never keeps the blocks of a page
+ * from being reused or the page from being retired. The thread
+ * pushes the chain itself when the batch is full, when another page
+ * needs the slot, every so often from the generic malloc path, on
+ * `nt_collect` and when it is done.
+ * -----------------------------------------------------------
+ */
+
+/**
+ * @brief Pushes the chain from `first` of `count` blocks onto the `thread_free` list of `page`.
+ */
+static void nt_free_chain_push(nt_page_t* page, nt_block_t* first, nt_block_t* last, size_t count) {
+    while (true) {
+        uintptr_t tfree = nt_atomic_read(&page->thread_free.value);
+        if (nt_unlikely(nt_tf_delayed(tfree) == NT_USE_DELAYED_FREE)) {
+            //! the page is full, the first block tells its owner as a single free does
+            nt_block_t* block = first;
+            first = nt_block_next(page, block);
+            _nt_free_block_mt(page, block);
+            if (--count == 0) return;
+            continue;
+        }
+        nt_block_set_next(page, last, nt_tf_block(tfree));
+        if (nt_atomic_compare_exchange(&page->thread_free.value, nt_tf_make(first, nt_tf_delayed(tfree)), tfree)) break;
+    }
+    nt_atomic_add_uintptr(&page->thread_freed, count);
+}
+
+/**
+ * @brief Takes the chain of `batch` back from its page and pushes it, by the thread of the slot.
+ */
+static void nt_free_batch_push(nt_free_batch_t* batch, nt_stats_t* stats) {
+    UNUSED(stats);
+    size_t count = batch->count;
+    batch->count = 0;
+    nt_block_t* first = (nt_block_t*)nt_atomic_exchange(&batch->head, 0);
+    if (first == nullptr) return;   //! empty, or the owner took it
+    //! the blocks keep the page alive until they are pushed
+    nt_page_t* page = batch->page;
+    nt_atomic_compare_exchange_ptr((volatile void**)&page->batch, nullptr, batch);
+    nt_stat_counter_increase(stats->free_batches, count);
+    nt_free_chain_push(page, first, batch->last, count);
+}
+
+void _nt_free_batch_flush(nt_tld_t* tld) {
+    for (nt_free_batch_t& batch : tld->free_batch) {
+        if (batch.count != 0) nt_free_batch_push(&batch, &tld->stats);
+    }
+}
+
+void _nt_free_batch_steal(nt_page_t* page) {
+    nt_free_batch_t* batch = (nt_free_batch_t*)nt_atomic_read_ptr((volatile void**)&page->batch);
+    if (nt_likely(batch == nullptr)) return;
+    //! unregistered first: a block appended after the chain is taken sees it and is pushed by its thread
+    if (!nt_atomic_compare_exchange_ptr((volatile void**)&page->batch, nullptr, batch)) return;
+    nt_block_t* block = (nt_block_t*)nt_atomic_exchange(&batch->head, 0);
+    size_t count = 0;
+    while (block != nullptr) {
+        nt_page_t* bpage = _nt_ptr_page(block);
+        nt_block_t* next = nt_block_next(bpage, block);
+        if (bpage == page) {
+            nt_block_set_next(page, block, page->local_free);
+            page->local_free = block;
+            page->used--;
+            count++;
+        } else {
+            //! the slot moved on to another page after it was registered here
+            _nt_free_block_mt(bpage, block);
+        }
+        block = next;
+    }
+    if (count != 0) _nt_free_stat_collected(page, count);
+}
+
+/**
+ * @brief Holds back the free of `block` of a page of another thread.
+ *
+ * @return false if the block must be freed right away.
+ */
+static bool nt_free_batch_add(nt_heap_t* heap, nt_page_t* page, nt_block_t* block) {
+    if (!page->batch_free || page->block_size > NT_SMALL_SIZE_MAX) return false;
+    nt_tld_t* tld = heap->tld;
+    long limit = nt_option_get(NT_OPTION_FREE_BATCH);
+    if (limit <= 1 || tld->free_batch_done) return false;
+
+    //! pages are spread over the slots by their index in the segment and the segment
+    uintptr_t key = ((uintptr_t)page / sizeof(nt_page_t)) ^ ((uintptr_t)page >> NT_SEGMENT_SHIFT);
+    nt_free_batch_t* batch = &tld->free_batch[key % NT_FREE_BATCH_SLOTS];
+    if (batch->page != page) {
+        if (batch->count != 0) nt_free_batch_push(batch, &tld->stats);
+        batch->page = page;
+    }
+    if (nt_atomic_read_ptr((volatile void**)&page->batch) != batch) {
+        //! one batching thread per page, the owner only looks at one slot
+        if (!nt_atomic_compare_exchange_ptr((volatile void**)&page->batch, batch, nullptr)) return false;
+        //! a full page is only collected again after a delayed free, pairs with the fence in `nt_page_to_full`
+        nt_atomic_fence();
+        if (nt_tf_delayed(nt_atomic_read(&page->thread_free.value)) == NT_USE_DELAYED_FREE) {
+            nt_atomic_compare_exchange_ptr((volatile void**)&page->batch, nullptr, batch);
+            return false;
+        }
+    }
+
+    uintptr_t head = 0;
+    do {
+        head = nt_atomic_read(&batch->head);
+        nt_block_set_next(page, block, (nt_block_t*)head);
+    } while (!nt_atomic_compare_exchange(&batch->head, (uintptr_t)block, head));
+    //! the owner only ever takes the whole chain, a block on an empty one starts a new chain
+    if (head == 0) {
+        batch->last = block;
+        batch->count = 0;
+    }
+
+    //! the owner took the chain meanwhile and may not look again, so it must not wait here
+    if (++batch->count >= (size_t)limit || nt_atomic_read_ptr((volatile void**)&page->batch) != batch) {
+        nt_free_batch_push(batch, &tld->stats);
+    }
+    return true;
+}
+
+static void _nt_free_generic(const nt_segment_t* segment, nt_page_t* page, bool local, void* p) {
+    nt_block_t* block = (page->flags.has_aligned ? _nt_page_ptr_unalign(segment, page, p) : (nt_block_t*)p);
+    if (nt_unlikely(page->flags.has_sampled)) _nt_sample_free(block);
+    if (local) {
+        _nt_free_block_local(page, block);
+    } else {
+        nt_heap_t* heap = nt_get_default_heap();
+        if (nt_unlikely(!nt_heap_is_initialized(heap))) {
+            //! a thread that only frees, e.g. a consumer, needs its thread data to batch
+            nt_thread_init();
+            heap = nt_get_default_heap();
+        }
+#if NT_STAT
+        if (nt_unlikely(_nt_os_numa_node_count() > 1)) {
+            //! the node of the freeing thread as of its last segment, a system call per free would cost too much
+            if (nt_heap_is_initialized(heap) && heap->tld->os.numa_node != segment->numa_node) {
+                nt_stat_counter_increase(heap->tld->stats.numa_foreign_frees, page->block_size);
+            }
+        }
+#endif
+        if (!nt_heap_is_initialized(heap) || !nt_free_batch_add(heap, page, block)) _nt_free_block_mt(page, block);
+    }
+}
+
+void _nt_free_stat_collected(const nt_page_t* page, size_t count) {
+#if NT_STAT > 1
+    //! the pages of an exited thread have no heap, its statistics were merged into the process
+    nt_stats_t* stats = (page->heap != nullptr ? &page->heap->tld->stats : &_nt_stats_main);
+    if (page->block_size <= NT_LARGE_SIZE_MAX) nt_stat_decrease(stats->normal[_nt_bin(page->block_size)], count);
+    nt_stat_decrease(stats->malloc, count * page->block_size);
+#else
+    UNUSED(page);
+    UNUSED(count);
+#endif
+}
+
+bool _nt_free_delayed_block(nt_block_t* block) {
+    nt_segment_t* segment = _nt_ptr_segment(block);
+    nt_page_t* page = _nt_segment_page_of(segment, block);
+    nt_assert_internal(segment->thread_id == _nt_thread_id());
+    if (nt_tf_delayed(nt_atomic_read(&page->thread_free.value)) == NT_DELAYED_FREEING) return false;
+    //! take the other pending frees as well, so that `used` is up to date for retiring the page
+    _nt_page_free_collect(page);
+    _nt_free_stat_collected(page, 1);
+    _nt_free_block_local(page, block);
+    return true;
+}
+
+void nt_free(void* p) {
+    if (nt_unlikely(p == nullptr)) return;
+    const nt_segment_t* segment = _nt_ptr_segment(p);
+    nt_page_t* page = _nt_segment_page_of(segment, p);
+    bool local = (segment->thread_id == _nt_thread_id());
+
+#if NT_STAT > 1
+    //! counted against the owner, a free by another thread once the owner collects it
+    if (local) _nt_free_stat_collected(page, 1);
+#endif
+
+    //! the common case: a block of a page of this thread without special flags
+    if (nt_likely(local && page->flags.value == 0)) {
+        _nt_free_block_local(page, (nt_block_t*)p);
+    } else {
+        _nt_free_generic(segment, page, local, p);
+    }
+}
+
+void nt_free_size(void* p, size_t size) {
+    UNUSED(size);
+    nt_assert(p == nullptr || size <= nt_usable_size(p));
+    nt_free(p);
+}
+
+/**
+ * -----------------------------------------------------------
+ * Usable size and reallocation
+ * -----------------------------------------------------------
+ */
+
+size_t nt_usable_size(const void* p) {
+    if (p == nullptr) return 0;
+    const nt_segment_t* segment = _nt_ptr_segment(p);
+    const nt_page_t* page = _nt_segment_page_of(segment, p);
+    size_t size = page->block_size;
+    if (nt_unlikely(page->flags.has_aligned)) {
+        //! the part of the block after the aligned pointer
+        size -= (size_t)((const uint8_t*)p - (const uint8_t*)_nt_page_ptr_unalign(segment, page, p));
+    }
+    return size;
+}
+
+/**
+ * @brief Grows a huge block in place into the rest of its segment, the segment is sized in steps
+ * of 64kb (or 2mb huge OS pages) so there is often some room left.
+ */
+static bool nt_huge_block_expand(nt_heap_t* heap, void* p, size_t newsize) {
+    nt_segment_t* segment = _nt_ptr_segment(p);
+    nt_page_t* page = _nt_segment_page_of(segment, p);
+    //! only the owner changes `block_size`, which its retire path reads
+    if (segment->page_kind != NT_PAGE_HUGE || segment->thread_id != _nt_thread_id() || page->flags.has_aligned) return false;
+    size_t room = segment->segment_size - segment->segment_info_size;
+    size_t block_size = _nt_wsize_from_size(newsize) * sizeof(uintptr_t);
+    if (block_size > room) return false;
+    nt_stat_increase(heap->tld->stats.huge, block_size - page->block_size);
+#if NT_STAT > 1
+    nt_heap_stat_increase(heap, malloc, block_size - page->block_size);
+#endif
+    page->block_size = block_size;
+    return true;
+}
+
+void* nt_heap_realloc(nt_heap_t* heap, void* p, size_t newsize) {
+    if (p == nullptr) return nt_heap_malloc(heap, newsize);
+    size_t size = nt_usable_size(p);
+    //! in place when the block is large enough and would not waste more than half of it
+    if (newsize <= size && newsize >= size / 2) return p;
+    if (newsize > size && size > NT_LARGE_SIZE_MAX && nt_heap_is_initialized(heap) && nt_huge_block_expand(heap, p, newsize)) {
+        return p;
+    }
+
+    void* newp = nt_heap_malloc(heap, newsize);
+    if (nt_unlikely(newp == nullptr)) return nullptr;   //! `p` stays valid
+    memcpy(newp, p, (newsize < size ? newsize : size));
+    nt_free(p);
+    return newp;
+}
+
+void* nt_realloc(void* p, size_t newsize) {
+    return nt_heap_realloc(nt_get_default_heap(), p, newsize);
+}
+
+NT_NAMESPACE_END
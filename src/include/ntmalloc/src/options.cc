@@ -0,0 +1,61 @@
+#include "../ntmalloc.h"
+#include "../ntmalloc_internal.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+NT_NAMESPACE_BEGEN
+
+/**
+ * -----------------------------------------------------------
+ * Options
+ *
+ * Every option has a default, which the environment variable
+ * `NT_MALLOC_<NAME>` overrides on first use, and `nt_option_set`
+ * overrides both.
+ * -----------------------------------------------------------
+ */
+
+typedef struct nt_option_desc {
+    long        value;
+    bool        initialized;
+    const char* name;
+} nt_option_desc_t;
+
+static nt_option_desc_t nt_options[NT_OPTION_COUNT] = {
+    { 100, false, "PURGE_DELAY" },      //! NT_OPTION_PURGE_DELAY
+    { 0,   false, "SHOW_STATS" },       //! NT_OPTION_SHOW_STATS
+    { 0,   false, "LARGE_OS_PAGES" },   //! NT_OPTION_LARGE_OS_PAGES
+    { 0,   false, "SAMPLE_RATE" },      //! NT_OPTION_SAMPLE_RATE
+    { 1,   false, "USE_NUMA" },         //! NT_OPTION_USE_NUMA
+    { 32,  false, "FREE_BATCH" },       //! NT_OPTION_FREE_BATCH
+};
+
+static void nt_option_init(nt_option_desc_t* desc) {
+    //! no allocation here, options are read from inside the allocator
+    char name[64];
+    snprintf(name, sizeof(name), "NT_MALLOC_%s", desc->name);
+    const char* env = getenv(name);
+    if (env != nullptr && env[0] != '\0') {
+        char* end = nullptr;
+        long value = strtol(env, &end, 10);
+        if (end != env) desc->value = value;
+    }
+    desc->initialized = true;
+}
+
+long nt_option_get(nt_option_t option) {
+    if (option < 0 || option >= NT_OPTION_COUNT) return 0;
+    nt_option_desc_t* desc = &nt_options[option];
+    if (nt_unlikely(!desc->initialized)) nt_option_init(desc);
+    return desc->value;
+}
+
+void nt_option_set(nt_option_t option, long value) {
+    if (option < 0 || option >= NT_OPTION_COUNT) return;
+    nt_options[option].value = value;
+    nt_options[option].initialized = true;
+}
+
+NT_NAMESPACE_END
@@ -0,0 +1,343 @@
+#include "../ntmalloc.h"
+#include "../ntmalloc_atomic.h"
+#include "../ntmalloc_internal.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+NT_NAMESPACE_BEGEN
+
+static inline uintptr_t _nt_align_up(uintptr_t sz, size_t alignment) {
+    uintptr_t x = (sz / alignment) * alignment;
+    if (x < sz) x += alignment;
+    if (x < sz) return 0;   //! overflow
+    return x;
+}
+
+/**
+ * @brief The OS page size, the granularity of `mmap` and of the address hints.
+ */
+static size_t nt_os_page_size(void) {
+    static size_t page_size = 0;
+    if (page_size == 0) {
+        long result = sysconf(_SC_PAGESIZE);
+        page_size = (result > 0 ? (size_t)result : 4096);
+    }
+    return page_size;
+}
+
+static void* nt_mmap(void* addr, size_t size, nt_stats_t* stats) {
+    void* p = mmap(addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+    nt_trace(NT_TRACE_OS_ALLOC, p, size);
+    nt_stat_increase(stats->mmap_calls, 1);
+    nt_stat_increase(stats->reserved, size);
+    nt_stat_increase(stats->committed, size);
+    return p;
+}
+
+static void nt_munmap(void* p, size_t size, nt_stats_t* stats) {
+    if (p == nullptr || size == 0) return;
+    munmap(p, size);
+    nt_trace(NT_TRACE_OS_FREE, p, size);
+    nt_stat_decrease(stats->reserved, size);
+    nt_stat_decrease(stats->committed, size);
+}
+
+uint64_t _nt_clock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Tells the OS the contents of `[p, p + size)` are no longer needed, the range stays mapped
+ * and is backed by (zeroed) memory again on the next touch.
+ * 
+ * `MADV_FREE` lets the kernel take the pages lazily, under memory pressure only, which is cheap;
+ * kernels without it (before 4.5) get `MADV_DONTNEED`.
+ */
+bool _nt_os_reset(void* p, size_t size, nt_stats_t* stats) {
+    //! only whole OS pages inside the range can be reset
+    uintptr_t start = _nt_align_up((uintptr_t)p, nt_os_page_size());
+    uintptr_t end = ((uintptr_t)p + size) & ~(uintptr_t)(nt_os_page_size() - 1);
+    if (end <= start) return false;
+    size_t csize = end - start;
+
+    static int advice = MADV_FREE;
+    int err = madvise((void*)start, csize, advice);
+    if (err != 0 && errno == EINVAL && advice == MADV_FREE) {
+        advice = MADV_DONTNEED;
+        err = madvise((void*)start, csize, advice);
+    }
+    if (err != 0) return false;
+    nt_trace(NT_TRACE_OS_RESET, start, csize);
+    nt_stat_increase(stats->reset, csize);
+    nt_stat_decrease(stats->committed, csize);
+    return true;
+}
+
+void _nt_os_unreset(void* p, size_t size, nt_stats_t* stats) {
+    //! nothing to do for the OS, the memory comes back on the first touch
+    uintptr_t start = _nt_align_up((uintptr_t)p, nt_os_page_size());
+    uintptr_t end = ((uintptr_t)p + size) & ~(uintptr_t)(nt_os_page_size() - 1);
+    if (end <= start) return;
+    nt_stat_decrease(stats->reset, end - start);
+    nt_stat_increase(stats->committed, end - start);
+}
+
+void* _nt_os_alloc(size_t size, nt_stats_t* stats) {
+    if (size == 0) return nullptr;
+    return nt_mmap(nullptr, size, stats);
+}
+
+void _nt_os_free(void* p, size_t size, nt_stats_t* stats) {
+    nt_munmap(p, size, stats);
+}
+
+/**
+ * @brief Maps `size` bytes from hugetlbfs, which only works when the administrator reserved huge pages.
+ */
+static void* nt_mmap_hugetlb(void* addr, size_t size, nt_stats_t* stats) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_2MB
+    flags |= MAP_HUGE_2MB;
+#endif
+    void* p = mmap(addr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+    nt_trace(NT_TRACE_OS_ALLOC, p, size);
+    nt_stat_increase(stats->mmap_calls, 1);
+    nt_stat_increase(stats->reserved, size);
+    nt_stat_increase(stats->committed, size);
+    nt_stat_increase(stats->large_pages, size);
+    return p;
+}
+
+static void nt_munmap_hugetlb(void* p, size_t size, nt_stats_t* stats) {
+    nt_munmap(p, size, stats);
+    nt_stat_decrease(stats->large_pages, size);
+}
+
+static void* nt_mmap_kind(void* addr, size_t size, bool hugetlb, nt_stats_t* stats) {
+    return (hugetlb ? nt_mmap_hugetlb(addr, size, stats) : nt_mmap(addr, size, stats));
+}
+
+static void nt_munmap_kind(void* p, size_t size, bool hugetlb, nt_stats_t* stats) {
+    if (hugetlb) {
+        nt_munmap_hugetlb(p, size, stats);
+    } else {
+        nt_munmap(p, size, stats);
+    }
+}
+
+/**
+ * @brief The slow but guaranteed way: over-allocate by `alignment` and unmap
+ * the unaligned head and the tail again, which costs 3 system calls.
+ */
+static void* nt_os_alloc_aligned_ensured(size_t size, size_t alignment, bool hugetlb, nt_stats_t* stats) {
+    size_t over_size = size + alignment;
+    if (over_size < size) return nullptr;
+    uint8_t* p = (uint8_t*)nt_mmap_kind(nullptr, over_size, hugetlb, stats);
+    if (p == nullptr) return nullptr;
+
+    //! hugetlbfs mappings start on a huge page, so head and tail are whole huge pages as well
+    uint8_t* aligned = (uint8_t*)_nt_align_up((uintptr_t)p, alignment);
+    size_t pre_size = (size_t)(aligned - p);
+    size_t post_size = over_size - pre_size - size;
+    if (pre_size > 0) nt_munmap_kind(p, pre_size, hugetlb, stats);
+    if (post_size > 0) nt_munmap_kind(aligned + size, post_size, hugetlb, stats);
+    return aligned;
+}
+
+static void* nt_os_mmap_aligned(size_t size, size_t alignment, bool hugetlb, nt_os_tld_t* tld) {
+    //! consecutive mappings are usually placed right next to each other, so when the
+    //! next probable address is aligned, first try a plain `mmap` of `size` at that hint
+    uint8_t* p = nullptr;
+    if (tld->mmap_next_probable != 0 && (tld->mmap_next_probable % alignment) == 0) {
+        p = (uint8_t*)nt_mmap_kind((void*)tld->mmap_next_probable, size, hugetlb, tld->stats);
+        if (p != nullptr && ((uintptr_t)p % alignment) == 0) {
+            nt_stat_increase(tld->stats->mmap_right_align, 1);
+        } else if (p != nullptr) {
+            nt_munmap_kind(p, size, hugetlb, tld->stats);
+            p = nullptr;
+        }
+    }
+    if (p == nullptr) {
+        nt_stat_increase(tld->stats->mmap_ensure_aligned, 1);
+        p = (uint8_t*)nt_os_alloc_aligned_ensured(size, alignment, hugetlb, tld->stats);
+        if (p == nullptr) return nullptr;
+    }
+
+    //! the mmap area of Linux grows downwards, so the next mapping most likely ends at `p`
+    uintptr_t next = ((uintptr_t)p > size ? (uintptr_t)p - size : 0);
+    tld->mmap_next_probable = _nt_align_up(next, nt_os_page_size());
+    tld->mmap_previous = p;
+    return p;
+}
+
+/**
+ * -----------------------------------------------------------
+ * Large OS pages
+ *
+ * With `NT_OPTION_LARGE_OS_PAGES` segments are backed by 2mb
+ * pages, which saves most dTLB misses of programs touching many
+ * buffers. Mode 2 first tries hugetlbfs, which fails unless huge
+ * pages were reserved (`vm.nr_hugepages`), and then falls back to
+ * advising transparent huge pages like mode 1. Segments are
+ * aligned to `NT_SEGMENT_SIZE`, a multiple of the huge page size.
+ * -----------------------------------------------------------
+ */
+
+/**
+ * @brief After hugetlbfs failed, this many allocations skip it before it is tried again.
+ */
+constexpr const uintptr_t NT_HUGETLB_RETRY = 64;
+
+static volatile uintptr_t nt_hugetlb_skip = 0;
+
+static bool nt_os_use_hugetlb(void) {
+    if (nt_atomic_read(&nt_hugetlb_skip) == 0) return true;
+    nt_atomic_decrement(&nt_hugetlb_skip);
+    return false;
+}
+
+/**
+ * -----------------------------------------------------------
+ * NUMA placement
+ *
+ * On machines with several nodes every segment is bound to the
+ * node of the thread allocating it (`MPOL_PREFERRED`, so it still
+ * falls back to other nodes when the preferred one is full). The
+ * system calls are made directly so no `libnuma` is needed, and
+ * nothing is done at all on single node machines.
+ * -----------------------------------------------------------
+ */
+
+constexpr const int NT_MPOL_PREFERRED = 1;      //! from <linux/mempolicy.h>
+constexpr const int NT_NUMA_MAX_NODES = 1024;
+
+static int nt_numa_node_count = 0;
+
+int _nt_os_numa_parse_nodes(const char* list) {
+    long max = -1;
+    long nodes = 0;
+    const char* p = list;
+    while (*p >= '0' && *p <= '9') {
+        char* end = nullptr;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            if (*p < '0' || *p > '9') return 1;
+            last = strtol(p, &end, 10);
+        }
+        if (last < first || last >= NT_NUMA_MAX_NODES) return 1;
+        nodes += last - first + 1;
+        if (last > max) max = last;
+        p = (*end == ',' ? end + 1 : end);
+    }
+    //! ids are kept as they are, so that a node maps to its own bit in the `mbind` mask
+    return (nodes <= 1 ? 1 : (int)max + 1);
+}
+
+int _nt_os_numa_node_count(void) {
+    if (nt_likely(nt_numa_node_count != 0)) return nt_numa_node_count;
+    //! the nodes online right now, `possible` also lists empty hotplug slots
+    int count = 1;
+    int fd = open("/sys/devices/system/node/online", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        char buf[1024];
+        ssize_t len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (len > 0) {
+            buf[len] = '\0';
+            count = _nt_os_numa_parse_nodes(buf);
+        }
+    }
+    if (nt_option_get(NT_OPTION_USE_NUMA) <= 0) count = 1;
+    nt_numa_node_count = count;
+    return count;
+}
+
+int _nt_os_numa_node(void) {
+    if (nt_likely(_nt_os_numa_node_count() <= 1)) return 0;
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) return 0;
+    return ((int)node < _nt_os_numa_node_count() ? (int)node : 0);
+}
+
+/**
+ * @brief Prefers the pages of a fresh mapping on `node` once they are touched.
+ */
+static void nt_os_numa_bind(void* p, size_t size, int node) {
+    if (_nt_os_numa_node_count() <= 1) return;
+    unsigned long mask[NT_NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+    mask[(size_t)node / (8 * sizeof(unsigned long))] = 1UL << ((size_t)node % (8 * sizeof(unsigned long)));
+    //! the mask holds `maxnode - 1` bits
+    static_cast<void>(syscall(SYS_mbind, p, size, NT_MPOL_PREFERRED, mask, (unsigned long)_nt_os_numa_node_count() + 1, 0));
+}
+
+static void* nt_os_alloc_aligned_kind(size_t size, size_t alignment, nt_os_mem_kind_t* kind, nt_os_tld_t* tld) {
+    *kind = NT_OS_MEM_NORMAL;
+    if (size == 0) return nullptr;
+    if (alignment <= nt_os_page_size()) return _nt_os_alloc(size, tld->stats);
+
+    long large = nt_option_get(NT_OPTION_LARGE_OS_PAGES);
+    if (large <= 0 || (size % NT_LARGE_OS_PAGE_SIZE) != 0 || (alignment % NT_LARGE_OS_PAGE_SIZE) != 0) {
+        return nt_os_mmap_aligned(size, alignment, false, tld);
+    }
+
+    if (large >= 2 && nt_os_use_hugetlb()) {
+        void* p = nt_os_mmap_aligned(size, alignment, true, tld);
+        if (p != nullptr) {
+            *kind = NT_OS_MEM_HUGETLB;
+            return p;
+        }
+        nt_atomic_exchange(&nt_hugetlb_skip, NT_HUGETLB_RETRY);
+    }
+
+    void* p = nt_os_mmap_aligned(size, alignment, false, tld);
+    if (p == nullptr) return nullptr;
+    if (madvise(p, size, MADV_HUGEPAGE) == 0) {
+        *kind = NT_OS_MEM_THP;
+        nt_stat_increase(tld->stats->thp_advised, size);
+    }
+    return p;
+}
+
+void* _nt_os_alloc_aligned(size_t size, size_t alignment, nt_os_mem_kind_t* kind, nt_os_tld_t* tld) {
+    void* p = nt_os_alloc_aligned_kind(size, alignment, kind, tld);
+    //! nothing was touched yet, so all pages follow the policy
+    if (p != nullptr) nt_os_numa_bind(p, size, tld->numa_node);
+    return p;
+}
+
+void _nt_os_free_aligned(void* p, size_t size, nt_os_mem_kind_t kind, nt_stats_t* stats) {
+    nt_munmap_kind(p, size, kind == NT_OS_MEM_HUGETLB, stats);
+    if (kind == NT_OS_MEM_THP) nt_stat_decrease(stats->thp_advised, size);
+}
+
+int64_t _nt_os_thp_backed(void) {
+    //! a single line `AnonHugePages:  <n> kB` in the summary of all mappings (Linux 4.14)
+    int fd = open("/proc/self/smaps_rollup", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    char buf[2048];
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) return -1;
+    buf[len] = '\0';
+    const char* line = strstr(buf, "AnonHugePages:");
+    if (line == nullptr) return -1;
+    return (int64_t)strtoll(line + sizeof("AnonHugePages:") - 1, nullptr, 10) * 1024;
+}
+
+NT_NAMESPACE_END
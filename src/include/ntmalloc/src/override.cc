@@ -0,0 +1,180 @@
+/**
+ * @file override.cc
+ * @brief Replaces the malloc API of the C library and the C++ allocation operators with ntmalloc.
+ *
+ * Only compiled into `ntmalloc_shared` (with `NT_MALLOC_OVERRIDE`), so that existing binaries
+ * run on ntmalloc with `LD_PRELOAD=libntmalloc.so`. Nothing here needs initialization: the first
+ * allocation of a thread takes the generic path, which sets up the process and the thread
+ * without allocating itself, using `_nt_heap_main` for the main thread and OS memory for others.
+ */
+
+#include "../ntmalloc.h"
+#include "../ntmalloc_internal.h"
+
+#if defined (NT_MALLOC_OVERRIDE)
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <unistd.h>
+
+NT_NAMESPACE_BEGEN
+
+/**
+ * @brief `posix_memalign` also requires the alignment to be a multiple of the pointer size.
+ */
+static int nt_posix_memalign(void** p, size_t alignment, size_t size) {
+    if (p == nullptr) return EINVAL;
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+    void* q = nt_malloc_aligned(size, alignment);
+    if (q == nullptr && size != 0) return ENOMEM;
+    *p = q;
+    return 0;
+}
+
+static size_t nt_os_page(void) {
+    static size_t page_size = 0;
+    if (page_size == 0) {
+        long result = sysconf(_SC_PAGESIZE);
+        page_size = (result > 0 ? (size_t)result : 4096);
+    }
+    return page_size;
+}
+
+static void* nt_reallocarray(void* p, size_t count, size_t size) {
+    size_t total = 0;
+    if (__builtin_mul_overflow(count, size, &total)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return nt_realloc(p, total);
+}
+
+/**
+ * @brief `operator new` does not return nullptr: it calls the new handler until the allocation
+ * succeeds, and throws `std::bad_alloc` when there is none.
+ */
+static void* nt_new_slow(size_t size, size_t alignment, bool nothrow) {
+    while (true) {
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            if (nothrow) return nullptr;
+            throw std::bad_alloc();
+        }
+        if (nothrow) {
+            try {
+                handler();
+            } catch (...) {
+                return nullptr;
+            }
+        } else {
+            handler();
+        }
+        void* p = (alignment == 0 ? nt_malloc(size) : nt_malloc_aligned(size, alignment));
+        if (p != nullptr) return p;
+    }
+}
+
+static inline void* nt_new(size_t size) {
+    void* p = nt_malloc(size);
+    return (nt_likely(p != nullptr) ? p : nt_new_slow(size, 0, false));
+}
+
+static inline void* nt_new_nothrow(size_t size) noexcept {
+    void* p = nt_malloc(size);
+    return (nt_likely(p != nullptr) ? p : nt_new_slow(size, 0, true));
+}
+
+static inline void* nt_new_aligned(size_t size, size_t alignment) {
+    void* p = nt_malloc_aligned(size, alignment);
+    return (nt_likely(p != nullptr) ? p : nt_new_slow(size, alignment, false));
+}
+
+static inline void* nt_new_aligned_nothrow(size_t size, size_t alignment) noexcept {
+    void* p = nt_malloc_aligned(size, alignment);
+    return (nt_likely(p != nullptr) ? p : nt_new_slow(size, alignment, true));
+}
+
+NT_NAMESPACE_END
+
+/**
+ * -----------------------------------------------------------
+ * The C library
+ *
+ * The `__libc_` names are what glibc itself and some programs
+ * call directly, they must not reach the glibc allocator either.
+ * -----------------------------------------------------------
+ */
+
+extern "C" {
+
+nt_export(void*) malloc(size_t size) noexcept                           { return nt::nt_malloc(size); }
+nt_export(void*) calloc(size_t count, size_t size) noexcept             { return nt::nt_calloc(count, size); }
+nt_export(void*) realloc(void* p, size_t newsize) noexcept              { return nt::nt_realloc(p, newsize); }
+nt_export(void) free(void* p) noexcept                                  { nt::nt_free(p); }
+nt_export(void) cfree(void* p) noexcept                                 { nt::nt_free(p); }
+nt_export(void*) reallocarray(void* p, size_t count, size_t size) noexcept { return nt::nt_reallocarray(p, count, size); }
+nt_export(size_t) malloc_usable_size(void* p) noexcept                  { return nt::nt_usable_size(p); }
+
+nt_export(int) posix_memalign(void** p, size_t alignment, size_t size) noexcept { return nt::nt_posix_memalign(p, alignment, size); }
+nt_export(void*) memalign(size_t alignment, size_t size) noexcept       { return nt::nt_malloc_aligned(size, alignment); }
+nt_export(void*) aligned_alloc(size_t alignment, size_t size) noexcept  { return nt::nt_aligned_alloc(alignment, size); }
+nt_export(void*) valloc(size_t size) noexcept                           { return nt::nt_malloc_aligned(size, nt::nt_os_page()); }
+nt_export(void*) pvalloc(size_t size) noexcept {
+    size_t page_size = nt::nt_os_page();
+    size_t psize = (size + page_size - 1) & ~(page_size - 1);
+    if (psize < size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return nt::nt_malloc_aligned(psize, page_size);
+}
+
+nt_export(void*) __libc_malloc(size_t size) noexcept                    { return nt::nt_malloc(size); }
+nt_export(void*) __libc_calloc(size_t count, size_t size) noexcept      { return nt::nt_calloc(count, size); }
+nt_export(void*) __libc_realloc(void* p, size_t newsize) noexcept       { return nt::nt_realloc(p, newsize); }
+nt_export(void) __libc_free(void* p) noexcept                           { nt::nt_free(p); }
+nt_export(void*) __libc_memalign(size_t alignment, size_t size) noexcept { return nt::nt_malloc_aligned(size, alignment); }
+nt_export(void*) __libc_valloc(size_t size) noexcept                    { return valloc(size); }
+nt_export(void*) __libc_pvalloc(size_t size) noexcept                   { return pvalloc(size); }
+nt_export(int) __posix_memalign(void** p, size_t alignment, size_t size) noexcept { return nt::nt_posix_memalign(p, alignment, size); }
+
+}
+
+/**
+ * -----------------------------------------------------------
+ * C++ operators, including the sized and aligned (C++17) ones
+ * -----------------------------------------------------------
+ */
+
+nt_export(void*) operator new(size_t size)                                      { return nt::nt_new(size); }
+nt_export(void*) operator new[](size_t size)                                    { return nt::nt_new(size); }
+nt_export(void*) operator new(size_t size, const std::nothrow_t&) noexcept      { return nt::nt_new_nothrow(size); }
+nt_export(void*) operator new[](size_t size, const std::nothrow_t&) noexcept    { return nt::nt_new_nothrow(size); }
+
+nt_export(void) operator delete(void* p) noexcept                               { nt::nt_free(p); }
+nt_export(void) operator delete[](void* p) noexcept                             { nt::nt_free(p); }
+nt_export(void) operator delete(void* p, const std::nothrow_t&) noexcept        { nt::nt_free(p); }
+nt_export(void) operator delete[](void* p, const std::nothrow_t&) noexcept      { nt::nt_free(p); }
+nt_export(void) operator delete(void* p, size_t size) noexcept                  { nt::nt_free_size(p, size); }
+nt_export(void) operator delete[](void* p, size_t size) noexcept                { nt::nt_free_size(p, size); }
+
+nt_export(void*) operator new(size_t size, std::align_val_t alignment)          { return nt::nt_new_aligned(size, (size_t)alignment); }
+nt_export(void*) operator new[](size_t size, std::align_val_t alignment)        { return nt::nt_new_aligned(size, (size_t)alignment); }
+nt_export(void*) operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return nt::nt_new_aligned_nothrow(size, (size_t)alignment);
+}
+nt_export(void*) operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return nt::nt_new_aligned_nothrow(size, (size_t)alignment);
+}
+
+//! aligned blocks are found back from any pointer into them, the alignment is not needed to free
+nt_export(void) operator delete(void* p, std::align_val_t) noexcept                              { nt::nt_free(p); }
+nt_export(void) operator delete[](void* p, std::align_val_t) noexcept                            { nt::nt_free(p); }
+nt_export(void) operator delete(void* p, size_t size, std::align_val_t) noexcept                 { nt::nt_free_size(p, size); }
+nt_export(void) operator delete[](void* p, size_t size, std::align_val_t) noexcept               { nt::nt_free_size(p, size); }
+nt_export(void) operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept       { nt::nt_free(p); }
+nt_export(void) operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept     { nt::nt_free(p); }
+
+#endif //! NT_MALLOC_OVERRIDE
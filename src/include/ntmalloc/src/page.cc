@@ -1,24 +1,644 @@
 #include "../ntmalloc.h"
+#include "../ntmalloc_atomic.h"
 #include "../ntmalloc_internal.h"
+#include <cerrno>
 #include <cstddef>
-#include <string>
-
-extern std::string stack_path;
+#include <cstdint>
 
 NT_NAMESPACE_BEGEN
 
+/**
+ * -----------------------------------------------------------
+ * Page free lists
+ * -----------------------------------------------------------
+ */
+
+/**
+ * @brief A fresh page is threaded at most this many bytes at a time, so that
+ * the OS only has to back the part of the page that is actually used.
+ */
+constexpr const size_t NT_MAX_EXTEND_SIZE = 4 * 1024;
+
+/**
+ * @brief The generic path checks for expired purges once every this many calls.
+ */
+constexpr const size_t NT_PURGE_INTERVAL = 16;
+
+/**
+ * @brief Takes the blocks freed by other threads, all at once, onto `local_free`.
+ */
+static void nt_page_thread_free_collect(nt_page_t* page) {
+    _nt_free_batch_steal(page);
+    uintptr_t tfree = 0;
+    uintptr_t tfreex = 0;
+    nt_block_t* head = nullptr;
+    do {
+        tfree = nt_atomic_read(&page->thread_free.value);
+        head = nt_tf_block(tfree);
+        if (head == nullptr) return;
+        tfreex = nt_tf_make(nullptr, nt_tf_delayed(tfree));
+    } while (!nt_atomic_compare_exchange(&page->thread_free.value, tfreex, tfree));
+
+    size_t count = 1;
+    nt_block_t* tail = head;
+    nt_block_t* next = nullptr;
+    while ((next = nt_block_next(page, tail)) != nullptr) {
+        count++;
+        tail = next;
+    }
+    nt_block_set_next(page, tail, page->local_free);
+    page->local_free = head;
+
+    nt_atomic_subtract(&page->thread_freed, count);
+    page->used -= count;
+    _nt_free_stat_collected(page, count);
+}
+
+void _nt_page_free_collect(nt_page_t* page) {
+    nt_page_thread_free_collect(page);
+
+    //! `local_free` only becomes available once `free` is exhausted, which gives
+    //! the generic path a regular heartbeat
+    if (page->free == nullptr && page->local_free != nullptr) {
+        page->free = page->local_free;
+        page->local_free = nullptr;
+        page->is_zero = false;
+    }
+}
+
+/**
+ * @brief A batch is threaded through at most this many runs of consecutive blocks.
+ */
+constexpr const size_t NT_EXTEND_SLICES_SHIFT = 3;
+
+/**
+ * @brief A run of a batch spans at least this many bytes, so a run is a few whole cache lines.
+ */
+constexpr const size_t NT_EXTEND_SLICE_MIN = 256;
+
+/**
+ * @brief Threads `extend` blocks starting at `first` in address order.
+ */
+static nt_block_t* nt_page_free_list_sequential(const nt_page_t* page, uint8_t* first, size_t bsize, size_t extend) {
+    nt_block_t* block = (nt_block_t*)first;
+    for (size_t i = 1; i < extend; i++) {
+        nt_block_t* next = (nt_block_t*)((uint8_t*)block + bsize);
+        nt_block_set_next(page, block, next);
+        block = next;
+    }
+    nt_block_set_next(page, block, nullptr);
+    return (nt_block_t*)first;
+}
+
+/**
+ * @brief Threads `extend` blocks starting at `first` in a random order that stays cache friendly.
+ *
+ * The batch is cut into up to 8 runs of consecutive blocks, and the list jumps to a
+ * random run at every block while each run is walked in address order. Consecutive
+ * allocations are thus hard to predict, yet every cache line and OS page of a run is
+ * still touched in order. It takes one store per block, as the sequential list does,
+ * and one random number per `NT_INTPTR_SIZE` blocks.
+ */
+static nt_block_t* nt_page_free_list_random(nt_heap_t* heap, const nt_page_t* page, uint8_t* first, size_t bsize, size_t extend) {
+    size_t shift = NT_EXTEND_SLICES_SHIFT;
+    while (shift > 0 && (extend >> shift) * bsize < NT_EXTEND_SLICE_MIN) shift--;
+    if (shift == 0) return nt_page_free_list_sequential(page, first, bsize, extend);
+
+    size_t slices = (size_t)1 << shift;
+    size_t slice_extend = extend >> shift;
+    uint8_t* next_block[(size_t)1 << NT_EXTEND_SLICES_SHIFT];
+    size_t left[(size_t)1 << NT_EXTEND_SLICES_SHIFT];
+    for (size_t i = 0; i < slices; i++) {
+        next_block[i] = first + i * slice_extend * bsize;
+        left[i] = slice_extend;
+    }
+    left[slices - 1] += extend - (slice_extend << shift);   //! the remainder goes to the last run
+
+    uintptr_t rnd = _nt_heap_random_next(heap);
+    size_t current = rnd & (slices - 1);
+    nt_block_t* head = (nt_block_t*)next_block[current];
+    left[current]--;
+    for (size_t i = 1; i < extend; i++) {
+        //! a byte of the random word per block
+        size_t round = i % NT_INTPTR_SIZE;
+        if (round == 0) rnd = _nt_random_shuffle(rnd);
+        size_t next = (rnd >> (8 * round)) & (slices - 1);
+        while (left[next] == 0) next = (next + 1) & (slices - 1);
+        left[next]--;
+        nt_block_t* block = (nt_block_t*)next_block[current];
+        next_block[current] += bsize;
+        nt_block_set_next(page, block, (nt_block_t*)next_block[next]);
+        current = next;
+    }
+    nt_block_set_next(page, (nt_block_t*)next_block[current], nullptr);
+    return head;
+}
+
+/**
+ * @brief Threads the next batch of never used blocks of `page` onto its free list.
+ *
+ * A fresh page is extended at most `NT_MAX_EXTEND_SIZE` bytes at a time, so the
+ * part of a page that a sparse size class never reaches is never touched.
+ */
+static void nt_page_extend_free(nt_heap_t* heap, nt_page_t* page) {
+    nt_assert_internal(page->free == nullptr);
+    if (page->capacity >= page->reserved) return;
+
+    size_t page_size = 0;
+    uint8_t* start = _nt_segment_page_start(_nt_page_segment(page), page, &page_size);
+    size_t bsize = page->block_size;
+
+    size_t extend = page->reserved - page->capacity;
+    size_t max_extend = NT_MAX_EXTEND_SIZE / bsize;
+    if (max_extend == 0) max_extend = 1;
+    if (extend > max_extend) extend = max_extend;
+
+    page->free = nt_page_free_list_random(heap, page, start + page->capacity * bsize, bsize, extend);
+    page->is_zero = page->is_zero_init;
+    page->capacity += (uint16_t)extend;
+    nt_stat_increase(heap->tld->stats.pages_extended, 1);
+}
+
+static inline bool nt_page_immediate_available(const nt_page_t* page) {
+    return (page->free != nullptr);
+}
+
+static void nt_page_init(nt_heap_t* heap, nt_page_t* page, size_t block_size) {
+    size_t page_size = 0;
+    _nt_segment_page_start(_nt_page_segment(page), page, &page_size);
+    page->block_size = block_size;
+    page->reserved = (uint16_t)(page_size / block_size);
+    page->cookie = heap->random | 1;
+    page->heap = heap;
+    page->batch_free = (heap == heap->tld->heap_backing);
+    nt_page_extend_free(heap, page);
+}
+
+/**
+ * -----------------------------------------------------------
+ * Page queues
+ *
+ * Every bin of a heap has a queue of pages, pages without free
+ * blocks are parked in the `NT_BIN_FULL` queue so they are not
+ * visited on every search. The first page of the queue of a small
+ * bin is mirrored in `pages_free_direct` for every word size that
+ * maps to that bin.
+ * -----------------------------------------------------------
+ */
+
+static inline bool nt_page_queue_is_full(const nt_heap_t* heap, const nt_page_queue_t* pq) {
+    return (pq == &heap->pages[NT_BIN_FULL]);
+}
+
+static inline nt_page_queue_t* nt_heap_page_queue_of(nt_heap_t* heap, const nt_page_t* page) {
+    uint8_t bin = (page->flags.is_full ? NT_BIN_FULL : _nt_bin(page->block_size));
+    return &heap->pages[bin];
+}
+
+static inline nt_page_queue_t* nt_page_queue(nt_heap_t* heap, size_t size) {
+    return &heap->pages[_nt_bin(size)];
+}
+
+/**
+ * @brief Points the `pages_free_direct` entries of all word sizes of the bin of `pq` to its first page.
+ */
+static void nt_heap_queue_first_update(nt_heap_t* heap, const nt_page_queue_t* pq) {
+    size_t size = pq->block_size;
+    if (size > NT_SMALL_SIZE_MAX) return;
+    nt_page_t* page = (pq->first != nullptr ? pq->first : (nt_page_t*)&_nt_page_empty);
+
+    size_t idx = _nt_wsize_from_size(size);
+    nt_page_t** pages_free = heap->pages_free_direct;
+    if (pages_free[idx] == page) return;   //! already set
+
+    //! the word sizes after the previous bin up to this one
+    size_t start = 0;
+    if (idx > 1) {
+        uint8_t bin = _nt_bin(size);
+        const nt_page_queue_t* prev = pq - 1;
+        while (bin == _nt_bin(prev->block_size) && prev > &heap->pages[0]) prev--;
+        start = 1 + _nt_wsize_from_size(prev->block_size);
+        if (start > idx) start = idx;
+    }
+    for (size_t sz = start; sz <= idx; sz++) pages_free[sz] = page;
+}
+
+static void nt_page_queue_remove(nt_heap_t* heap, nt_page_queue_t* pq, nt_page_t* page) {
+    if (page->prev != nullptr) page->prev->next = page->next;
+    if (page->next != nullptr) page->next->prev = page->prev;
+    if (page == pq->last) pq->last = page->prev;
+    if (page == pq->first) {
+        pq->first = page->next;
+        nt_heap_queue_first_update(heap, pq);
+    }
+    heap->page_count--;
+    page->next = nullptr;
+    page->prev = nullptr;
+    page->heap = nullptr;
+    page->flags.is_full = false;
+}
+
+static void nt_page_queue_push(nt_heap_t* heap, nt_page_queue_t* pq, nt_page_t* page) {
+    page->flags.is_full = nt_page_queue_is_full(heap, pq);
+    page->heap = heap;
+    page->next = pq->first;
+    page->prev = nullptr;
+    if (pq->first != nullptr) {
+        pq->first->prev = page;
+        pq->first = page;
+    } else {
+        pq->first = pq->last = page;
+    }
+    nt_heap_queue_first_update(heap, pq);
+    heap->page_count++;
+}
+
+/**
+ * @brief Moves `page` from queue `from` to the end of queue `to`.
+ */
+static void nt_page_queue_enqueue_from(nt_heap_t* heap, nt_page_queue_t* to, nt_page_queue_t* from, nt_page_t* page) {
+    if (page->prev != nullptr) page->prev->next = page->next;
+    if (page->next != nullptr) page->next->prev = page->prev;
+    if (page == from->last) from->last = page->prev;
+    if (page == from->first) {
+        from->first = page->next;
+        nt_heap_queue_first_update(heap, from);
+    }
+
+    page->prev = to->last;
+    page->next = nullptr;
+    if (to->last != nullptr) {
+        to->last->next = page;
+        to->last = page;
+    } else {
+        to->first = to->last = page;
+        nt_heap_queue_first_update(heap, to);
+    }
+    page->flags.is_full = nt_page_queue_is_full(heap, to);
+}
+
+static void nt_page_queue_move_to_front(nt_heap_t* heap, nt_page_queue_t* pq, nt_page_t* page) {
+    if (pq->first == page) return;
+    nt_page_queue_remove(heap, pq, page);
+    nt_page_queue_push(heap, pq, page);
+}
+
+/**
+ * -----------------------------------------------------------
+ * Full pages and delayed free
+ *
+ * Frees of other threads to a full page are handed to the heap
+ * (`thread_delayed_free`) rather than the page, so that the owner
+ * notices the page has room again and moves it out of the full queue.
+ *
+ * A huge page holds a single block, so it is always full: the free
+ * by another thread hands the block to the heap as well, and the
+ * owner retires the page the next time it takes `thread_delayed_free`.
+ * -----------------------------------------------------------
+ */
+
+void _nt_page_use_delayed_free(nt_page_t* page, nt_delayed_t delay) {
+    uintptr_t tfree = 0;
+    uintptr_t tfreex = 0;
+    do {
+        tfree = nt_atomic_read(&page->thread_free.value);
+        if (nt_unlikely(nt_tf_delayed(tfree) == NT_DELAYED_FREEING)) {
+            //! another thread is adding a block to the heap, wait until it is done
+            nt_atomic_yield();
+            continue;
+        }
+        if (nt_tf_delayed(tfree) == delay) return;
+        tfreex = nt_tf_make(nt_tf_block(tfree), delay);
+        if (nt_atomic_compare_exchange(&page->thread_free.value, tfreex, tfree)) return;
+    } while (true);
+}
+
+static void nt_page_to_full(nt_heap_t* heap, nt_page_t* page, nt_page_queue_t* pq) {
+    _nt_page_use_delayed_free(page, NT_USE_DELAYED_FREE);
+    if (page->flags.is_full) return;
+    nt_trace(NT_TRACE_PAGE_FULL, page, page->block_size);
+    nt_page_queue_enqueue_from(heap, &heap->pages[NT_BIN_FULL], pq, page);
+    //! another thread may have freed a block, or registered a batch, just before the delayed free was set
+    nt_atomic_fence();
+    _nt_page_free_collect(page);
+    if (nt_page_immediate_available(page)) _nt_page_unfull(page);
+}
+
+/**
+ * @brief Hands the free of the block of huge `page` to its heap from now on, and collects one that came earlier.
+ */
+static void nt_huge_page_use_delayed_free(nt_page_t* page) {
+    _nt_page_use_delayed_free(page, NT_USE_DELAYED_FREE);
+    //! the block may have been freed just before the delayed free was set, as in `nt_page_to_full`
+    nt_atomic_fence();
+    _nt_page_free_collect(page);
+}
+
+void _nt_page_unfull(nt_page_t* page) {
+    nt_assert_internal(page->flags.is_full);
+    _nt_page_use_delayed_free(page, NT_NO_DELAYED_FREE);
+    if (!page->flags.is_full) return;
+    nt_heap_t* heap = page->heap;
+    nt_page_queue_t* pq = &heap->pages[_nt_bin(page->block_size)];
+    nt_trace(NT_TRACE_PAGE_UNFULL, page, page->block_size);
+    nt_page_queue_enqueue_from(heap, pq, &heap->pages[NT_BIN_FULL], page);
+}
+
+void _nt_heap_delayed_free(nt_heap_t* heap) {
+    //! take over the whole list
+    nt_block_t* block = nullptr;
+    do {
+        block = (nt_block_t*)nt_atomic_read_ptr((volatile void**)&heap->thread_delayed_free);
+    } while (block != nullptr && !nt_atomic_compare_exchange_ptr((volatile void**)&heap->thread_delayed_free, nullptr, block));
+
+    if (block != nullptr) nt_trace(NT_TRACE_DELAYED_FREE, heap, block);
+    while (block != nullptr) {
+        nt_block_t* next = (nt_block_t*)block->next;
+        if (!_nt_free_delayed_block(block)) {
+            //! the freeing thread has not yet reset `NT_DELAYED_FREEING`, put it back for the next round
+            nt_block_t* dfree = nullptr;
+            do {
+                dfree = (nt_block_t*)nt_atomic_read_ptr((volatile void**)&heap->thread_delayed_free);
+                block->next = (nt_block_t::nt_encode_t)dfree;
+            } while (!nt_atomic_compare_exchange_ptr((volatile void**)&heap->thread_delayed_free, block, dfree));
+        }
+        block = next;
+    }
+}
+
+/**
+ * -----------------------------------------------------------
+ * Abandoned pages
+ * -----------------------------------------------------------
+ */
+
+void _nt_page_reclaim(nt_heap_t* heap, nt_page_t* page) {
+    nt_assert_internal(page->heap == nullptr);
+    //! frees into the page go through the full queue protocol again
+    nt_page_queue_push(heap, nt_page_queue(heap, page->block_size), page);
+    if (page->block_size > NT_LARGE_SIZE_MAX) {
+        //! the caller retires the page when its block was freed meanwhile
+        nt_huge_page_use_delayed_free(page);
+    } else {
+        _nt_page_use_delayed_free(page, NT_NO_DELAYED_FREE);
+    }
+}
+
+void _nt_heap_collect_abandon(nt_heap_t* heap) {
+    //! no more frees may go to `thread_delayed_free` once this heap is gone
+    _nt_heap_delayed_free(heap);
+    for (size_t i = 0; i <= NT_BIN_FULL; i++) {
+        for (nt_page_t* page = heap->pages[i].first; page != nullptr; page = page->next) {
+            _nt_page_use_delayed_free(page, NT_NEVER_DELAYED_FREE);
+        }
+    }
+    //! blocks handed over before the pages were switched
+    _nt_heap_delayed_free(heap);
+
+    for (size_t i = 0; i <= NT_BIN_FULL; i++) {
+        nt_page_queue_t* pq = &heap->pages[i];
+        nt_page_t* page = nullptr;
+        while ((page = pq->first) != nullptr) {
+            _nt_page_free_collect(page);
+            bool is_huge = (page->block_size > NT_LARGE_SIZE_MAX);
+            nt_page_queue_remove(heap, pq, page);
+            if (page->used == 0) {
+                if (is_huge) nt_stat_decrease(heap->tld->stats.huge, page->block_size);
+                _nt_segment_page_free(page, &heap->tld->segments);
+            } else {
+                _nt_segment_page_abandon(page, &heap->tld->segments);
+            }
+        }
+    }
+}
+
+/**
+ * -----------------------------------------------------------
+ * Heaps of the same thread
+ * -----------------------------------------------------------
+ */
+
+/**
+ * @brief Stops other threads handing blocks to `heap->thread_delayed_free` and frees those already there,
+ * frees go to the `thread_free` list of their page from then on.
+ */
+static void nt_heap_delayed_free_stop(nt_heap_t* heap) {
+    for (size_t i = 0; i <= NT_BIN_FULL; i++) {
+        for (nt_page_t* page = heap->pages[i].first; page != nullptr; page = page->next) {
+            _nt_page_use_delayed_free(page, NT_NEVER_DELAYED_FREE);
+        }
+    }
+    _nt_heap_delayed_free(heap);
+}
+
+void _nt_heap_absorb(nt_heap_t* heap, nt_heap_t* from) {
+    nt_heap_delayed_free_stop(from);
+    for (size_t i = 0; i <= NT_BIN_FULL; i++) {
+        nt_page_queue_t* pq = &from->pages[i];
+        nt_page_t* page = nullptr;
+        while ((page = pq->first) != nullptr) {
+            nt_page_queue_remove(from, pq, page);
+            //! full pages go to the queue of their size, the next search parks them again
+            nt_page_queue_push(heap, nt_page_queue(heap, page->block_size), page);
+            if (page->block_size > NT_LARGE_SIZE_MAX) {
+                nt_huge_page_use_delayed_free(page);
+                if (page->used == 0) _nt_page_retire(page);
+            } else {
+                _nt_page_use_delayed_free(page, NT_NO_DELAYED_FREE);
+            }
+        }
+    }
+}
+
+void _nt_heap_destroy_pages(nt_heap_t* heap) {
+    nt_heap_delayed_free_stop(heap);
+    nt_tld_t* tld = heap->tld;
+    for (size_t i = 0; i <= NT_BIN_FULL; i++) {
+        nt_page_queue_t* pq = &heap->pages[i];
+        nt_page_t* page = nullptr;
+        while ((page = pq->first) != nullptr) {
+            _nt_page_free_collect(page);
+            //! the blocks still in use are freed along with the page
+            size_t inuse = page->used - page->thread_freed;
+#if NT_STAT > 1
+            if (page->block_size <= NT_LARGE_SIZE_MAX) nt_stat_decrease(tld->stats.normal[_nt_bin(page->block_size)], inuse);
+            nt_stat_decrease(tld->stats.malloc, inuse * page->block_size);
+#else
+            UNUSED(inuse);
+#endif
+            if (page->block_size > NT_LARGE_SIZE_MAX) nt_stat_decrease(tld->stats.huge, page->block_size);
+            if (page->flags.has_sampled) _nt_sample_forget_page(page);
+            nt_page_queue_remove(heap, pq, page);
+            _nt_segment_page_free(page, &tld->segments);
+        }
+    }
+}
+
+/**
+ * -----------------------------------------------------------
+ * Finding a page with free blocks
+ * -----------------------------------------------------------
+ */
+
+static nt_page_t* nt_page_fresh_alloc(nt_heap_t* heap, nt_page_queue_t* pq, size_t block_size) {
+    nt_page_t* page = _nt_segment_page_alloc(block_size, &heap->tld->segments, &heap->tld->os);
+    if (page == nullptr) return nullptr;
+    nt_page_init(heap, page, block_size);
+    nt_page_queue_push(heap, pq, page);
+    nt_trace(NT_TRACE_PAGE_FRESH, page, block_size);
+    return page;
+}
+
+static nt_page_t* nt_page_fresh(nt_heap_t* heap, nt_page_queue_t* pq) {
+    return nt_page_fresh_alloc(heap, pq, pq->block_size);
+}
+
+static nt_page_t* nt_page_queue_find_free_ex(nt_heap_t* heap, nt_page_queue_t* pq, bool first_try) {
+    size_t count = 0;
+    nt_page_t* page = pq->first;
+    while (page != nullptr) {
+        nt_page_t* next = page->next;
+        count++;
+        //! 1. blocks freed in the meantime
+        _nt_page_free_collect(page);
+        if (nt_page_immediate_available(page)) break;
+        //! 2. room to extend
+        if (page->capacity < page->reserved) {
+            nt_page_extend_free(heap, page);
+            break;
+        }
+        //! 3. completely full, park it so long-lived pages are not visited all the time
+        nt_page_to_full(heap, page, pq);
+        page = next;
+    }
+
+    nt_stat_counter_increase(heap->tld->stats.searches, count);
+
+    if (page == nullptr) {
+        //! before taking a fresh page, adopt the segments of exited threads and search again
+        if (first_try && !heap->no_reclaim && _nt_segment_try_reclaim_abandoned(heap, false, &heap->tld->segments)) {
+            return nt_page_queue_find_free_ex(heap, pq, false);
+        }
+        page = nt_page_fresh(heap, pq);
+    } else {
+        nt_page_queue_move_to_front(heap, pq, page);
+    }
+    return page;
+}
+
+static nt_page_t* nt_heap_find_free_page(nt_heap_t* heap, size_t size) {
+    nt_page_queue_t* pq = nt_page_queue(heap, size);
+    nt_page_t* page = pq->first;
+    if (page != nullptr) {
+        _nt_page_free_collect(page);
+        if (nt_page_immediate_available(page)) return page;
+    }
+    return nt_page_queue_find_free_ex(heap, pq, true);
+}
+
+/**
+ * @brief Every huge object gets a fresh page of its own in the `NT_BIN_HUGE` queue.
+ */
+static nt_page_t* nt_huge_page_alloc(nt_heap_t* heap, size_t size) {
+    nt_page_queue_t* pq = &heap->pages[NT_BIN_HUGE];
+    size_t block_size = _nt_wsize_from_size(size) * sizeof(uintptr_t);
+    nt_page_t* page = nt_page_fresh_alloc(heap, pq, block_size);
+    if (page != nullptr) {
+        //! a free by another thread reaches the heap in O(1) rather than a search of this queue
+        _nt_page_use_delayed_free(page, NT_USE_DELAYED_FREE);
+        nt_stat_increase(heap->tld->stats.huge, block_size);
+        nt_trace(NT_TRACE_HUGE_ALLOC, page, block_size);
+    }
+    return page;
+}
+
+/**
+ * -----------------------------------------------------------
+ * Page retirement
+ * -----------------------------------------------------------
+ */
+
+/**
+ * @brief A page with less than 1/8 of its blocks available, `nullptr` counts as well.
+ */
+static inline bool nt_page_mostly_used(const nt_page_t* page) {
+    if (page == nullptr) return true;
+    return (page->reserved - page->used + page->thread_freed) < (size_t)(page->reserved / 8);
+}
+
+void _nt_page_retire(nt_page_t* page) {
+    nt_assert_internal(page->used == page->thread_freed);
+    nt_heap_t* heap = page->heap;
+    //! don't retire too often, or we end up retiring and re-allocating most of the time:
+    //! keep the page when its neighbours are (nearly) full and it may be the only one with room
+    bool is_huge = (page->block_size > NT_LARGE_SIZE_MAX);
+    if (!is_huge && !page->flags.is_full && nt_page_mostly_used(page->prev) && nt_page_mostly_used(page->next)) return;
+    //! blocks of other threads may still be on their way, those pages are collected later
+    if (nt_tf_block(nt_atomic_read(&page->thread_free.value)) != nullptr || page->thread_freed != 0) return;
+
+    if (is_huge) nt_stat_decrease(heap->tld->stats.huge, page->block_size);
+    nt_trace(NT_TRACE_PAGE_RETIRE, page, page->block_size);
+
+    nt_page_queue_remove(heap, nt_heap_page_queue_of(heap, page), page);
+    _nt_segment_page_free(page, &heap->tld->segments);
+}
 
 void* _nt_malloc_generic(nt_heap_t* heap, size_t size) {
-    stack_path += "_nt_malloc_generic -> ";
     nt_assert_internal(heap != nullptr);
 
     //! initialize if necessary
     if (nt_unlikely(!nt_heap_is_initialized(heap))) {
         nt_thread_init();
-        // TODO
+        heap = nt_get_default_heap();
+        if (!nt_heap_is_initialized(heap)) return nullptr;
+    }
+
+    nt_trace(NT_TRACE_MALLOC_GENERIC, size, heap);
+
+    //! free the blocks that other threads freed into full pages of this heap
+    _nt_heap_delayed_free(heap);
+
+    //! purge expired free memory every so often, off the fast path
+    if (nt_unlikely((++heap->tld->heartbeat % NT_PURGE_INTERVAL) == 0)) {
+        _nt_segment_purge(&heap->tld->segments, false);
+        _nt_free_batch_flush(heap->tld);
+    }
+
+    //! sizes this large can not be satisfied, and would overflow the size computations below
+    if (nt_unlikely(size > (size_t)PTRDIFF_MAX)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    nt_page_t* page = nullptr;
+    if (nt_unlikely(size > NT_LARGE_SIZE_MAX)) {
+        page = nt_huge_page_alloc(heap, size);
+    } else {
+        page = nt_heap_find_free_page(heap, size);
+    }
+    if (nt_unlikely(page == nullptr)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    nt_assert_internal(nt_page_immediate_available(page));
+    return _nt_page_malloc(heap, page, size);
+}
+
+void nt_collect(bool force) {
+    nt_heap_t* heap = nt_get_default_heap();
+    if (!nt_heap_is_initialized(heap)) {
+        //! nothing to purge yet, but a forced collect may still adopt abandoned segments
+        if (!force) return;
+        nt_thread_init();
+        heap = nt_get_default_heap();
+        if (!nt_heap_is_initialized(heap)) return;
     }
-    // TODO
-    return {};
+    _nt_heap_delayed_free(heap);
+    _nt_free_batch_flush(heap->tld);
+    //! adopted segments go to the backing heap, whichever heap is the default
+    nt_heap_t* bheap = heap->tld->heap_backing;
+    if (force && !bheap->no_reclaim) _nt_segment_try_reclaim_abandoned(bheap, true, &heap->tld->segments);
+    _nt_segment_purge(&heap->tld->segments, force);
 }
 
-NT_NAMESPACE_END
\ No newline at end of file
+NT_NAMESPACE_END
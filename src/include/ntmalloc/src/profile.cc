@@ -0,0 +1,345 @@
+#include "../ntmalloc.h"
+#include "../ntmalloc_atomic.h"
+#include "../ntmalloc_internal.h"
+
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+NT_NAMESPACE_BEGEN
+
+/**
+ * -----------------------------------------------------------
+ * Sampling heap profiler
+ *
+ * Every heap counts down the bytes it allocates, and when the
+ * countdown runs out the stack of that allocation is recorded.
+ * The countdowns are drawn from an exponential distribution
+ * with `NT_OPTION_SAMPLE_RATE` as mean, so that each byte is
+ * equally likely to be sampled. The sampled blocks that are
+ * still alive are kept in a hash table, and their page is
+ * flagged `has_sampled` so that only frees of those pages leave
+ * the fast path to look them up. All tables live in OS memory
+ * behind one lock, which only sampled allocations and frees of
+ * flagged pages take.
+ * -----------------------------------------------------------
+ */
+
+/**
+ * @brief The deepest stack recorded for a sample.
+ */
+constexpr const size_t NT_SAMPLE_FRAMES = 32;
+/**
+ * @brief The number of distinct stacks kept, further stacks are counted under the first one (without frames).
+ */
+constexpr const size_t NT_SAMPLE_SITES = 4096;
+/**
+ * @brief The bytes after which a heap checks again whether sampling was turned on.
+ */
+constexpr const int64_t NT_SAMPLE_RECHECK = 1024 * 1024;
+/**
+ * @brief The initial room of the table of live samples, it doubles when it is half full.
+ */
+constexpr const size_t NT_SAMPLE_TABLE_MIN = 1024;
+
+typedef struct nt_sample_site {
+    uint64_t    hash;
+    size_t      depth;
+    void*       frames[NT_SAMPLE_FRAMES];
+    int64_t     live_count;
+    int64_t     live_bytes;
+    int64_t     alloc_count;
+    int64_t     alloc_bytes;
+} nt_sample_site_t;
+
+typedef struct nt_sample {
+    void*       block;      //! nullptr for an empty slot
+    size_t      size;
+    size_t      site;
+} nt_sample_t;
+
+typedef struct nt_profile {
+    volatile uintptr_t  lock;
+    nt_sample_site_t*   sites;          //! `NT_SAMPLE_SITES` entries, open addressing on the stack hash
+    size_t              site_count;
+    nt_sample_t*        samples;        //! open addressing on the block address, no tombstones
+    size_t              capacity;
+    size_t              count;
+} nt_profile_t;
+
+static nt_profile_t nt_profile;
+
+//! set while a thread is inside the profiler, allocations made by `backtrace` itself are not sampled
+static nt_thread(bool) nt_sample_busy;
+static nt_thread(uint64_t) nt_sample_random;
+
+static void nt_profile_lock(void) {
+    while (!nt_atomic_compare_exchange(&nt_profile.lock, 1, 0)) nt_atomic_yield();
+}
+
+static void nt_profile_unlock(void) {
+    nt_atomic_exchange(&nt_profile.lock, 0);
+}
+
+/**
+ * @brief The next countdown, exponentially distributed with mean `rate`.
+ */
+static int64_t nt_sample_next(long rate) {
+    uint64_t x = nt_sample_random;
+    if (nt_unlikely(x == 0)) {
+        x = (uint64_t)(uintptr_t)&nt_sample_random ^ (uint64_t)time(nullptr) ^ _nt_thread_id();
+        if (x == 0) x = 1;
+    }
+    //! xorshift64
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    nt_sample_random = x;
+    //! 53 random bits as a double in (0, 1]
+    double u = ((double)(x >> 11) + 1.0) / 9007199254740992.0;
+    double next = -std::log(u) * (double)rate;
+    if (next < 1.0) return 1;
+    if (next > (double)rate * 32.0) return (int64_t)rate * 32;
+    return (int64_t)next;
+}
+
+static inline size_t nt_sample_slot(const void* block, size_t capacity) {
+    return (size_t)((((uintptr_t)block >> 3) * 0x9e3779b97f4a7c15ULL) >> 20) & (capacity - 1);
+}
+
+static void nt_sample_table_insert(nt_sample_t* samples, size_t capacity, const nt_sample_t* sample) {
+    size_t i = nt_sample_slot(sample->block, capacity);
+    while (samples[i].block != nullptr) i = (i + 1) & (capacity - 1);
+    samples[i] = *sample;
+}
+
+/**
+ * @brief Makes room for one more sample, the table is never more than half full.
+ */
+static bool nt_sample_table_reserve(void) {
+    if (nt_profile.samples != nullptr && (nt_profile.count + 1) * 2 <= nt_profile.capacity) return true;
+    size_t capacity = (nt_profile.capacity == 0 ? NT_SAMPLE_TABLE_MIN : nt_profile.capacity * 2);
+    nt_sample_t* samples = (nt_sample_t*)_nt_os_alloc(capacity * sizeof(nt_sample_t), &_nt_stats_main);
+    if (samples == nullptr) return false;
+    for (size_t i = 0; i < nt_profile.capacity; i++) {
+        if (nt_profile.samples[i].block != nullptr) nt_sample_table_insert(samples, capacity, &nt_profile.samples[i]);
+    }
+    if (nt_profile.samples != nullptr) _nt_os_free(nt_profile.samples, nt_profile.capacity * sizeof(nt_sample_t), &_nt_stats_main);
+    nt_profile.samples = samples;
+    nt_profile.capacity = capacity;
+    return true;
+}
+
+/**
+ * @brief Removes the sample in slot `i`, and moves later samples of the same run back into the hole.
+ */
+static void nt_sample_table_remove(size_t i) {
+    nt_sample_t* samples = nt_profile.samples;
+    size_t mask = nt_profile.capacity - 1;
+    nt_sample_t* sample = &samples[i];
+    nt_sample_site_t* site = &nt_profile.sites[sample->site];
+    site->live_count--;
+    site->live_bytes -= (int64_t)sample->size;
+    nt_page_t* page = _nt_ptr_page(sample->block);
+    if (--page->sampled == 0) page->flags.has_sampled = false;
+    nt_profile.count--;
+
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; samples[j].block != nullptr; j = (j + 1) & mask) {
+        size_t home = nt_sample_slot(samples[j].block, nt_profile.capacity);
+        //! the sample may move back when its home slot is not in (hole, j]
+        bool stays = (hole <= j ? (hole < home && home <= j) : (hole < home || home <= j));
+        if (stays) continue;
+        samples[hole] = samples[j];
+        hole = j;
+    }
+    samples[hole].block = nullptr;
+}
+
+/**
+ * @brief Finds or adds the site of a stack, the first site collects what no longer fits.
+ */
+static size_t nt_sample_site_of(void* const* frames, size_t depth) {
+    if (nt_profile.sites == nullptr) {
+        nt_profile.sites = (nt_sample_site_t*)_nt_os_alloc(NT_SAMPLE_SITES * sizeof(nt_sample_site_t), &_nt_stats_main);
+        if (nt_profile.sites == nullptr) return SIZE_MAX;
+        nt_profile.site_count = 1;
+    }
+    uint64_t hash = 0xcbf29ce484222325ULL;      //! FNV-1a over the return addresses
+    for (size_t i = 0; i < depth; i++) hash = (hash ^ (uint64_t)(uintptr_t)frames[i]) * 0x100000001b3ULL;
+    hash |= 1;
+
+    size_t mask = NT_SAMPLE_SITES - 1;
+    for (size_t i = (size_t)hash & mask, n = 0; n < NT_SAMPLE_SITES; i = (i + 1) & mask, n++) {
+        if (i == 0) continue;
+        nt_sample_site_t* site = &nt_profile.sites[i];
+        if (site->hash == hash && site->depth == depth && memcmp(site->frames, frames, depth * sizeof(void*)) == 0) return i;
+        if (site->hash != 0) continue;
+        if (nt_profile.site_count * 4 > NT_SAMPLE_SITES * 3) break;
+        site->hash = hash;
+        site->depth = depth;
+        memcpy(site->frames, frames, depth * sizeof(void*));
+        nt_profile.site_count++;
+        return i;
+    }
+    return 0;
+}
+
+void _nt_sample_init(nt_heap_t* heap) {
+    long rate = nt_option_get(NT_OPTION_SAMPLE_RATE);
+    heap->sample_countdown = (rate <= 0 ? NT_SAMPLE_RECHECK : nt_sample_next(rate));
+}
+
+void _nt_sample_malloc(nt_heap_t* heap, nt_page_t* page, void* block, size_t size) {
+    long rate = nt_option_get(NT_OPTION_SAMPLE_RATE);
+    if (rate <= 0 || nt_sample_busy) {
+        heap->sample_countdown = (rate <= 0 ? NT_SAMPLE_RECHECK : nt_sample_next(rate));
+        return;
+    }
+    heap->sample_countdown = nt_sample_next(rate);
+    nt_sample_busy = true;
+
+    //! the first frame is this function
+    void* frames[NT_SAMPLE_FRAMES + 1];
+    int depth = backtrace(frames, (int)(NT_SAMPLE_FRAMES + 1));
+    size_t skip = (depth > 0 ? 1 : 0);
+
+    nt_profile_lock();
+    size_t site = nt_sample_site_of(frames + skip, (size_t)depth - skip);
+    if (site != SIZE_MAX && nt_sample_table_reserve()) {
+        nt_sample_t sample = { block, size, site };
+        nt_sample_table_insert(nt_profile.samples, nt_profile.capacity, &sample);
+        nt_profile.count++;
+        nt_sample_site_t* s = &nt_profile.sites[site];
+        s->live_count++;
+        s->live_bytes += (int64_t)size;
+        s->alloc_count++;
+        s->alloc_bytes += (int64_t)size;
+        page->sampled++;
+        page->flags.has_sampled = true;
+    }
+    nt_profile_unlock();
+    nt_sample_busy = false;
+}
+
+void _nt_sample_free(void* block) {
+    nt_profile_lock();
+    if (nt_profile.samples != nullptr) {
+        size_t mask = nt_profile.capacity - 1;
+        for (size_t i = nt_sample_slot(block, nt_profile.capacity); nt_profile.samples[i].block != nullptr; i = (i + 1) & mask) {
+            if (nt_profile.samples[i].block == block) {
+                nt_sample_table_remove(i);
+                break;
+            }
+        }
+    }
+    nt_profile_unlock();
+}
+
+void _nt_sample_forget_page(nt_page_t* page) {
+    size_t page_size = 0;
+    uint8_t* start = _nt_segment_page_start(_nt_page_segment(page), page, &page_size);
+    nt_profile_lock();
+    for (size_t i = 0; i < nt_profile.capacity && page->sampled > 0; ) {
+        uint8_t* block = (uint8_t*)nt_profile.samples[i].block;
+        if (block != nullptr && block >= start && block < start + page_size) {
+            //! a later sample moves into slot `i`, look at it again
+            nt_sample_table_remove(i);
+        } else {
+            i++;
+        }
+    }
+    nt_profile_unlock();
+}
+
+/**
+ * -----------------------------------------------------------
+ * Writing the profile
+ * -----------------------------------------------------------
+ */
+
+typedef struct nt_profile_out {
+    int     fd;
+    size_t  len;
+    char    buf[4096];
+} nt_profile_out_t;
+
+static void nt_profile_flush(nt_profile_out_t* out) {
+    size_t done = 0;
+    while (done < out->len) {
+        ssize_t n = write(out->fd, out->buf + done, out->len - done);
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    out->len = 0;
+}
+
+static void nt_profile_printf(nt_profile_out_t* out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void nt_profile_printf(nt_profile_out_t* out, const char* fmt, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n <= 0) return;
+    size_t len = ((size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    if (out->len + len > sizeof(out->buf)) nt_profile_flush(out);
+    memcpy(out->buf + out->len, line, len);
+    out->len += len;
+}
+
+size_t nt_profile_dump(int fd) {
+    nt_profile_out_t out;
+    out.fd = fd;
+    out.len = 0;
+    size_t written = 0;
+
+    nt_profile_lock();
+    int64_t live_count = 0, live_bytes = 0, alloc_count = 0, alloc_bytes = 0;
+    for (size_t i = 0; nt_profile.sites != nullptr && i < NT_SAMPLE_SITES; i++) {
+        const nt_sample_site_t* site = &nt_profile.sites[i];
+        live_count += site->live_count;
+        live_bytes += site->live_bytes;
+        alloc_count += site->alloc_count;
+        alloc_bytes += site->alloc_bytes;
+    }
+    //! `heap_v2` tells pprof the samples were taken once every `rate` bytes on average
+    nt_profile_printf(&out, "heap profile: %lld: %lld [%lld: %lld] @ heap_v2/%ld\n",
+                      (long long)live_count, (long long)live_bytes, (long long)alloc_count, (long long)alloc_bytes,
+                      nt_option_get(NT_OPTION_SAMPLE_RATE));
+    for (size_t i = 0; nt_profile.sites != nullptr && i < NT_SAMPLE_SITES; i++) {
+        const nt_sample_site_t* site = &nt_profile.sites[i];
+        if (site->alloc_count == 0) continue;
+        nt_profile_printf(&out, "%lld: %lld [%lld: %lld] @",
+                          (long long)site->live_count, (long long)site->live_bytes,
+                          (long long)site->alloc_count, (long long)site->alloc_bytes);
+        for (size_t f = 0; f < site->depth; f++) nt_profile_printf(&out, " %p", site->frames[f]);
+        nt_profile_printf(&out, "\n");
+        written++;
+    }
+    nt_profile_unlock();
+
+    //! pprof maps the addresses back to the binaries with the mappings
+    nt_profile_printf(&out, "\nMAPPED_LIBRARIES:\n");
+    nt_profile_flush(&out);
+    int maps = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (maps >= 0) {
+        ssize_t n = 0;
+        while ((n = read(maps, out.buf, sizeof(out.buf))) > 0) {
+            out.len = (size_t)n;
+            nt_profile_flush(&out);
+        }
+        close(maps);
+    }
+    return written;
+}
+
+NT_NAMESPACE_END
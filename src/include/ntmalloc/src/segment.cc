@@ -0,0 +1,591 @@
+#include "../ntmalloc.h"
+#include "../ntmalloc_atomic.h"
+#include "../ntmalloc_internal.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+NT_NAMESPACE_BEGEN
+
+/**
+ * -----------------------------------------------------------
+ * Segment queues: segments with free pages, per thread
+ * -----------------------------------------------------------
+ */
+
+static bool nt_segment_queue_is_empty(const nt_segment_queue_t* queue) {
+    return (queue->first == nullptr);
+}
+
+static void nt_segment_enqueue(nt_segment_queue_t* queue, nt_segment_t* segment) {
+    segment->next = nullptr;
+    segment->prev = queue->last;
+    if (queue->last != nullptr) {
+        queue->last->next = segment;
+        queue->last = segment;
+    } else {
+        queue->last = queue->first = segment;
+    }
+}
+
+static void nt_segment_queue_remove(nt_segment_queue_t* queue, nt_segment_t* segment) {
+    if (segment->prev != nullptr) segment->prev->next = segment->next;
+    if (segment->next != nullptr) segment->next->prev = segment->prev;
+    if (segment == queue->first) queue->first = segment->next;
+    if (segment == queue->last) queue->last = segment->prev;
+    segment->next = nullptr;
+    segment->prev = nullptr;
+}
+
+/**
+ * -----------------------------------------------------------
+ * Purging
+ *
+ * Free pages of a segment and cached segments give their physical
+ * memory back to the OS once they stayed unused for
+ * `NT_OPTION_PURGE_DELAY` milliseconds, so a burst does not leave
+ * the RSS at its peak forever. Memory is only touched again on
+ * reuse, the OS backs it lazily. While waiting, the deadline is
+ * kept in `used`, which is otherwise 0 for a free page or segment.
+ * -----------------------------------------------------------
+ */
+
+static void nt_segment_memory(const nt_segment_t* segment, uint8_t** start, size_t* size) {
+    //! everything after the segment info, which links the segment into the cache
+    *start = (uint8_t*)segment + segment->segment_info_size;
+    *size = segment->segment_size - segment->segment_info_size;
+}
+
+static void nt_page_purge(nt_page_t* page, nt_segments_tld_t* tld) {
+    if (page->is_reset) return;
+    //! purging part of a huge page would split it, only whole segments are purged then
+    if (_nt_page_segment(page)->mem_kind != NT_OS_MEM_NORMAL) return;
+    size_t psize = 0;
+    uint8_t* start = _nt_segment_page_start(_nt_page_segment(page), page, &psize);
+    page->is_reset = _nt_os_reset(start, psize, tld->stats);
+}
+
+static void nt_page_unreset(nt_page_t* page, nt_segments_tld_t* tld) {
+    if (!page->is_reset) return;
+    size_t psize = 0;
+    uint8_t* start = _nt_segment_page_start(_nt_page_segment(page), page, &psize);
+    _nt_os_unreset(start, psize, tld->stats);
+    page->is_reset = false;
+}
+
+static void nt_page_purge_remove(nt_page_t* page, nt_segments_tld_t* tld) {
+    if (page->used == 0) return;   //! not waiting
+    nt_page_queue_t* pq = &tld->pages_purge;
+    if (page->prev != nullptr) page->prev->next = page->next;
+    if (page->next != nullptr) page->next->prev = page->prev;
+    if (page == pq->first) pq->first = page->next;
+    if (page == pq->last) pq->last = page->prev;
+    page->next = nullptr;
+    page->prev = nullptr;
+    page->used = 0;
+}
+
+static void nt_page_purge_schedule(nt_page_t* page, nt_segments_tld_t* tld) {
+    long delay = nt_option_get(NT_OPTION_PURGE_DELAY);
+    if (delay < 0) return;
+    if (delay == 0) {
+        nt_page_purge(page, tld);
+        return;
+    }
+    page->used = (size_t)(_nt_clock_now() + (uint64_t)delay);
+    nt_page_queue_t* pq = &tld->pages_purge;
+    page->prev = nullptr;
+    page->next = pq->first;
+    if (pq->first != nullptr) {
+        pq->first->prev = page;
+    } else {
+        pq->last = page;
+    }
+    pq->first = page;
+}
+
+static void nt_segment_purge(nt_segment_t* segment, nt_segments_tld_t* tld) {
+    segment->used = 0;
+    if (segment->is_reset || segment->mem_kind == NT_OS_MEM_HUGETLB) return;
+    uint8_t* start = nullptr;
+    size_t size = 0;
+    nt_segment_memory(segment, &start, &size);
+    segment->is_reset = _nt_os_reset(start, size, tld->stats);
+}
+
+static void nt_segment_unreset(nt_segment_t* segment, nt_segments_tld_t* tld) {
+    segment->used = 0;
+    if (!segment->is_reset) return;
+    uint8_t* start = nullptr;
+    size_t size = 0;
+    nt_segment_memory(segment, &start, &size);
+    _nt_os_unreset(start, size, tld->stats);
+    segment->is_reset = false;
+}
+
+static void nt_segment_purge_schedule(nt_segment_t* segment, nt_segments_tld_t* tld) {
+    long delay = nt_option_get(NT_OPTION_PURGE_DELAY);
+    if (delay < 0) return;
+    if (delay == 0) {
+        nt_segment_purge(segment, tld);
+        return;
+    }
+    segment->used = (size_t)(_nt_clock_now() + (uint64_t)delay);
+}
+
+void _nt_segment_purge(nt_segments_tld_t* tld, bool force) {
+    //! cheap when there is nothing to do, the clock is only read when something waits
+    bool pending = (tld->pages_purge.last != nullptr);
+    for (nt_segment_t* segment = tld->cache.first; !pending && segment != nullptr; segment = segment->next) {
+        pending = (segment->used != 0);
+    }
+    if (!pending) return;
+    uint64_t now = (force ? UINT64_MAX : _nt_clock_now());
+
+    //! the oldest pages are at the end
+    nt_page_t* page = tld->pages_purge.last;
+    while (page != nullptr && (uint64_t)page->used <= now) {
+        nt_page_t* prev = page->prev;
+        nt_page_purge_remove(page, tld);
+        nt_page_purge(page, tld);
+        page = prev;
+    }
+    for (nt_segment_t* segment = tld->cache.first; segment != nullptr; segment = segment->next) {
+        if (segment->used != 0 && (uint64_t)segment->used <= now) nt_segment_purge(segment, tld);
+    }
+}
+
+/**
+ * @brief Settles the purge state of the pages of a segment that is about to be cached or unmapped.
+ */
+static void nt_segment_pages_unreset(nt_segment_t* segment, nt_segments_tld_t* tld) {
+    for (size_t i = 0; i < segment->capacity; i++) {
+        nt_page_t* page = &segment->pages[i];
+        nt_page_purge_remove(page, tld);
+        nt_page_unreset(page, tld);
+    }
+}
+
+static void nt_segment_os_free(nt_segment_t* segment, nt_segments_tld_t* tld) {
+    nt_segment_unreset(segment, tld);
+    _nt_os_free_aligned(segment, segment->segment_size, segment->mem_kind, tld->stats);
+}
+
+/**
+ * -----------------------------------------------------------
+ * Segment cache
+ *
+ * Freed segments are kept per thread, so that a burst of
+ * allocations and frees does not map and unmap segments all the
+ * time. The cache is bounded both in count and relative to the
+ * peak size of the segments of the thread. On NUMA machines a
+ * thread that moved to another node reuses segments of its new
+ * node first, and evicts those of other nodes first.
+ * -----------------------------------------------------------
+ */
+
+constexpr const size_t NT_SEGMENT_CACHE_MAX      = 16;
+constexpr const size_t NT_SEGMENT_CACHE_FRACTION = 4;   //! at most 1/4 of the peak size
+
+static bool nt_segment_cache_full(const nt_segments_tld_t* tld) {
+    if (tld->cache_count == 0) return false;   //! always keep at least one segment
+    if (tld->cache_count >= NT_SEGMENT_CACHE_MAX) return true;
+    return (tld->cache_size + NT_SEGMENT_SIZE) * NT_SEGMENT_CACHE_FRACTION > tld->peak_size;
+}
+
+/**
+ * @brief Takes a segment out of the cache, preferring one placed on `numa_node` unless it is -1.
+ */
+static nt_segment_t* nt_segment_cache_pop(int numa_node, nt_segments_tld_t* tld) {
+    //! the most recently cached segment, which is the least likely to be purged already
+    nt_segment_t* segment = tld->cache.last;
+    if (segment == nullptr) return nullptr;
+    if (numa_node >= 0) {
+        nt_segment_t* local = segment;
+        while (local != nullptr && local->numa_node != numa_node) local = local->prev;
+        if (local != nullptr) segment = local;
+    }
+    nt_segment_queue_remove(&tld->cache, segment);
+    tld->cache_count--;
+    tld->cache_size -= segment->segment_size;
+    nt_segment_unreset(segment, tld);
+    return segment;
+}
+
+static void nt_segment_os_free(nt_segment_t* segment, nt_segments_tld_t* tld);
+
+static bool nt_segment_cache_push(nt_segment_t* segment, nt_segments_tld_t* tld) {
+    if (segment->segment_size != NT_SEGMENT_SIZE) return false;
+    if (nt_segment_cache_full(tld)) {
+        //! make room by unmapping the oldest segment of another node, if there is one
+        nt_segment_t* remote = tld->cache.first;
+        while (remote != nullptr && remote->numa_node == segment->numa_node) remote = remote->next;
+        if (remote == nullptr) return false;
+        nt_segment_queue_remove(&tld->cache, remote);
+        tld->cache_count--;
+        tld->cache_size -= remote->segment_size;
+        nt_segment_os_free(remote, tld);
+    }
+    nt_segment_enqueue(&tld->cache, segment);
+    tld->cache_count++;
+    tld->cache_size += segment->segment_size;
+    nt_segment_purge_schedule(segment, tld);
+    return true;
+}
+
+void _nt_segment_thread_collect(nt_segments_tld_t* tld) {
+    nt_segment_t* segment = nullptr;
+    while ((segment = nt_segment_cache_pop(-1, tld)) != nullptr) {
+        nt_segment_os_free(segment, tld);
+    }
+}
+
+/**
+ * -----------------------------------------------------------
+ * Segment allocation
+ * -----------------------------------------------------------
+ */
+
+/**
+ * @brief Huge segments are sized in steps of this many bytes.
+ */
+constexpr const size_t NT_HUGE_SEGMENT_ALIGN = 64 * 1024;
+
+static size_t nt_segment_info_size(size_t capacity) {
+    size_t size = sizeof(nt_segment_t) + (capacity - 1) * sizeof(nt_page_t);
+    return (size + NT_SEGMENT_INFO_ALIGN - 1) & ~(NT_SEGMENT_INFO_ALIGN - 1);
+}
+
+uint8_t* _nt_segment_page_start(const nt_segment_t* segment, const nt_page_t* page, size_t* page_size) {
+    size_t psize = (segment->page_kind == NT_PAGE_HUGE ? segment->segment_size : (size_t)1 << segment->page_shift);
+    uint8_t* p = (uint8_t*)segment + page->segment_idx * psize;
+    if (page->segment_idx == 0) {
+        //! the first page starts after the segment info
+        p += segment->segment_info_size;
+        psize -= segment->segment_info_size;
+    }
+    if (page_size != nullptr) *page_size = psize;
+    return p;
+}
+
+/**
+ * @brief Allocates a segment of `NT_SEGMENT_SIZE`, or when `required` is not 0 a huge segment
+ * large enough to hold a page of `required` bytes after the segment info.
+ */
+static nt_segment_t* nt_segment_alloc(size_t required, nt_page_kind_t page_kind, size_t page_shift, nt_segments_tld_t* tld, nt_os_tld_t* os_tld) {
+    size_t capacity = (required == 0 ? NT_SEGMENT_SIZE >> page_shift : 1);
+    size_t info_size = nt_segment_info_size(capacity);
+    size_t segment_size = NT_SEGMENT_SIZE;
+    if (required != 0) {
+        //! in whole huge pages when those are wanted
+        size_t align = (nt_option_get(NT_OPTION_LARGE_OS_PAGES) > 0 ? NT_LARGE_OS_PAGE_SIZE : NT_HUGE_SEGMENT_ALIGN);
+        segment_size = (required + info_size + align - 1) & ~(align - 1);
+        if (segment_size < required) return nullptr;   //! overflow
+    }
+
+    //! the thread may have been moved to another node since its last segment
+    os_tld->numa_node = _nt_os_numa_node();
+    nt_segment_t* segment = (required == 0 ? nt_segment_cache_pop(os_tld->numa_node, tld) : nullptr);
+    if (segment != nullptr) {
+        //! a cached segment keeps the info of its previous life, which may have had another page kind
+        size_t clear_size = (segment->segment_info_size > info_size ? segment->segment_info_size : info_size);
+        nt_os_mem_kind_t mem_kind = segment->mem_kind;
+        int numa_node = segment->numa_node;
+        memset((void*)segment, 0, clear_size);
+        segment->mem_kind = mem_kind;
+        segment->numa_node = numa_node;
+        nt_trace(NT_TRACE_SEGMENT_CACHED, segment, segment_size);
+    } else {
+        //! fresh OS memory is zeroed, so only the fields that are not 0 need to be set;
+        //! huge segments are aligned as well so that `_nt_ptr_segment` works on their block
+        nt_os_mem_kind_t mem_kind = NT_OS_MEM_NORMAL;
+        segment = (nt_segment_t*)_nt_os_alloc_aligned(segment_size, NT_SEGMENT_SIZE, &mem_kind, os_tld);
+        if (segment == nullptr) return nullptr;
+        segment->mem_kind = mem_kind;
+        segment->numa_node = os_tld->numa_node;
+        for (size_t i = 0; i < capacity; i++) {
+            segment->pages[i].is_zero_init = true;
+        }
+        nt_trace(NT_TRACE_SEGMENT_ALLOC, segment, segment_size);
+    }
+
+    segment->page_kind = page_kind;
+    segment->capacity = capacity;
+    segment->page_shift = page_shift;
+    segment->segment_size = segment_size;
+    segment->segment_info_size = info_size;
+    segment->cookie = (uintptr_t)segment ^ _nt_heap_main.cookie;
+    segment->thread_id = _nt_thread_id();
+    for (size_t i = 0; i < capacity; i++) {
+        segment->pages[i].segment_idx = (uint8_t)i;
+    }
+
+    tld->current_size += segment_size;
+    if (tld->current_size > tld->peak_size) tld->peak_size = tld->current_size;
+    nt_stat_increase(tld->stats->segments, 1);
+    return segment;
+}
+
+static void nt_segment_free(nt_segment_t* segment, nt_segments_tld_t* tld) {
+    if (segment->page_kind == NT_PAGE_SMALL) nt_segment_queue_remove(&tld->small_free, segment);
+    tld->current_size -= segment->segment_size;
+    nt_stat_decrease(tld->stats->segments, 1);
+    nt_trace(NT_TRACE_SEGMENT_FREE, segment, segment->segment_size);
+
+    //! the thread id is cleared so a stale pointer into a cached segment is never taken as local
+    segment->thread_id = 0;
+    nt_segment_pages_unreset(segment, tld);
+    if (!nt_segment_cache_push(segment, tld)) {
+        nt_segment_os_free(segment, tld);
+    }
+}
+
+/**
+ * -----------------------------------------------------------
+ * Page allocation and free
+ * -----------------------------------------------------------
+ */
+
+static nt_page_t* nt_segment_find_free(nt_segment_t* segment) {
+    for (size_t i = 0; i < segment->capacity; i++) {
+        nt_page_t* page = &segment->pages[i];
+        if (!page->segment_used) return page;
+    }
+    nt_assert(false);
+    return nullptr;
+}
+
+static nt_page_t* nt_segment_small_page_alloc(nt_segments_tld_t* tld, nt_os_tld_t* os_tld) {
+    if (nt_segment_queue_is_empty(&tld->small_free)) {
+        nt_segment_t* segment = nt_segment_alloc(0, NT_PAGE_SMALL, NT_SMALL_PAGE_SHIFT, tld, os_tld);
+        if (segment == nullptr) return nullptr;
+        nt_segment_enqueue(&tld->small_free, segment);
+    }
+
+    nt_segment_t* segment = tld->small_free.first;
+    nt_page_t* page = nt_segment_find_free(segment);
+    nt_page_purge_remove(page, tld);
+    nt_page_unreset(page, tld);
+    page->segment_used = true;
+    segment->used++;
+    if (segment->used == segment->capacity) {
+        //! no more free pages, stop looking at this segment
+        nt_segment_queue_remove(&tld->small_free, segment);
+    }
+    return page;
+}
+
+/**
+ * @brief A large page spans a whole segment of its own.
+ */
+static nt_page_t* nt_segment_large_page_alloc(nt_segments_tld_t* tld, nt_os_tld_t* os_tld) {
+    nt_segment_t* segment = nt_segment_alloc(0, NT_PAGE_LARGE, NT_LARGE_PAGE_SHIFT, tld, os_tld);
+    if (segment == nullptr) return nullptr;
+    nt_page_t* page = &segment->pages[0];
+    page->segment_used = true;
+    segment->used = 1;
+    return page;
+}
+
+/**
+ * @brief A huge page holds a single block in a segment of its own, sized to fit.
+ */
+static nt_page_t* nt_segment_huge_page_alloc(size_t size, nt_segments_tld_t* tld, nt_os_tld_t* os_tld) {
+    nt_segment_t* segment = nt_segment_alloc(size, NT_PAGE_HUGE, NT_SEGMENT_SHIFT, tld, os_tld);
+    if (segment == nullptr) return nullptr;
+    nt_page_t* page = &segment->pages[0];
+    page->segment_used = true;
+    segment->used = 1;
+    return page;
+}
+
+nt_page_t* _nt_segment_page_alloc(size_t block_size, nt_segments_tld_t* tld, nt_os_tld_t* os_tld) {
+    nt_page_t* page = nullptr;
+    if (block_size <= NT_SMALL_PAGE_SIZE / 8) {
+        page = nt_segment_small_page_alloc(tld, os_tld);
+    } else if (block_size <= NT_LARGE_SIZE_MAX) {
+        page = nt_segment_large_page_alloc(tld, os_tld);
+    } else {
+        page = nt_segment_huge_page_alloc(block_size, tld, os_tld);
+    }
+    if (page != nullptr) nt_stat_increase(tld->stats->pages, 1);
+    return page;
+}
+
+static void nt_segment_abandon(nt_segment_t* segment, nt_segments_tld_t* tld);
+
+/**
+ * @brief Marks `page` unused, the caller decides what happens to the segment.
+ */
+static void nt_segment_page_clear(nt_segment_t* segment, nt_page_t* page, nt_segments_tld_t* tld) {
+    nt_assert_internal(page->segment_used && segment->used > 0);
+    nt_stat_decrease(tld->stats->pages, 1);
+
+    //! back to the zeroed state of a page that was never used
+    uint8_t segment_idx = page->segment_idx;
+    memset((void*)page, 0, sizeof(*page));
+    page->segment_idx = segment_idx;
+    segment->used--;
+}
+
+void _nt_segment_page_free(nt_page_t* page, nt_segments_tld_t* tld) {
+    nt_segment_t* segment = _nt_page_segment(page);
+    nt_segment_page_clear(segment, page, tld);
+    if (segment->used == 0) {
+        nt_segment_free(segment, tld);
+        return;
+    }
+    nt_page_purge_schedule(page, tld);
+    if (segment->page_kind == NT_PAGE_SMALL && segment->used + 1 == segment->capacity) {
+        //! the segment was full and has a free page again
+        nt_segment_enqueue(&tld->small_free, segment);
+    }
+    //! an exiting thread freed the last page that was not abandoned yet
+    if (nt_unlikely(segment->used == segment->abandoned)) nt_segment_abandon(segment, tld);
+}
+
+/**
+ * -----------------------------------------------------------
+ * Abandonment
+ *
+ * When a thread exits with blocks still in use, its segments are
+ * pushed onto a global lock-free list. Blocks freed in the meantime
+ * go to the `thread_free` list of their page as for any other
+ * thread. Threads that need a fresh page first adopt some of these
+ * segments, so that the memory of short lived threads is reused
+ * rather than stranded until the process exits.
+ *
+ * Reclaiming takes the whole list with a single exchange and puts
+ * back what it does not adopt, so a segment is never read through
+ * a list head that another thread may have adopted and freed.
+ * -----------------------------------------------------------
+ */
+
+static nt_segment_t* volatile nt_abandoned = nullptr;
+static volatile uintptr_t nt_abandoned_count = 0;  //! a hint, only exact when nothing is in flight
+
+static void nt_abandoned_push(nt_segment_t* first, nt_segment_t* last) {
+    nt_segment_t* head = nullptr;
+    do {
+        head = (nt_segment_t*)nt_atomic_read_ptr((volatile void**)&nt_abandoned);
+        last->abandoned_next = head;
+    } while (!nt_atomic_compare_exchange_ptr((volatile void**)&nt_abandoned, first, head));
+}
+
+static void nt_segment_abandon(nt_segment_t* segment, nt_segments_tld_t* tld) {
+    nt_assert_internal(segment->used == segment->abandoned);
+    nt_trace(NT_TRACE_SEGMENT_ABANDON, segment, segment->used);
+    if (segment->page_kind == NT_PAGE_SMALL) nt_segment_queue_remove(&tld->small_free, segment);
+    //! the free pages must leave the purge list of this thread before another thread can adopt them
+    for (size_t i = 0; i < segment->capacity; i++) {
+        nt_page_t* page = &segment->pages[i];
+        if (page->segment_used) continue;
+        nt_page_purge_remove(page, tld);
+        nt_page_purge(page, tld);
+    }
+    tld->current_size -= segment->segment_size;
+    nt_stat_decrease(tld->stats->segments, 1);
+    nt_stat_increase(tld->stats->segments_abandoned, 1);
+
+    segment->thread_id = 0;
+    nt_abandoned_push(segment, segment);
+    nt_atomic_increment(&nt_abandoned_count);
+}
+
+void _nt_segment_page_abandon(nt_page_t* page, nt_segments_tld_t* tld) {
+    nt_segment_t* segment = _nt_page_segment(page);
+    nt_assert_internal(page->segment_used && page->heap == nullptr);
+    segment->abandoned++;
+    nt_stat_increase(tld->stats->pages_abandoned, 1);
+    if (segment->abandoned == segment->used) nt_segment_abandon(segment, tld);
+}
+
+/**
+ * @brief Adopts an abandoned `segment` into `heap`, freeing the pages that were emptied meanwhile.
+ */
+static void nt_segment_reclaim(nt_segment_t* segment, nt_heap_t* heap, nt_segments_tld_t* tld) {
+    nt_atomic_decrement(&nt_abandoned_count);
+    nt_trace(NT_TRACE_SEGMENT_RECLAIM, segment, segment->used);
+    segment->thread_id = _nt_thread_id();
+    segment->abandoned_next = nullptr;
+    tld->current_size += segment->segment_size;
+    if (tld->current_size > tld->peak_size) tld->peak_size = tld->current_size;
+    nt_stat_increase(tld->stats->segments, 1);
+    nt_stat_decrease(tld->stats->segments_abandoned, 1);
+
+    for (size_t i = 0; i < segment->capacity; i++) {
+        nt_page_t* page = &segment->pages[i];
+        if (!page->segment_used) continue;
+        segment->abandoned--;
+        nt_stat_decrease(tld->stats->pages_abandoned, 1);
+        _nt_page_free_collect(page);
+        if (page->used == 0) {
+            //! everything was freed while the segment was abandoned
+            if (page->block_size > NT_LARGE_SIZE_MAX) nt_stat_decrease(tld->stats->huge, page->block_size);
+            nt_segment_page_clear(segment, page, tld);
+            if (segment->used != 0) nt_page_purge_schedule(page, tld);
+        } else {
+            _nt_page_reclaim(heap, page);
+        }
+    }
+    nt_assert_internal(segment->abandoned == 0);
+
+    if (segment->used == 0) {
+        nt_segment_free(segment, tld);
+    } else if (segment->page_kind == NT_PAGE_HUGE && segment->pages[0].used == 0) {
+        //! the block was freed while `_nt_page_reclaim` handed its frees to the heap
+        _nt_page_retire(&segment->pages[0]);
+    } else if (segment->page_kind == NT_PAGE_SMALL && segment->used < segment->capacity) {
+        nt_segment_enqueue(&tld->small_free, segment);
+    }
+}
+
+/**
+ * @brief Pushes the list starting at `first` back onto the abandoned segments.
+ */
+static void nt_abandoned_push_list(nt_segment_t* first) {
+    if (first == nullptr) return;
+    nt_segment_t* last = first;
+    while (last->abandoned_next != nullptr) last = last->abandoned_next;
+    nt_abandoned_push(first, last);
+}
+
+bool _nt_segment_try_reclaim_abandoned(nt_heap_t* heap, bool try_all, nt_segments_tld_t* tld) {
+    uintptr_t count = nt_atomic_read(&nt_abandoned_count);
+    if (count == 0) return false;
+    //! adopt a few at a time, so a single thread does not take all the memory of exited ones
+    uintptr_t atmost = (try_all ? UINTPTR_MAX : (count / 8 > 8 ? count / 8 : 8));
+    //! segments of the node of this thread first, the others only when there are none
+    int numa_node = (try_all || _nt_os_numa_node_count() <= 1 ? -1 : _nt_os_numa_node());
+
+    nt_segment_t* segment = (nt_segment_t*)nt_atomic_exchange((volatile uintptr_t*)&nt_abandoned, 0);
+    nt_segment_t* remote = nullptr;
+    uintptr_t reclaimed = 0;
+    while (segment != nullptr && reclaimed < atmost) {
+        nt_segment_t* next = segment->abandoned_next;
+        if (numa_node >= 0 && segment->numa_node != numa_node) {
+            segment->abandoned_next = remote;
+            remote = segment;
+        } else {
+            reclaimed++;
+            nt_segment_reclaim(segment, heap, tld);
+        }
+        segment = next;
+    }
+    if (reclaimed == 0) {
+        while (remote != nullptr && reclaimed < atmost) {
+            nt_segment_t* next = remote->abandoned_next;
+            reclaimed++;
+            nt_segment_reclaim(remote, heap, tld);
+            remote = next;
+        }
+    }
+
+    //! put back the rest
+    nt_abandoned_push_list(segment);
+    nt_abandoned_push_list(remote);
+    return (reclaimed > 0);
+}
+
+NT_NAMESPACE_END
@@ -0,0 +1,289 @@
+#include "../ntmalloc.h"
+#include "../ntmalloc_atomic.h"
+#include "../ntmalloc_internal.h"
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+NT_NAMESPACE_BEGEN
+
+/**
+ * @brief The process totals, threads add their statistics here when they are done.
+ */
+nt_stats_t _nt_stats_main = { NT_STAT_EMPTY };
+
+/**
+ * -----------------------------------------------------------
+ * Statistics operations
+ * -----------------------------------------------------------
+ */
+
+static bool nt_is_in_main(const void* stat) {
+    return ((const uint8_t*)stat >= (const uint8_t*)&_nt_stats_main
+            && (const uint8_t*)stat < (const uint8_t*)&_nt_stats_main + sizeof(nt_stats_t));
+}
+
+static void nt_stat_update(nt_stat_count_t* stat, int64_t amount) {
+    if (amount == 0) return;
+    if (nt_is_in_main(stat)) {
+        //! the totals are shared by all threads
+        int64_t current = nt_atomic_add(&stat->current, amount);
+        nt_atomic_max64(&stat->peak, current);
+        if (amount > 0) {
+            nt_atomic_add(&stat->allocated, amount);
+        } else {
+            nt_atomic_add(&stat->freed, -amount);
+        }
+        return;
+    }
+    stat->current += amount;
+    if (stat->current > stat->peak) stat->peak = stat->current;
+    if (amount > 0) {
+        stat->allocated += amount;
+    } else {
+        stat->freed += -amount;
+    }
+}
+
+void _nt_stat_increase(nt_stat_count_t* stat, size_t amount) {
+    nt_stat_update(stat, (int64_t)amount);
+}
+
+void _nt_stat_decrease(nt_stat_count_t* stat, size_t amount) {
+    nt_stat_update(stat, -((int64_t)amount));
+}
+
+void _nt_stat_counter_increase(nt_stat_counter_t* stat, size_t amount) {
+    if (nt_is_in_main(stat)) {
+        nt_atomic_add(&stat->count, 1);
+        nt_atomic_add(&stat->total, (int64_t)amount);
+        return;
+    }
+    stat->count++;
+    stat->total += (int64_t)amount;
+}
+
+/**
+ * -----------------------------------------------------------
+ * Merging thread statistics into the process totals
+ * -----------------------------------------------------------
+ */
+
+static void nt_stat_add(nt_stat_count_t* stat, const nt_stat_count_t* src) {
+    if (src->allocated == 0 && src->freed == 0) return;
+    nt_atomic_add(&stat->allocated, src->allocated);
+    nt_atomic_add(&stat->freed, src->freed);
+    int64_t current = nt_atomic_add(&stat->current, src->current);
+    //! the peaks of different threads need not coincide, the largest is a lower bound
+    nt_atomic_max64(&stat->peak, src->peak > current ? src->peak : current);
+}
+
+static void nt_stat_counter_add(nt_stat_counter_t* stat, const nt_stat_counter_t* src) {
+    nt_atomic_add(&stat->total, src->total);
+    nt_atomic_add(&stat->count, src->count);
+}
+
+static void nt_stats_add(nt_stats_t* stats, const nt_stats_t* src) {
+    if (stats == src) return;
+    nt_stat_add(&stats->segments, &src->segments);
+    nt_stat_add(&stats->pages, &src->pages);
+    nt_stat_add(&stats->reserved, &src->reserved);
+    nt_stat_add(&stats->committed, &src->committed);
+    nt_stat_add(&stats->reset, &src->reset);
+    nt_stat_add(&stats->segments_abandoned, &src->segments_abandoned);
+    nt_stat_add(&stats->pages_abandoned, &src->pages_abandoned);
+    nt_stat_add(&stats->pages_extended, &src->pages_extended);
+    nt_stat_add(&stats->mmap_calls, &src->mmap_calls);
+    nt_stat_add(&stats->mmap_right_align, &src->mmap_right_align);
+    nt_stat_add(&stats->mmap_ensure_aligned, &src->mmap_ensure_aligned);
+    nt_stat_add(&stats->threads, &src->threads);
+    nt_stat_add(&stats->huge, &src->huge);
+    nt_stat_add(&stats->large_pages, &src->large_pages);
+    nt_stat_add(&stats->thp_advised, &src->thp_advised);
+    nt_stat_add(&stats->malloc, &src->malloc);
+    nt_stat_counter_add(&stats->searches, &src->searches);
+    nt_stat_counter_add(&stats->numa_foreign_frees, &src->numa_foreign_frees);
+    nt_stat_counter_add(&stats->free_batches, &src->free_batches);
+#if NT_STAT > 1
+    for (size_t i = 0; i <= NT_BIN_HUGE; i++) {
+        nt_stat_add(&stats->normal[i], &src->normal[i]);
+    }
+#endif
+}
+
+void _nt_stats_done(nt_stats_t* stats) {
+    if (stats == &_nt_stats_main) return;
+    nt_stats_add(&_nt_stats_main, stats);
+    memset((void*)stats, 0, sizeof(*stats));
+}
+
+/**
+ * @brief The process totals including the calling thread, which has not added its statistics yet.
+ */
+static void nt_stats_snapshot(nt_stats_t* stats) {
+    memcpy((void*)stats, (const void*)&_nt_stats_main, sizeof(*stats));
+    nt_heap_t* heap = nt_get_default_heap();
+    if (nt_heap_is_initialized(heap)) nt_stats_add(stats, &heap->tld->stats);
+}
+
+void nt_stats_merge(void) {
+    nt_heap_t* heap = nt_get_default_heap();
+    if (nt_heap_is_initialized(heap)) _nt_stats_done(&heap->tld->stats);
+}
+
+void nt_stats_reset(void) {
+    nt_heap_t* heap = nt_get_default_heap();
+    if (nt_heap_is_initialized(heap)) memset((void*)&heap->tld->stats, 0, sizeof(nt_stats_t));
+    memset((void*)&_nt_stats_main, 0, sizeof(nt_stats_t));
+}
+
+/**
+ * -----------------------------------------------------------
+ * Reporting
+ *
+ * Both reports are formatted on the stack, never through `nt_malloc`,
+ * either into a buffer of the caller or straight to a file descriptor.
+ * -----------------------------------------------------------
+ */
+
+typedef struct nt_stats_out {
+    char*   buf;        //! the buffer of the caller when `fd` is -1
+    size_t  size;
+    size_t  len;        //! the length of the complete output, even if it did not fit
+    int     fd;
+    char    line[256];
+} nt_stats_out_t;
+
+static void nt_stats_out_printf(nt_stats_out_t* out, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(out->line, sizeof(out->line), fmt, args);
+    va_end(args);
+    if (n <= 0) return;
+    size_t len = ((size_t)n < sizeof(out->line) ? (size_t)n : sizeof(out->line) - 1);
+    if (out->fd >= 0) {
+        if (write(out->fd, out->line, len) < 0) return;
+    } else if (out->len < out->size) {
+        size_t room = out->size - out->len - 1;
+        memcpy(out->buf + out->len, out->line, (len < room ? len : room));
+    }
+    out->len += len;
+}
+
+typedef struct nt_stat_field {
+    const char* name;
+    size_t      offset;
+} nt_stat_field_t;
+
+#define NT_STAT_FIELD(name)     { #name, offsetof(nt_stats_t, name) }
+
+static const nt_stat_field_t nt_stat_fields[] = {
+    NT_STAT_FIELD(segments),            NT_STAT_FIELD(pages),
+    NT_STAT_FIELD(reserved),            NT_STAT_FIELD(committed),
+    NT_STAT_FIELD(reset),               NT_STAT_FIELD(segments_abandoned),
+    NT_STAT_FIELD(pages_abandoned),     NT_STAT_FIELD(pages_extended),
+    NT_STAT_FIELD(mmap_calls),          NT_STAT_FIELD(mmap_right_align),
+    NT_STAT_FIELD(mmap_ensure_aligned), NT_STAT_FIELD(threads),
+    NT_STAT_FIELD(huge),                NT_STAT_FIELD(large_pages),
+    NT_STAT_FIELD(thp_advised),         NT_STAT_FIELD(malloc),
+};
+
+static const nt_stat_count_t* nt_stat_field(const nt_stats_t* stats, const nt_stat_field_t* field) {
+    return (const nt_stat_count_t*)((const uint8_t*)stats + field->offset);
+}
+
+#if NT_STAT > 1
+/**
+ * @brief The block size of every bin, as set up in the page queues of a heap.
+ */
+static size_t nt_bin_block_size(size_t bin) {
+    return _nt_heap_empty.pages[bin].block_size;
+}
+#endif
+
+static void nt_stats_print_to(nt_stats_out_t* out, const nt_stats_t* stats) {
+    nt_stats_out_printf(out, "%-20s %14s %14s %14s %14s\n", "ntmalloc", "peak", "allocated", "freed", "current");
+    for (const nt_stat_field_t& field : nt_stat_fields) {
+        const nt_stat_count_t* stat = nt_stat_field(stats, &field);
+        nt_stats_out_printf(out, "%-20s %14lld %14lld %14lld %14lld\n", field.name, (long long)stat->peak,
+                            (long long)stat->allocated, (long long)stat->freed, (long long)stat->current);
+    }
+    nt_stats_out_printf(out, "%-20s %14lld %14lld\n", "searches", (long long)stats->searches.count, (long long)stats->searches.total);
+    if (stats->numa_foreign_frees.count != 0) {
+        nt_stats_out_printf(out, "%-20s %14lld %14lld\n", "numa_foreign_frees", (long long)stats->numa_foreign_frees.count,
+                            (long long)stats->numa_foreign_frees.total);
+    }
+    nt_stats_out_printf(out, "%-20s %14lld %14lld\n", "free_batches", (long long)stats->free_batches.count,
+                        (long long)stats->free_batches.total);
+    //! read from the kernel on every call, so only in the table where two calls need not agree
+    int64_t thp_backed = _nt_os_thp_backed();
+    if (thp_backed >= 0) nt_stats_out_printf(out, "%-20s %14s %14s %14s %14lld\n", "thp_backed", "", "", "", (long long)thp_backed);
+#if NT_STAT > 1
+    nt_stats_out_printf(out, "%-6s %10s %14s %14s %14s %14s %14s\n", "bin", "block", "peak", "allocated", "freed", "current", "peak bytes");
+    for (size_t bin = 0; bin < NT_BIN_HUGE; bin++) {
+        const nt_stat_count_t* stat = &stats->normal[bin];
+        if (stat->allocated == 0) continue;
+        size_t block_size = nt_bin_block_size(bin);
+        nt_stats_out_printf(out, "%-6zu %10zu %14lld %14lld %14lld %14lld %14lld\n", bin, block_size, (long long)stat->peak,
+                            (long long)stat->allocated, (long long)stat->freed, (long long)stat->current,
+                            (long long)stat->peak * (long long)block_size);
+    }
+#endif
+}
+
+static void nt_stats_json_to(nt_stats_out_t* out, const nt_stats_t* stats) {
+    nt_stats_out_printf(out, "{");
+    for (const nt_stat_field_t& field : nt_stat_fields) {
+        const nt_stat_count_t* stat = nt_stat_field(stats, &field);
+        nt_stats_out_printf(out, "\"%s\":{\"peak\":%lld,\"allocated\":%lld,\"freed\":%lld,\"current\":%lld},", field.name,
+                            (long long)stat->peak, (long long)stat->allocated, (long long)stat->freed, (long long)stat->current);
+    }
+    nt_stats_out_printf(out, "\"searches\":{\"count\":%lld,\"total\":%lld},", (long long)stats->searches.count,
+                        (long long)stats->searches.total);
+    nt_stats_out_printf(out, "\"numa_foreign_frees\":{\"count\":%lld,\"total\":%lld},", (long long)stats->numa_foreign_frees.count,
+                        (long long)stats->numa_foreign_frees.total);
+    nt_stats_out_printf(out, "\"free_batches\":{\"count\":%lld,\"total\":%lld},\"bins\":[",
+                        (long long)stats->free_batches.count, (long long)stats->free_batches.total);
+#if NT_STAT > 1
+    bool first = true;
+    for (size_t bin = 0; bin < NT_BIN_HUGE; bin++) {
+        const nt_stat_count_t* stat = &stats->normal[bin];
+        if (stat->allocated == 0) continue;
+        size_t block_size = nt_bin_block_size(bin);
+        nt_stats_out_printf(out, "%s{\"bin\":%zu,\"block_size\":%zu,\"peak\":%lld,\"allocated\":%lld,\"freed\":%lld,\"current\":%lld,\"peak_bytes\":%lld}",
+                            (first ? "" : ","), bin, block_size, (long long)stat->peak, (long long)stat->allocated,
+                            (long long)stat->freed, (long long)stat->current, (long long)stat->peak * (long long)block_size);
+        first = false;
+    }
+#endif
+    nt_stats_out_printf(out, "]}");
+}
+
+void nt_stats_print(int fd) {
+    nt_stats_t stats;
+    nt_stats_snapshot(&stats);
+    nt_stats_out_t out;
+    out.buf = nullptr;
+    out.size = 0;
+    out.len = 0;
+    out.fd = fd;
+    nt_stats_print_to(&out, &stats);
+}
+
+size_t nt_stats_json(char* buf, size_t size) {
+    nt_stats_t stats;
+    nt_stats_snapshot(&stats);
+    nt_stats_out_t out;
+    out.buf = buf;
+    out.size = (buf != nullptr ? size : 0);
+    out.len = 0;
+    out.fd = -1;
+    nt_stats_json_to(&out, &stats);
+    if (out.size > 0) out.buf[(out.len < out.size ? out.len : out.size - 1)] = '\0';
+    return out.len;
+}
+
+NT_NAMESPACE_END
@@ -0,0 +1,94 @@
+#include "../ntmalloc.h"
+#include "../ntmalloc_internal.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <unistd.h>
+
+NT_NAMESPACE_BEGEN
+
+/**
+ * -----------------------------------------------------------
+ * Per thread event ring
+ * -----------------------------------------------------------
+ */
+
+#if (NT_TRACE)
+static nt_thread(nt_trace_ring_t) nt_trace_ring;
+
+void _nt_trace(nt_trace_event_t event, uintptr_t arg0, uintptr_t arg1) {
+    nt_trace_ring_t* ring = &nt_trace_ring;
+    nt_trace_entry_t* entry = &ring->entries[ring->count % NT_TRACE_RING_SIZE];
+    entry->seq = ring->count++;
+    entry->event = event;
+    entry->arg0 = arg0;
+    entry->arg1 = arg1;
+}
+#endif
+
+size_t nt_trace_read(nt_trace_entry_t* entries, size_t count) {
+#if (NT_TRACE)
+    const nt_trace_ring_t* ring = &nt_trace_ring;
+    size_t available = (ring->count < NT_TRACE_RING_SIZE ? (size_t)ring->count : NT_TRACE_RING_SIZE);
+    if (count > available) count = available;
+    //! the newest `count` events, oldest first
+    uint64_t first = ring->count - count;
+    for (size_t i = 0; i < count; i++) {
+        entries[i] = ring->entries[(first + i) % NT_TRACE_RING_SIZE];
+    }
+    return count;
+#else
+    UNUSED(entries);
+    UNUSED(count);
+    return 0;
+#endif
+}
+
+const char* nt_trace_event_name(nt_trace_event_t event) {
+    switch (event) {
+        case NT_TRACE_NONE:             return "none";
+        case NT_TRACE_PROCESS_INIT:     return "process_init";
+        case NT_TRACE_THREAD_INIT:      return "thread_init";
+        case NT_TRACE_THREAD_DONE:      return "thread_done";
+        case NT_TRACE_MALLOC_GENERIC:   return "malloc_generic";
+        case NT_TRACE_PAGE_FRESH:       return "page_fresh";
+        case NT_TRACE_PAGE_FULL:        return "page_full";
+        case NT_TRACE_PAGE_UNFULL:      return "page_unfull";
+        case NT_TRACE_PAGE_RETIRE:      return "page_retire";
+        case NT_TRACE_HUGE_ALLOC:       return "huge_alloc";
+        case NT_TRACE_DELAYED_FREE:     return "delayed_free";
+        case NT_TRACE_SEGMENT_ALLOC:    return "segment_alloc";
+        case NT_TRACE_SEGMENT_CACHED:   return "segment_cached";
+        case NT_TRACE_SEGMENT_FREE:     return "segment_free";
+        case NT_TRACE_OS_ALLOC:         return "os_alloc";
+        case NT_TRACE_OS_FREE:          return "os_free";
+        case NT_TRACE_OS_RESET:         return "os_reset";
+        case NT_TRACE_SEGMENT_ABANDON:  return "segment_abandon";
+        case NT_TRACE_SEGMENT_RECLAIM:  return "segment_reclaim";
+        default:                        return "unknown";
+    }
+}
+
+size_t nt_trace_dump(int fd) {
+    //! formatted on the stack and written directly, so dumping works from anywhere, even a signal handler
+    char line[128];
+#if (NT_TRACE)
+    const nt_trace_ring_t* ring = &nt_trace_ring;
+    size_t available = (ring->count < NT_TRACE_RING_SIZE ? (size_t)ring->count : NT_TRACE_RING_SIZE);
+    uint64_t first = ring->count - available;
+    for (size_t i = 0; i < available; i++) {
+        const nt_trace_entry_t* entry = &ring->entries[(first + i) % NT_TRACE_RING_SIZE];
+        int len = snprintf(line, sizeof(line), "%8llu %-16s 0x%zx 0x%zx\n", (unsigned long long)entry->seq,
+                           nt_trace_event_name(entry->event), (size_t)entry->arg0, (size_t)entry->arg1);
+        if (len > 0 && write(fd, line, (size_t)len) < 0) return i;
+    }
+    return available;
+#else
+    int len = snprintf(line, sizeof(line), "ntmalloc: tracing is disabled, build with NT_TRACE=1\n");
+    if (len > 0 && write(fd, line, (size_t)len) < 0) return 0;
+    return 0;
+#endif
+}
+
+NT_NAMESPACE_END
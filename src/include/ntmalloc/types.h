@@ -66,6 +66,16 @@ constexpr const size_t NT_SMALL_PAGE_SIZE   = 1 << NT_SMALL_PAGE_SHIFT;
  */
 constexpr const size_t NT_LARGE_PAGE_SIZE   = 1 << NT_LARGE_PAGE_SHIFT;
 
+/**
+ * @brief The segment info is rounded up to this, so every page starts at least this well aligned.
+ */
+constexpr const size_t NT_SEGMENT_INFO_ALIGN = 16 * 16;
+
+/**
+ * @brief The size of a transparent or hugetlbfs huge page of the OS, 2mb
+ */
+constexpr const size_t NT_LARGE_OS_PAGE_SIZE = 1 << 21;
+
 constexpr const size_t NT_SMALL_PAGES_PER_SEGMENT = NT_SEGMENT_SIZE / NT_SMALL_PAGE_SIZE;
 constexpr const size_t NT_LARGE_PAGES_PER_SEGMENT = NT_SEGMENT_SIZE / NT_LARGE_PAGE_SIZE;
 
@@ -87,13 +97,15 @@ typedef enum nt_delayed {
     NT_NO_DELAYED_FREE = 0,
     NT_USE_DELAYED_FREE,
     NT_DELAYED_FREEING,
+    NT_NEVER_DELAYED_FREE,      // the page is abandoned, other threads always free into the page
 } nt_delayed_t;
 
 typedef union nt_page_flags {
-    uint16_t value;
+    uint32_t value;
     struct {
         bool has_aligned;
         bool is_full;
+        bool has_sampled;       // a block of the page was sampled by the heap profiler
     };
 } nt_page_flags_t;
 
@@ -135,10 +147,14 @@ typedef struct nt_page {
     uint8_t             segment_idx;
     bool                segment_used;
     bool                is_reset;
+    bool                is_zero_init;       //! the memory of the page is still zeroed, fresh from the OS
 
     nt_page_flags_t     flags;
     uint16_t            capacity;
     uint16_t            reserved;
+    bool                is_zero;            //! the blocks on `free` are zeroed, except for their link
+    bool                batch_free;         //! other threads may hold frees back in batches, not for heaps that `nt_heap_destroy` releases
+    uint16_t            sampled;            //! blocks of the page in the heap profile, guarded by its lock
     
     nt_block_t*         free;               //! list of available free blocks (`malloc` allocates from this list)
     uintptr_t           cookie;
@@ -150,16 +166,26 @@ typedef struct nt_page {
 
     size_t              block_size;
     nt_heap_t*          heap;
+    struct nt_free_batch* volatile batch;   //! the slot of another thread holding back frees into this page
     nt_page*            next;
     nt_page*            prev;
 } nt_page_t;
 
 typedef enum nt_page_kind {
-    NT_PAGE_SAMLL,
+    NT_PAGE_SMALL,
     NT_PAGE_LARGE,
     NT_PAGE_HUGE,
 } nt_page_kind_t;
 
+/**
+ * @brief How the OS backs the memory of a segment.
+ */
+typedef enum nt_os_mem_kind {
+    NT_OS_MEM_NORMAL,
+    NT_OS_MEM_THP,          // advised with `MADV_HUGEPAGE`, backed by transparent huge pages when the kernel can
+    NT_OS_MEM_HUGETLB,      // mapped with `MAP_HUGETLB`, always huge pages, never purged
+} nt_os_mem_kind_t;
+
 /**
  * @brief Segments are large allocated memory blocks (2mb on 64 bit) from
  * the OS. Inside segments we allocated fixed size _pages_ that contain blocks.
@@ -178,6 +204,9 @@ typedef struct nt_segment {
     size_t          page_shift;
     uintptr_t       thread_id;
     nt_page_kind_t  page_kind;      // kind of pages: small, large, or huge
+    bool            is_reset;       // the memory of a cached segment was purged
+    nt_os_mem_kind_t mem_kind;
+    int             numa_node;      // the node the memory was placed on, 0 on single node machines
     nt_page_t       pages[1];
 } nt_segment_t;
 
@@ -205,6 +234,8 @@ typedef struct nt_heap {
     uintptr_t               cookie;
     uintptr_t               random;
     size_t                  page_count;
+    nt_heap_t*              next;                                       //! the other heaps made by `nt_heap_new` in this thread
+    int64_t                 sample_countdown;                           //! bytes left to allocate until the heap profiler samples
     bool                    no_reclaim;
 } nt_heap_t;
 
@@ -262,8 +293,12 @@ typedef struct nt_stats {
     nt_stat_count_t mmap_ensure_aligned;
     nt_stat_count_t threads;
     nt_stat_count_t huge;
+    nt_stat_count_t large_pages;        // bytes mapped with `MAP_HUGETLB`
+    nt_stat_count_t thp_advised;        // bytes advised with `MADV_HUGEPAGE`
     nt_stat_count_t malloc;
-    nt_stat_counter_t seraches;
+    nt_stat_counter_t searches;
+    nt_stat_counter_t numa_foreign_frees;   // frees from a thread on another NUMA node than the memory, in bytes
+    nt_stat_counter_t free_batches;         // chains of blocks freed by another thread with one CAS, in blocks
 #ifdef NT_STAT
 #   if NT_STAT > 1
     nt_stat_count_t normal[NT_BIN_HUGE + 1];
@@ -283,6 +318,7 @@ typedef struct nt_segments_tld {
     size_t             cache_count;
     size_t             cache_size;
     nt_segment_queue_t cache;
+    nt_page_queue_t    pages_purge;     // free pages waiting for their purge delay, newest first
     nt_stats_t*        stats;
 } nt_segments_tld_t;
 
@@ -291,12 +327,31 @@ typedef struct nt_os_tld {
     void*               mmap_previous;
     uint8_t*            pool;
     size_t              pool_available;
+    int                 numa_node;      // the node the thread last ran on, new segments are placed there
     nt_stats_t*         stats;
 } nt_os_tld_t;
 
+/**
+ * @brief The frees into one page of another thread, held back to be pushed as one chain.
+ */
+typedef struct nt_free_batch {
+    nt_page_t*          page;       // the page of the chain, only used by the thread of the slot
+    volatile uintptr_t  head;       // the chain, appended to by the thread of the slot, taken whole by either side
+    nt_block_t*         last;       // the tail of the chain
+    size_t              count;      // the length of the chain, unless the owner took it meanwhile
+} nt_free_batch_t;
+
+/**
+ * @brief The number of pages a thread holds back frees for at a time.
+ */
+constexpr const size_t NT_FREE_BATCH_SLOTS = 32;
+
 typedef struct nt_tld {
     unsigned long long  heartbeat;
+    bool                free_batch_done;    // the thread is done, its frees are no longer held back
+    nt_free_batch_t     free_batch[NT_FREE_BATCH_SLOTS];
     nt_heap_t*          heap_backing;
+    nt_heap_t*          heaps;          // heaps made by `nt_heap_new`, linked by `next`
     nt_segments_tld_t   segments;
     nt_os_tld_t         os;
     nt_stats_t          stats;
@@ -323,12 +378,23 @@ typedef struct nt_tld {
 #define nt_assert_expensive(x)
 #endif
 
+void _nt_stat_increase(nt_stat_count_t* stat, size_t amount);
 void _nt_stat_decrease(nt_stat_count_t* stat, size_t amount);
+void _nt_stat_counter_increase(nt_stat_counter_t* stat, size_t amount);
 
 #if (NT_STAT)
-#   define nt_stat_decrease(stat, amount)       _nt_stat_decrease(&(stat), amount)
+#   define nt_stat_increase(stat, amount)           _nt_stat_increase(&(stat), amount)
+#   define nt_stat_decrease(stat, amount)           _nt_stat_decrease(&(stat), amount)
+#   define nt_stat_counter_increase(stat, amount)   _nt_stat_counter_increase(&(stat), amount)
+#else
+#   define nt_stat_increase(stat, amount)           (void)0
+#   define nt_stat_decrease(stat, amount)           (void)0
+#   define nt_stat_counter_increase(stat, amount)   (void)0
 #endif
 
+#define nt_heap_stat_increase(heap, stat, amount)  nt_stat_increase((heap)->tld->stats.stat, amount)
+#define nt_heap_stat_decrease(heap, stat, amount)  nt_stat_decrease((heap)->tld->stats.stat, amount)
+
 NT_NAMESPACE_END
 
 #endif //! __LIBNT_MALLOC_DEFS_H
\ No newline at end of file
@@ -1,8 +1,11 @@
+#ifndef __LIBNT_SOCKET_H
+#define __LIBNT_SOCKET_H
 
 #include "defs.h"
 #include "fd.h"
 #include <memory>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 NT_NAMESPACE_BEGEN
 class socket {
@@ -15,6 +18,18 @@ class socket {
     socket &operator=(socket &&) = delete;
     socket(std::string ip, short port);
 
+    /**
+     * @brief Connect to `ip:port` without terminating the process on failure.
+     *
+     * Unlike the constructor, a refused or unreachable peer is reported to the
+     * caller, which is what reconnecting clients need.
+     *
+     * @param ip The dotted IPv4 address of the server.
+     * @param port The port of the server.
+     * @return the connected socket, or nullptr if the connection failed.
+     */
+    static std::unique_ptr<socket> connect(const std::string &ip, short port);
+
     /**
      * @brief Read data from socket fd
      * @param buf The buffer to read the data into.
@@ -23,6 +38,10 @@ class socket {
      * second of return value is number of bytes written.
      */
     ssize_t recv(std::string &buf, ssize_t limits = limits::max());
+    /**
+     * @brief Read data from socket fd into a buffer of a `std::pmr::memory_resource`.
+     */
+    ssize_t recv(std::pmr::string &buf, ssize_t limits = limits::max());
 
     /**
      * @brief Read data from socket fd
@@ -32,6 +51,15 @@ class socket {
      */
     std::pair<std::string, ssize_t> recv(ssize_t limits = limits::max());
 
+    /**
+     * @brief Read at most `len` raw bytes into a caller owned buffer.
+     *
+     * @param buf The buffer to receive into.
+     * @param len The capacity of `buf`.
+     * @return the number of bytes received, 0 on orderly shutdown, -1 on error.
+     */
+    ssize_t recv(char *buf, size_t len);
+
     /**
      * @brief Send data through the file descriptor.
      *
@@ -43,8 +71,42 @@ class socket {
 
     ssize_t send(std::string& content);
 
+    /**
+     * @brief Gather-write several buffers with a single system call.
+     *
+     * @param iov The buffers to be sent.
+     * @param iovcnt The number of buffers.
+     * @return The number of bytes sent, -1 on error.
+     */
+    ssize_t sendv(const struct iovec *iov, int iovcnt);
+
+    /**
+     * @brief Enable or disable Nagle's algorithm (`TCP_NODELAY`).
+     *
+     * @param enable true to send small segments immediately.
+     * @return true if the option was applied.
+     */
+    bool set_nodelay(bool enable);
+
+    /**
+     * @brief Switch the socket between blocking and non-blocking mode.
+     *
+     * @param enable true to make `recv`/`send` return -1 with `EAGAIN` instead of waiting.
+     * @return true if the mode was applied.
+     */
+    bool set_nonblocking(bool enable);
+
+    /**
+     * @brief Get the native socket descriptor.
+     */
+    int get_fd() const;
+
   private:
+    explicit socket(int fd);
+
     std::unique_ptr<nt::file_discriptor> _fd;
 };
 
-NT_NAMESPACE_END
\ No newline at end of file
+NT_NAMESPACE_END
+
+#endif //! __LIBNT_SOCKET_H
@@ -2,9 +2,12 @@
 #include "include/defs.h"
 #include "include/log.h"
 #include <arpa/inet.h>
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
 #include <memory>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdexcept>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -31,14 +34,46 @@ socket::socket(std::string ip, short port) {
     _fd = std::make_unique<file_discriptor>(ret);
 }
 
+socket::socket(int fd) : _fd(std::make_unique<file_discriptor>(fd)) {}
+
+std::unique_ptr<socket> socket::connect(const std::string &ip, short port) {
+    int ret = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (ret == -1) {
+        erron << "create socket error!";
+        return nullptr;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(ip.c_str());
+    addr.sin_port = htons(port);
+
+    if (::connect(ret, (sockaddr *)&addr, sizeof(addr)) == -1) {
+        ::close(ret);
+        return nullptr;
+    }
+    return std::unique_ptr<socket>(new socket(ret));
+}
+
 ssize_t socket::recv(std::string &buf, ssize_t limits) {
     return _fd->read(buf, limits);
 }
+ssize_t socket::recv(std::pmr::string &buf, ssize_t limits) {
+    return _fd->read(buf, limits);
+}
 std::pair<std::string, ssize_t> socket::recv(ssize_t limits) {
     std::string res;
     ssize_t writted = _fd->receive(res, limits);
     return std::make_pair(res, writted);
 }
+ssize_t socket::recv(char *buf, size_t len) {
+    ssize_t ret = 0;
+    do {
+        ret = ::recv(get_fd(), buf, len, 0);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
 
 ssize_t socket::send(const char *content, const ssize_t buf_len) {
     return _fd->send(content, buf_len);
@@ -46,4 +81,29 @@ ssize_t socket::send(const char *content, const ssize_t buf_len) {
 ssize_t socket::send(std::string &content) {
     return send(content.c_str(), content.length());
 }
-NT_NAMESPACE_END
\ No newline at end of file
+ssize_t socket::sendv(const struct iovec *iov, int iovcnt) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec *>(iov);
+    msg.msg_iovlen = iovcnt;
+
+    ssize_t ret = 0;
+    do {
+        //! `MSG_NOSIGNAL` so a peer that already closed does not kill us with SIGPIPE
+        ret = ::sendmsg(get_fd(), &msg, MSG_NOSIGNAL);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
+
+bool socket::set_nodelay(bool enable) {
+    int flag = enable ? 1 : 0;
+    return ::setsockopt(get_fd(), IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) == 0;
+}
+bool socket::set_nonblocking(bool enable) {
+    int flag = ::fcntl(get_fd(), F_GETFL);
+    if (flag == -1) return false;
+    flag = enable ? (flag | O_NONBLOCK) : (flag & ~O_NONBLOCK);
+    return ::fcntl(get_fd(), F_SETFL, flag) == 0;
+}
+int socket::get_fd() const { return static_cast<int>(_fd->get_fd()); }
+NT_NAMESPACE_END
@@ -0,0 +1,649 @@
+/// ntbench runs standard allocator workloads against ntmalloc and the system
+/// allocator and reports the throughput, the resident set left behind and
+/// its peak. Every run happens in a forked child, so one allocator never
+/// inherits the heap of another and the peak is that of the run alone.
+/// The trace workload replays the allocations our HTTP layer makes for
+/// requests and responses (recorded through a `std::pmr` resource), or a
+/// trace file given with `--trace`.
+
+#include "../include/defs.h"
+#include "../include/http/http_request.h"
+#include "../include/http/http_response.h"
+#include "../include/ntmalloc/ntmalloc.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+/**
+ * @brief The allocator under test.
+ */
+struct allocator_ops {
+    const char* name;
+    void* (*malloc)(size_t);
+    void  (*free)(void*);
+    void* (*realloc)(void*, size_t);
+};
+
+void* sys_malloc(size_t size) { return ::malloc(size); }
+void  sys_free(void* p) { ::free(p); }
+void* sys_realloc(void* p, size_t size) { return ::realloc(p, size); }
+
+const allocator_ops allocators[] = {
+    { "ntmalloc", nt::nt_malloc, nt::nt_free, nt::nt_realloc },
+    { "system",   sys_malloc,    sys_free,    sys_realloc },
+};
+
+/**
+ * @brief One allocation (`size` != 0) or free (`size` == 0) of a trace, the id names the block.
+ */
+struct trace_event {
+    uint32_t id;
+    uint32_t size;
+};
+
+/**
+ * @brief The command line configuration of a run.
+ */
+struct config {
+    size_t      threads = 4;
+    double      scale = 1.0;            // multiplies the iterations of every workload
+    std::string workloads;              // comma separated, empty for all
+    std::string allocators;             // comma separated, empty for all
+    std::string trace_file;             // replayed by the trace workload instead of the recorded HTTP trace
+    std::string record_file;            // where to write the recorded HTTP trace
+    bool        json = false;
+    bool        stats = false;          // print the ntmalloc statistics of every ntmalloc run to stderr
+
+    std::vector<trace_event> trace;
+    uint32_t    trace_ids = 0;          // the number of distinct ids in `trace`
+};
+
+/**
+ * @brief What a child reports back through its pipe.
+ */
+struct result {
+    uint64_t ops = 0;                   // allocations and frees
+    double   seconds = 0.0;
+    long     rss_kb = 0;                // resident after the workload freed everything
+    long     peak_kb = 0;               // the high water mark during the workload
+};
+
+/**
+ * @brief A small, fast generator, one per thread so that workloads do not share a cache line.
+ */
+struct xorshift {
+    uint64_t state;
+    explicit xorshift(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    size_t range(size_t min, size_t max) { return min + static_cast<size_t>(next() % (max - min + 1)); }
+};
+
+/**
+ * @brief A reusable barrier, `std::barrier` is C++20.
+ */
+class barrier {
+    std::mutex lock;
+    std::condition_variable cv;
+    size_t count;
+    size_t waiting = 0;
+    size_t generation = 0;
+public:
+    explicit barrier(size_t n) : count(n) {}
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock);
+        size_t gen = generation;
+        if (++waiting == count) {
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+            return;
+        }
+        cv.wait(guard, [this, gen]() { return gen != generation; });
+    }
+};
+
+inline void touch(void* p, size_t size) {
+    //! a store per page, as a user of the memory would make
+    for (size_t i = 0; i < size; i += 4096) static_cast<volatile char*>(p)[i] = 1;
+    if (size != 0) static_cast<volatile char*>(p)[size - 1] = 1;
+}
+
+size_t scaled(const config& cfg, size_t n) {
+    size_t value = static_cast<size_t>(static_cast<double>(n) * cfg.scale);
+    return value == 0 ? 1 : value;
+}
+
+/** ---- Workloads ---- */
+
+/**
+ * @brief larson: every thread replaces random blocks of its slots, then hands them to its neighbour,
+ * so most blocks are freed by another thread than the one allocating them.
+ */
+uint64_t run_larson(const config& cfg, const allocator_ops& ops) {
+    const size_t slots = 1000;
+    const size_t rounds = scaled(cfg, 20);
+    const size_t replacements = 20000;
+    std::vector<std::vector<void*>> arrays(cfg.threads, std::vector<void*>(slots, nullptr));
+    barrier sync(cfg.threads);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < cfg.threads; t++) {
+        workers.emplace_back([&, t]() {
+            xorshift rng(t + 1);
+            for (size_t r = 0; r < rounds; r++) {
+                std::vector<void*>& slot = arrays[(t + r) % cfg.threads];
+                for (size_t i = 0; i < replacements; i++) {
+                    size_t idx = rng.range(0, slots - 1);
+                    ops.free(slot[idx]);
+                    size_t size = rng.range(16, 1024);
+                    slot[idx] = ops.malloc(size);
+                    static_cast<char*>(slot[idx])[0] = 1;
+                }
+                sync.wait();
+            }
+            for (void*& p : arrays[(t + rounds) % cfg.threads]) {
+                ops.free(p);
+                p = nullptr;
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    return 2 * rounds * replacements * cfg.threads;
+}
+
+/**
+ * @brief cache-scratch: each thread frees a small block allocated next to those of the other
+ * threads, then repeatedly allocates and writes one; an allocator that hands out blocks of one
+ * cache line to several threads makes the writes false share.
+ */
+uint64_t run_cache_scratch(const config& cfg, const allocator_ops& ops) {
+    const size_t iterations = scaled(cfg, 200000);
+    const size_t writes = 50;
+    std::vector<void*> initial(cfg.threads);
+    for (void*& p : initial) p = ops.malloc(8);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < cfg.threads; t++) {
+        workers.emplace_back([&, t]() {
+            ops.free(initial[t]);
+            for (size_t i = 0; i < iterations; i++) {
+                volatile char* p = static_cast<volatile char*>(ops.malloc(8));
+                for (size_t j = 0; j < writes; j++) p[j % 8] = static_cast<char>(p[j % 8] + 1);
+                ops.free(const_cast<char*>(p));
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    return 2 * (iterations + 1) * cfg.threads;
+}
+
+/**
+ * @brief size-classes: batches of blocks of one size are allocated and freed, for sizes from 8 bytes to 64 KiB.
+ */
+uint64_t run_size_classes(const config& cfg, const allocator_ops& ops) {
+    const size_t repeats = scaled(cfg, 40);
+    const size_t batch = 256;
+    std::vector<size_t> sizes;
+    for (size_t size = 8; size <= 64 * 1024; size *= 2) {
+        sizes.push_back(size);
+        sizes.push_back(size + size / 2);
+    }
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < cfg.threads; t++) {
+        workers.emplace_back([&]() {
+            std::vector<void*> blocks(batch);
+            for (size_t r = 0; r < repeats; r++) {
+                for (size_t size : sizes) {
+                    for (void*& p : blocks) {
+                        p = ops.malloc(size);
+                        static_cast<char*>(p)[0] = 1;
+                    }
+                    //! every other block first, so pages are not simply emptied in order
+                    for (size_t i = 0; i < batch; i += 2) ops.free(blocks[i]);
+                    for (size_t i = 1; i < batch; i += 2) ops.free(blocks[i]);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    return 2 * repeats * sizes.size() * batch * cfg.threads;
+}
+
+/**
+ * @brief realloc: buffers grow by a quarter at a time from 16 bytes to 256 KiB, as a string or a receive buffer does.
+ */
+uint64_t run_realloc(const config& cfg, const allocator_ops& ops) {
+    const size_t repeats = scaled(cfg, 2000);
+    std::atomic<uint64_t> total { 0 };
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < cfg.threads; t++) {
+        workers.emplace_back([&]() {
+            uint64_t count = 0;
+            for (size_t r = 0; r < repeats; r++) {
+                void* p = nullptr;
+                for (size_t size = 16; size <= 256 * 1024; size += size / 4 + 8) {
+                    p = ops.realloc(p, size);
+                    static_cast<char*>(p)[size - 1] = 1;
+                    count++;
+                }
+                ops.free(p);
+                count++;
+            }
+            total.fetch_add(count, std::memory_order_relaxed);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    return total.load();
+}
+
+/**
+ * @brief A bounded single producer, single consumer queue of blocks.
+ */
+struct spsc_ring {
+    static constexpr size_t capacity = 1024;
+    void* slots[capacity];
+    alignas(64) std::atomic<size_t> head { 0 };
+    alignas(64) std::atomic<size_t> tail { 0 };
+
+    bool push(void* p) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == capacity) return false;
+        slots[t % capacity] = p;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(void** p) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        *p = slots[h % capacity];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/**
+ * @brief producer-consumer: pairs of threads where one allocates request buffers and the other frees them.
+ */
+uint64_t run_producer_consumer(const config& cfg, const allocator_ops& ops) {
+    const size_t pairs = cfg.threads < 2 ? 1 : cfg.threads / 2;
+    const size_t count = scaled(cfg, 1000000);
+    std::vector<spsc_ring> rings(pairs);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < pairs; t++) {
+        workers.emplace_back([&, t]() {
+            xorshift rng(t + 1);
+            for (size_t i = 0; i < count; i++) {
+                size_t size = rng.range(16, 512);
+                void* p = ops.malloc(size);
+                static_cast<char*>(p)[0] = 1;
+                while (!rings[t].push(p)) std::this_thread::yield();
+            }
+        });
+        workers.emplace_back([&, t]() {
+            void* p = nullptr;
+            for (size_t i = 0; i < count; i++) {
+                while (!rings[t].pop(&p)) std::this_thread::yield();
+                ops.free(p);
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    return 2 * count * pairs;
+}
+
+/**
+ * @brief trace: every thread replays the trace on its own.
+ */
+uint64_t run_trace(const config& cfg, const allocator_ops& ops) {
+    const size_t repeats = scaled(cfg, 20);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < cfg.threads; t++) {
+        workers.emplace_back([&]() {
+            std::vector<void*> blocks(cfg.trace_ids, nullptr);
+            for (size_t r = 0; r < repeats; r++) {
+                for (const trace_event& event : cfg.trace) {
+                    if (event.size != 0) {
+                        blocks[event.id] = ops.malloc(event.size);
+                        touch(blocks[event.id], event.size);
+                    } else {
+                        ops.free(blocks[event.id]);
+                        blocks[event.id] = nullptr;
+                    }
+                }
+                //! a trace may end with blocks still alive
+                for (void*& p : blocks) {
+                    ops.free(p);
+                    p = nullptr;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    return repeats * cfg.trace.size() * cfg.threads;
+}
+
+struct workload {
+    const char* name;
+    uint64_t (*run)(const config&, const allocator_ops&);
+};
+
+const workload workloads[] = {
+    { "larson",            run_larson },
+    { "cache-scratch",     run_cache_scratch },
+    { "size-classes",      run_size_classes },
+    { "realloc",           run_realloc },
+    { "producer-consumer", run_producer_consumer },
+    { "trace",             run_trace },
+};
+
+/** ---- HTTP trace ---- */
+
+/**
+ * @brief Records the allocations made through it as a trace, and serves them from `upstream`.
+ */
+class recording_resource : public std::pmr::memory_resource {
+    std::pmr::memory_resource* upstream;
+    std::vector<trace_event>& events;
+    std::unordered_map<void*, uint32_t> live;
+    std::vector<uint32_t> free_ids;     // ids are reused so the replay needs few slots
+    uint32_t next_id = 0;
+public:
+    explicit recording_resource(std::vector<trace_event>& out)
+        : upstream(std::pmr::new_delete_resource()), events(out) {}
+
+    uint32_t ids() const { return next_id; }
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* p = upstream->allocate(bytes, alignment);
+        uint32_t id = next_id;
+        if (!free_ids.empty()) {
+            id = free_ids.back();
+            free_ids.pop_back();
+        } else {
+            next_id++;
+        }
+        live[p] = id;
+        events.push_back({ id, static_cast<uint32_t>(bytes == 0 ? 1 : bytes) });
+        return p;
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        auto found = live.find(p);
+        if (found != live.end()) {
+            events.push_back({ found->second, 0 });
+            free_ids.push_back(found->second);
+            live.erase(found);
+        }
+        upstream->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+/**
+ * @brief Records what parsing and answering a stream of requests allocates, a few requests in flight at a time.
+ */
+void record_http_trace(config& cfg) {
+    recording_resource resource(cfg.trace);
+    {
+        std::pmr::polymorphic_allocator<char> alloc(&resource);
+        const size_t in_flight = 16;
+        std::vector<nt::HTTP::pmr::Request> requests;
+        std::vector<nt::HTTP::pmr::Response> responses;
+        xorshift rng(42);
+        for (size_t i = 0; i < 2000; i++) {
+            std::string raw = "GET /api/items/" + std::to_string(i) + "?page=" + std::to_string(rng.range(1, 99)) + " HTTP/1.1\r\n"
+                              "Host: backend.local\r\nUser-Agent: ntload\r\nAccept: */*\r\n";
+            for (size_t h = rng.range(0, 6); h > 0; h--) {
+                raw += "X-Trace-" + std::to_string(h) + ": " + std::string(rng.range(8, 120), 'v') + "\r\n";
+            }
+            raw += "\r\n";
+            if (requests.size() == in_flight) requests.erase(requests.begin());
+            requests.emplace_back(alloc);
+            nt::HTTP::parse_request(raw.data(), raw.size(), requests.back());
+
+            nt::HTTP::pmr::Response resp(alloc);
+            resp.status = 200;
+            resp.headers.emplace("Content-Type", "application/json");
+            resp.body.assign(rng.range(64, 16 * 1024), 'b');
+            std::pmr::string wire(alloc);
+            resp.serialize(wire);
+            if (responses.size() == in_flight) responses.erase(responses.begin());
+            responses.emplace_back(alloc);
+            nt::HTTP::parse_response(wire.data(), wire.size(), responses.back());
+        }
+    }
+    cfg.trace_ids = resource.ids();
+}
+
+bool load_trace(config& cfg) {
+    FILE* file = fopen(cfg.trace_file.c_str(), "r");
+    if (file == nullptr) return false;
+    char op = 0;
+    unsigned long id = 0;
+    unsigned long size = 0;
+    bool ok = true;
+    while (ok && fscanf(file, " %c %lu", &op, &id) == 2) {
+        if (op == 'a') {
+            ok = (fscanf(file, "%lu", &size) == 1 && size != 0);
+            cfg.trace.push_back({ static_cast<uint32_t>(id), static_cast<uint32_t>(size) });
+        } else if (op == 'f') {
+            cfg.trace.push_back({ static_cast<uint32_t>(id), 0 });
+        } else {
+            ok = false;
+        }
+        if (id >= cfg.trace_ids) cfg.trace_ids = static_cast<uint32_t>(id + 1);
+    }
+    ok = ok && feof(file);
+    fclose(file);
+    return ok;
+}
+
+bool save_trace(const config& cfg) {
+    FILE* file = fopen(cfg.record_file.c_str(), "w");
+    if (file == nullptr) return false;
+    for (const trace_event& event : cfg.trace) {
+        if (event.size != 0) fprintf(file, "a %u %u\n", event.id, event.size);
+        else fprintf(file, "f %u\n", event.id);
+    }
+    return fclose(file) == 0;
+}
+
+/** ---- Runs ---- */
+
+/**
+ * @brief Reads a `kB` field of /proc/self/status, e.g. `VmRSS` or `VmHWM`.
+ */
+long status_kb(const char* field) {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file == nullptr) return -1;
+    char line[256];
+    long value = -1;
+    size_t len = strlen(field);
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        if (strncmp(line, field, len) == 0 && line[len] == ':') {
+            value = strtol(line + len + 1, nullptr, 10);
+            break;
+        }
+    }
+    fclose(file);
+    return value;
+}
+
+void reset_peak() {
+    //! `5` resets the high water mark of the resident set (Linux 4.0)
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (file == nullptr) return;
+    fputs("5", file);
+    fclose(file);
+}
+
+/**
+ * @brief Runs one workload in a child process, so it starts from a fresh heap.
+ */
+bool run_forked(const config& cfg, const workload& load, const allocator_ops& ops, result& res) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        result child;
+        long base = status_kb("VmRSS");
+        reset_peak();
+        clock_type::time_point start = clock_type::now();
+        child.ops = load.run(cfg, ops);
+        child.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+        //! what the allocator keeps of the workload once everything is freed, and at most
+        child.rss_kb = status_kb("VmRSS") - base;
+        child.peak_kb = status_kb("VmHWM") - base;
+        if (cfg.stats && ops.free == nt::nt_free) {
+            fprintf(stderr, "%s:\n", load.name);
+            nt::nt_stats_print(STDERR_FILENO);
+        }
+        bool written = (write(fds[1], &child, sizeof(child)) == static_cast<ssize_t>(sizeof(child)));
+        _exit(written ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = (read(fds[0], &res, sizeof(res)) == static_cast<ssize_t>(sizeof(res)));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool selected(const std::string& list, const char* name) {
+    if (list.empty()) return true;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        if (list.compare(start, end - start, name) == 0) return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+void usage() {
+    fprintf(stderr,
+        "Usage: ntbench <options>\n"
+        "  -t, --threads    <N>  number of threads (default 4)\n"
+        "  -s, --scale      <F>  multiply the iterations of every workload (default 1)\n"
+        "  -w, --workloads  <L>  comma separated workloads (default all):\n"
+        "                        larson, cache-scratch, size-classes, realloc, producer-consumer, trace\n"
+        "  -a, --allocators <L>  comma separated allocators (default all): ntmalloc, system\n"
+        "      --trace      <F>  replay this trace instead of the recorded HTTP trace,\n"
+        "                        lines of `a <id> <size>` and `f <id>`\n"
+        "      --record     <F>  write the recorded HTTP trace to this file\n"
+        "      --stats            print the ntmalloc statistics of every run to stderr,\n"
+        "                         e.g. `free_batches` shows the blocks freed per atomic push\n"
+        "      --json             print the results as JSON\n");
+}
+
+}
+
+int main(int argc, char** argv) {
+    config cfg;
+
+    static const option long_options[] = {
+        { "threads",    required_argument, nullptr, 't' },
+        { "scale",      required_argument, nullptr, 's' },
+        { "workloads",  required_argument, nullptr, 'w' },
+        { "allocators", required_argument, nullptr, 'a' },
+        { "trace",      required_argument, nullptr, 'T' },
+        { "record",     required_argument, nullptr, 'r' },
+        { "json",       no_argument,       nullptr, 'j' },
+        { "stats",      no_argument,       nullptr, 'S' },
+        { "help",       no_argument,       nullptr, 'h' },
+        { nullptr,      0,                 nullptr, 0 },
+    };
+
+    int opt = 0;
+    while ((opt = getopt_long(argc, argv, "t:s:w:a:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 't': cfg.threads = strtoul(optarg, nullptr, 10); break;
+            case 's': cfg.scale = strtod(optarg, nullptr); break;
+            case 'w': cfg.workloads = optarg; break;
+            case 'a': cfg.allocators = optarg; break;
+            case 'T': cfg.trace_file = optarg; break;
+            case 'r': cfg.record_file = optarg; break;
+            case 'j': cfg.json = true; break;
+            case 'S': cfg.stats = true; break;
+            case 'h':
+            default:
+                usage();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc || cfg.threads == 0 || cfg.scale <= 0) {
+        usage();
+        return 1;
+    }
+
+    if (!cfg.trace_file.empty()) {
+        if (!load_trace(cfg)) {
+            fprintf(stderr, "invalid trace: %s\n", cfg.trace_file.c_str());
+            return 1;
+        }
+    } else {
+        record_http_trace(cfg);
+    }
+    if (!cfg.record_file.empty() && !save_trace(cfg)) {
+        fprintf(stderr, "unable to write %s\n", cfg.record_file.c_str());
+        return 1;
+    }
+
+    bool first = true;
+    bool failed = false;
+    if (cfg.json) printf("[");
+    else printf("%-18s %-9s %8s %9s %14s %10s %10s\n", "workload", "allocator", "threads", "seconds", "ops/sec", "rss kB", "peak kB");
+    for (const workload& load : workloads) {
+        if (!selected(cfg.workloads, load.name)) continue;
+        for (const allocator_ops& ops : allocators) {
+            if (!selected(cfg.allocators, ops.name)) continue;
+            result res;
+            if (!run_forked(cfg, load, ops, res)) {
+                fprintf(stderr, "%s with %s failed\n", load.name, ops.name);
+                failed = true;
+                continue;
+            }
+            double rate = res.seconds > 0 ? static_cast<double>(res.ops) / res.seconds : 0.0;
+            if (cfg.json) {
+                printf("%s{\"workload\":\"%s\",\"allocator\":\"%s\",\"threads\":%zu,\"ops\":%llu,\"seconds\":%.6f,"
+                       "\"ops_per_sec\":%.3f,\"rss_kb\":%ld,\"peak_kb\":%ld}", first ? "" : ",", load.name, ops.name,
+                       cfg.threads, static_cast<unsigned long long>(res.ops), res.seconds, rate, res.rss_kb, res.peak_kb);
+            } else {
+                printf("%-18s %-9s %8zu %9.3f %14.0f %10ld %10ld\n", load.name, ops.name, cfg.threads, res.seconds, rate,
+                       res.rss_kb, res.peak_kb);
+            }
+            fflush(stdout);
+            first = false;
+        }
+    }
+    if (cfg.json) printf("]\n");
+    return failed ? 2 : 0;
+}
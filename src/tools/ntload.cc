@@ -0,0 +1,473 @@
+/// ntload is a wrk-style HTTP/1.1 load generator built on `nt::HTTP::client`,
+/// or on `nt::HTTP::h2_client` with `--h2` to multiplex streams over h2c.
+/// Every thread drives its connections from one epoll loop, optionally at a
+/// constant (open-loop) request rate, and latencies are measured from the
+/// moment each request was *scheduled* so stalls are not hidden by
+/// coordinated omission.
+
+#include "../include/defs.h"
+#include "../include/histogram.h"
+#include "../include/http/http2_client.h"
+#include "../include/http/http_client.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <memory>
+#include <netdb.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+/**
+ * @brief The command line configuration of a run.
+ */
+struct config {
+    std::string host;
+    std::string ip;
+    short       port = 80;
+    nt::HTTP::Request request;
+
+    size_t   threads = 2;
+    size_t   connections = 10;       // per thread
+    size_t   pipeline = 1;
+    double   duration = 10.0;        // seconds, 0 when only `requests` limits the run
+    uint64_t requests = 0;           // total request count, 0 for unlimited
+    double   rate = 0.0;             // total requests per second, 0 for closed-loop
+    double   timeout = 2.0;          // seconds to wait for outstanding responses at the end
+    bool     json = false;
+    bool     h2 = false;             // HTTP/2 with prior knowledge, `pipeline` streams per connection
+};
+
+/**
+ * @brief The results of one thread, merged by the main thread at the end.
+ */
+struct result {
+    nt::histogram latency;           // from the scheduled start (corrected)
+    nt::histogram service;           // from the actual send (uncorrected)
+    uint64_t completed = 0;
+    uint64_t non_2xx = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    uint64_t reconnects = 0;
+};
+
+/**
+ * @brief One pipelined (or multiplexed) connection and the timestamps of its outstanding requests.
+ */
+template <typename Client>
+struct connection {
+    explicit connection(Client&& c) : cli(std::move(c)) {}
+
+    Client               cli;
+    //! intended and actual start (ns) of every outstanding request, by tag
+    std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> started;
+    uint64_t             next_tag = 0;
+    uint64_t             next_answer = 0;  // the tag of the next in-order response
+    uint64_t             next = 0;   // when the next request is due (ns)
+    int                  fd = -1;    // the descriptor registered with epoll
+    size_t               generation = 0;  // `cli.connections()` when `fd` was registered
+    uint32_t             events = 0;
+    bool                 failed = false;
+};
+
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock_type::now().time_since_epoch()).count());
+}
+
+std::atomic<uint64_t> issued { 0 };  // requests handed out across threads, for `-n`
+
+/**
+ * @brief Claim the right to send one more request within the `-n` limit.
+ */
+bool claim_request(const config& cfg) {
+    if (cfg.requests == 0) return true;
+    return issued.fetch_add(1, std::memory_order_relaxed) < cfg.requests;
+}
+
+nt::HTTP::client make_client(const config& cfg, nt::HTTP::client*) {
+    nt::HTTP::client::options opts;
+    opts.pipeline_depth = cfg.pipeline;
+    opts.nonblocking = true;
+    return nt::HTTP::client(cfg.ip, cfg.port, opts);
+}
+
+nt::HTTP::h2_client make_client(const config& cfg, nt::HTTP::h2_client*) {
+    nt::HTTP::h2_client::options opts;
+    opts.max_concurrent_streams = cfg.pipeline;
+    opts.nonblocking = true;
+    return nt::HTTP::h2_client(cfg.ip, cfg.port, opts);
+}
+
+//! HTTP/1.1 answers in order, so the tags are implied
+bool send_tagged(nt::HTTP::client& cli, const nt::HTTP::Request& req, uint64_t) {
+    return cli.send(req);
+}
+
+bool send_tagged(nt::HTTP::h2_client& cli, const nt::HTTP::Request& req, uint64_t tag) {
+    return cli.send(req, tag);
+}
+
+bool recv_tagged(nt::HTTP::client& cli, nt::HTTP::Response& resp, uint64_t& tag, uint64_t& next_answer) {
+    if (!cli.try_recv(resp)) return false;
+    tag = next_answer++;
+    return true;
+}
+
+bool recv_tagged(nt::HTTP::h2_client& cli, nt::HTTP::Response& resp, uint64_t& tag, uint64_t&) {
+    return cli.try_recv(resp, &tag);
+}
+
+/**
+ * @brief Keep the epoll registration of a connection in line with its state.
+ */
+template <typename Client>
+void update_interest(int epfd, connection<Client>& conn, size_t index) {
+    int fd = conn.cli.get_fd();
+    uint32_t events = EPOLLIN | (conn.cli.wants_write() ? static_cast<uint32_t>(EPOLLOUT) : static_cast<uint32_t>(0));
+    if (fd != conn.fd || conn.cli.connections() != conn.generation) {
+        //! a reconnect replaced the descriptor (possibly reusing its number),
+        //! the old one was closed and so already left the set
+        conn.fd = fd;
+        conn.generation = conn.cli.connections();
+        conn.events = 0;
+        if (fd < 0) return;
+        epoll_event ev {};
+        ev.events = events;
+        ev.data.u64 = index;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+        conn.events = events;
+    } else if (fd >= 0 && events != conn.events) {
+        epoll_event ev {};
+        ev.events = events;
+        ev.data.u64 = index;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+        conn.events = events;
+    }
+}
+
+template <typename Client>
+void run_thread(const config& cfg, uint64_t start, uint64_t deadline, result& res) {
+    //! every connection gets its share of the rate, staggered so they do not fire in lockstep
+    double per_connection_rate = cfg.rate / static_cast<double>(cfg.threads * cfg.connections);
+    uint64_t interval = per_connection_rate > 0 ? static_cast<uint64_t>(1e9 / per_connection_rate) : 0;
+
+    std::vector<std::unique_ptr<connection<Client>>> conns;
+    for (size_t i = 0; i < cfg.connections; i++) {
+        conns.push_back(std::make_unique<connection<Client>>(make_client(cfg, static_cast<Client*>(nullptr))));
+        conns.back()->next = start + (interval * i) / cfg.connections;
+    }
+
+    int epfd = epoll_create1(0);
+    std::vector<epoll_event> events(cfg.connections + 1);
+    //! epoll_wait only sleeps whole milliseconds, which would make every open-loop send late by up
+    //! to 1ms and count that as latency; the timer fires at the nanosecond the next send is due
+    const uint64_t timer_index = UINT64_MAX;
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd >= 0) {
+        epoll_event ev {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = timer_index;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+    }
+    uint64_t armed = 0;
+    bool stopping = false;
+    uint64_t drain_deadline = 0;
+
+    while (true) {
+        uint64_t now = now_ns();
+        if (!stopping && ((deadline != 0 && now >= deadline) || (cfg.requests != 0 && issued.load(std::memory_order_relaxed) >= cfg.requests))) {
+            stopping = true;
+            drain_deadline = now + static_cast<uint64_t>(cfg.timeout * 1e9);
+        }
+
+        //! issue every request that is due, the window permitting
+        bool idle = true;
+        uint64_t wake = now + 1000 * 1000;
+        for (size_t i = 0; i < conns.size(); i++) {
+            connection<Client>& conn = *conns[i];
+            if (conn.failed) continue;
+            while (!stopping && conn.cli.outstanding() < cfg.pipeline && (interval == 0 || conn.next <= now)) {
+                if (!claim_request(cfg)) {
+                    stopping = true;
+                    drain_deadline = now + static_cast<uint64_t>(cfg.timeout * 1e9);
+                    break;
+                }
+                if (!send_tagged(conn.cli, cfg.request, conn.next_tag)) {
+                    res.errors++;
+                    break;
+                }
+                conn.started.emplace(conn.next_tag++, std::make_pair(interval == 0 ? now : conn.next, now));
+                conn.next += interval;
+            }
+            if (interval != 0 && !stopping) wake = std::min(wake, conn.next);
+            if (!conn.cli.flush()) {
+                conn.failed = true;
+                res.errors++;
+            }
+            if (conn.cli.outstanding() != 0) idle = false;
+            update_interest(epfd, conn, i);
+        }
+        if (stopping && (idle || now >= drain_deadline)) break;
+
+        int timeout_ms = wake > now ? static_cast<int>((wake - now + 999999) / 1000000) : 0;
+        if (tfd >= 0 && interval != 0 && !stopping && timeout_ms != 0) {
+            //! only open-loop sends are due at a fixed time, the closed loop and the drain get by with
+            //! the 1ms epoll timeout rather than rearming the timer each round.
+            //! steady_clock is CLOCK_MONOTONIC, so `wake` is an absolute time of the timer
+            if (wake != armed) {
+                itimerspec spec {};
+                spec.it_value.tv_sec = static_cast<time_t>(wake / 1000000000);
+                spec.it_value.tv_nsec = static_cast<long>(wake % 1000000000);
+                if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0) armed = wake;
+            }
+            if (armed == wake) timeout_ms = -1;
+        }
+        int ready = epoll_wait(epfd, events.data(), static_cast<int>(events.size()), timeout_ms);
+        now = now_ns();
+        for (int e = 0; e < ready; e++) {
+            if (events[e].data.u64 == timer_index) {
+                uint64_t expirations = 0;
+                if (read(tfd, &expirations, sizeof(expirations)) == sizeof(expirations)) armed = 0;
+                continue;
+            }
+            connection<Client>& conn = *conns[events[e].data.u64];
+            if (!conn.cli.poll()) {
+                conn.failed = true;
+                res.errors++;
+                continue;
+            }
+
+            nt::HTTP::Response resp;
+            uint64_t tag = 0;
+            while (recv_tagged(conn.cli, resp, tag, conn.next_answer)) {
+                auto started = conn.started.find(tag);
+                if (started == conn.started.end()) continue;
+                res.latency.record((now - started->second.first) / 1000);
+                res.service.record((now - started->second.second) / 1000);
+                conn.started.erase(started);
+                res.completed++;
+                if (resp.status < 200 || resp.status > 299) res.non_2xx++;
+            }
+        }
+    }
+
+    for (auto& conn : conns) {
+        res.bytes += conn->cli.bytes_received();
+        if (conn->cli.connections() > 1) res.reconnects += conn->cli.connections() - 1;
+    }
+    if (tfd >= 0) close(tfd);
+    close(epfd);
+}
+
+bool resolve(config& cfg) {
+    addrinfo hints {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(cfg.host.c_str(), nullptr, &hints, &found) != 0 || found == nullptr) return false;
+
+    char buf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(found->ai_addr)->sin_addr, buf, sizeof(buf));
+    cfg.ip = buf;
+    freeaddrinfo(found);
+    return true;
+}
+
+bool parse_url(const std::string& url, config& cfg) {
+    std::string rest = url;
+    const std::string scheme = "http://";
+    if (rest.compare(0, scheme.size(), scheme) == 0) rest = rest.substr(scheme.size());
+    else if (rest.find("://") != std::string::npos) return false;
+
+    size_t slash = rest.find('/');
+    std::string authority = rest.substr(0, slash);
+    cfg.request.path = slash == std::string::npos ? "/" : rest.substr(slash);
+
+    size_t colon = authority.find(':');
+    cfg.host = authority.substr(0, colon);
+    if (colon != std::string::npos) cfg.port = static_cast<short>(std::stoi(authority.substr(colon + 1)));
+    if (cfg.host.empty()) return false;
+    cfg.request.headers["Host"] = authority;
+    return true;
+}
+
+double parse_duration(const char* text) {
+    char* end = nullptr;
+    double value = strtod(text, &end);
+    if (end != nullptr) {
+        if (*end == 'm') value *= 60;
+        else if (*end == 'h') value *= 3600;
+    }
+    return value;
+}
+
+void usage() {
+    fprintf(stderr,
+        "Usage: ntload <options> <url>\n"
+        "  -t, --threads     <N>  number of threads (default 2)\n"
+        "  -c, --connections <N>  connections per thread (default 10)\n"
+        "  -p, --pipeline    <N>  outstanding requests (HTTP/2 streams) per connection (default 1)\n"
+        "  -d, --duration    <T>  duration of the test, e.g. 30s, 2m (default 10s)\n"
+        "  -n, --requests    <N>  stop after N requests in total\n"
+        "  -R, --rate        <N>  total requests per second, open-loop (default: closed-loop)\n"
+        "  -m, --method      <M>  request method (default GET)\n"
+        "  -H, --header      <H>  add a request header, e.g. \"Accept: */*\"\n"
+        "  -b, --body        <B>  request body\n"
+        "      --timeout     <T>  time to wait for outstanding responses at the end (default 2s)\n"
+        "      --h2               use HTTP/2 with prior knowledge (h2c) and multiplex streams\n"
+        "      --json             print the results as JSON\n");
+}
+
+void print_text(const config& cfg, const result& total, double elapsed) {
+    printf("Running %.1fs test @ http://%s:%d%s\n", elapsed, cfg.host.c_str(),
+           static_cast<unsigned short>(cfg.port), cfg.request.path.c_str());
+    printf("  %zu threads and %zu connections per thread, %s %zu", cfg.threads, cfg.connections,
+           cfg.h2 ? "HTTP/2 streams" : "pipeline", cfg.pipeline);
+    if (cfg.rate > 0) printf(", target %.0f requests/sec", cfg.rate);
+    printf("\n  Latency   mean %.3fms  stdev %.3fms  max %.3fms\n",
+           total.latency.mean() / 1000.0, total.latency.stddev() / 1000.0,
+           static_cast<double>(total.latency.max()) / 1000.0);
+    printf("  Latency Distribution (corrected for coordinated omission)\n%s",
+           total.latency.to_text(1000.0, "ms").c_str());
+    printf("  Service Time Distribution (uncorrected)\n%s",
+           total.service.to_text(1000.0, "ms").c_str());
+    printf("  %llu requests in %.2fs, %.2fMB read\n", static_cast<unsigned long long>(total.completed),
+           elapsed, static_cast<double>(total.bytes) / (1024.0 * 1024.0));
+    if (total.non_2xx != 0) printf("  Non-2xx responses: %llu\n", static_cast<unsigned long long>(total.non_2xx));
+    if (total.errors != 0 || total.reconnects != 0) {
+        printf("  Errors: %llu, reconnects: %llu\n", static_cast<unsigned long long>(total.errors),
+               static_cast<unsigned long long>(total.reconnects));
+    }
+    printf("Requests/sec: %.2f\n", static_cast<double>(total.completed) / elapsed);
+    printf("Transfer/sec: %.2fMB\n", static_cast<double>(total.bytes) / elapsed / (1024.0 * 1024.0));
+}
+
+void print_json(const config& cfg, const result& total, double elapsed) {
+    printf("{\"url\":\"http://%s:%d%s\",\"protocol\":\"%s\",\"threads\":%zu,\"connections\":%zu,\"pipeline\":%zu,\"rate\":%.3f,"
+           "\"duration\":%.6f,\"requests\":%llu,\"bytes\":%llu,\"non_2xx\":%llu,\"errors\":%llu,\"reconnects\":%llu,"
+           "\"requests_per_sec\":%.3f,\"latency_us\":%s,\"service_us\":%s}\n",
+           cfg.host.c_str(), static_cast<unsigned short>(cfg.port), cfg.request.path.c_str(),
+           cfg.h2 ? "h2c" : "http/1.1", cfg.threads, cfg.connections, cfg.pipeline, cfg.rate, elapsed,
+           static_cast<unsigned long long>(total.completed), static_cast<unsigned long long>(total.bytes),
+           static_cast<unsigned long long>(total.non_2xx), static_cast<unsigned long long>(total.errors),
+           static_cast<unsigned long long>(total.reconnects), static_cast<double>(total.completed) / elapsed,
+           total.latency.to_json().c_str(), total.service.to_json().c_str());
+}
+
+}
+
+int main(int argc, char** argv) {
+    config cfg;
+    cfg.request.method = "GET";
+    bool duration_given = false;
+
+    static const option long_options[] = {
+        { "threads",     required_argument, nullptr, 't' },
+        { "connections", required_argument, nullptr, 'c' },
+        { "pipeline",    required_argument, nullptr, 'p' },
+        { "duration",    required_argument, nullptr, 'd' },
+        { "requests",    required_argument, nullptr, 'n' },
+        { "rate",        required_argument, nullptr, 'R' },
+        { "method",      required_argument, nullptr, 'm' },
+        { "header",      required_argument, nullptr, 'H' },
+        { "body",        required_argument, nullptr, 'b' },
+        { "timeout",     required_argument, nullptr, 'T' },
+        { "json",        no_argument,       nullptr, 'j' },
+        { "h2",          no_argument,       nullptr, '2' },
+        { "help",        no_argument,       nullptr, 'h' },
+        { nullptr,       0,                 nullptr, 0 },
+    };
+
+    int opt = 0;
+    while ((opt = getopt_long(argc, argv, "t:c:p:d:n:R:m:H:b:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 't': cfg.threads = strtoul(optarg, nullptr, 10); break;
+            case 'c': cfg.connections = strtoul(optarg, nullptr, 10); break;
+            case 'p': cfg.pipeline = strtoul(optarg, nullptr, 10); break;
+            case 'd': cfg.duration = parse_duration(optarg); duration_given = true; break;
+            case 'n': cfg.requests = strtoull(optarg, nullptr, 10); break;
+            case 'R': cfg.rate = strtod(optarg, nullptr); break;
+            case 'm': cfg.request.method = optarg; break;
+            case 'b': cfg.request.body = optarg; break;
+            case 'T': cfg.timeout = parse_duration(optarg); break;
+            case 'j': cfg.json = true; break;
+            case '2': cfg.h2 = true; break;
+            case 'H': {
+                std::string header = optarg;
+                size_t colon = header.find(':');
+                if (colon == std::string::npos) {
+                    usage();
+                    return 1;
+                }
+                size_t value = header.find_first_not_of(' ', colon + 1);
+                cfg.request.headers[header.substr(0, colon)] = value == std::string::npos ? "" : header.substr(value);
+                break;
+            }
+            case 'h':
+            default:
+                usage();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc || cfg.threads == 0 || cfg.connections == 0 || cfg.pipeline == 0) {
+        usage();
+        return 1;
+    }
+    if (!parse_url(argv[optind], cfg)) {
+        fprintf(stderr, "invalid url: %s\n", argv[optind]);
+        return 1;
+    }
+    if (!resolve(cfg)) {
+        fprintf(stderr, "unable to resolve %s\n", cfg.host.c_str());
+        return 1;
+    }
+    //! with only a request count the run is not bounded by time
+    if (cfg.requests != 0 && !duration_given) cfg.duration = 0;
+
+    std::vector<result> results(cfg.threads);
+    std::vector<std::thread> workers;
+    uint64_t start = now_ns();
+    uint64_t deadline = cfg.duration > 0 ? start + static_cast<uint64_t>(cfg.duration * 1e9) : 0;
+    for (size_t i = 0; i < cfg.threads; i++) {
+        if (cfg.h2) {
+            workers.emplace_back(run_thread<nt::HTTP::h2_client>, std::cref(cfg), start, deadline, std::ref(results[i]));
+        } else {
+            workers.emplace_back(run_thread<nt::HTTP::client>, std::cref(cfg), start, deadline, std::ref(results[i]));
+        }
+    }
+    for (auto& worker : workers) worker.join();
+    double elapsed = static_cast<double>(now_ns() - start) / 1e9;
+
+    result total;
+    for (const auto& res : results) {
+        total.latency.merge(res.latency);
+        total.service.merge(res.service);
+        total.completed  += res.completed;
+        total.non_2xx    += res.non_2xx;
+        total.errors     += res.errors;
+        total.bytes      += res.bytes;
+        total.reconnects += res.reconnects;
+    }
+
+    if (cfg.json) {
+        print_json(cfg, total, elapsed);
+    } else {
+        print_text(cfg, total, elapsed);
+    }
+    return total.errors == 0 ? 0 : 2;
+}
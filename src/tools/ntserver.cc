@@ -0,0 +1,131 @@
+/// ntserver is a stand-in HTTP/1.1 server built on `nt::HTTP::server`, used as a
+/// local target when measuring client side changes without real backends.
+
+#include "../include/defs.h"
+#include "../include/http/http_server.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
+#include <iterator>
+#include <pthread.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+void usage() {
+    fprintf(stderr,
+        "Usage: ntserver <options>\n"
+        "  -b, --bind        <IP>    address to listen on (default 0.0.0.0)\n"
+        "  -p, --port        <N>     port to listen on (default 8080)\n"
+        "  -t, --threads     <N>     number of worker threads (default 1)\n"
+        "  -s, --size        <N>     body size of the default response in bytes (default 0)\n"
+        "  -l, --latency     <US>    delay every response by US microseconds\n"
+        "  -r, --response    <SPEC>  canned response, PATH=STATUS[:BODY] or PATH=STATUS@FILE,\n"
+        "                            PATH may be a route pattern with :param and *wildcard segments\n"
+        "      --max-requests <N>    close a connection after N requests\n"
+        "      --no-keep-alive       close the connection after every response\n");
+}
+
+/**
+ * @brief Parse `PATH=STATUS[:BODY]` or `PATH=STATUS@FILE` into a canned response,
+ * or into a route of `routes` when PATH is a pattern.
+ */
+bool parse_response_spec(const std::string& spec, nt::HTTP::server& srv, nt::HTTP::router& routes) {
+    size_t eq = spec.find('=');
+    if (eq == std::string::npos || eq == 0) return false;
+
+    std::string path = spec.substr(0, eq);
+    std::string rest = spec.substr(eq + 1);
+    size_t sep = rest.find_first_of(":@");
+
+    nt::HTTP::Response resp;
+    resp.status = atoi(rest.substr(0, sep).c_str());
+    if (resp.status < 100 || resp.status > 999) return false;
+    if (sep != std::string::npos && rest[sep] == ':') {
+        resp.body = rest.substr(sep + 1);
+    } else if (sep != std::string::npos) {
+        std::ifstream file(rest.substr(sep + 1), std::ios::binary);
+        if (!file) return false;
+        resp.body.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    resp.headers["Content-Type"] = "text/plain";
+    if (path.find_first_of(":*") != std::string::npos) {
+        return routes.add(path, [resp](const nt::HTTP::Request&, const nt::HTTP::route_params&, nt::HTTP::Response& out) {
+            out = resp;
+        });
+    }
+    srv.set_response(path, resp);
+    return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+    nt::HTTP::server::options opts;
+    std::vector<std::string> specs;
+
+    static const option long_options[] = {
+        { "bind",          required_argument, nullptr, 'b' },
+        { "port",          required_argument, nullptr, 'p' },
+        { "threads",       required_argument, nullptr, 't' },
+        { "size",          required_argument, nullptr, 's' },
+        { "latency",       required_argument, nullptr, 'l' },
+        { "response",      required_argument, nullptr, 'r' },
+        { "max-requests",  required_argument, nullptr, 'M' },
+        { "no-keep-alive", no_argument,       nullptr, 'K' },
+        { "help",          no_argument,       nullptr, 'h' },
+        { nullptr,         0,                 nullptr, 0 },
+    };
+
+    int opt = 0;
+    while ((opt = getopt_long(argc, argv, "b:p:t:s:l:r:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'b': opts.ip = optarg; break;
+            case 'p': opts.port = static_cast<short>(atoi(optarg)); break;
+            case 't': opts.threads = strtoul(optarg, nullptr, 10); break;
+            case 's': opts.response_size = strtoul(optarg, nullptr, 10); break;
+            case 'l': opts.latency_us = strtoull(optarg, nullptr, 10); break;
+            case 'r': specs.emplace_back(optarg); break;
+            case 'M': opts.max_requests = strtoul(optarg, nullptr, 10); break;
+            case 'K': opts.keep_alive = false; break;
+            case 'h':
+            default:
+                usage();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    nt::HTTP::server srv(opts);
+    nt::HTTP::router routes;
+    for (const auto& spec : specs) {
+        if (!parse_response_spec(spec, srv, routes)) {
+            fprintf(stderr, "invalid response: %s\n", spec.c_str());
+            return 1;
+        }
+    }
+    srv.set_router(std::move(routes));
+
+    //! the workers inherit the blocked signals, only this thread waits for them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!srv.start()) return 1;
+    fprintf(stderr, "ntserver listening on %s:%d with %zu threads\n", opts.ip.c_str(),
+            static_cast<unsigned short>(srv.get_port()), opts.threads);
+
+    int received = 0;
+    sigwait(&signals, &received);
+    srv.stop();
+    srv.wait();
+    fprintf(stderr, "served %llu requests\n", static_cast<unsigned long long>(srv.requests()));
+    return 0;
+}
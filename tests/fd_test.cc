@@ -24,33 +24,38 @@ TEST(TEST_READ, read_test) {
     std::string buf;
     auto read_len = fd.read(buf, 128);
     ASSERT_EQ(128, read_len);
-    ASSERT_EQ("", buf);
+    ASSERT_EQ(std::string(128, '\0'), buf);
 
+    //! reads append, NULs included
     read_len = fd.read(buf, 512);
     ASSERT_EQ(512, read_len);
-    ASSERT_EQ("", buf);
+    ASSERT_EQ(std::string(640, '\0'), buf);
 
+    buf.clear();
     read_len = fd.read(buf, 1024);
     ASSERT_EQ(1024, read_len);
-    ASSERT_EQ("", buf);
+    ASSERT_EQ(std::string(1024, '\0'), buf);
 
+    buf.clear();
     read_len = fd.read(buf, std::numeric_limits<size_t>::max());
     ASSERT_EQ(1024 * 1024, read_len);
-    ASSERT_EQ("", buf);
+    ASSERT_EQ(1024u * 1024u, buf.size());
 
+    buf.clear();
     for (int i = 0; i < 10e5; i += 100) {
         read_len = fd.read(buf, 1);
         ASSERT_EQ(1, read_len);
-        ASSERT_EQ("", buf);
     }
+    ASSERT_EQ(std::string(10000, '\0'), buf);
 
     for (int i = 0; i < 10e5; i += 100) {
         if (i == 1024 * 1024) {
             i %= 1024 * 1024;
         }
+        buf.clear();
         read_len = fd.read(buf, i);
         ASSERT_EQ(i, read_len);
-        ASSERT_EQ("", buf);
+        ASSERT_EQ(static_cast<size_t>(i), buf.size());
     }
 }
 
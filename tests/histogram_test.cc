@@ -0,0 +1,67 @@
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "../src/include/histogram.h"
+
+TEST(TEST_HISTOGRAM, percentile_test) {
+    nt::histogram h;
+    for (uint64_t i = 1; i <= 100000; i++) h.record(i);
+
+    ASSERT_EQ(100000u, h.total_count());
+    ASSERT_EQ(1u, h.min());
+    ASSERT_EQ(100000u, h.max());
+    //! 3 significant digits: every percentile is within 0.1% of the exact value
+    ASSERT_NEAR(50000.0, static_cast<double>(h.value_at_percentile(50.0)), 50.0);
+    ASSERT_NEAR(99000.0, static_cast<double>(h.value_at_percentile(99.0)), 99.0);
+    ASSERT_NEAR(99999.0, static_cast<double>(h.value_at_percentile(99.999)), 100.0);
+    ASSERT_EQ(100000u, h.value_at_percentile(100.0));
+    ASSERT_NEAR(50000.5, h.mean(), 50.0);
+
+    //! small values are exact
+    nt::histogram small;
+    for (uint64_t i = 0; i < 1000; i++) small.record(i);
+    ASSERT_EQ(499u, small.value_at_percentile(50.0));
+    ASSERT_EQ(989u, small.value_at_percentile(99.0));
+}
+
+TEST(TEST_HISTOGRAM, corrected_test) {
+    //! a closed-loop tester expecting a sample every 10 units stalls for 1000 units once
+    nt::histogram raw;
+    nt::histogram corrected;
+    for (int i = 0; i < 1000; i++) {
+        raw.record(10);
+        corrected.record_corrected(10, 10);
+    }
+    raw.record(1000);
+    corrected.record_corrected(1000, 10);
+
+    ASSERT_EQ(1001u, raw.total_count());
+    ASSERT_EQ(1100u, corrected.total_count());
+    ASSERT_EQ(10u, raw.value_at_percentile(99.0));
+    //! the back-filled samples 990, 980, ... 10 move the tail
+    ASSERT_GT(corrected.value_at_percentile(99.0), 800u);
+}
+
+TEST(TEST_HISTOGRAM, merge_test) {
+    nt::histogram a;
+    nt::histogram b;
+    a.record(5, 10);
+    b.record(500000, 10);
+    a.merge(b);
+    ASSERT_EQ(20u, a.total_count());
+    ASSERT_EQ(5u, a.min());
+    ASSERT_EQ(500000u, a.max());
+    ASSERT_EQ(5u, a.value_at_percentile(50.0));
+
+    std::string json = a.to_json();
+    ASSERT_NE(std::string::npos, json.find("\"count\":20"));
+    ASSERT_NE(std::string::npos, json.find("\"99.999\":500000"));
+    a.reset();
+    ASSERT_EQ(0u, a.total_count());
+}
+
+GTEST_API_ int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,406 @@
+#include <arpa/inet.h>
+#include <atomic>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <map>
+#include <netinet/in.h>
+#include <set>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../src/include/http/hpack.h"
+#include "../src/include/http/http2_client.h"
+#include "../src/include/http/http2_frame.h"
+
+static std::string unhex(const std::string& hex) {
+    std::string out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        out.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+    }
+    return out;
+}
+
+/**
+ * @brief A blocking single connection at a time h2c server answering every request with
+ * its path (or its body for requests with a body), in reverse order of arrival to exercise
+ * out of order completion. Streams above `max_streams` are refused with `REFUSED_STREAM`,
+ * and after `goaway_after` responses on a connection it sends `GOAWAY` and closes the connection.
+ * With `drop_requests` it completes the settings exchange but closes the connection on every request.
+ */
+class h2_server {
+public:
+    h2_server(uint32_t max_streams, size_t goaway_after, bool drop_requests = false)
+      : _max_streams(max_streams), _goaway_after(goaway_after), _drop_requests(drop_requests) {
+        _listen = ::socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(_listen, (sockaddr*)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(_listen, (sockaddr*)&addr, &len);
+        _port = ntohs(addr.sin_port);
+        listen(_listen, 16);
+        _thread = std::thread([this]() { run(); });
+    }
+    ~h2_server() {
+        ::shutdown(_listen, SHUT_RDWR);
+        ::close(_listen);
+        _thread.join();
+    }
+    short port() const { return static_cast<short>(_port); }
+    size_t accepted() const { return _accepted; }
+    size_t max_open() const { return _max_open; }
+    size_t refused() const { return _refused; }
+
+private:
+    struct stream {
+        nt::HTTP::Request req;
+    };
+
+    void run() {
+        while (true) {
+            int conn = accept(_listen, nullptr, nullptr);
+            if (conn < 0) return;
+            _accepted++;
+            serve(conn);
+            ::close(conn);
+        }
+    }
+
+    static void send_all(int conn, const std::string& out) {
+        ::send(conn, out.data(), out.size(), MSG_NOSIGNAL);
+    }
+
+    void serve(int conn) {
+        nt::HTTP::hpack_decoder decoder;
+        nt::HTTP::hpack_encoder encoder;
+        std::map<uint32_t, stream> streams;
+        std::set<uint32_t> refused;
+        std::string in;
+        std::string block;
+        size_t answered = 0;
+        bool preface = false;
+        char buf[65536];
+
+        std::string out;
+        nt::HTTP::write_h2_settings(out, { { nt::HTTP::h2_setting::max_concurrent_streams, _max_streams } });
+        send_all(conn, out);
+
+        while (true) {
+            ssize_t n = ::recv(conn, buf, sizeof(buf), 0);
+            if (n <= 0) return;
+            in.append(buf, static_cast<size_t>(n));
+            if (!preface) {
+                if (in.size() < nt::HTTP::H2_CLIENT_PREFACE.size()) continue;
+                ASSERT_EQ(nt::HTTP::H2_CLIENT_PREFACE, std::string_view(in).substr(0, nt::HTTP::H2_CLIENT_PREFACE.size()));
+                in.erase(0, nt::HTTP::H2_CLIENT_PREFACE.size());
+                preface = true;
+            }
+
+            out.clear();
+            std::vector<uint32_t> ready;
+            while (true) {
+                nt::HTTP::h2_frame frame;
+                ssize_t consumed = nt::HTTP::parse_h2_frame(in.data(), in.size(), nt::HTTP::H2_DEFAULT_MAX_FRAME_SIZE, frame);
+                if (consumed == 0) break;
+                ASSERT_GT(consumed, 0);
+                std::string_view content;
+                switch (frame.type) {
+                    case nt::HTTP::h2_frame_type::settings:
+                        if ((frame.flags & nt::HTTP::H2_FLAG_ACK) == 0) nt::HTTP::write_h2_settings_ack(out);
+                        break;
+                    case nt::HTTP::h2_frame_type::headers:
+                    case nt::HTTP::h2_frame_type::continuation:
+                        if (_drop_requests) {
+                            send_all(conn, out);
+                            return;
+                        }
+                        ASSERT_TRUE(nt::HTTP::h2_frame_content(frame, content));
+                        block.append(content.data(), content.size());
+                        if (frame.flags & nt::HTTP::H2_FLAG_END_HEADERS) {
+                            nt::HTTP::header_list headers;
+                            ASSERT_TRUE(decoder.decode(block.data(), block.size(), headers));
+                            block.clear();
+                            //! streams opened before our SETTINGS arrived may exceed the limit
+                            if (streams.size() >= _max_streams) {
+                                nt::HTTP::write_h2_rst_stream(out, frame.stream_id, nt::HTTP::h2_error::refused_stream);
+                                refused.insert(frame.stream_id);
+                                _refused++;
+                                break;
+                            }
+                            ASSERT_TRUE(nt::HTTP::h2_request_from_headers(headers, streams[frame.stream_id].req));
+                        }
+                        if (frame.flags & nt::HTTP::H2_FLAG_END_STREAM) ready.push_back(frame.stream_id);
+                        break;
+                    case nt::HTTP::h2_frame_type::data:
+                        ASSERT_TRUE(nt::HTTP::h2_frame_content(frame, content));
+                        if (refused.count(frame.stream_id) != 0) break;
+                        streams[frame.stream_id].req.body.append(content.data(), content.size());
+                        if (!frame.payload.empty()) {
+                            nt::HTTP::write_h2_window_update(out, 0, static_cast<uint32_t>(frame.payload.size()));
+                            nt::HTTP::write_h2_window_update(out, frame.stream_id, static_cast<uint32_t>(frame.payload.size()));
+                        }
+                        if (frame.flags & nt::HTTP::H2_FLAG_END_STREAM) ready.push_back(frame.stream_id);
+                        break;
+                    default:
+                        break;
+                }
+                in.erase(0, static_cast<size_t>(consumed));
+            }
+            _max_open = std::max(_max_open.load(), streams.size());
+
+            uint32_t last = 0;
+            for (auto it = ready.rbegin(); it != ready.rend(); ++it) {
+                stream& s = streams[*it];
+                nt::HTTP::Response resp;
+                resp.body = s.req.body.empty() ? s.req.method + " " + s.req.path : s.req.body;
+                nt::HTTP::header_list headers;
+                nt::HTTP::h2_response_headers(resp, headers);
+                block.clear();
+                encoder.encode(headers, block);
+                nt::HTTP::write_h2_headers(out, *it, block, false);
+                block.clear();
+                std::string_view body = resp.body;
+                do {
+                    std::string_view chunk = body.substr(0, nt::HTTP::H2_DEFAULT_MAX_FRAME_SIZE);
+                    body.remove_prefix(chunk.size());
+                    nt::HTTP::write_h2_data(out, *it, chunk, body.empty());
+                } while (!body.empty());
+                streams.erase(*it);
+                last = std::max(last, *it);
+                answered++;
+            }
+            if (_goaway_after != 0 && answered >= _goaway_after) {
+                nt::HTTP::write_h2_goaway(out, last, nt::HTTP::h2_error::no_error);
+                send_all(conn, out);
+                return;
+            }
+            send_all(conn, out);
+        }
+    }
+
+    int                 _listen;
+    int                 _port;
+    uint32_t            _max_streams;
+    size_t              _goaway_after;
+    bool                _drop_requests;
+    std::atomic<size_t> _accepted { 0 };
+    std::atomic<size_t> _max_open { 0 };
+    std::atomic<size_t> _refused { 0 };
+    std::thread         _thread;
+};
+
+TEST(TEST_HPACK, rfc_vectors_test) {
+    //! RFC 7541 C.4, requests with Huffman coding sharing one dynamic table
+    nt::HTTP::header_list first = {
+        { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" },
+    };
+    nt::HTTP::header_list second = first;
+    second.emplace_back("cache-control", "no-cache");
+    nt::HTTP::header_list third = {
+        { ":method", "GET" }, { ":scheme", "https" }, { ":path", "/index.html" },
+        { ":authority", "www.example.com" }, { "custom-key", "custom-value" },
+    };
+    const char* wire[] = {
+        "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+        "828684be5886a8eb10649cbf",
+        "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+    };
+
+    nt::HTTP::hpack_encoder encoder;
+    nt::HTTP::hpack_decoder decoder;
+    const nt::HTTP::header_list* lists[] = { &first, &second, &third };
+    for (int i = 0; i < 3; i++) {
+        std::string block;
+        encoder.encode(*lists[i], block);
+        ASSERT_EQ(unhex(wire[i]), block);
+        nt::HTTP::header_list decoded;
+        ASSERT_TRUE(decoder.decode(block.data(), block.size(), decoded));
+        ASSERT_EQ(*lists[i], decoded);
+    }
+
+    //! an index beyond the dynamic table
+    nt::HTTP::header_list decoded;
+    std::string bad = unhex("ff00");
+    ASSERT_FALSE(decoder.decode(bad.data(), bad.size(), decoded));
+}
+
+TEST(TEST_HPACK, huffman_test) {
+    std::string all;
+    for (int c = 0; c < 256; c++) all.push_back(static_cast<char>(c));
+    all += "the quick brown fox jumps over the lazy dog";
+
+    std::string encoded;
+    nt::HTTP::huffman_encode(all, encoded);
+    ASSERT_EQ(nt::HTTP::huffman_encoded_size(all), encoded.size());
+    std::string decoded;
+    ASSERT_TRUE(nt::HTTP::huffman_decode(encoded.data(), encoded.size(), decoded));
+    ASSERT_EQ(all, decoded);
+
+    //! "a" is 00011, the padding must be the EOS prefix and shorter than a byte
+    decoded.clear();
+    ASSERT_TRUE(nt::HTTP::huffman_decode("\x1f", 1, decoded));
+    ASSERT_EQ("a", decoded);
+    ASSERT_FALSE(nt::HTTP::huffman_decode("\x18", 1, decoded));
+    ASSERT_FALSE(nt::HTTP::huffman_decode("\x1f\xff", 2, decoded));
+}
+
+TEST(TEST_HPACK, table_test) {
+    nt::HTTP::hpack_table table(100);
+    table.add("a", "1");        // 34 bytes
+    table.add("b", "2");
+    table.add("c", "3");        // evicts "a"
+    ASSERT_EQ(2u, table.count());
+    ASSERT_EQ(68u, table.size());
+    ASSERT_EQ("c", table.get(62)->first);
+    ASSERT_EQ("b", table.get(63)->first);
+    ASSERT_EQ(nullptr, table.get(64));
+    ASSERT_EQ(":method", table.get(2)->first);
+
+    bool name_only = false;
+    ASSERT_EQ(63u, table.find("b", "2", name_only));
+    ASSERT_FALSE(name_only);
+    ASSERT_EQ(62u, table.find("c", "x", name_only));
+    ASSERT_TRUE(name_only);
+    ASSERT_EQ(8u, table.find(":status", "200", name_only));
+
+    table.resize(40);
+    ASSERT_EQ(1u, table.count());
+    table.add(std::string(100, 'x'), "");
+    ASSERT_EQ(0u, table.count());
+}
+
+TEST(TEST_H2_FRAME, codec_test) {
+    std::string out;
+    std::string block(40, 'h');
+    nt::HTTP::write_h2_headers(out, 3, block, true, 16);
+    nt::HTTP::write_h2_ping(out, "12345678", false);
+
+    std::string assembled;
+    size_t pos = 0;
+    int frames = 0;
+    nt::HTTP::h2_frame frame;
+    while (true) {
+        ssize_t consumed = nt::HTTP::parse_h2_frame(out.data() + pos, out.size() - pos, 16, frame);
+        if (consumed == 0) break;
+        ASSERT_GT(consumed, 0);
+        pos += static_cast<size_t>(consumed);
+        frames++;
+        if (frame.type == nt::HTTP::h2_frame_type::ping) break;
+        ASSERT_EQ(3u, frame.stream_id);
+        ASSERT_EQ(frames == 1 ? nt::HTTP::h2_frame_type::headers : nt::HTTP::h2_frame_type::continuation, frame.type);
+        ASSERT_EQ(frames == 1, (frame.flags & nt::HTTP::H2_FLAG_END_STREAM) != 0);
+        ASSERT_EQ(frames == 3, (frame.flags & nt::HTTP::H2_FLAG_END_HEADERS) != 0);
+        assembled.append(frame.payload.data(), frame.payload.size());
+    }
+    ASSERT_EQ(4, frames);
+    ASSERT_EQ(block, assembled);
+    ASSERT_EQ("12345678", frame.payload);
+    ASSERT_EQ(out.size(), pos);
+
+    //! a frame above the announced size is a connection error
+    ASSERT_EQ(-1, nt::HTTP::parse_h2_frame(out.data(), out.size(), 15, frame));
+    ASSERT_EQ(0, nt::HTTP::parse_h2_frame(out.data(), 8, 16, frame));
+
+    nt::HTTP::Request req;
+    req.method = "POST";
+    req.path = "/rpc";
+    req.headers["Content-Type"] = "application/grpc";
+    req.headers["Connection"] = "keep-alive";
+    req.body = "abc";
+    nt::HTTP::header_list headers;
+    nt::HTTP::h2_request_headers(req, "example:80", headers);
+    ASSERT_EQ(":method", headers[0].first);
+    nt::HTTP::Request parsed;
+    ASSERT_TRUE(nt::HTTP::h2_request_from_headers(headers, parsed));
+    ASSERT_EQ("POST", parsed.method);
+    ASSERT_EQ("/rpc", parsed.path);
+    ASSERT_EQ("example:80", parsed.headers["host"]);
+    ASSERT_EQ("application/grpc", parsed.headers["content-type"]);
+    ASSERT_EQ("3", parsed.headers["content-length"]);
+    ASSERT_EQ(0u, parsed.headers.count("connection"));
+}
+
+TEST(TEST_H2_CLIENT, multiplex_test) {
+    h2_server server(10, 0);
+    nt::HTTP::h2_client::options opts;
+    opts.max_concurrent_streams = 32;
+    nt::HTTP::h2_client cli("127.0.0.1", server.port(), opts);
+
+    std::map<std::string, int> seen;
+    for (int i = 0; i < 200; i++) {
+        nt::HTTP::Request req;
+        req.path = "/" + std::to_string(i);
+        ASSERT_TRUE(cli.send(req));
+        ASSERT_LE(cli.outstanding(), 32u);
+    }
+    nt::HTTP::Response resp;
+    while (cli.recv(resp)) {
+        ASSERT_EQ(200, resp.status);
+        ASSERT_EQ("HTTP/2", resp.version);
+        ASSERT_EQ("GET " + resp.path, resp.body);
+        seen[resp.path]++;
+    }
+    ASSERT_EQ(200u, seen.size());
+    ASSERT_EQ(1u, cli.connections());
+    //! streams refused before the server's SETTINGS arrived were replayed
+    ASSERT_LE(server.max_open(), 10u);
+    ASSERT_GT(server.max_open(), 1u);
+    ASSERT_GT(server.refused(), 0u);
+
+    //! a body larger than the default 64K window needs WINDOW_UPDATEs
+    nt::HTTP::Request post;
+    post.method = "POST";
+    post.path = "/upload";
+    post.body.assign(300000, 'b');
+    ASSERT_TRUE(cli.request(post, resp));
+    ASSERT_EQ(post.body, resp.body);
+    ASSERT_EQ("/upload", resp.path);
+}
+
+TEST(TEST_H2_CLIENT, goaway_test) {
+    h2_server server(4, 5);
+    nt::HTTP::h2_client cli("127.0.0.1", server.port());
+
+    for (int i = 0; i < 30; i++) {
+        nt::HTTP::Request req;
+        req.path = "/" + std::to_string(i);
+        ASSERT_TRUE(cli.send(req));
+    }
+    size_t received = 0;
+    nt::HTTP::Response resp;
+    while (cli.recv(resp)) {
+        ASSERT_EQ("GET " + resp.path, resp.body);
+        received++;
+    }
+    ASSERT_EQ(30u, received);
+    ASSERT_GT(cli.connections(), 1u);
+    ASSERT_EQ(cli.connections(), server.accepted());
+}
+
+TEST(TEST_H2_CLIENT, dropped_request_test) {
+    h2_server server(10, 0, true);
+    nt::HTTP::h2_client::options opts;
+    opts.max_retries = 2;
+    nt::HTTP::h2_client cli("127.0.0.1", server.port(), opts);
+
+    //! a completed settings exchange is no progress, the request is replayed a few times and then fails
+    nt::HTTP::Request req;
+    req.path = "/dropped";
+    nt::HTTP::Response resp;
+    ASSERT_FALSE(cli.request(req, resp));
+    ASSERT_EQ(0u, cli.outstanding());
+    ASSERT_GT(cli.connections(), 1u);
+    ASSERT_LE(cli.connections(), opts.max_retries + 1);
+}
+
+GTEST_API_ int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,520 @@
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <memory_resource>
+#include <netinet/in.h>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include "../src/include/http/http_client.h"
+#include "../src/include/http/http_request.h"
+#include "../src/include/http/http_response.h"
+#include "../src/include/http/http_router.h"
+#include "../src/include/http/http_server.h"
+#include "../src/include/http/http_url.h"
+
+/**
+ * @brief A blocking single connection at a time server echoing the request path,
+ * which closes the connection (with `Connection: close`) after `close_after` responses.
+ * `port` 0 picks a free port, a given one lets a test bring the server back up after an outage.
+ */
+class echo_server {
+public:
+    explicit echo_server(size_t close_after, int port = 0) : _close_after(close_after) {
+        _listen = ::socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        bind(_listen, (sockaddr*)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(_listen, (sockaddr*)&addr, &len);
+        _port = ntohs(addr.sin_port);
+        listen(_listen, 16);
+        _thread = std::thread([this]() { run(); });
+    }
+    ~echo_server() {
+        _stop = true;
+        ::shutdown(_listen, SHUT_RDWR);
+        ::close(_listen);
+        //! drop the connection being served as well, like a crashed server would
+        int conn = _conn.load();
+        if (conn >= 0) ::shutdown(conn, SHUT_RDWR);
+        _thread.join();
+    }
+    short port() const { return static_cast<short>(_port); }
+    int raw_port() const { return _port; }
+    size_t accepted() const { return _accepted; }
+
+private:
+    void run() {
+        while (!_stop) {
+            int conn = accept(_listen, nullptr, nullptr);
+            if (conn < 0) return;
+            _accepted++;
+            _conn = conn;
+            if (!_stop) serve(conn);
+            _conn = -1;
+            ::close(conn);
+        }
+    }
+    void serve(int conn) {
+        std::string in;
+        size_t answered = 0;
+        char buf[4096];
+        while (true) {
+            nt::HTTP::Request req;
+            ssize_t consumed = nt::HTTP::parse_request(in.data(), in.size(), req);
+            if (consumed == 0) {
+                ssize_t n = ::recv(conn, buf, sizeof(buf), 0);
+                if (n <= 0) return;
+                in.append(buf, static_cast<size_t>(n));
+                continue;
+            }
+            ASSERT_GT(consumed, 0);
+            in.erase(0, static_cast<size_t>(consumed));
+
+            nt::HTTP::Response resp;
+            resp.body = req.path;
+            if (++answered == _close_after) resp.headers["Connection"] = "close";
+            std::string out = resp.to_string();
+            ::send(conn, out.data(), out.size(), MSG_NOSIGNAL);
+            if (answered == _close_after) {
+                //! lingering close: closing with unread requests queued would reset the
+                //! connection and could drop the `Connection: close` response in flight
+                ::shutdown(conn, SHUT_WR);
+                while (::recv(conn, buf, sizeof(buf), 0) > 0) {}
+                return;
+            }
+        }
+    }
+
+    int               _listen;
+    int               _port;
+    size_t            _close_after;
+    std::atomic<bool> _stop { false };
+    std::atomic<size_t> _accepted { 0 };
+    std::atomic<int>  _conn { -1 };
+    std::thread       _thread;
+};
+
+TEST(TEST_REQUEST, serialize_parse_test) {
+    nt::HTTP::Request req;
+    req.method = "POST";
+    req.path = "/submit?x=1";
+    req.headers["Host"] = "example";
+    req.body = "hello";
+
+    std::string wire = req.to_string();
+    nt::HTTP::Request parsed;
+    ASSERT_EQ(static_cast<ssize_t>(wire.size()), nt::HTTP::parse_request(wire.data(), wire.size(), parsed));
+    ASSERT_EQ("POST", parsed.method);
+    ASSERT_EQ("/submit?x=1", parsed.path);
+    ASSERT_EQ("HTTP/1.1", parsed.version);
+    ASSERT_EQ("example", parsed.headers["host"]);
+    ASSERT_EQ("hello", parsed.body);
+
+    //! every strict prefix is incomplete
+    for (size_t i = 0; i < wire.size(); i++) {
+        ASSERT_EQ(0, nt::HTTP::parse_request(wire.data(), i, parsed));
+    }
+    ASSERT_EQ(-1, nt::HTTP::parse_request("GARBAGE\r\n\r\n", 11, parsed));
+
+    //! a length that does not fit is an error, not a wrapped around small one
+    std::string huge = "POST / HTTP/1.1\r\nContent-Length: 18446744073709551621\r\n\r\nhello";
+    ASSERT_EQ(-1, nt::HTTP::parse_request(huge.data(), huge.size(), parsed));
+}
+
+TEST(TEST_RESPONSE, parse_test) {
+    nt::HTTP::Response resp;
+    std::string wire = "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nabcHTTP/1.1 404 Not Found\r\n";
+    ssize_t consumed = nt::HTTP::parse_response(wire.data(), wire.size(), resp);
+    ASSERT_EQ(41, consumed);
+    ASSERT_EQ(200, resp.status);
+    ASSERT_EQ("abc", resp.body);
+    ASSERT_EQ(0, nt::HTTP::parse_response(wire.data() + consumed, wire.size() - consumed, resp));
+
+    std::string chunked = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\n\r\n";
+    ASSERT_EQ(static_cast<ssize_t>(chunked.size()), nt::HTTP::parse_response(chunked.data(), chunked.size(), resp));
+    ASSERT_EQ("hello world", resp.body);
+    ASSERT_EQ(0, nt::HTTP::parse_response(chunked.data(), chunked.size() - 2, resp));
+
+    std::string head = "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n";
+    ASSERT_EQ(static_cast<ssize_t>(head.size()), nt::HTTP::parse_response(head.data(), head.size(), resp, true));
+    ASSERT_EQ("", resp.body);
+
+    std::string until_close = "HTTP/1.0 200 OK\r\n\r\nall of it";
+    ASSERT_EQ(0, nt::HTTP::parse_response(until_close.data(), until_close.size(), resp));
+    ASSERT_EQ(static_cast<ssize_t>(until_close.size()), nt::HTTP::parse_response(until_close.data(), until_close.size(), resp, false, true));
+    ASSERT_EQ("all of it", resp.body);
+    ASSERT_EQ("HTTP/1.0", resp.version);
+}
+
+TEST(TEST_RESPONSE, serialize_test) {
+    //! an empty reason is sent as the standard phrase of the status
+    nt::HTTP::Response resp;
+    resp.status = 404;
+    resp.body = "gone";
+    ASSERT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 4\r\n\r\ngone", resp.to_string());
+    resp.reason = "Nowhere";
+    ASSERT_EQ("HTTP/1.1 404 Nowhere\r\nContent-Length: 4\r\n\r\ngone", resp.to_string());
+    resp.status = 599;
+    resp.reason.clear();
+    ASSERT_EQ("HTTP/1.1 599 \r\nContent-Length: 4\r\n\r\ngone", resp.to_string());
+
+    //! responses without a body get no length
+    resp.body.clear();
+    for (int status : { 101, 204, 304 }) {
+        resp.status = status;
+        std::string wire = resp.to_string();
+        ASSERT_EQ(std::string::npos, wire.find("Content-Length")) << wire;
+        ASSERT_EQ(std::string("HTTP/1.1 ") + std::to_string(status) + " " + std::string(nt::HTTP::status_reason(status)) + "\r\n\r\n", wire);
+    }
+}
+
+TEST(TEST_REQUEST, pmr_test) {
+    //! everything parsed goes to the resource of the request, nothing to the default one
+    alignas(std::max_align_t) char arena[4096];
+    std::pmr::monotonic_buffer_resource resource(arena, sizeof(arena), std::pmr::null_memory_resource());
+    nt::HTTP::pmr::Request req(&resource);
+    std::string wire = "PUT /upload HTTP/1.1\r\nHost: example\r\nX-Request-Identifier: 0123456789abcdef0123456789\r\n"
+                       "Transfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n";
+    ASSERT_EQ(static_cast<ssize_t>(wire.size()), nt::HTTP::parse_request(wire.data(), wire.size(), req));
+    ASSERT_EQ("PUT", req.method);
+    ASSERT_EQ("0123456789abcdef0123456789", req.headers["x-request-identifier"]);
+    ASSERT_EQ("hello", req.body);
+    ASSERT_EQ(&resource, req.headers.begin()->second.get_allocator().resource());
+
+    nt::HTTP::pmr::Response resp(&resource);
+    resp.status = 201;
+    resp.body = req.body;
+    std::pmr::string out(&resource);
+    resp.serialize(out);
+    ASSERT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 5\r\n\r\nhello", out);
+    nt::HTTP::Response parsed;
+    ASSERT_EQ(static_cast<ssize_t>(out.size()), nt::HTTP::parse_response(out.data(), out.size(), parsed));
+    ASSERT_EQ(201, parsed.status);
+}
+
+TEST(TEST_URL, parse_test) {
+    nt::HTTP::url_view url = nt::HTTP::parse_url("/a/b?x=1&y=%20z#top");
+    ASSERT_EQ("", url.scheme);
+    ASSERT_EQ("/a/b", url.path);
+    ASSERT_EQ("x=1&y=%20z", url.query);
+    ASSERT_EQ("top", url.fragment);
+
+    url = nt::HTTP::parse_url("http://example.com:8080?q");
+    ASSERT_EQ("http", url.scheme);
+    ASSERT_EQ("example.com:8080", url.authority);
+    ASSERT_EQ("/", url.path);
+    ASSERT_EQ("q", url.query);
+
+    std::string_view query = "a=1&&flag&b=two";
+    std::string_view key;
+    std::string_view value;
+    ASSERT_TRUE(nt::HTTP::next_query_param(query, key, value));
+    ASSERT_EQ("a", key);
+    ASSERT_EQ("1", value);
+    ASSERT_TRUE(nt::HTTP::next_query_param(query, key, value));
+    ASSERT_EQ("flag", key);
+    ASSERT_EQ("", value);
+    ASSERT_TRUE(nt::HTTP::next_query_param(query, key, value));
+    ASSERT_EQ("b", key);
+    ASSERT_FALSE(nt::HTTP::next_query_param(query, key, value));
+    ASSERT_TRUE(nt::HTTP::find_query_param("a=1&b=two", "b", value));
+    ASSERT_EQ("two", value);
+}
+
+TEST(TEST_URL, percent_decode_test) {
+    std::string out;
+    ASSERT_TRUE(nt::HTTP::percent_decode("a%20b+c%2fd", out));
+    ASSERT_EQ("a b+c/d", out);
+    ASSERT_TRUE(nt::HTTP::percent_decode("a%20b+c", out, true));
+    ASSERT_EQ("a b c", out);
+    ASSERT_FALSE(nt::HTTP::percent_decode("bad%2", out));
+    ASSERT_FALSE(nt::HTTP::percent_decode("bad%zz", out));
+
+    //! escapes at every offset around the 16 byte blocks, decoded in place
+    for (size_t at = 0; at < 40; at++) {
+        std::string encoded(40, 'x');
+        encoded.replace(at, 1, "%41");
+        std::string expected(40, 'x');
+        expected[at] = 'A';
+        ssize_t n = nt::HTTP::percent_decode(encoded.data(), encoded.size(), &encoded[0]);
+        ASSERT_EQ(40, n);
+        encoded.resize(static_cast<size_t>(n));
+        ASSERT_EQ(expected, encoded);
+    }
+}
+
+TEST(TEST_ROUTER, match_test) {
+    nt::HTTP::router routes;
+    std::string hit;
+    auto route = [&hit](const char* name) {
+        return [&hit, name](const nt::HTTP::Request&, const nt::HTTP::route_params&, nt::HTTP::Response&) { hit = name; };
+    };
+    ASSERT_TRUE(routes.add("/users/:id", route("user")));
+    ASSERT_TRUE(routes.add("/users/me", route("me")));
+    ASSERT_TRUE(routes.add("/users/:id/posts/:post", route("post")));
+    ASSERT_TRUE(routes.add("/static/*file", route("static")));
+    ASSERT_TRUE(routes.add("/", route("root")));
+    ASSERT_TRUE(routes.add("DELETE", "/users/:id", route("delete")));
+    ASSERT_FALSE(routes.add("/users/:name/x", route("conflict")));
+    ASSERT_FALSE(routes.add("/users/me", route("duplicate")));
+    ASSERT_FALSE(routes.add("/bad:param", route("bad")));
+    ASSERT_FALSE(routes.add("/*rest/more", route("bad")));
+    ASSERT_EQ(6u, routes.size());
+
+    nt::HTTP::Request req;
+    nt::HTTP::Response resp;
+    nt::HTTP::route_params params;
+    auto dispatch = [&](const char* method, const char* path) {
+        hit.clear();
+        const nt::HTTP::router::handler_type* handler = routes.match(method, path, params);
+        if (handler != nullptr) (*handler)(req, params, resp);
+        return hit;
+    };
+
+    ASSERT_EQ("me", dispatch("GET", "/users/me"));
+    ASSERT_EQ(0u, params.count);
+    ASSERT_EQ("user", dispatch("GET", "/users/42"));
+    ASSERT_EQ("42", params.get("id"));
+    ASSERT_EQ("delete", dispatch("DELETE", "/users/42"));
+    ASSERT_EQ("post", dispatch("GET", "/users/me/posts/7"));
+    ASSERT_EQ("me", params.get("id"));
+    ASSERT_EQ("7", params.get("post"));
+    ASSERT_EQ("static", dispatch("GET", "/static/css/site.css"));
+    ASSERT_EQ("css/site.css", params.get("file"));
+    ASSERT_EQ("static", dispatch("GET", "/static/"));
+    ASSERT_EQ("", params.get("file"));
+    ASSERT_EQ("root", dispatch("GET", "/"));
+    ASSERT_EQ("", dispatch("GET", "/users/"));
+    ASSERT_EQ("", dispatch("GET", "/users/42/posts"));
+    ASSERT_EQ("", dispatch("GET", "/nowhere"));
+}
+
+TEST(TEST_CLIENT, pipeline_test) {
+    echo_server server(0);
+    nt::HTTP::client::options opts;
+    opts.pipeline_depth = 8;
+    nt::HTTP::client cli("127.0.0.1", server.port(), opts);
+
+    size_t received = 0;
+    for (int i = 0; i < 200; i++) {
+        nt::HTTP::Request req;
+        req.path = "/" + std::to_string(i);
+        ASSERT_TRUE(cli.send(req));
+        ASSERT_LE(cli.outstanding(), 8u);
+    }
+    nt::HTTP::Response resp;
+    while (cli.recv(resp)) {
+        ASSERT_EQ(200, resp.status);
+        ASSERT_EQ("/" + std::to_string(received), resp.path);
+        ASSERT_EQ(resp.path, resp.body);
+        received++;
+    }
+    ASSERT_EQ(200u, received);
+    ASSERT_EQ(1u, cli.connections());
+}
+
+TEST(TEST_CLIENT, reconnect_test) {
+    echo_server server(3);
+    nt::HTTP::client::options opts;
+    opts.pipeline_depth = 4;
+    nt::HTTP::client cli("127.0.0.1", server.port(), opts);
+
+    size_t received = 0;
+    nt::HTTP::Response resp;
+    for (int i = 0; i < 30; i++) {
+        nt::HTTP::Request req;
+        req.path = "/" + std::to_string(i);
+        ASSERT_TRUE(cli.send(req));
+    }
+    while (cli.recv(resp)) {
+        ASSERT_EQ("/" + std::to_string(received), resp.body);
+        received++;
+    }
+    ASSERT_EQ(30u, received);
+    ASSERT_EQ(10u, cli.connections());
+    ASSERT_EQ(10u, server.accepted());
+}
+
+TEST(TEST_CLIENT, outage_test) {
+    auto server = std::make_unique<echo_server>(0);
+    int port = server->raw_port();
+    nt::HTTP::client::options opts;
+    opts.max_retries = 1;
+    nt::HTTP::client cli("127.0.0.1", server->port(), opts);
+
+    nt::HTTP::Request req;
+    nt::HTTP::Response resp;
+    for (int outage = 0; outage < 2; outage++) {
+        req.path = "/up" + std::to_string(outage);
+        ASSERT_TRUE(cli.request(req, resp));
+        ASSERT_EQ(req.path, resp.body);
+
+        //! every request fails while the server is down, more often than `max_retries`
+        server.reset();
+        for (int i = 0; i < 4; i++) {
+            ASSERT_FALSE(cli.request(req, resp));
+            ASSERT_EQ(0u, cli.outstanding());
+        }
+
+        //! and the client finds the server again once it is back
+        server = std::make_unique<echo_server>(0, port);
+        req.path = "/back" + std::to_string(outage);
+        ASSERT_TRUE(cli.request(req, resp));
+        ASSERT_EQ(req.path, resp.body);
+    }
+    ASSERT_EQ(3u, cli.connections());
+}
+
+TEST(TEST_SERVER, serve_test) {
+    nt::HTTP::server::options sopts;
+    sopts.ip = "127.0.0.1";
+    sopts.port = 0;
+    sopts.threads = 2;
+    sopts.response_size = 16;
+    sopts.max_requests = 7;
+    nt::HTTP::server server(sopts);
+
+    nt::HTTP::Response pong;
+    pong.body = "pong";
+    server.set_response("/ping", pong);
+    nt::HTTP::router routes;
+    routes.add("/items/:id", [](const nt::HTTP::Request&, const nt::HTTP::route_params& params, nt::HTTP::Response& resp) {
+        resp.body = std::string(params.get("id"));
+    });
+    server.set_router(std::move(routes));
+    server.set_handler([](const nt::HTTP::Request& req, nt::HTTP::Response& resp) {
+        resp.status = 201;
+        resp.body = req.method + " " + req.path;
+    });
+    ASSERT_TRUE(server.start());
+    ASSERT_NE(0, server.get_port());
+
+    nt::HTTP::client::options copts;
+    copts.pipeline_depth = 16;
+    nt::HTTP::client cli("127.0.0.1", server.get_port(), copts);
+    for (int i = 0; i < 100; i++) {
+        nt::HTTP::Request req;
+        if (i % 3 == 2) {
+            req.path = "/items/" + std::to_string(i) + "?full=1";
+        } else {
+            req.path = i % 3 == 0 ? "/ping?n=" + std::to_string(i) : "/echo/" + std::to_string(i);
+        }
+        ASSERT_TRUE(cli.send(req));
+    }
+    nt::HTTP::Response resp;
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(cli.recv(resp));
+        if (i % 3 == 2) {
+            ASSERT_EQ(200, resp.status);
+            ASSERT_EQ(std::to_string(i), resp.body);
+        } else if (i % 3 == 0) {
+            ASSERT_EQ(200, resp.status);
+            ASSERT_EQ("pong", resp.body);
+        } else {
+            ASSERT_EQ(201, resp.status);
+            ASSERT_EQ("GET /echo/" + std::to_string(i), resp.body);
+        }
+    }
+    //! `max_requests` closes every connection after 7 responses
+    ASSERT_EQ(15u, cli.connections());
+    ASSERT_EQ(100u, server.requests());
+
+    //! HEAD gets the headers of a GET only, the pipelined GET after it still parses
+    nt::HTTP::client head_cli("127.0.0.1", server.get_port(), copts);
+    for (const char* path : { "/ping", "/echo/head", "/items/7" }) {
+        nt::HTTP::Request req;
+        req.method = "HEAD";
+        req.path = path;
+        ASSERT_TRUE(head_cli.send(req));
+    }
+    nt::HTTP::Request get;
+    get.path = "/ping";
+    ASSERT_TRUE(head_cli.send(get));
+    for (const char* length : { "4", "15", "1" }) {
+        ASSERT_TRUE(head_cli.recv(resp));
+        ASSERT_EQ("", resp.body);
+        const std::string* value = nt::HTTP::find_header_nocase(resp.headers, "content-length");
+        ASSERT_NE(nullptr, value);
+        ASSERT_EQ(length, *value);
+    }
+    ASSERT_TRUE(head_cli.recv(resp));
+    ASSERT_EQ("pong", resp.body);
+    ASSERT_EQ(1u, head_cli.connections());
+
+    server.stop();
+    server.wait();
+}
+
+TEST(TEST_SERVER, restart_test) {
+    nt::HTTP::server::options sopts;
+    sopts.ip = "127.0.0.1";
+    sopts.port = 0;
+    sopts.threads = 4;
+    nt::HTTP::server server(sopts);
+    auto open_fds = []() {
+        size_t count = 0;
+        for (int fd = 0; fd < 4096; fd++) count += (fcntl(fd, F_GETFD) != -1);
+        return count;
+    };
+
+    ASSERT_TRUE(server.start());
+    server.stop();
+    server.wait();
+    size_t fds = open_fds();
+    //! a restart replaces the listening sockets of every worker instead of leaking them
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(server.start());
+        nt::HTTP::client cli("127.0.0.1", server.get_port());
+        nt::HTTP::Request req;
+        nt::HTTP::Response resp;
+        ASSERT_TRUE(cli.request(req, resp));
+        ASSERT_EQ(200, resp.status);
+        server.stop();
+        server.wait();
+    }
+    ASSERT_EQ(fds, open_fds());
+}
+
+TEST(TEST_SERVER, latency_test) {
+    nt::HTTP::server::options sopts;
+    sopts.ip = "127.0.0.1";
+    sopts.port = 0;
+    sopts.latency_us = 20 * 1000;
+    sopts.response_size = 1000;
+    nt::HTTP::server server(sopts);
+    ASSERT_TRUE(server.start());
+
+    nt::HTTP::client::options copts;
+    copts.pipeline_depth = 4;
+    nt::HTTP::client cli("127.0.0.1", server.get_port(), copts);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 4; i++) ASSERT_TRUE(cli.send(nt::HTTP::Request()));
+    nt::HTTP::Response resp;
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(cli.recv(resp));
+        ASSERT_EQ(1000u, resp.body.size());
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    //! the pipelined requests are delayed concurrently, not one after the other
+    ASSERT_GE(elapsed, std::chrono::milliseconds(20));
+    ASSERT_LT(elapsed, std::chrono::milliseconds(70));
+}
+
+GTEST_API_ int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
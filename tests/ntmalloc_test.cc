@@ -0,0 +1,1006 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <map>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../src/include/http/http_request.h"
+#include "../src/include/ntmalloc/ntmalloc.h"
+#include "../src/include/ntmalloc/ntmalloc_allocator.h"
+#include "../src/include/ntmalloc/ntmalloc_internal.h"
+
+TEST(TEST_NTMALLOC, small_malloc_test) {
+    //! every small size, including 0, gets a distinct block of at least that size
+    std::vector<std::pair<uint8_t*, size_t>> blocks;
+    for (size_t size = 0; size <= nt::NT_SMALL_SIZE_MAX; size++) {
+        uint8_t* p = (uint8_t*)nt::nt_malloc(size);
+        ASSERT_NE(nullptr, p) << size;
+        ASSERT_EQ(0u, (uintptr_t)p % sizeof(void*));
+        nt::nt_page_t* page = nt::_nt_ptr_page(p);
+        ASSERT_GE(page->block_size, size);
+        ASSERT_EQ(nt::nt_get_default_heap(), page->heap);
+        memset(p, (int)(size & 0xff), size);
+        blocks.emplace_back(p, size);
+    }
+    for (const auto& b : blocks) {
+        for (size_t i = 0; i < b.second; i++) ASSERT_EQ((uint8_t)(b.second & 0xff), b.first[i]);
+    }
+
+}
+
+TEST(TEST_NTMALLOC, page_extend_test) {
+    //! enough blocks to fill several pages and segments, consecutive blocks come from one
+    //! batch of a page, in a random order within the batch
+    const size_t count = 3 * nt::NT_SEGMENT_SIZE / 64;
+    std::set<uintptr_t> seen;
+    std::set<nt::nt_segment_t*> segments;
+    uint8_t* prev = nullptr;
+    size_t nearby = 0;
+    size_t contiguous = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t* p = (uint8_t*)nt::nt_malloc(64);
+        ASSERT_NE(nullptr, p);
+        ASSERT_TRUE(seen.insert((uintptr_t)p).second);
+        *(uint64_t*)p = i;
+        if (prev != nullptr && p == prev + 64) contiguous++;
+        if (prev != nullptr && nt::_nt_ptr_page(p) == nt::_nt_ptr_page(prev) &&
+            (size_t)(p > prev ? p - prev : prev - p) < 4096) {
+            nearby++;
+        }
+        prev = p;
+        segments.insert(nt::_nt_ptr_segment(p));
+    }
+    EXPECT_GE(segments.size(), 3u);
+    EXPECT_GT(nearby, count * 9 / 10);
+    EXPECT_LT(contiguous, count / 2);
+
+    nt::nt_page_t* page = nt::_nt_ptr_page(prev);
+    EXPECT_EQ(64u, page->block_size);
+    EXPECT_LE(page->capacity, page->reserved);
+    EXPECT_EQ(nt::NT_SMALL_PAGE_SIZE / 64, page->reserved);
+}
+
+TEST(TEST_NTMALLOC, thread_heap_test) {
+    nt::nt_heap_t* main_heap = nullptr;
+    void* main_block = nt::nt_malloc(32);
+    ASSERT_NE(nullptr, main_block);
+    main_heap = nt::_nt_ptr_page(main_block)->heap;
+
+    std::vector<std::thread> threads;
+    std::vector<nt::nt_heap_t*> heaps(4, nullptr);
+    std::atomic<size_t> running { heaps.size() };
+    for (size_t t = 0; t < heaps.size(); t++) {
+        threads.emplace_back([t, &heaps, &running]() {
+            for (int i = 0; i < 10000; i++) {
+                void* p = nt::nt_malloc(16 + (size_t)(i % 64));
+                if (p == nullptr) {
+                    running--;
+                    return;
+                }
+                memset(p, 0x5a, 16);
+            }
+            void* p = nt::nt_malloc(32);
+            heaps[t] = nt::_nt_ptr_page(p)->heap;
+            //! pages and segments belong to the allocating thread
+            if (nt::_nt_ptr_segment(p)->thread_id != nt::_nt_thread_id()) heaps[t] = nullptr;
+            //! the data of an exited thread is reused, so all of them must be alive at once
+            running--;
+            while (running.load() != 0) std::this_thread::yield();
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    std::set<nt::nt_heap_t*> distinct { main_heap };
+    for (nt::nt_heap_t* heap : heaps) {
+        ASSERT_NE(nullptr, heap);
+        distinct.insert(heap);
+    }
+    EXPECT_EQ(heaps.size() + 1, distinct.size());
+}
+
+TEST(TEST_NTMALLOC, local_free_test) {
+    nt::nt_free(nullptr);
+
+    const size_t count = 1000;
+    std::set<uintptr_t> blocks;
+    for (size_t i = 0; i < count; i++) {
+        void* p = nt::nt_malloc(48);
+        ASSERT_NE(nullptr, p);
+        blocks.insert((uintptr_t)p);
+    }
+    nt::nt_heap_t* heap = nt::nt_get_default_heap();
+    size_t page_count = heap->page_count;
+    for (uintptr_t p : blocks) nt::nt_free((void*)p);
+
+    //! freed blocks are handed out again, no new page is needed
+    size_t reused = 0;
+    for (size_t i = 0; i < count; i++) {
+        void* p = nt::nt_malloc(48);
+        ASSERT_NE(nullptr, p);
+        if (blocks.count((uintptr_t)p) != 0) reused++;
+    }
+    EXPECT_GT(reused, count / 2);
+    EXPECT_EQ(page_count, heap->page_count);
+}
+
+TEST(TEST_NTMALLOC, thread_free_test) {
+    const size_t count = 20000;
+    const size_t nthreads = 4;
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < count; i++) {
+        void* p = nt::nt_malloc(32);
+        ASSERT_NE(nullptr, p);
+        blocks.push_back(p);
+    }
+
+    nt::nt_heap_t* heap = nt::nt_get_default_heap();
+    size_t page_count = heap->page_count;
+
+    //! every thread frees its own quarter of blocks owned by the main thread
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < nthreads; t++) {
+        threads.emplace_back([t, count, nthreads, &blocks]() {
+            for (size_t i = t * count / nthreads; i < (t + 1) * count / nthreads; i++) {
+                nt::nt_free(blocks[i]);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    //! the owner collects the foreign frees and reuses every block
+    std::set<uintptr_t> freed;
+    for (void* p : blocks) freed.insert((uintptr_t)p);
+    size_t reused = 0;
+    for (size_t i = 0; i < count; i++) {
+        void* p = nt::nt_malloc(32);
+        ASSERT_NE(nullptr, p);
+        if (freed.count((uintptr_t)p) != 0) reused++;
+    }
+    EXPECT_GT(reused, count / 2);
+    EXPECT_EQ(page_count, heap->page_count);
+}
+
+TEST(TEST_NTMALLOC, segment_cache_test) {
+    //! a fresh thread, so the segments and statistics only reflect this test
+    std::thread worker([]() {
+        const size_t count = 3 * nt::NT_SEGMENT_SIZE / 64;
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < count; i++) {
+            void* p = nt::nt_malloc(64);
+            ASSERT_NE(nullptr, p);
+            ASSERT_EQ(0u, (uintptr_t)nt::_nt_ptr_segment(p) % nt::NT_SEGMENT_SIZE);
+            blocks.push_back(p);
+        }
+        nt::nt_tld_t* tld = nt::nt_get_default_heap()->tld;
+        size_t peak_size = tld->segments.current_size;
+#if NT_STAT
+        int64_t first_mmaps = tld->stats.mmap_calls.allocated;
+#endif
+        EXPECT_GE(peak_size, 3 * nt::NT_SEGMENT_SIZE);
+
+        //! empty pages are retired, empty segments are cached or unmapped
+        for (void* p : blocks) nt::nt_free(p);
+        EXPECT_LT(tld->segments.current_size, peak_size);
+        EXPECT_GE(tld->segments.cache_count, 1u);
+
+        //! the same burst again is served partly from the cache
+        for (size_t i = 0; i < count; i++) {
+            blocks[i] = nt::nt_malloc(64);
+            ASSERT_NE(nullptr, blocks[i]);
+        }
+#if NT_STAT
+        EXPECT_LT(tld->stats.mmap_calls.allocated - first_mmaps, first_mmaps);
+#endif
+
+        //! a large page spans a segment of its own
+        nt::nt_page_t* page = nt::_nt_segment_page_alloc(16 * 1024, &tld->segments, &tld->os);
+        ASSERT_NE(nullptr, page);
+        nt::nt_segment_t* segment = nt::_nt_page_segment(page);
+        EXPECT_EQ(nt::NT_PAGE_LARGE, segment->page_kind);
+        EXPECT_EQ(1u, segment->capacity);
+        EXPECT_EQ(nt::_nt_thread_id(), segment->thread_id);
+        size_t page_size = 0;
+        nt::_nt_segment_page_start(segment, page, &page_size);
+        EXPECT_GT(page_size, nt::NT_SEGMENT_SIZE - nt::NT_SMALL_PAGE_SIZE);
+        size_t current_size = tld->segments.current_size;
+        nt::_nt_segment_page_free(page, &tld->segments);
+        EXPECT_EQ(current_size - nt::NT_SEGMENT_SIZE, tld->segments.current_size);
+    });
+    worker.join();
+}
+
+TEST(TEST_NTMALLOC, bin_test) {
+    nt::nt_heap_t* heap = nt::nt_get_default_heap();
+    uint8_t last = 1;
+    for (size_t size = 0; size <= nt::NT_LARGE_SIZE_MAX; size++) {
+        uint8_t bin = nt::_nt_bin(size);
+        //! bins grow with the size and the block size of the bin fits the request without much waste
+        ASSERT_GE(bin, last) << size;
+        ASSERT_LT(bin, nt::NT_BIN_HUGE) << size;
+        size_t block_size = heap->pages[bin].block_size;
+        ASSERT_GE(block_size, size) << size;
+        if (size > 8 * sizeof(void*)) {
+            ASSERT_LE(block_size - size, block_size / 4) << size;
+        }
+        last = bin;
+    }
+    EXPECT_EQ(nt::NT_BIN_HUGE, nt::_nt_bin(nt::NT_LARGE_SIZE_MAX + 1));
+
+    //! a block comes from the queue of its bin and the direct pages follow the first page of the queue
+    for (size_t size : { 8, 72, 80, 100, 500, 1000 }) {
+        void* p = nt::nt_malloc(size);
+        ASSERT_NE(nullptr, p);
+        nt::nt_page_t* page = nt::_nt_ptr_page(p);
+        EXPECT_EQ(heap->pages[nt::_nt_bin(size)].block_size, page->block_size);
+        EXPECT_EQ(heap->pages[nt::_nt_bin(size)].first, heap->pages_free_direct[nt::_nt_wsize_from_size(size)]);
+        nt::nt_free(p);
+    }
+}
+
+TEST(TEST_NTMALLOC, full_page_test) {
+    std::vector<void*> blocks;
+    nt::nt_heap_t* heap = nullptr;
+    std::thread owner([&blocks, &heap]() {
+        //! several pages worth of blocks, all pages but the last one end up in the full queue
+        for (size_t i = 0; i < 4 * nt::NT_SMALL_PAGE_SIZE / 256; i++) {
+            void* p = nt::nt_malloc(256);
+            ASSERT_NE(nullptr, p);
+            blocks.push_back(p);
+        }
+        heap = nt::nt_get_default_heap();
+        ASSERT_NE(nullptr, heap->pages[nt::NT_BIN_FULL].first);
+        EXPECT_TRUE(heap->pages[nt::NT_BIN_FULL].first->flags.is_full);
+        EXPECT_EQ(heap->pages[nt::NT_BIN_FULL].first, nt::_nt_ptr_page(blocks.front()));
+
+        //! frees of another thread into full pages are handed to the heap
+        std::thread other([&blocks]() {
+            for (void* p : blocks) nt::nt_free(p);
+        });
+        other.join();
+        EXPECT_NE(nullptr, heap->thread_delayed_free);
+
+        //! the owner takes them back and unfulls the pages
+        size_t page_count = heap->page_count;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            void* p = nt::nt_malloc(256);
+            ASSERT_NE(nullptr, p);
+        }
+        EXPECT_EQ(nullptr, heap->thread_delayed_free);
+        EXPECT_LE(heap->page_count, page_count);
+    });
+    owner.join();
+}
+
+TEST(TEST_NTMALLOC, large_malloc_test) {
+    std::thread worker([]() {
+        nt::nt_tld_t* tld = nullptr;
+        for (size_t size : { nt::NT_SMALL_SIZE_MAX + 1, (size_t)8 * 1024, (size_t)8 * 1024 + 1, (size_t)100000,
+                             nt::NT_LARGE_SIZE_MAX, nt::NT_LARGE_SIZE_MAX + 1, (size_t)1024 * 1024, 3 * nt::NT_SEGMENT_SIZE + 7 }) {
+            uint8_t* p = (uint8_t*)nt::nt_malloc(size);
+            ASSERT_NE(nullptr, p) << size;
+            memset(p, 0x7f, size);
+            nt::nt_page_t* page = nt::_nt_ptr_page(p);
+            nt::nt_segment_t* segment = nt::_nt_ptr_segment(p);
+            ASSERT_GE(page->block_size, size);
+            tld = page->heap->tld;
+
+            if (page->block_size <= nt::NT_SMALL_PAGE_SIZE / 8) {
+                EXPECT_EQ(nt::NT_PAGE_SMALL, segment->page_kind) << size;
+            } else if (size <= nt::NT_LARGE_SIZE_MAX) {
+                EXPECT_EQ(nt::NT_PAGE_LARGE, segment->page_kind) << size;
+            } else {
+                //! a huge object is unmapped as soon as it is freed
+                EXPECT_EQ(nt::NT_PAGE_HUGE, segment->page_kind) << size;
+                EXPECT_EQ(1u, page->reserved);
+                EXPECT_GE(segment->segment_size, size + segment->segment_info_size);
+#if NT_STAT
+                EXPECT_EQ((int64_t)page->block_size, tld->stats.huge.current);
+#endif
+                size_t current_size = tld->segments.current_size;
+                size_t segment_size = segment->segment_size;
+                nt::nt_free(p);
+#if NT_STAT
+                EXPECT_EQ(0, tld->stats.huge.current);
+#endif
+                EXPECT_EQ(current_size - segment_size, tld->segments.current_size);
+            }
+        }
+
+        //! a huge object freed by another thread is handed to the heap, the owner unmaps it right away
+        nt::nt_heap_t* heap = nt::nt_get_default_heap();
+        size_t current_size = tld->segments.current_size;
+        void* huge = nt::nt_malloc(3 * nt::NT_SEGMENT_SIZE);
+        ASSERT_NE(nullptr, huge);
+        std::thread other([huge]() { nt::nt_free(huge); });
+        other.join();
+        EXPECT_NE(nullptr, heap->thread_delayed_free);
+        nt::nt_collect(false);
+        EXPECT_EQ(nullptr, heap->thread_delayed_free);
+        EXPECT_EQ(nullptr, heap->pages[nt::NT_BIN_HUGE].first);
+        EXPECT_EQ(current_size, tld->segments.current_size);
+#if NT_STAT
+        EXPECT_GT(tld->stats.huge.allocated, 3 * (int64_t)nt::NT_SEGMENT_SIZE);
+#endif
+    });
+    worker.join();
+
+    //! too large to ever succeed
+    errno = 0;
+    EXPECT_EQ(nullptr, nt::nt_malloc(SIZE_MAX));
+    EXPECT_EQ(ENOMEM, errno);
+}
+
+TEST(TEST_NTMALLOC, trace_test) {
+    std::thread worker([]() {
+        void* small = nt::nt_malloc(64);
+        void* huge = nt::nt_malloc(2 * nt::NT_SEGMENT_SIZE);
+        ASSERT_NE(nullptr, small);
+        ASSERT_NE(nullptr, huge);
+        nt::nt_free(huge);
+
+        std::vector<nt::nt_trace_entry_t> entries(nt::NT_TRACE_RING_SIZE);
+        size_t count = nt::nt_trace_read(entries.data(), entries.size());
+#if NT_TRACE
+        //! the slow path events of this thread, in order
+        ASSERT_GT(count, 0u);
+        std::vector<nt::nt_trace_event_t> events;
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0) EXPECT_EQ(entries[i - 1].seq + 1, entries[i].seq);
+            events.push_back(entries[i].event);
+        }
+        auto position = [&events](nt::nt_trace_event_t event) {
+            return std::find(events.begin(), events.end(), event) - events.begin();
+        };
+        EXPECT_LT(position(nt::NT_TRACE_THREAD_INIT), position(nt::NT_TRACE_PAGE_FRESH));
+        EXPECT_LT(position(nt::NT_TRACE_PAGE_FRESH), position(nt::NT_TRACE_HUGE_ALLOC));
+        EXPECT_LT(position(nt::NT_TRACE_HUGE_ALLOC), position(nt::NT_TRACE_PAGE_RETIRE));
+        EXPECT_EQ(nt::NT_TRACE_OS_FREE, events.back());
+        EXPECT_EQ(2 * nt::NT_SEGMENT_SIZE, entries[position(nt::NT_TRACE_HUGE_ALLOC)].arg1);
+#else
+        EXPECT_EQ(0u, count);
+#endif
+        EXPECT_STREQ("page_retire", nt::nt_trace_event_name(nt::NT_TRACE_PAGE_RETIRE));
+        nt::nt_free(small);
+    });
+    worker.join();
+}
+
+TEST(TEST_NTMALLOC, stats_test) {
+    nt::nt_stats_reset();
+    const size_t bin = nt::_nt_bin(100);
+    std::thread worker([]() {
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < 1000; i++) blocks.push_back(nt::nt_malloc(100));
+        for (size_t i = 0; i < 400; i++) nt::nt_free(blocks[i]);
+    });
+    worker.join();
+
+    //! the statistics of an exited thread are part of the process totals
+    size_t len = nt::nt_stats_json(nullptr, 0);
+    ASSERT_GT(len, 0u);
+    std::string json(len + 1, '\0');
+    EXPECT_EQ(len, nt::nt_stats_json(&json[0], json.size()));
+    json.resize(len);
+    EXPECT_EQ('{', json.front());
+    EXPECT_EQ('}', json.back());
+    EXPECT_NE(std::string::npos, json.find("\"segments\":{"));
+    EXPECT_NE(std::string::npos, json.find("\"bins\":["));
+#if NT_STAT
+    EXPECT_GE(nt::_nt_stats_main.threads.allocated, 1);
+#endif
+#if NT_STAT > 1
+    const nt::nt_stat_count_t& stat = nt::_nt_stats_main.normal[bin];
+    EXPECT_GE(stat.allocated, 1000);
+    EXPECT_GE(stat.freed, 400);
+    EXPECT_GE(stat.peak, 1000);
+    std::string entry = "{\"bin\":" + std::to_string(bin) + ",\"block_size\":112,";
+    EXPECT_NE(std::string::npos, json.find(entry)) << json;
+#else
+    UNUSED(bin);
+#endif
+
+    //! a report changes nothing, the peaks stay put
+    std::string again(len + 1, '\0');
+    EXPECT_EQ(len, nt::nt_stats_json(&again[0], again.size()));
+    again.resize(len);
+    EXPECT_EQ(json, again);
+
+    //! a short buffer is truncated but still terminated
+    char small[16];
+    EXPECT_EQ(len, nt::nt_stats_json(small, sizeof(small)));
+    EXPECT_EQ(sizeof(small) - 1, strlen(small));
+
+#if NT_STAT > 1
+    //! frees by a consumer count against the producer, whose peak stays near what is live
+    const size_t live = 100, rounds = 50;
+    const size_t handoff = nt::_nt_bin(3000);
+    int64_t peak = nt::_nt_stats_main.normal[handoff].peak;
+    std::thread producer([&]() {
+        nt::nt_thread_init();
+        nt::nt_stats_t* stats = &nt::nt_get_default_heap()->tld->stats;
+        for (size_t r = 0; r < rounds; r++) {
+            std::vector<void*> round;
+            for (size_t i = 0; i < live; i++) round.push_back(nt::nt_malloc(3000));
+            std::thread consumer([&round, handoff]() {
+                for (void* p : round) nt::nt_free(p);
+                nt::nt_heap_t* heap = nt::nt_get_default_heap();
+                if (nt::nt_heap_is_initialized(heap)) {
+                    EXPECT_GE(heap->tld->stats.normal[handoff].current, 0);
+                }
+            });
+            consumer.join();
+            EXPECT_GE(stats->normal[handoff].current, 0);
+        }
+        EXPECT_LE(stats->normal[handoff].peak, (int64_t)(4 * live));
+        //! at most the last round is still waiting to be collected
+        EXPECT_LE(stats->normal[handoff].current, (int64_t)live);
+    });
+    producer.join();
+    EXPECT_LE(nt::_nt_stats_main.normal[handoff].peak, std::max<int64_t>(peak, 4 * live));
+#endif
+}
+
+TEST(TEST_NTMALLOC, purge_test) {
+    long delay = nt::nt_option_get(nt::NT_OPTION_PURGE_DELAY);
+    //! long enough that no purge is ever due during the test, however slow the machine
+    nt::nt_option_set(nt::NT_OPTION_PURGE_DELAY, 10 * 1000);
+    std::thread worker([]() {
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < 2 * nt::NT_SEGMENT_SIZE / 64; i++) {
+            void* p = nt::nt_malloc(64);
+            ASSERT_NE(nullptr, p);
+            memset(p, 0x11, 64);
+            blocks.push_back(p);
+        }
+        nt::nt_tld_t* tld = nt::nt_get_default_heap()->tld;
+#if NT_STAT
+        //! reclaimed segments may bring pages purged by other threads
+        int64_t reset = tld->stats.reset.current;
+#endif
+        //! the first block keeps its segment alive, so its free pages wait in `pages_purge`
+        for (size_t i = 1; i < blocks.size(); i++) nt::nt_free(blocks[i]);
+
+        //! free memory is kept for the purge delay
+        nt::nt_collect(false);
+#if NT_STAT
+        EXPECT_EQ(reset, tld->stats.reset.current);
+#endif
+        EXPECT_NE(nullptr, tld->segments.pages_purge.first);
+
+        //! and purged right away by a forced collect
+        nt::nt_collect(true);
+#if NT_STAT
+        EXPECT_GT(tld->stats.reset.current, reset);
+#endif
+        EXPECT_EQ(nullptr, tld->segments.pages_purge.first);
+#if NT_STAT
+        int64_t committed = tld->stats.committed.current;
+#endif
+
+        //! purged memory is used again as is, the OS backs it on the first touch
+        for (size_t i = 1; i < blocks.size(); i++) {
+            blocks[i] = nt::nt_malloc(64);
+            ASSERT_NE(nullptr, blocks[i]);
+            memset(blocks[i], 0x22, 64);
+        }
+#if NT_STAT
+        EXPECT_GT(tld->stats.committed.current, committed);
+#endif
+        for (void* p : blocks) nt::nt_free(p);
+        nt::nt_collect(true);
+        EXPECT_EQ(nullptr, tld->segments.pages_purge.first);
+    });
+    worker.join();
+    nt::nt_option_set(nt::NT_OPTION_PURGE_DELAY, delay);
+}
+
+TEST(TEST_NTMALLOC, abandon_test) {
+    //! the first thread to allocate becomes the main thread, which never abandons its segments
+    nt::nt_free(nt::nt_malloc(8));
+
+    //! a thread exits with live blocks
+#if NT_STAT
+    int64_t abandoned = nt::_nt_stats_main.segments_abandoned.allocated;
+#endif
+    std::vector<void*> blocks;
+    std::thread owner([&blocks]() {
+        for (size_t i = 0; i < 1000; i++) blocks.push_back(nt::nt_malloc(48));
+    });
+    owner.join();
+    nt::nt_segment_t* segment = nt::_nt_ptr_segment(blocks[0]);
+    EXPECT_EQ(0u, segment->thread_id);
+    EXPECT_EQ(segment->used, segment->abandoned);
+#if NT_STAT
+    EXPECT_GT(nt::_nt_stats_main.segments_abandoned.allocated, abandoned);
+#endif
+
+    //! blocks can still be freed while nobody owns the segment
+    for (size_t i = 0; i < blocks.size(); i += 2) nt::nt_free(blocks[i]);
+
+    std::thread adopter([&blocks, segment]() {
+        //! a thread needing a fresh page adopts it instead of mapping a new segment
+        void* p = nt::nt_malloc(48);
+        ASSERT_NE(nullptr, p);
+        EXPECT_EQ(nt::_nt_thread_id(), segment->thread_id);
+        EXPECT_EQ(0u, segment->abandoned);
+        EXPECT_EQ(segment, nt::_nt_ptr_segment(p));
+        nt::nt_free(p);
+        for (size_t i = 1; i < blocks.size(); i += 2) nt::nt_free(blocks[i]);
+    });
+    adopter.join();
+
+    //! a forced collect adopts everything that is left
+    std::thread owner2([&blocks]() {
+        blocks.clear();
+        blocks.push_back(nt::nt_malloc(100 * 1024));
+        blocks.push_back(nt::nt_malloc(4 * 1024 * 1024));
+    });
+    owner2.join();
+    std::thread collector([&blocks]() {
+        nt::nt_collect(true);
+        for (void* p : blocks) {
+            EXPECT_EQ(nt::_nt_thread_id(), nt::_nt_ptr_segment(p)->thread_id);
+            nt::nt_free(p);
+        }
+    });
+    collector.join();
+}
+
+TEST(TEST_NTMALLOC, thread_churn_test) {
+    auto churn = []() {
+        nt::nt_heap_t* heap = nullptr;
+        std::thread worker([&heap]() {
+            void* p = nt::nt_malloc(64);
+            heap = nt::nt_heap_get_backing();
+            nt::nt_free(p);
+        });
+        worker.join();
+        return heap;
+    };
+    nt::nt_heap_t* first = churn();
+
+    //! threads started one after another run on the data of the one before
+#if NT_STAT
+    int64_t reserved = nt::_nt_stats_main.reserved.current;
+#endif
+    for (size_t i = 0; i < 200; i++) ASSERT_EQ(first, churn());
+#if NT_STAT
+    EXPECT_LE(nt::_nt_stats_main.reserved.current, reserved);
+#endif
+}
+
+TEST(TEST_NTMALLOC, large_os_pages_test) {
+    long large = nt::nt_option_get(nt::NT_OPTION_LARGE_OS_PAGES);
+    for (long mode = 1; mode <= 2; mode++) {
+        nt::nt_option_set(nt::NT_OPTION_LARGE_OS_PAGES, mode);
+        std::thread worker([]() {
+            //! a fresh thread maps fresh segments, unless it adopts those left by other tests
+            nt::nt_thread_init();
+            nt::nt_get_default_heap()->no_reclaim = true;
+            void* p = nt::nt_malloc(64);
+            void* q = nt::nt_malloc(5 * 1024 * 1024);
+            ASSERT_NE(nullptr, p);
+            ASSERT_NE(nullptr, q);
+            for (void* x : { p, q }) {
+                nt::nt_segment_t* segment = nt::_nt_ptr_segment(x);
+                EXPECT_EQ(0u, (uintptr_t)segment % nt::NT_LARGE_OS_PAGE_SIZE);
+                EXPECT_EQ(0u, segment->segment_size % nt::NT_LARGE_OS_PAGE_SIZE);
+                //! hugetlbfs needs reserved pages, transparent huge pages are the fallback
+                EXPECT_NE(nt::NT_OS_MEM_NORMAL, segment->mem_kind);
+            }
+#if NT_STAT
+            nt::nt_tld_t* tld = nt::nt_get_default_heap()->tld;
+            EXPECT_GT(tld->stats.large_pages.current + tld->stats.thp_advised.current, 0);
+#endif
+            memset(q, 1, 5 * 1024 * 1024);
+            nt::nt_free(p);
+            nt::nt_free(q);
+        });
+        worker.join();
+    }
+    nt::nt_option_set(nt::NT_OPTION_LARGE_OS_PAGES, large);
+}
+
+TEST(TEST_NTMALLOC, calloc_test) {
+    //! dirty blocks have to be cleared, fresh ones only in their link
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < 100; i++) {
+        void* p = nt::nt_malloc(200);
+        memset(p, 0xab, 200);
+        blocks.push_back(p);
+    }
+    for (void* p : blocks) nt::nt_free(p);
+    for (size_t size : { (size_t)8, (size_t)200, (size_t)5000, (size_t)100 * 1024, (size_t)5 * 1024 * 1024 }) {
+        //! every block is freed dirty, so the next one may well be the same memory
+        size_t rounds = (size > nt::NT_LARGE_SIZE_MAX ? 4 : 200);
+        for (size_t i = 0; i < rounds; i++) {
+            uint8_t* p = (uint8_t*)nt::nt_calloc(1, size);
+            ASSERT_NE(nullptr, p);
+            EXPECT_EQ(size, (size_t)std::count(p, p + size, 0));
+            memset(p, 0xcd, size);
+            nt::nt_free(p);
+        }
+    }
+    errno = 0;
+    EXPECT_EQ(nullptr, nt::nt_calloc(SIZE_MAX / 2, 3));
+    EXPECT_EQ(ENOMEM, errno);
+}
+
+TEST(TEST_NTMALLOC, realloc_test) {
+    //! growing by appending, the contents move along
+    char* p = nullptr;
+    size_t moved = 0;
+    for (size_t size = 1; size <= 64 * 1024; size++) {
+        char* q = (char*)nt::nt_realloc(p, size);
+        ASSERT_NE(nullptr, q);
+        if (q != p) moved++;
+        q[size - 1] = (char)size;
+        p = q;
+    }
+    for (size_t size = 1; size <= 64 * 1024; size++) ASSERT_EQ((char)size, p[size - 1]);
+    //! only when the size class changes
+    EXPECT_LT(moved, (size_t)64);
+    //! shrinking a little keeps the block, a lot moves it
+    EXPECT_EQ(p, nt::nt_realloc(p, 40 * 1024));
+    p = (char*)nt::nt_realloc(p, 100);
+    EXPECT_EQ((char)100, p[99]);
+    nt::nt_free(p);
+
+    //! a huge block grows into the room left in its segment
+    size_t size = 5 * 1024 * 1024 + 100;
+    char* h = (char*)nt::nt_malloc(size);
+    ASSERT_NE(nullptr, h);
+    h[size - 1] = 'x';
+    nt::nt_segment_t* segment = nt::_nt_ptr_segment(h);
+    size_t room = segment->segment_size - segment->segment_info_size;
+    ASSERT_GT(room, nt::nt_usable_size(h));
+    EXPECT_EQ(h, nt::nt_realloc(h, room));
+    EXPECT_GE(nt::nt_usable_size(h), room);
+    EXPECT_EQ('x', h[size - 1]);
+    char* h2 = (char*)nt::nt_realloc(h, room + 1);
+    ASSERT_NE(nullptr, h2);
+    EXPECT_EQ('x', h2[size - 1]);
+    nt::nt_free(h2);
+
+    EXPECT_EQ(0u, nt::nt_usable_size(nullptr));
+    void* z = nt::nt_realloc(nullptr, 10);
+    EXPECT_GE(nt::nt_usable_size(z), 10u);
+    nt::nt_free_size(z, 10);
+}
+
+TEST(TEST_NTMALLOC, aligned_test) {
+    std::vector<void*> blocks;
+    for (size_t alignment = 1; alignment <= 1024 * 1024; alignment *= 2) {
+        for (size_t size : { (size_t)1, (size_t)24, (size_t)100, (size_t)1000, (size_t)70000 }) {
+            uint8_t* p = (uint8_t*)nt::nt_malloc_aligned(size, alignment);
+            ASSERT_NE(nullptr, p);
+            EXPECT_EQ(0u, (uintptr_t)p % alignment) << size << " " << alignment;
+            ASSERT_GE(nt::nt_usable_size(p), size);
+            memset(p, 0x5a, nt::nt_usable_size(p));
+            blocks.push_back(p);
+        }
+    }
+    //! aligned blocks are freed from any pointer into them, locally and by other threads
+    std::thread([&blocks]() {
+        for (size_t i = 0; i < blocks.size(); i += 2) nt::nt_free(blocks[i]);
+    }).join();
+    for (size_t i = 1; i < blocks.size(); i += 2) nt::nt_free(blocks[i]);
+
+    //! size classes that are a multiple of the alignment waste nothing
+    void* p = nt::nt_aligned_alloc(64, 192);
+    EXPECT_EQ(0u, (uintptr_t)p % 64);
+    EXPECT_EQ(192u, nt::nt_usable_size(p));
+    EXPECT_FALSE(nt::_nt_ptr_page(p)->flags.has_aligned);
+    nt::nt_free(p);
+
+    errno = 0;
+    EXPECT_EQ(nullptr, nt::nt_malloc_aligned(16, 24));
+    EXPECT_EQ(EINVAL, errno);
+}
+
+#ifdef NT_MALLOC_SHARED_PATH
+TEST(TEST_NTMALLOC, override_test) {
+    //! the statistics at exit show the child allocated through ntmalloc; a shell that exits
+    //! through `exit` and keeps stderr open until then (unlike coreutils)
+    std::string command = "LD_PRELOAD=" NT_MALLOC_SHARED_PATH " NT_MALLOC_SHOW_STATS=1 "
+                          "bash -c 'for i in $(seq 1000); do x=\"$x$i\"; done' 2>&1 >/dev/null";
+    FILE* child = popen(command.c_str(), "r");
+    ASSERT_NE(nullptr, child);
+    std::string output;
+    char buf[4096];
+    size_t n = 0;
+    while ((n = fread(buf, 1, sizeof(buf), child)) > 0) output.append(buf, n);
+    EXPECT_EQ(0, pclose(child));
+    EXPECT_NE(std::string::npos, output.find("ntmalloc")) << output;
+    EXPECT_NE(std::string::npos, output.find("segments")) << output;
+}
+#endif
+
+TEST(TEST_NTMALLOC, heap_test) {
+    void* survivor = nullptr;
+    std::thread worker([&survivor]() {
+        nt::nt_heap_t* backing = nt::nt_heap_get_backing();
+        backing->no_reclaim = true;
+        nt::nt_stats_t* stats = &backing->tld->stats;
+
+        //! destroy gives back every page at once, without freeing the blocks
+        nt::nt_heap_t* heap = nt::nt_heap_new();
+        ASSERT_NE(nullptr, heap);
+        EXPECT_EQ(backing->tld, heap->tld);
+        int64_t pages = stats->pages.current;
+        //! the heap itself is a block of the backing heap, freed along with it
+        int64_t malloced = stats->malloc.current - (int64_t)nt::nt_usable_size(heap);
+        for (size_t i = 0; i < 2000; i++) ASSERT_NE(nullptr, nt::nt_heap_malloc(heap, 16 + i % 512));
+        ASSERT_NE(nullptr, nt::nt_heap_malloc(heap, 5 * 1024 * 1024));
+        EXPECT_GT(heap->page_count, 2u);
+#if NT_STAT
+        EXPECT_GT(stats->pages.current, pages);
+#endif
+        nt::nt_heap_destroy(heap);
+        EXPECT_GE(pages, stats->pages.current);
+#if NT_STAT > 1
+        EXPECT_EQ(malloced, stats->malloc.current);
+#else
+        UNUSED(malloced);
+#endif
+
+        //! delete hands the blocks still in use to the backing heap
+        heap = nt::nt_heap_new();
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < 1000; i++) blocks.push_back(nt::nt_heap_malloc(heap, 64));
+        for (size_t i = 0; i < blocks.size(); i += 2) nt::nt_free(blocks[i]);
+        nt::nt_heap_delete(heap);
+        for (size_t i = 1; i < blocks.size(); i += 2) {
+            EXPECT_EQ(backing, nt::_nt_ptr_page(blocks[i])->heap);
+            nt::nt_free(blocks[i]);
+        }
+
+        //! the default heap serves `nt_malloc`
+        heap = nt::nt_heap_new();
+        EXPECT_EQ(backing, nt::nt_heap_set_default(heap));
+        void* p = nt::nt_malloc(32);
+        EXPECT_EQ(heap, nt::_nt_ptr_page(p)->heap);
+        nt::nt_heap_destroy(heap);
+        EXPECT_EQ(backing, nt::nt_heap_get_default());
+
+        //! a heap left alive is deleted when its thread exits, its blocks stay valid
+        heap = nt::nt_heap_new();
+        survivor = nt::nt_heap_malloc(heap, 128);
+        nt::nt_heap_set_default(heap);
+    });
+    worker.join();
+    ASSERT_NE(nullptr, survivor);
+    memset(survivor, 0xa5, 128);
+    nt::nt_free(survivor);
+}
+
+TEST(TEST_NTMALLOC, allocator_test) {
+    std::thread worker([]() {
+        nt::nt_heap_t* heap = nt::nt_heap_new();
+        ASSERT_NE(nullptr, heap);
+
+        //! containers with an allocator of a heap keep all their nodes there
+        nt::allocator<int> alloc(heap);
+        std::vector<int, nt::allocator<int>> ints(alloc);
+        for (int i = 0; i < 10000; i++) ints.push_back(i);
+        EXPECT_EQ(heap, nt::_nt_ptr_page(ints.data())->heap);
+        std::map<int, int, std::less<int>, nt::allocator<std::pair<const int, int>>> map(alloc);
+        for (int i = 0; i < 100; i++) map[i] = i;
+        EXPECT_EQ(heap, nt::_nt_ptr_page(&*map.begin())->heap);
+        EXPECT_TRUE(alloc == map.get_allocator());
+        EXPECT_FALSE(alloc == nt::allocator<int>());
+
+        //! over-aligned types take the aligned path
+        struct alignas(64) line { char bytes[64]; };
+        std::vector<line, nt::allocator<line>> lines(3, line{}, nt::allocator<line>(heap));
+        EXPECT_EQ(0u, (uintptr_t)lines.data() % 64);
+        EXPECT_THROW(static_cast<void>(alloc.allocate(SIZE_MAX / 2)), std::bad_array_new_length);
+
+        //! a request parsed into a heap of its own, released at once without destructors
+        nt::nt_heap_t* conn = nt::nt_heap_new();
+        nt::heap_resource resource(conn);
+        auto* req = new (nt::nt_malloc(sizeof(nt::HTTP::pmr::Request))) nt::HTTP::pmr::Request(&resource);
+        std::string wire = "GET /index.html HTTP/1.1\r\nHost: example\r\nUser-Agent: a-rather-long-user-agent-string/1.0\r\n\r\n";
+        ASSERT_EQ(static_cast<ssize_t>(wire.size()), nt::HTTP::parse_request(wire.data(), wire.size(), *req));
+        EXPECT_EQ("a-rather-long-user-agent-string/1.0", req->headers["user-agent"]);
+        EXPECT_EQ(conn, nt::_nt_ptr_page(req->headers["user-agent"].data())->heap);
+        EXPECT_TRUE(resource.is_equal(nt::heap_resource(conn)));
+        EXPECT_FALSE(resource.is_equal(nt::heap_resource(heap)));
+        nt::nt_heap_destroy(conn);
+        nt::nt_free(req);
+
+        ints.clear();
+        ints.shrink_to_fit();
+        map.clear();
+        lines.clear();
+        lines.shrink_to_fit();
+        nt::nt_heap_delete(heap);
+    });
+    worker.join();
+}
+
+/**
+ * @brief Reads the totals from the first line of a heap profile written by `nt_profile_dump`.
+ */
+static bool profile_totals(int64_t totals[4], long* rate) {
+    char path[] = "/tmp/ntmalloc_profile_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return false;
+    unlink(path);
+    nt::nt_profile_dump(fd);
+    char line[256] = {0};
+    bool ok = (pread(fd, line, sizeof(line) - 1, 0) > 0);
+    close(fd);
+    long long t[4] = {0};
+    ok = ok && sscanf(line, "heap profile: %lld: %lld [%lld: %lld] @ heap_v2/%ld", &t[0], &t[1], &t[2], &t[3], rate) == 5;
+    for (int i = 0; i < 4; i++) totals[i] = t[i];
+    return ok;
+}
+
+TEST(TEST_NTMALLOC, profile_test) {
+    long rate = 0;
+    int64_t before[4], during[4], after[4];
+    ASSERT_TRUE(profile_totals(before, &rate));
+    EXPECT_EQ(0, rate);
+
+    std::vector<void*> blocks(1024);
+    nt::nt_option_set(nt::NT_OPTION_SAMPLE_RATE, 4096);
+    std::thread worker([&blocks, &during, &after, &rate]() {
+        //! 1mb in 1kb blocks, some 256 samples
+        for (void*& p : blocks) p = nt::nt_malloc(1024);
+        ASSERT_TRUE(profile_totals(during, &rate));
+        EXPECT_EQ(4096, rate);
+
+        //! every sampled block is dropped again when freed, one by one or with its heap
+        for (void* p : blocks) nt::nt_free(p);
+        nt::nt_heap_t* heap = nt::nt_heap_new();
+        for (size_t i = 0; i < 1024; i++) ASSERT_NE(nullptr, nt::nt_heap_malloc(heap, 1024));
+        nt::nt_heap_destroy(heap);
+        ASSERT_TRUE(profile_totals(after, &rate));
+    });
+    worker.join();
+    nt::nt_option_set(nt::NT_OPTION_SAMPLE_RATE, 0);
+
+    int64_t live = during[0] - before[0];
+    EXPECT_GT(live, 64);
+    EXPECT_LT(live, 1024);
+    EXPECT_EQ(live * 1024, during[1] - before[1]);
+    EXPECT_EQ(before[0], after[0]);
+    EXPECT_EQ(before[1], after[1]);
+    EXPECT_GT(after[2] - during[2], 64);
+}
+
+TEST(TEST_NTMALLOC, free_list_random_test) {
+    nt::nt_heap_t* first = nt::nt_heap_new();
+    nt::nt_heap_t* second = nt::nt_heap_new();
+    ASSERT_NE(nullptr, first);
+    ASSERT_NE(nullptr, second);
+    EXPECT_NE(0u, first->random);
+    EXPECT_NE(first->random, second->random);
+
+    //! a fresh page only threads its first batch, however large the page
+    void* p = nt::nt_heap_malloc(first, 1024);
+    ASSERT_NE(nullptr, p);
+    nt::nt_page_t* page = nt::_nt_ptr_page(p);
+    EXPECT_LT(page->capacity, page->reserved);
+    EXPECT_LE(page->capacity * page->block_size, 4096u);
+
+    //! every block of the batch is handed out exactly once
+    std::set<void*> blocks { p };
+    for (size_t i = 1; i < page->capacity; i++) {
+        void* q = nt::nt_heap_malloc(first, 1024);
+        EXPECT_EQ(page, nt::_nt_ptr_page(q));
+        EXPECT_TRUE(blocks.insert(q).second);
+    }
+    nt::nt_heap_destroy(first);
+    nt::nt_heap_destroy(second);
+}
+
+/**
+ * @brief Reads a counter such as `"free_batches":{"count":1,"total":2}` from the statistics.
+ */
+static bool stats_counter(const char* name, long long* count, long long* total) {
+    std::string json(nt::nt_stats_json(nullptr, 0) + 1, '\0');
+    nt::nt_stats_json(&json[0], json.size());
+    std::string key = std::string("\"") + name + "\":";
+    size_t at = json.find(key);
+    if (at == std::string::npos) return false;
+    return sscanf(json.c_str() + at + key.size(), "{\"count\":%lld,\"total\":%lld}", count, total) == 2;
+}
+
+TEST(TEST_NTMALLOC, free_batch_test) {
+    long long count_before = 0, total_before = 0;
+    ASSERT_TRUE(stats_counter("free_batches", &count_before, &total_before));
+
+    const size_t n = 1000;
+    std::thread producer([n]() {
+        std::vector<void*> blocks(n);
+        std::set<nt::nt_page_t*> pages;
+        for (void*& p : blocks) {
+            p = nt::nt_malloc(64);
+            ASSERT_NE(nullptr, p);
+            pages.insert(nt::_nt_ptr_page(p));
+        }
+        std::atomic<bool> freed(false), done(false);
+        std::thread consumer([&blocks, &freed, &done]() {
+            for (void* p : blocks) nt::nt_free(p);
+            //! the thread goes idle holding a partial batch, it neither allocates nor collects
+            freed = true;
+            while (!done) std::this_thread::yield();
+        });
+        while (!freed) std::this_thread::yield();
+        //! the owner takes the held back frees itself, every block is back but the first
+        //! free into a full page which went to the delayed frees of this heap
+        size_t used = 0;
+        for (nt::nt_page_t* page : pages) {
+            nt::_nt_page_free_collect(page);
+            used += page->used;
+            EXPECT_EQ(nullptr, page->batch);
+        }
+        EXPECT_LE(used, pages.size());
+        nt::_nt_heap_delayed_free(nt::nt_get_default_heap());
+        done = true;
+        consumer.join();
+    });
+    producer.join();
+
+#if NT_STAT
+    long long count = 0, total = 0;
+    ASSERT_TRUE(stats_counter("free_batches", &count, &total));
+    //! the blocks of the full batches were pushed, far fewer atomic pushes than blocks
+    EXPECT_LE(total - total_before, (long long)n);
+    EXPECT_LT((count - count_before) * 8, total - total_before);
+#endif
+}
+
+TEST(TEST_NTMALLOC, numa_test) {
+    //! sysfs node lists, as read from `/sys/devices/system/node/online`
+    EXPECT_EQ(1, nt::_nt_os_numa_parse_nodes("0\n"));
+    EXPECT_EQ(4, nt::_nt_os_numa_parse_nodes("0-3\n"));
+    EXPECT_EQ(4, nt::_nt_os_numa_parse_nodes("0-1,3\n"));
+    EXPECT_EQ(6, nt::_nt_os_numa_parse_nodes("0,2,4-5"));
+    EXPECT_EQ(1, nt::_nt_os_numa_parse_nodes("1"));
+    EXPECT_EQ(1, nt::_nt_os_numa_parse_nodes(""));
+    EXPECT_EQ(1, nt::_nt_os_numa_parse_nodes("3-1"));
+    EXPECT_EQ(1, nt::_nt_os_numa_parse_nodes("0-4096"));
+
+    int nodes = nt::_nt_os_numa_node_count();
+    ASSERT_GE(nodes, 1);
+    int node = nt::_nt_os_numa_node();
+    EXPECT_GE(node, 0);
+    EXPECT_LT(node, nodes);
+
+    std::thread worker([nodes]() {
+        //! a segment is placed on the node the thread ran on when it was allocated
+        void* p = nt::nt_malloc(64);
+        ASSERT_NE(nullptr, p);
+        nt::nt_segment_t* segment = nt::_nt_ptr_segment(p);
+        EXPECT_GE(segment->numa_node, 0);
+        EXPECT_LT(segment->numa_node, nodes);
+        if (nodes == 1) {
+            EXPECT_EQ(0, segment->numa_node);
+        }
+        nt::nt_free(p);
+    });
+    worker.join();
+
+    std::string json(nt::nt_stats_json(nullptr, 0) + 1, '\0');
+    nt::nt_stats_json(&json[0], json.size());
+    EXPECT_NE(std::string::npos, json.find("\"numa_foreign_frees\":{"));
+}
+
+GTEST_API_ int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,355 @@
+#include <arpa/inet.h>
+#include <atomic>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include "../src/include/http/websocket.h"
+#include "../src/include/http/websocket_client.h"
+
+/**
+ * @brief A blocking single connection at a time WebSocket echo server.
+ *
+ * Every text or binary message is echoed back unfragmented, after a ping that the
+ * client has to answer. The text message "bye" makes the server start the closing
+ * handshake with 1001, a close from the client is echoed.
+ */
+class ws_server {
+public:
+    ws_server() {
+        _listen = ::socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(_listen, (sockaddr*)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(_listen, (sockaddr*)&addr, &len);
+        _port = ntohs(addr.sin_port);
+        listen(_listen, 16);
+        _thread = std::thread([this]() { run(); });
+    }
+    ~ws_server() {
+        ::shutdown(_listen, SHUT_RDWR);
+        ::close(_listen);
+        _thread.join();
+    }
+    short port() const { return static_cast<short>(_port); }
+    size_t pongs() const { return _pongs; }
+    size_t frames() const { return _frames; }
+    uint16_t close_code() const { return _close_code; }
+
+private:
+    void run() {
+        while (true) {
+            int conn = accept(_listen, nullptr, nullptr);
+            if (conn < 0) return;
+            serve(conn);
+            ::close(conn);
+        }
+    }
+
+    static void send_all(int conn, const std::string& out) {
+        ::send(conn, out.data(), out.size(), MSG_NOSIGNAL);
+    }
+
+    void serve(int conn) {
+        std::string in;
+        std::string out;
+        std::string message;
+        nt::HTTP::ws_opcode message_opcode = nt::HTTP::ws_opcode::binary;
+        bool upgraded = false;
+        char buf[65536];
+
+        while (true) {
+            ssize_t n = ::recv(conn, buf, sizeof(buf), 0);
+            if (n <= 0) return;
+            in.append(buf, static_cast<size_t>(n));
+
+            out.clear();
+            if (!upgraded) {
+                nt::HTTP::Request req;
+                ssize_t consumed = nt::HTTP::parse_request(in.data(), in.size(), req);
+                if (consumed == 0) continue;
+                ASSERT_GT(consumed, 0);
+                in.erase(0, static_cast<size_t>(consumed));
+                nt::HTTP::Response resp;
+                ASSERT_TRUE(nt::HTTP::ws_accept_handshake(req, resp));
+                resp.serialize(out);
+                nt::HTTP::write_ws_frame(out, nt::HTTP::ws_opcode::ping, "are you there");
+                upgraded = true;
+            }
+
+            while (true) {
+                nt::HTTP::ws_frame frame;
+                ssize_t consumed = nt::HTTP::parse_ws_frame(in.data(), in.size(), 1 << 24, frame);
+                if (consumed == 0) break;
+                ASSERT_GT(consumed, 0);
+                ASSERT_TRUE(frame.masked);
+                _frames++;
+                char* payload = &in[static_cast<size_t>(frame.payload.data() - in.data())];
+                nt::HTTP::ws_mask(payload, payload, frame.payload.size(), frame.mask_key);
+
+                switch (frame.opcode) {
+                    case nt::HTTP::ws_opcode::pong:
+                        EXPECT_EQ("are you there", frame.payload);
+                        _pongs++;
+                        break;
+                    case nt::HTTP::ws_opcode::ping:
+                        nt::HTTP::write_ws_frame(out, nt::HTTP::ws_opcode::pong, frame.payload);
+                        break;
+                    case nt::HTTP::ws_opcode::close: {
+                        uint16_t code = 0;
+                        std::string_view reason;
+                        ASSERT_TRUE(nt::HTTP::parse_ws_close(frame.payload, code, reason));
+                        _close_code = code;
+                        if (!_close_sent) nt::HTTP::write_ws_close(out, code, reason);
+                        send_all(conn, out);
+                        return;
+                    }
+                    case nt::HTTP::ws_opcode::continuation:
+                        message.append(frame.payload.data(), frame.payload.size());
+                        break;
+                    default:
+                        message.assign(frame.payload.data(), frame.payload.size());
+                        message_opcode = frame.opcode;
+                        break;
+                }
+                if (frame.fin && (frame.opcode == nt::HTTP::ws_opcode::continuation
+                                  || frame.opcode == nt::HTTP::ws_opcode::text
+                                  || frame.opcode == nt::HTTP::ws_opcode::binary)) {
+                    if (message == "bye") {
+                        nt::HTTP::write_ws_close(out, static_cast<uint16_t>(nt::HTTP::ws_close_code::going_away), "bye");
+                        _close_sent = true;
+                    } else if (!_close_sent) {
+                        nt::HTTP::write_ws_frame(out, message_opcode, message);
+                    }
+                }
+                in.erase(0, static_cast<size_t>(consumed));
+            }
+            send_all(conn, out);
+        }
+    }
+
+    int                   _listen;
+    int                   _port;
+    bool                  _close_sent = false;
+    std::atomic<size_t>   _pongs { 0 };
+    std::atomic<size_t>   _frames { 0 };
+    std::atomic<uint16_t> _close_code { 0 };
+    std::thread           _thread;
+};
+
+TEST(TEST_WEBSOCKET, handshake_test) {
+    //! RFC 6455 1.3
+    EXPECT_EQ("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", nt::HTTP::ws_accept_key("dGhlIHNhbXBsZSBub25jZQ=="));
+
+    std::string key = nt::HTTP::ws_generate_key();
+    EXPECT_EQ(24u, key.size());
+    EXPECT_NE(key, nt::HTTP::ws_generate_key());
+
+    nt::HTTP::Request req;
+    nt::HTTP::ws_handshake_request(req, "127.0.0.1:80", "/chat", key);
+    std::string wire;
+    req.serialize(wire);
+    nt::HTTP::Request parsed;
+    ASSERT_EQ(static_cast<ssize_t>(wire.size()), nt::HTTP::parse_request(wire.data(), wire.size(), parsed));
+
+    nt::HTTP::Response resp;
+    ASSERT_TRUE(nt::HTTP::ws_accept_handshake(parsed, resp));
+    EXPECT_EQ(101, resp.status);
+    wire.clear();
+    resp.serialize(wire);
+    EXPECT_EQ(std::string::npos, wire.find("Content-Length"));
+    EXPECT_TRUE(nt::HTTP::ws_check_handshake(resp, key));
+    EXPECT_FALSE(nt::HTTP::ws_check_handshake(resp, nt::HTTP::ws_generate_key()));
+
+    nt::HTTP::Request bad = parsed;
+    bad.headers.erase("upgrade");
+    EXPECT_FALSE(nt::HTTP::ws_accept_handshake(bad, resp));
+    bad = parsed;
+    bad.headers["sec-websocket-version"] = "8";
+    EXPECT_FALSE(nt::HTTP::ws_accept_handshake(bad, resp));
+    bad = parsed;
+    bad.method = "POST";
+    EXPECT_FALSE(nt::HTTP::ws_accept_handshake(bad, resp));
+}
+
+TEST(TEST_WEBSOCKET, mask_test) {
+    const uint8_t key_bytes[4] = { 0x37, 0xfa, 0x21, 0x3d };
+    uint32_t key;
+    memcpy(&key, key_bytes, 4);
+
+    std::string in;
+    for (size_t i = 0; i < 300; i++) in.push_back(static_cast<char>(i * 7 + 3));
+    for (size_t len = 0; len <= in.size(); len += (len < 70 ? 1 : 37)) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            std::string expected(len, '\0');
+            for (size_t i = 0; i < len; i++) expected[i] = static_cast<char>(in[i] ^ key_bytes[(i + offset) & 3]);
+            std::string out(len, '\0');
+            nt::HTTP::ws_mask(in.data(), &out[0], len, key, offset);
+            ASSERT_EQ(expected, out) << len << " " << offset;
+            //! in place, and unmasking restores the input
+            nt::HTTP::ws_mask(out.data(), &out[0], len, key, offset);
+            ASSERT_EQ(in.substr(0, len), out);
+        }
+    }
+
+    //! piecewise masking at odd offsets equals masking at once
+    std::string whole(in.size(), '\0');
+    nt::HTTP::ws_mask(in.data(), &whole[0], in.size(), key);
+    std::string pieces(in.size(), '\0');
+    for (size_t pos = 0; pos < in.size(); pos += 13) {
+        size_t n = std::min<size_t>(13, in.size() - pos);
+        nt::HTTP::ws_mask(in.data() + pos, &pieces[pos], n, key, pos);
+    }
+    EXPECT_EQ(whole, pieces);
+}
+
+TEST(TEST_WEBSOCKET, codec_test) {
+    //! RFC 6455 5.7
+    nt::HTTP::ws_frame frame;
+    std::string hello("\x81\x05\x48\x65\x6c\x6c\x6f", 7);
+    ASSERT_EQ(7, nt::HTTP::parse_ws_frame(hello.data(), hello.size(), 1024, frame));
+    EXPECT_TRUE(frame.fin);
+    EXPECT_EQ(nt::HTTP::ws_opcode::text, frame.opcode);
+    EXPECT_FALSE(frame.masked);
+    EXPECT_EQ("Hello", frame.payload);
+
+    std::string masked("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58", 11);
+    ASSERT_EQ(11, nt::HTTP::parse_ws_frame(masked.data(), masked.size(), 1024, frame));
+    EXPECT_TRUE(frame.masked);
+    std::string payload(frame.payload);
+    nt::HTTP::ws_mask(payload.data(), &payload[0], payload.size(), frame.mask_key);
+    EXPECT_EQ("Hello", payload);
+
+    std::string out;
+    nt::HTTP::write_ws_frame(out, nt::HTTP::ws_opcode::text, "Hello", true, true, frame.mask_key);
+    EXPECT_EQ(masked, out);
+    out.clear();
+    nt::HTTP::write_ws_frame(out, nt::HTTP::ws_opcode::text, "Hel", false);
+    nt::HTTP::write_ws_frame(out, nt::HTTP::ws_opcode::continuation, "lo", true);
+    EXPECT_EQ(std::string("\x01\x03\x48\x65\x6c\x80\x02\x6c\x6f", 9), out);
+
+    //! every length encoding, incomplete prefixes included
+    for (size_t len : { 0, 125, 126, 65535, 65536, 100000 }) {
+        std::string data(len, 'x');
+        out.clear();
+        nt::HTTP::write_ws_frame(out, nt::HTTP::ws_opcode::binary, data, true, true, 0x12345678);
+        ASSERT_EQ(static_cast<ssize_t>(out.size()), nt::HTTP::parse_ws_frame(out.data(), out.size(), 1 << 20, frame));
+        ASSERT_EQ(len, frame.payload.size());
+        EXPECT_EQ(0x12345678u, frame.mask_key);
+        std::string unmasked(frame.payload);
+        nt::HTTP::ws_mask(unmasked.data(), &unmasked[0], unmasked.size(), frame.mask_key);
+        EXPECT_EQ(data, unmasked);
+        for (size_t prefix : { 0, 1, 3, 9, 13 }) {
+            if (prefix < out.size()) {
+                EXPECT_EQ(0, nt::HTTP::parse_ws_frame(out.data(), prefix, 1 << 20, frame));
+            }
+        }
+        if (len > 0) {
+            EXPECT_EQ(-1, nt::HTTP::parse_ws_frame(out.data(), out.size(), len - 1, frame));
+        }
+    }
+
+    //! reserved bits, unknown opcodes, fragmented or oversized control frames
+    EXPECT_EQ(-1, nt::HTTP::parse_ws_frame("\xc1\x00", 2, 1024, frame));
+    EXPECT_EQ(-1, nt::HTTP::parse_ws_frame("\x83\x00", 2, 1024, frame));
+    EXPECT_EQ(-1, nt::HTTP::parse_ws_frame("\x09\x00", 2, 1024, frame));
+    EXPECT_EQ(-1, nt::HTTP::parse_ws_frame("\x89\x7e\x00\x7e", 4, 1024, frame));
+
+    uint16_t code = 0;
+    std::string_view reason;
+    out.clear();
+    nt::HTTP::write_ws_close(out, 1001, "going away");
+    ASSERT_EQ(static_cast<ssize_t>(out.size()), nt::HTTP::parse_ws_frame(out.data(), out.size(), 1024, frame));
+    EXPECT_EQ(nt::HTTP::ws_opcode::close, frame.opcode);
+    ASSERT_TRUE(nt::HTTP::parse_ws_close(frame.payload, code, reason));
+    EXPECT_EQ(1001, code);
+    EXPECT_EQ("going away", reason);
+    ASSERT_TRUE(nt::HTTP::parse_ws_close("", code, reason));
+    EXPECT_EQ(1005, code);
+    EXPECT_FALSE(nt::HTTP::parse_ws_close("\x03", code, reason));
+    EXPECT_FALSE(nt::HTTP::parse_ws_close(std::string_view("\x03\xee", 2), code, reason));
+}
+
+TEST(TEST_WS_CLIENT, echo_test) {
+    ws_server server;
+    nt::HTTP::ws_client::options opts;
+    opts.fragment_size = 4096;
+    nt::HTTP::ws_client cli("127.0.0.1", server.port(), "/echo", opts);
+    ASSERT_TRUE(cli.connect());
+
+    //! a burst of messages queued before a single flush
+    for (int i = 0; i < 500; i++) {
+        ASSERT_TRUE(cli.send_text("message " + std::to_string(i)));
+    }
+    std::string large(200 * 1024, '\0');
+    for (size_t i = 0; i < large.size(); i++) large[i] = static_cast<char>(i * 31);
+    ASSERT_TRUE(cli.send_binary(large));
+    ASSERT_TRUE(cli.flush());
+
+    nt::HTTP::ws_opcode opcode;
+    std::string_view data;
+    for (int i = 0; i < 500; i++) {
+        ASSERT_TRUE(cli.recv(opcode, data));
+        EXPECT_EQ(nt::HTTP::ws_opcode::text, opcode);
+        EXPECT_EQ("message " + std::to_string(i), data);
+    }
+    ASSERT_TRUE(cli.recv(opcode, data));
+    EXPECT_EQ(nt::HTTP::ws_opcode::binary, opcode);
+    EXPECT_EQ(large, data);
+    EXPECT_EQ(501u, cli.messages_received());
+    //! the large message went out as 4 KiB frames, and the ping was answered
+    for (int i = 0; i < 100 && server.pongs() == 0; i++) usleep(10 * 1000);
+    EXPECT_EQ(500u + 50u + 1u, server.frames());
+    EXPECT_EQ(1u, server.pongs());
+
+    ASSERT_TRUE(cli.close(1000, "done"));
+    EXPECT_FALSE(cli.send_text("too late"));
+    ASSERT_TRUE(cli.recv(opcode, data));
+    EXPECT_EQ(nt::HTTP::ws_opcode::close, opcode);
+    EXPECT_EQ("done", data);
+    EXPECT_EQ(1000, cli.close_code());
+    EXPECT_FALSE(cli.recv(opcode, data));
+    EXPECT_FALSE(cli.is_open());
+}
+
+TEST(TEST_WS_CLIENT, server_close_test) {
+    ws_server server;
+    nt::HTTP::ws_client cli("127.0.0.1", server.port());
+    ASSERT_TRUE(cli.connect());
+    ASSERT_TRUE(cli.send_text("hello"));
+    ASSERT_TRUE(cli.send_text("bye"));
+    ASSERT_TRUE(cli.flush());
+
+    nt::HTTP::ws_opcode opcode;
+    std::string_view data;
+    ASSERT_TRUE(cli.recv(opcode, data));
+    EXPECT_EQ("hello", data);
+    ASSERT_TRUE(cli.recv(opcode, data));
+    EXPECT_EQ(nt::HTTP::ws_opcode::close, opcode);
+    EXPECT_EQ("bye", data);
+    EXPECT_EQ(1001, cli.close_code());
+    EXPECT_FALSE(cli.is_open());
+    EXPECT_FALSE(cli.recv(opcode, data));
+
+    //! the client echoed the close code to complete the handshake
+    for (int i = 0; i < 100 && server.close_code() == 0; i++) usleep(10 * 1000);
+    EXPECT_EQ(1001, server.close_code());
+
+    //! a server that is not there, or refuses the upgrade
+    nt::HTTP::ws_client refused("127.0.0.1", 1);
+    EXPECT_FALSE(refused.connect());
+}
+
+GTEST_API_ int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}